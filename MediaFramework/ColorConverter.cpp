@@ -72,6 +72,9 @@
 #include "ColorConverter.h"
 #include <libyuv.h>
 #include "primitive/bswap.h"
+#include "primitive/depth.h"
+
+#include <unistd.h> // sysconf
 
 __BEGIN_DECLS
 
@@ -262,6 +265,47 @@ static const PixelDescriptor kPixel444YpCbCr = {
     }
 };
 
+static const PixelDescriptor kPixel420YpCbCr10Planar = {
+    .name           = "i010",
+    .format         = kPixelFormat420YpCbCr10Planar,
+    .similar        = { kPixelFormatUnknown, kPixelFormatUnknown, kPixelFormatUnknown },
+    .color          = kColorYpCbCr,
+    .bpp            = 24,
+    .nb_planes      = 3,
+    .planes         = {
+        { .bpp = 16, .hss = 1, .vss = 1 },
+        { .bpp = 16, .hss = 2, .vss = 2 },
+        { .bpp = 16, .hss = 2, .vss = 2 },
+    }
+};
+
+static const PixelDescriptor kPixel420YpCbCr10SemiPlanar = {
+    .name           = "p010",
+    .format         = kPixelFormat420YpCbCr10SemiPlanar,
+    .similar        = { kPixelFormatUnknown, kPixelFormatUnknown, kPixelFormatUnknown },
+    .color          = kColorYpCbCr,
+    .bpp            = 24,
+    .nb_planes      = 2,
+    .planes         = {
+        { .bpp = 16, .hss = 1, .vss = 1 },
+        { .bpp = 32, .hss = 2, .vss = 2 },  // u & v
+    }
+};
+
+// v210 rows are padded to 48 pixels, bpp here is rounded up
+// and NOT exact, @see V210_STRIDE
+static const PixelDescriptor kPixel422YpCbCr10 = {
+    .name           = "v210",
+    .format         = kPixelFormat422YpCbCr10,
+    .similar        = { kPixelFormatUnknown, kPixelFormatUnknown, kPixelFormatUnknown },
+    .color          = kColorYpCbCr,
+    .bpp            = 22,
+    .nb_planes      = 1,
+    .planes         = {
+        { .bpp = 22, .hss = 1, .vss = 1 },
+    }
+};
+
 static const PixelDescriptor kPixelRGB565 = {
     .name           = "RGB565",
     .format         = kPixelFormatRGB565,
@@ -365,6 +409,7 @@ static const PixelDescriptor * kPixelDescriptorList[] = {
     &kPixel422YpCbCrPlanar,
     &kPixel422YpCrCbPlanar,
     &kPixel444YpCbCrPlanar,
+    &kPixel444YpCrCbPlanar,
     // bi-planar YpCbCr
     &kPixel420YpCbCrSemiPlanar,
     &kPixel420YpCrCbSemiPlanar,
@@ -374,6 +419,10 @@ static const PixelDescriptor * kPixelDescriptorList[] = {
     &kPixel422YpCbCrWO,
     &kPixel422YpCrCbWO,
     &kPixel444YpCbCr,
+    // 10-bit YpCbCr
+    &kPixel420YpCbCr10Planar,
+    &kPixel420YpCbCr10SemiPlanar,
+    &kPixel422YpCbCr10,
     // rgb
     &kPixelRGB565,
     &kPixelBGR565,
@@ -562,67 +611,16 @@ union hnd_t {
     Packed2PackedMatrix_t       packed2packedMAT;
 };
 
-// aabb -> bbaa
-static Int swap16(const UInt8 * src, UInt32 src_bytes,
-        UInt8 * dst, UInt32 dst_bytes) {
-    UInt16 * from = (UInt16 *)src;
-    UInt16 * to = (UInt16 *)dst;
-    for (UInt32 i = 0; i < src_bytes; i += sizeof(UInt16)) {
-        *to++ = bswap16(*from++);
-    }
-    return 0;
-}
+typedef void (*bswap_row_t)(const UInt8 *, UInt8 *, UInt32);
 
-static Int swap16_565(const UInt8 * src, UInt32 src_bytes,
-        UInt8 * dst, UInt32 dst_bytes) {
-    UInt16 * from = (UInt16 *)src;
-    UInt16 * to = (UInt16 *)dst;
-    for (UInt32 i = 0; i < src_bytes; i += sizeof(UInt16)) {
-        UInt16 x = *from++;
-        UInt8 r, g, b;
-        r = (x & 0xf800) >> 11;
-        g = (x & 0x7E0) >> 5;
-        b = (x & 0x1F);
-        *to++ = ((b << 11) | (g << 5) | r);
-    }
-    return 0;
-}
-
-// aabbcc -> ccbbaa
-static Int swap24(const UInt8 * src, UInt32 src_bytes,
-        UInt8 * dst, UInt32 dst_bytes) {
-    for (UInt32 i = 0; i < src_bytes; i += 3) {
-        // support inplace swap
-        UInt8 a   = src[0];
-        UInt8 b   = src[2];
-        dst[0]      = b;
-        dst[2]      = a;
-        src         += 3;
-        dst         += 3;
-    }
-    return 0;
-}
-
-// aabbccdd -> ddccbbaa
-static Int swap32(const UInt8 * src, UInt32 src_bytes,
-        UInt8 * dst, UInt32 dst_bytes) {
-    UInt32 * from = (UInt32 *)src;
-    UInt32 * to = (UInt32 *)dst;
-    for (UInt32 i = 0; i < src_bytes; i += sizeof(UInt32)) {
-        *to++ = bswap32(*from++);
+// get byte swap row kernel by pixel bpp
+static bswap_row_t get_bswap_row(UInt32 bpp) {
+    switch (bpp) {
+        case 16:    return bswap16_row;
+        case 24:    return bswap24_row;
+        case 32:    return bswap32_row;
+        default:    return Nil;
     }
-    return 0;
-}
-
-// aabbccdd -> aaddccbb
-static Int swap32l(const UInt8 * src, UInt32 src_bytes,
-        UInt8 * dst, UInt32 dst_bytes) {
-    UInt32 * from = (UInt32 *)src;
-    UInt32 * to = (UInt32 *)dst;
-    for (UInt32 i = 0; i < src_bytes; i += sizeof(UInt32)) {
-        *to++ = bswap32l(*from++);
-    }
-    return 0;
 }
 
 __END_DECLS
@@ -631,9 +629,9 @@ __BEGIN_NAMESPACE_MFWK
 
 enum {
     SWAP_UV         = (1<<0),   // swap uv planes before/after process, only work for planar pixels
-    BSWAP_INPUT     = (1<<1),   // do byte swap on input, @see swap16/swap24/swap32
-    BSWAP_OUTPUT    = (1<<2),   // do byte swap on output, @see swap16/swap24/swap32
-    BSWAP_32L       = (1<<3),   // do byte swap on low byte, @see swap32l
+    BSWAP_INPUT     = (1<<1),   // do byte swap on input, @see bswap16_row/bswap24_row/bswap32_row
+    BSWAP_OUTPUT    = (1<<2),   // do byte swap on output, @see bswap16_row/bswap24_row/bswap32_row
+    BSWAP_32L       = (1<<3),   // do byte swap on low byte, @see bswap32l_row
     BSWAP_32H       = (1<<4),   // do byte swap on high byte, @see swap32h
     
     //
@@ -665,9 +663,9 @@ static const convert_t kTo420YpCbCrPlanar[] = {
     { kPixelFormatRGBA,                 .hnd.packed2planar = libyuv::ABGRToI420                         },
     { kPixelFormatABGR,                 .hnd.packed2planar = libyuv::RGBAToI420                         },
     { kPixelFormatBGR,                  .hnd.packed2planar = libyuv::RGB24ToI420                        },
-    { kPixelFormatRGB,                  .hnd.packed2planar = libyuv::RGB24ToI420,   .flags = SWAP_UV    },
+    { kPixelFormatRGB,                  .hnd.packed2planar = libyuv::RGB24ToI420,   .flags = BSWAP_INPUT},
     { kPixelFormatBGR565,               .hnd.packed2planar = libyuv::RGB565ToI420                       },
-    { kPixelFormatRGB565,               .hnd.packed2planar = libyuv::RGB565ToI420,  .flags = SWAP_UV    },
+    { kPixelFormatRGB565,               .hnd.packed2planar = libyuv::RGB565ToI420,  .flags = BSWAP_INPUT},
     // END OF LIST
     { kPixelFormatUnknown }
 };
@@ -693,9 +691,9 @@ static const convert_t kToBGRA[] = {
     { kPixelFormatRGBA,                 .hnd.packed2packed = libyuv::ABGRToARGB                         },
     { kPixelFormatABGR,                 .hnd.packed2packed = libyuv::RGBAToARGB                         },
     { kPixelFormatBGR,                  .hnd.packed2packed = libyuv::RGB24ToARGB                        },
-    { kPixelFormatRGB,                  .hnd.packed2packed = libyuv::RGB24ToARGB,   .flags = BSWAP_32L  },
+    { kPixelFormatRGB,                  .hnd.packed2packed = libyuv::RGB24ToARGB,   .flags = BSWAP_INPUT},
     { kPixelFormatBGR565,               .hnd.packed2packed = libyuv::RGB565ToARGB                       },
-    { kPixelFormatRGB565,               .hnd.packed2packed = libyuv::RGB565ToARGB,  .flags = BSWAP_32L  },
+    { kPixelFormatRGB565,               .hnd.packed2packed = libyuv::RGB565ToARGB,  .flags = BSWAP_INPUT},
     // END OF LIST
     { kPixelFormatUnknown }
 };
@@ -726,8 +724,8 @@ static const convert_t kToRGBA[] = {
     { kPixelFormatABGR,                 .hnd.packed2packed = libyuv::RGBAToABGR                             },
     { kPixelFormatRGB,                  .hnd.packed2packed = libyuv::BGR24ToABGR                            },
     { kPixelFormatBGR,                  .hnd.packed2packed = libyuv::BGR24ToABGR,       .flags = BSWAP_32L  },
-    { kPixelFormatRGB565,               .hnd.packed2packed = libyuv::BGR565ToABGR                           },
-    { kPixelFormatRGB565,               .hnd.packed2packed = libyuv::BGR565ToABGR,      .flags = BSWAP_32L  },
+    { kPixelFormatBGR565,               .hnd.packed2packed = libyuv::BGR565ToABGR,      .flags = BSWAP_32L  },
+    { kPixelFormatRGB565,               .hnd.packed2packed = libyuv::BGR565ToABGR,      .flags = BSWAP_INPUT|BSWAP_32L  },
     // END OF LIST
     { kPixelFormatUnknown }
 };
@@ -737,6 +735,8 @@ static const convert_t kToBGR[] = {
     { kPixelFormat420YpCbCrPlanar,      .hnd.planar2packed = libyuv::I420ToRGB24        },
     { kPixelFormat420YpCbCrSemiPlanar,  .hnd.semiplanar2packed = libyuv::NV12ToRGB24    },
     { kPixelFormat420YpCrCbSemiPlanar,  .hnd.semiplanar2packed = libyuv::NV21ToRGB24    },
+    { kPixelFormatBGRA,                 .hnd.packed2packed = libyuv::ARGBToRGB24                            },
+    { kPixelFormatARGB,                 .hnd.packed2packed = libyuv::ARGBToRGB24,       .flags = BSWAP_INPUT},
     // END OF LIST
     { kPixelFormatUnknown }
 };
@@ -746,6 +746,8 @@ static const convert_t kToRGB16[] = {
     { kPixelFormat420YpCbCrPlanar,      .hnd.planar2packed = libyuv::I420ToRGB565       },
     { kPixelFormat420YpCbCrSemiPlanar,  .hnd.semiplanar2packed = libyuv::NV12ToRGB565   },
     { kPixelFormat420YpCrCbSemiPlanar,  .hnd.semiplanar2packed = libyuv::NV12ToRGB565   },
+    { kPixelFormatBGRA,                 .hnd.packed2packed = libyuv::ARGBToRGB565                           },
+    { kPixelFormatARGB,                 .hnd.packed2packed = libyuv::ARGBToRGB565,      .flags = BSWAP_INPUT},
     // END OF LIST
     { kPixelFormatUnknown }
 };
@@ -779,10 +781,32 @@ struct ColorConvertorContext : public SharedObject {
     const PixelDescriptor * opd;
     hnd_t                   hnd;
     UInt32                flags;
+    sp<Buffer>              strip;      // strip buffers for input byte swap, one per band
+    libyuv::FilterMode      filter;     // scale filter
+    libyuv::RotationMode    rotation;   // clockwise rotation
+    Bool                    vflip;      // flip input vertically before rotation
+    UInt32                  threads;    // max threads for conversion, including caller
+    UInt32                  threshold;  // min pixels for parallel conversion
 };
 
+// rows per strip when byte swap is fused with conversion,
+// SHOULD be multiple of vss and small enough to stay in cache.
+// bands for parallel conversion are aligned to strips too.
+static const UInt32 kStripRows = 16;
+
+// default parallel threshold: frames larger than 1080p
+static const UInt32 kParallelThreshold = 1920 * 1088;
+
+// max worker threads shared by all color converters
+#define MAX_WORKERS (15)
+
 static MediaUnitContext colorconvertor_alloc() {
     sp<ColorConvertorContext> ccc = new ColorConvertorContext;
+    ccc->filter = libyuv::kFilterBilinear;
+    ccc->rotation   = libyuv::kRotate0;
+    ccc->vflip      = False;
+    ccc->threads    = 1;
+    ccc->threshold  = kParallelThreshold;
     return ccc->RetainObject();
 }
 
@@ -901,6 +925,245 @@ static MediaError colorconvertor_init_rgb16(MediaUnitContext ref, const MediaFor
     return ccc->hnd.planar2packed != Nil ? kMediaNoError : kMediaErrorNotSupported;
 }
 
+// convert a strip of rows, planes & strides are prepared by caller.
+static void colorconvertor_strip(const ColorConvertorContext * ccc,
+                                 const UInt8 * src[], const UInt32 src_stride[],
+                                 UInt8 * dst[], const UInt32 dst_stride[],
+                                 UInt32 width, UInt32 height) {
+    const hnd_t& hnd = ccc->hnd;
+    // only handlers with COLOR_MATRIX take color matrix
+    const eColorMatrix matrix = (ccc->flags & COLOR_MATRIX) ? ccc->ipf.matrix : kColorMatrixNull;
+    switch (ccc->ipd->nb_planes) {
+        case 3: switch (ccc->opd->nb_planes) {
+            case 3:
+                hnd.planar2planar(src[0], src_stride[0],
+                                  src[1], src_stride[1],
+                                  src[2], src_stride[2],
+                                  dst[0], dst_stride[0],
+                                  dst[1], dst_stride[1],
+                                  dst[2], dst_stride[2],
+                                  width, height);
+                break;
+            case 2:
+                hnd.planar2semiplanar(src[0], src_stride[0],
+                                      src[1], src_stride[1],
+                                      src[2], src_stride[2],
+                                      dst[0], dst_stride[0],
+                                      dst[1], dst_stride[1],
+                                      width, height);
+                break;
+            case 1:
+                if (matrix) {
+                    hnd.planar2packedMAT(src[0], src_stride[0],
+                                         src[1], src_stride[1],
+                                         src[2], src_stride[2],
+                                         dst[0], dst_stride[0],
+                                         GetLibyuvMatrix(matrix),
+                                         width, height);
+                } else {
+                    hnd.planar2packed(src[0], src_stride[0],
+                                      src[1], src_stride[1],
+                                      src[2], src_stride[2],
+                                      dst[0], dst_stride[0],
+                                      width, height);
+                }
+                break;
+            default:
+                break;
+        } break;
+        case 2: switch (ccc->opd->nb_planes) {
+            case 3:
+                hnd.semiplanar2planar(src[0], src_stride[0],
+                                      src[1], src_stride[1],
+                                      dst[0], dst_stride[0],
+                                      dst[1], dst_stride[1],
+                                      dst[2], dst_stride[2],
+                                      width, height);
+                break;
+            case 2:
+                hnd.semiplanar2semiplanar(src[0], src_stride[0],
+                                          src[1], src_stride[1],
+                                          dst[0], dst_stride[0],
+                                          dst[1], dst_stride[1],
+                                          width, height);
+                break;
+            case 1:
+                if (matrix) {
+                    hnd.semiplanar2packedMAT(src[0], src_stride[0],
+                                             src[1], src_stride[1],
+                                             dst[0], dst_stride[0],
+                                             GetLibyuvMatrix(matrix),
+                                             width, height);
+                } else {
+                    hnd.semiplanar2packed(src[0], src_stride[0],
+                                          src[1], src_stride[1],
+                                          dst[0], dst_stride[0],
+                                          width, height);
+                }
+                break;
+            default:
+                break;
+        } break;
+        case 1: switch (ccc->opd->nb_planes) {
+            case 3:
+                hnd.packed2planar(src[0], src_stride[0],
+                                  dst[0], dst_stride[0],
+                                  dst[1], dst_stride[1],
+                                  dst[2], dst_stride[2],
+                                  width, height);
+                break;
+            case 2:
+                hnd.packed2semiplanar(src[0], src_stride[0],
+                                      dst[0], dst_stride[0],
+                                      dst[1], dst_stride[1],
+                                      width, height);
+                break;
+            case 1:
+                if (matrix) {
+                    hnd.packed2packedMAT(src[0], src_stride[0],
+                                         dst[0], dst_stride[0],
+                                         GetLibyuvMatrix(matrix),
+                                         width, height);
+                } else {
+                    hnd.packed2packed(src[0], src_stride[0],
+                                      dst[0], dst_stride[0],
+                                      width, height);
+                }
+                break;
+            default:
+                break;
+        } break;
+        default:    break;
+    }
+}
+
+// planes of a frame and how to convert them
+struct ColorRows {
+    const ColorConvertorContext *   ccc;
+    const UInt8 *                   src[4];
+    UInt32                          src_stride[4];
+    UInt8 *                         dst[4];
+    UInt32                          dst_stride[4];
+    bswap_row_t                     iswap;
+    bswap_row_t                     oswap;
+    UInt32                          ibytes;     // bytes of an input row after cropping
+    UInt32                          obytes;     // bytes of an output row
+};
+
+// convert rows [y0, y1), y0 SHOULD be multiple of kStripRows
+static void colorconvertor_rows(const ColorRows& cr, UInt32 y0, UInt32 y1, UInt8 * strip) {
+    const PixelDescriptor * ipd = cr.ccc->ipd;
+    const PixelDescriptor * opd = cr.ccc->opd;
+    const UInt32 width          = cr.ccc->opf.width;
+    
+    const UInt8 * from[4];
+    UInt32 from_stride[4];
+    UInt8 * to[4];
+    for (UInt32 i = 0; i < ipd->nb_planes; ++i) from_stride[i] = cr.src_stride[i];
+    
+    // no byte swap: convert all rows at once
+    const UInt32 step = (cr.iswap || cr.oswap) ? kStripRows : y1 - y0;
+    
+    // byte swap only happens on packed pixels, fuse it with the conversion:
+    // convert strip by strip and swap the rows while they are still in cache.
+    for (UInt32 y = y0; y < y1; y += step) {
+        const UInt32 rows = y1 - y < step ? y1 - y : step;
+        for (UInt32 i = 0; i < ipd->nb_planes; ++i) {
+            from[i] = cr.src[i] + (y / ipd->planes[i].vss) * cr.src_stride[i];
+        }
+        for (UInt32 i = 0; i < opd->nb_planes; ++i) {
+            to[i] = cr.dst[i] + (y / opd->planes[i].vss) * cr.dst_stride[i];
+        }
+        
+        if (cr.iswap) {
+            for (UInt32 j = 0; j < rows; ++j) {
+                cr.iswap(from[0] + j * cr.src_stride[0], strip + j * cr.ibytes, cr.ibytes);
+            }
+            from[0]         = strip;
+            from_stride[0]  = cr.ibytes;
+        }
+        
+        colorconvertor_strip(cr.ccc, from, from_stride, to, cr.dst_stride, width, rows);
+        
+        if (cr.oswap) {
+            for (UInt32 j = 0; j < rows; ++j) {
+                UInt8 * row = to[0] + j * cr.dst_stride[0];
+                cr.oswap(row, row, cr.obytes);
+            }
+        }
+    }
+}
+
+// workers are created on demand, and terminated with the last color converter
+static Mutex sWorkerLock;
+static UInt32 sWorkerUsers = 0;
+static sp<Looper> sWorkers[MAX_WORKERS];
+
+static void AcquireColorWorkers() {
+    AutoLock _l(sWorkerLock);
+    ++sWorkerUsers;
+}
+
+static void ReleaseColorWorkers() {
+    sp<Looper> workers[MAX_WORKERS];
+    {
+        AutoLock _l(sWorkerLock);
+        CHECK_GT(sWorkerUsers, 0);
+        if (--sWorkerUsers) return;
+        for (UInt32 i = 0; i < MAX_WORKERS; ++i) {
+            workers[i] = sWorkers[i];
+            sWorkers[i].clear();
+        }
+    }
+    for (UInt32 i = 0; i < MAX_WORKERS; ++i) {
+        if (!workers[i].isNil()) workers[i]->terminate();
+    }
+}
+
+static sp<Looper> GetColorWorker(UInt32 index) {
+    CHECK_LT(index, MAX_WORKERS);
+    AutoLock _l(sWorkerLock);
+    CHECK_GT(sWorkerUsers, 0);
+    if (sWorkers[index].isNil()) {
+        sWorkers[index] = new Looper(String::format("cc-worker-%u", index));
+    }
+    return sWorkers[index];
+}
+
+struct ColorBandSync : public SharedObject {
+    Mutex       mLock;
+    Condition   mWait;
+    UInt32      mPending;
+    
+    ColorBandSync(UInt32 n) : SharedObject(), mPending(n) { }
+    
+    void done() {
+        AutoLock _l(mLock);
+        if (--mPending == 0) mWait.signal();
+    }
+    
+    void wait() {
+        AutoLock _l(mLock);
+        while (mPending) mWait.wait(mLock);
+    }
+};
+
+struct ColorBandJob : public Job {
+    const ColorRows *   mRows;
+    const UInt32        mStart;
+    const UInt32        mEnd;
+    UInt8 *             mStrip;
+    sp<ColorBandSync>   mSync;
+    
+    ColorBandJob(const ColorRows * rows, UInt32 y0, UInt32 y1, UInt8 * strip, const sp<ColorBandSync>& sync) :
+    Job(), mRows(rows), mStart(y0), mEnd(y1), mStrip(strip), mSync(sync) { }
+    
+    virtual void onJob() {
+        colorconvertor_rows(*mRows, mStart, mEnd, mStrip);
+        mSync->done();
+    }
+};
+
 MediaError colorconvertor_process(MediaUnitContext ref, const MediaBufferList * input, MediaBufferList * output) {
     DEBUG("process: %s", GetMediaBufferListString(*input).c_str());
     sp<ColorConvertorContext> ccc = static_cast<ColorConvertorContext *>(ref);
@@ -949,180 +1212,471 @@ MediaError colorconvertor_process(MediaUnitContext ref, const MediaBufferList *
         }
     }
     
-    UInt32 offset[ipd->nb_planes];
+    ColorRows cr;
+    cr.ccc = ccc.get();
     for (UInt32 i = 0; i < ipd->nb_planes; ++i) {
         const UInt32 y = ipf.rect.y / ipd->planes[i].vss;
-        offset[i] = ((ipf.width * y + ipf.rect.x) * ipd->planes[i].bpp) / (8 * ipd->planes[i].hss);
-        //DEBUG("offset[%zu]: %zu", i, offset[i]);
+        cr.src_stride[i]    = (ipf.width * ipd->planes[i].bpp) / (8 * ipd->planes[i].hss);
+        cr.src[i]           = ibf[i].data + y * cr.src_stride[i] + (ipf.rect.x * ipd->planes[i].bpp) / (8 * ipd->planes[i].hss);
     }
-    switch (ipd->nb_planes) {
-        case 3: switch (opd->nb_planes) {
-            case 3:
-                ccc->hnd.planar2planar(ibf[0].data + offset[0],
-                                       (ipf.width * ipd->planes[0].bpp) / (8 * ipd->planes[0].hss),
-                                       ibf[1].data + offset[1],
-                                       (ipf.width * ipd->planes[1].bpp) / (8 * ipd->planes[1].hss),
-                                       ibf[2].data + offset[2],
-                                       (ipf.width * ipd->planes[2].bpp) / (8 * ipd->planes[2].hss),
-                                       obf[0].data,
-                                       (opf.width * opd->planes[0].bpp) / (8 * opd->planes[0].hss),
-                                       obf[1].data,
-                                       (opf.width * opd->planes[1].bpp) / (8 * opd->planes[1].hss),
-                                       obf[2].data,
-                                       (opf.width * opd->planes[2].bpp) / (8 * opd->planes[2].hss),
-                                       opf.width,
-                                       opf.height);
-                break;
-            case 2:
-                ccc->hnd.planar2semiplanar(ibf[0].data + offset[0],
-                                           (ipf.width * ipd->planes[0].bpp) / (8 * ipd->planes[0].hss),
-                                           ibf[1].data + offset[1],
-                                           (ipf.width * ipd->planes[1].bpp) / (8 * ipd->planes[1].hss),
-                                           ibf[2].data + offset[2],
-                                           (ipf.width * ipd->planes[2].bpp) / (8 * ipd->planes[2].hss),
-                                           obf[0].data,
-                                           (opf.width * opd->planes[0].bpp) / (8 * opd->planes[0].hss),
-                                           obf[1].data,
-                                           (opf.width * opd->planes[1].bpp) / (8 * opd->planes[1].hss),
-                                           opf.width,
-                                           opf.height);
-                break;
-            case 1:
-                if (ipf.matrix) {
-                    ccc->hnd.planar2packedMAT(ibf[0].data + offset[0],
-                                              (ipf.width * ipd->planes[0].bpp) / (8 * ipd->planes[0].hss),
-                                              ibf[1].data + offset[1],
-                                              (ipf.width * ipd->planes[1].bpp) / (8 * ipd->planes[1].hss),
-                                              ibf[2].data + offset[2],
-                                              (ipf.width * ipd->planes[2].bpp) / (8 * ipd->planes[2].hss),
-                                              obf[0].data,
-                                              (opf.width * opd->bpp) / 8,
-                                              GetLibyuvMatrix(ipf.matrix),
-                                              opf.width,
-                                              opf.height);
-                } else {
-                    ccc->hnd.planar2packed(ibf[0].data + offset[0],
-                                           (ipf.width * ipd->planes[0].bpp) / (8 * ipd->planes[0].hss),
-                                           ibf[1].data + offset[1],
-                                           (ipf.width * ipd->planes[1].bpp) / (8 * ipd->planes[1].hss),
-                                           ibf[2].data + offset[2],
-                                           (ipf.width * ipd->planes[2].bpp) / (8 * ipd->planes[2].hss),
-                                           obf[0].data,
-                                           (opf.width * opd->bpp) / 8,
-                                           opf.width,
-                                           opf.height);
+    for (UInt32 i = 0; i < opd->nb_planes; ++i) {
+        cr.dst_stride[i]    = (opf.width * opd->planes[i].bpp) / (8 * opd->planes[i].hss);
+        cr.dst[i]           = obf[i].data;
+    }
+    
+    cr.iswap    = Nil;
+    cr.oswap    = Nil;
+    if (ccc->flags & BSWAP_INPUT) {
+        CHECK_EQ(ipd->nb_planes, 1);
+        cr.iswap = get_bswap_row(ipd->bpp);
+    }
+    if (ccc->flags & BSWAP_32L) {
+        CHECK_EQ(opd->nb_planes, 1);
+        cr.oswap = bswap32l_row;
+    } else if (ccc->flags & BSWAP_OUTPUT) {
+        CHECK_EQ(opd->nb_planes, 1);
+        cr.oswap = get_bswap_row(opd->bpp);
+    }
+    cr.ibytes   = (opf.width * ipd->bpp) / 8;
+    cr.obytes   = (opf.width * opd->bpp) / 8;
+    
+    // split frame into bands of strips, strips are aligned to vss
+    UInt32 bands = 1;
+    const UInt32 strips = (opf.height + kStripRows - 1) / kStripRows;
+    if (ccc->threads > 1 && (UInt32)(opf.width * opf.height) >= ccc->threshold) {
+        bands = ccc->threads < strips ? ccc->threads : strips;
+    }
+    
+    UInt8 * strip = Nil;
+    if (cr.iswap) {
+        const UInt32 bytes = bands * kStripRows * cr.ibytes;
+        if (ccc->strip.isNil() || ccc->strip->capacity() < bytes) {
+            ccc->strip = new Buffer(bytes);
+        }
+        strip = (UInt8 *)ccc->strip->data();
+    }
+    
+    if (bands == 1) {
+        colorconvertor_rows(cr, 0, opf.height, strip);
+    } else {
+        const UInt32 rows = ((strips + bands - 1) / bands) * kStripRows;
+        sp<ColorBandSync> sync = new ColorBandSync(bands - 1);
+        // dispatch bands to workers, and convert the first band on caller thread
+        for (UInt32 i = 1; i < bands; ++i) {
+            const UInt32 y0 = i * rows;
+            const UInt32 y1 = y0 + rows < (UInt32)opf.height ? y0 + rows : opf.height;
+            if (y0 >= y1) {
+                sync->done();
+                continue;
+            }
+            GetColorWorker(i - 1)->dispatch(new ColorBandJob(&cr, y0, y1,
+                                                             strip ? strip + i * kStripRows * cr.ibytes : Nil,
+                                                             sync));
+        }
+        colorconvertor_rows(cr, 0, rows < (UInt32)opf.height ? rows : opf.height, strip);
+        sync->wait();
+    }
+    
+    DEBUG("process: => %s", GetMediaBufferListString(*output).c_str());
+    return kMediaNoError;
+}
+
+// pixel formats can be scaled by libyuv directly
+static const ePixelFormat kScalePixelFormatList[] = {
+    kPixelFormat420YpCbCrPlanar,
+    kPixelFormat420YpCrCbPlanar,
+    kPixelFormatARGB,
+    kPixelFormatBGRA,
+    kPixelFormatRGBA,
+    kPixelFormatABGR,
+    kPixelFormatUnknown
+};
+
+static libyuv::FilterMode GetLibyuvFilter(eScaleFilter filter) {
+    switch (filter) {
+        case kScaleFilterNone:      return libyuv::kFilterNone;
+        case kScaleFilterLinear:    return libyuv::kFilterLinear;
+        case kScaleFilterBox:       return libyuv::kFilterBox;
+        default:                    return libyuv::kFilterBilinear;
+    }
+}
+
+static MediaError colorscaler_init(MediaUnitContext ref, const MediaFormat * iformat, const MediaFormat * oformat) {
+    DEBUG("scaler init %s => %s", GetImageFormatString(iformat->image).c_str(), GetImageFormatString(oformat->image).c_str());
+    sp<ColorConvertorContext> ccc = static_cast<ColorConvertorContext *>(ref);
+    // scaler never do pixel convertion
+    if (iformat->image.format != oformat->image.format) {
+        ERROR("pixel format mismatch");
+        return kMediaErrorBadParameters;
+    }
+    if (!ContainsPixelFormat(kScalePixelFormatList, iformat->image.format)) {
+        return kMediaErrorNotSupported;
+    }
+    if (iformat->image.rect.w <= 0 || iformat->image.rect.h <= 0 ||
+        iformat->image.rect.x + iformat->image.rect.w > iformat->image.width ||
+        iformat->image.rect.y + iformat->image.rect.h > iformat->image.height ||
+        oformat->image.width <= 0 || oformat->image.height <= 0) {
+        ERROR("bad pixel dimention");
+        return kMediaErrorBadParameters;
+    }
+    
+    ccc->ipf    = iformat->image;
+    ccc->opf    = oformat->image;
+    ccc->ipd    = GetPixelFormatDescriptor(ccc->ipf.format);
+    ccc->opd    = GetPixelFormatDescriptor(ccc->opf.format);
+    ccc->flags  = 0;
+    return kMediaNoError;
+}
+
+// crop input by ipf.rect and scale it to output size
+static MediaError colorscaler_process(MediaUnitContext ref, const MediaBufferList * input, MediaBufferList * output) {
+    DEBUG("scale: %s", GetMediaBufferListString(*input).c_str());
+    sp<ColorConvertorContext> ccc = static_cast<ColorConvertorContext *>(ref);
+    const PixelDescriptor * pd  = ccc->ipd;
+    const ImageFormat& ipf      = ccc->ipf;
+    const ImageFormat& opf      = ccc->opf;
+    
+    if (input->count != pd->nb_planes || output->count != pd->nb_planes) {
+        return kMediaErrorBadParameters;
+    }
+    
+    const UInt8 * src[pd->nb_planes];
+    UInt32 src_stride[pd->nb_planes];
+    UInt8 * dst[pd->nb_planes];
+    UInt32 dst_stride[pd->nb_planes];
+    for (UInt32 i = 0; i < pd->nb_planes; ++i) {
+        const UInt32 hss = pd->planes[i].hss;
+        const UInt32 vss = pd->planes[i].vss;
+        if (input->buffers[i].size < (ipf.width * ipf.height * pd->planes[i].bpp) / (8 * hss * vss)) {
+            ERROR("bad input buffer, size mismatch.");
+            return kMediaErrorBadParameters;
+        }
+        const UInt32 size = (opf.width * opf.height * pd->planes[i].bpp) / (8 * hss * vss);
+        if (output->buffers[i].capacity < size) {
+            ERROR("bad output buffer, capacity mismatch");
+            return kMediaErrorBadParameters;
+        }
+        output->buffers[i].size = size;
+        
+        src_stride[i]   = (ipf.width * pd->planes[i].bpp) / (8 * hss);
+        src[i]          = input->buffers[i].data + (ipf.rect.y / vss) * src_stride[i] +
+                          (ipf.rect.x * pd->planes[i].bpp) / (8 * hss);
+        dst_stride[i]   = (opf.width * pd->planes[i].bpp) / (8 * hss);
+        dst[i]          = output->buffers[i].data;
+    }
+    
+    Int st;
+    if (pd->nb_planes == 3) {
+        st = libyuv::I420Scale(src[0], src_stride[0],
+                               src[1], src_stride[1],
+                               src[2], src_stride[2],
+                               ipf.rect.w, ipf.rect.h,
+                               dst[0], dst_stride[0],
+                               dst[1], dst_stride[1],
+                               dst[2], dst_stride[2],
+                               opf.width, opf.height,
+                               ccc->filter);
+    } else {
+        st = libyuv::ARGBScale(src[0], src_stride[0],
+                               ipf.rect.w, ipf.rect.h,
+                               dst[0], dst_stride[0],
+                               opf.width, opf.height,
+                               ccc->filter);
+    }
+    
+    DEBUG("scale: => %s", GetMediaBufferListString(*output).c_str());
+    return st == 0 ? kMediaNoError : kMediaErrorUnknown;
+}
+
+// 10-bit pixels -> 8-bit 420p or 10-bit i010, no scale.
+// samples are narrowed with ordered dither, and v210 4:2:2 chroma
+// is averaged over two rows for 4:2:0.
+static MediaError colordepth_init(MediaUnitContext ref, const MediaFormat * iformat, const MediaFormat * oformat) {
+    DEBUG("depth init %s => %s", GetImageFormatString(iformat->image).c_str(), GetImageFormatString(oformat->image).c_str());
+    sp<ColorConvertorContext> ccc = static_cast<ColorConvertorContext *>(ref);
+    if (colorconvertor_init_common(ccc, iformat, oformat) != kMediaNoError) {
+        return kMediaErrorBadParameters;
+    }
+    if (ccc->ipf.format == ccc->opf.format) {
+        return kMediaErrorNotSupported;
+    }
+    if (ccc->opf.format != kPixelFormat420YpCbCrPlanar &&
+        ccc->opf.format != kPixelFormat420YpCbCr10Planar) {
+        ERROR("bad output format %s", GetImageFormatString(ccc->opf).c_str());
+        return kMediaErrorBadParameters;
+    }
+    ccc->flags  = 0;
+    // chroma rows & columns are shared by two pixels, keep crop on them
+    ccc->ipf.rect.x &= ~1;
+    ccc->ipf.rect.y &= ~1;
+    
+    // v210: unpack two rows into Y'/Cb/Cr samples
+    if (ccc->ipf.format == kPixelFormat422YpCbCr10) {
+        const UInt32 samples = 2 * (((ccc->ipf.width + 5) / 6) * 6);
+        ccc->strip = new Buffer(2 * samples * sizeof(UInt16));
+    }
+    return kMediaNoError;
+}
+
+static MediaError colordepth_process(MediaUnitContext ref, const MediaBufferList * input, MediaBufferList * output) {
+    DEBUG("depth: %s", GetMediaBufferListString(*input).c_str());
+    sp<ColorConvertorContext> ccc = static_cast<ColorConvertorContext *>(ref);
+    const PixelDescriptor * ipd = ccc->ipd;
+    const PixelDescriptor * opd = ccc->opd;
+    const ImageFormat& ipf      = ccc->ipf;
+    const ImageFormat& opf      = ccc->opf;
+    
+    if (input->count != ipd->nb_planes || output->count != opd->nb_planes) {
+        return kMediaErrorBadParameters;
+    }
+    
+    // check input size
+    const Bool v210 = ipf.format == kPixelFormat422YpCbCr10;
+    UInt32 src_stride[3];
+    for (UInt32 i = 0; i < ipd->nb_planes; ++i) {
+        src_stride[i] = v210 ? V210_STRIDE(ipf.width) : (ipf.width * ipd->planes[i].bpp) / (8 * ipd->planes[i].hss);
+        if (input->buffers[i].size < (src_stride[i] * ipf.height) / ipd->planes[i].vss) {
+            ERROR("bad input buffer, size mismatch.");
+            return kMediaErrorBadParameters;
+        }
+    }
+    
+    // check output capacity
+    UInt32 dst_stride[3];
+    for (UInt32 i = 0; i < opd->nb_planes; ++i) {
+        const UInt32 size = (opf.width * opf.height * opd->planes[i].bpp) / (8 * opd->planes[i].hss * opd->planes[i].vss);
+        if (output->buffers[i].capacity < size) {
+            ERROR("bad output buffer, capacity mismatch");
+            return kMediaErrorBadParameters;
+        }
+        output->buffers[i].size = size; // set output size
+        dst_stride[i] = (opf.width * opd->planes[i].bpp) / (8 * opd->planes[i].hss);
+    }
+    
+    const Bool narrow       = opf.format == kPixelFormat420YpCbCrPlanar;
+    const UInt32 width      = opf.width;
+    const UInt32 cwidth     = width / 2;
+    const UInt32 x          = ipf.rect.x;
+    // I010 & v210 samples are in low bits, P010 samples are in high bits
+    const UInt32 shift      = ipf.format == kPixelFormat420YpCbCr10SemiPlanar ? 0 : 6;
+    
+    // v210 scratch: two rows of Y', Cb & Cr
+    const UInt32 samples    = v210 ? 2 * (((ipf.width + 5) / 6) * 6) : 0;
+    UInt16 * scratch        = v210 ? (UInt16 *)ccc->strip->data() : Nil;
+    
+    for (UInt32 r = 0; r < (UInt32)opf.height; r += 2) {
+        const UInt32 n      = r + 1 < (UInt32)opf.height ? 2 : 1;
+        const UInt32 sy     = ipf.rect.y + r;
+        const UInt16 * y[2];
+        const UInt16 * u    = Nil;
+        const UInt16 * v    = Nil;
+        const UInt16 * uv   = Nil;
+        
+        switch (ipf.format) {
+            case kPixelFormat420YpCbCr10Planar:
+                for (UInt32 j = 0; j < n; ++j) {
+                    y[j] = (const UInt16 *)(input->buffers[0].data + (sy + j) * src_stride[0]) + x;
                 }
+                u   = (const UInt16 *)(input->buffers[1].data + (sy / 2) * src_stride[1]) + x / 2;
+                v   = (const UInt16 *)(input->buffers[2].data + (sy / 2) * src_stride[2]) + x / 2;
                 break;
-            default:
-                break;
-        } break;
-        case 2: switch (opd->nb_planes) {
-            case 3:
-                ccc->hnd.semiplanar2planar(ibf[0].data + offset[0],
-                                           (ipf.width * ipd->planes[0].bpp) / (8 * ipd->planes[0].hss),
-                                           ibf[1].data + offset[1],
-                                           (ipf.width * ipd->planes[1].bpp) / (8 * ipd->planes[1].hss),
-                                           obf[0].data,
-                                           (opf.width * opd->planes[0].bpp) / (8 * opd->planes[0].hss),
-                                           obf[1].data,
-                                           (opf.width * opd->planes[1].bpp) / (8 * opd->planes[1].hss),
-                                           obf[2].data,
-                                           (opf.width * opd->planes[2].bpp) / (8 * opd->planes[2].hss),
-                                           opf.width,
-                                           opf.height);
-                break;
-            case 2:
-                ccc->hnd.semiplanar2semiplanar(ibf[0].data + offset[0],
-                                               (ipf.width * ipd->planes[0].bpp) / (8 * ipd->planes[0].hss),
-                                               ibf[1].data + offset[1],
-                                               (ipf.width * ipd->planes[1].bpp) / (8 * ipd->planes[1].hss),
-                                               obf[0].data,
-                                               (opf.width * opd->planes[0].bpp) / (8 * opd->planes[0].hss),
-                                               obf[1].data,
-                                               (opf.width * opd->planes[1].bpp) / (8 * opd->planes[1].hss),
-                                               opf.width,
-                                               opf.height);
-                break;
-            case 1:
-                if (ipf.matrix) {
-                    ccc->hnd.semiplanar2packedMAT(ibf[0].data + offset[0],
-                                                  (ipf.width * ipd->planes[0].bpp) / (8 * ipd->planes[0].hss),
-                                                  ibf[1].data + offset[1],
-                                                  (ipf.width * ipd->planes[1].bpp) / (8 * ipd->planes[1].hss),
-                                                  obf[0].data,
-                                                  (opf.width * opd->bpp) / 8,
-                                                  GetLibyuvMatrix(ipf.matrix),
-                                                  opf.width,
-                                                  opf.height);
-                } else {
-                    ccc->hnd.semiplanar2packed(ibf[0].data + offset[0],
-                                               (ipf.width * ipd->planes[0].bpp) / (8 * ipd->planes[0].hss),
-                                               ibf[1].data + offset[1],
-                                               (ipf.width * ipd->planes[1].bpp) / (8 * ipd->planes[1].hss),
-                                               obf[0].data,
-                                               (opf.width * opd->bpp) / 8,
-                                               opf.width,
-                                               opf.height);
+            case kPixelFormat420YpCbCr10SemiPlanar:
+                for (UInt32 j = 0; j < n; ++j) {
+                    y[j] = (const UInt16 *)(input->buffers[0].data + (sy + j) * src_stride[0]) + x;
                 }
+                uv  = (const UInt16 *)(input->buffers[1].data + (sy / 2) * src_stride[1]) + (x / 2) * 2;
                 break;
-            default:
-                break;
-        } break;
-        case 1: switch (opd->nb_planes) {
-            case 3:
-                ccc->hnd.packed2planar(ibf[0].data + offset[0],
-                                       (ipf.width * ipd->bpp) / 8,
-                                       obf[0].data,
-                                       (opf.width * opd->planes[0].bpp) / (8 * opd->planes[0].hss),
-                                       obf[1].data,
-                                       (opf.width * opd->planes[1].bpp) / (8 * opd->planes[1].hss),
-                                       obf[2].data,
-                                       (opf.width * opd->planes[2].bpp) / (8 * opd->planes[2].hss),
-                                       opf.width,
-                                       opf.height);
-                break;
-            case 2:
-                ccc->hnd.packed2semiplanar(ibf[0].data + offset[0],
-                                           (ipf.width * ipd->bpp) / 8,
-                                           obf[0].data,
-                                           (opf.width * opd->planes[0].bpp) / (8 * opd->planes[0].hss),
-                                           obf[1].data,
-                                           (opf.width * opd->planes[1].bpp) / (8 * opd->planes[1].hss),
-                                           opf.width,
-                                           opf.height);
-                break;
-            case 1:
-                if (ipf.matrix) {
-                    ccc->hnd.packed2packedMAT(ibf[0].data + offset[0],
-                                              (ipf.width * ipd->bpp) / 8,
-                                              obf[0].data,
-                                              (opf.width * opd->bpp) / 8,
-                                              GetLibyuvMatrix(ipf.matrix),
-                                              opf.width, opf.height);
-                } else {
-                    ccc->hnd.packed2packed(ibf[0].data + offset[0],
-                                           (ipf.width * ipd->bpp) / 8,
-                                           obf[0].data,
-                                           (opf.width * opd->bpp) / 8,
-                                           opf.width, opf.height);
+            case kPixelFormat422YpCbCr10: {
+                UInt16 * cu[2];
+                UInt16 * cv[2];
+                for (UInt32 j = 0; j < n; ++j) {
+                    UInt16 * ty = scratch + j * samples;
+                    cu[j]       = ty + samples / 2;
+                    cv[j]       = cu[j] + samples / 4;
+                    unpack_v210_row(input->buffers[0].data + (sy + j) * src_stride[0], ty, cu[j], cv[j], ipf.width);
+                    y[j]        = ty + x;
                 }
-                break;
+                // 4:2:2 -> 4:2:0, average in place
+                if (n == 2) {
+                    average16_row(cu[0] + x / 2, cu[1] + x / 2, cu[0] + x / 2, cwidth);
+                    average16_row(cv[0] + x / 2, cv[1] + x / 2, cv[0] + x / 2, cwidth);
+                }
+                u   = cu[0] + x / 2;
+                v   = cv[0] + x / 2;
+            } break;
             default:
-                break;
-        } break;
-        default:    break;
+                return kMediaErrorNotSupported;
+        }
+        
+        UInt8 * dy      = output->buffers[0].data + r * dst_stride[0];
+        UInt8 * du      = output->buffers[1].data + (r / 2) * dst_stride[1];
+        UInt8 * dv      = output->buffers[2].data + (r / 2) * dst_stride[2];
+        if (narrow) {
+            for (UInt32 j = 0; j < n; ++j) {
+                narrow16_row(y[j], dy + j * dst_stride[0], width, shift, kDither4x4[(r + j) & 3]);
+            }
+            const UInt16 * dither = kDither4x4[(r / 2) & 3];
+            if (uv) {
+                narrow16x2_row(uv, du, dv, cwidth, shift, dither);
+            } else {
+                narrow16_row(u, du, cwidth, shift, dither);
+                narrow16_row(v, dv, cwidth, shift, dither);
+            }
+        } else {
+            // -> i010, lossless
+            for (UInt32 j = 0; j < n; ++j) {
+                shift16_row(y[j], (UInt16 *)(dy + j * dst_stride[0]), width, 6 - shift);
+            }
+            if (uv) {
+                split16_row(uv, (UInt16 *)du, (UInt16 *)dv, cwidth, 6 - shift);
+            } else {
+                shift16_row(u, (UInt16 *)du, cwidth, 0);
+                shift16_row(v, (UInt16 *)dv, cwidth, 0);
+            }
+        }
     }
     
-    if (ccc->flags & BSWAP_32L) {
-        DEBUG("swap32l");
-        swap32l(obf[0].data, obf[0].size,
-                obf[0].data, obf[0].size);
+    DEBUG("depth: => %s", GetMediaBufferListString(*output).c_str());
+    return kMediaNoError;
+}
+
+// pixel formats can be rotated by libyuv directly, yuv are converted
+// into 420p while rotating, and rgb are rotated without conversion.
+static const ePixelFormat kRotatePixelFormatList[] = {
+    kPixelFormat420YpCbCrPlanar,
+    kPixelFormat420YpCrCbPlanar,
+    kPixelFormat420YpCbCrSemiPlanar,
+    kPixelFormat420YpCrCbSemiPlanar,
+    kPixelFormatARGB,
+    kPixelFormatBGRA,
+    kPixelFormatRGBA,
+    kPixelFormatABGR,
+    kPixelFormatUnknown
+};
+
+static const ePixelFormat kRotateOutputFormatList[] = {
+    kPixelFormat420YpCbCrPlanar,
+    kPixelFormatARGB,
+    kPixelFormatBGRA,
+    kPixelFormatRGBA,
+    kPixelFormatABGR,
+    kPixelFormatUnknown
+};
+
+static ePixelFormat GetRotateOutput(const ePixelFormat& iformat) {
+    return IsRGB(iformat) ? iformat : kPixelFormat420YpCbCrPlanar;
+}
+
+static MediaError colorrotator_init(MediaUnitContext ref, const MediaFormat * iformat, const MediaFormat * oformat) {
+    DEBUG("rotator init %s => %s", GetImageFormatString(iformat->image).c_str(), GetImageFormatString(oformat->image).c_str());
+    sp<ColorConvertorContext> ccc = static_cast<ColorConvertorContext *>(ref);
+    if (!ContainsPixelFormat(kRotatePixelFormatList, iformat->image.format) ||
+        GetRotateOutput(iformat->image.format) != oformat->image.format) {
+        return kMediaErrorNotSupported;
+    }
+    if (iformat->image.rect.w <= 0 || iformat->image.rect.h <= 0 ||
+        iformat->image.rect.x + iformat->image.rect.w > iformat->image.width ||
+        iformat->image.rect.y + iformat->image.rect.h > iformat->image.height ||
+        oformat->image.width <= 0 || oformat->image.height <= 0) {
+        ERROR("bad pixel dimention");
+        return kMediaErrorBadParameters;
     }
     
-    DEBUG("process: => %s", GetMediaBufferListString(*output).c_str());
+    ccc->ipf    = iformat->image;
+    ccc->opf    = oformat->image;
+    ccc->ipd    = GetPixelFormatDescriptor(ccc->ipf.format);
+    ccc->opd    = GetPixelFormatDescriptor(ccc->opf.format);
+    ccc->flags  = 0;
     return kMediaNoError;
 }
 
+// crop input by ipf.rect, then flip & rotate it, convert to 420p in the same pass
+static MediaError colorrotator_process(MediaUnitContext ref, const MediaBufferList * input, MediaBufferList * output) {
+    DEBUG("rotate: %s", GetMediaBufferListString(*input).c_str());
+    sp<ColorConvertorContext> ccc = static_cast<ColorConvertorContext *>(ref);
+    const PixelDescriptor * ipd = ccc->ipd;
+    const PixelDescriptor * opd = ccc->opd;
+    const ImageFormat& ipf      = ccc->ipf;
+    const ImageFormat& opf      = ccc->opf;
+    
+    if (input->count != ipd->nb_planes || output->count != opd->nb_planes) {
+        return kMediaErrorBadParameters;
+    }
+    
+    const Bool swap = ccc->rotation == libyuv::kRotate90 || ccc->rotation == libyuv::kRotate270;
+    if (opf.width != (swap ? ipf.rect.h : ipf.rect.w) ||
+        opf.height != (swap ? ipf.rect.w : ipf.rect.h)) {
+        ERROR("bad output dimention");
+        return kMediaErrorBadParameters;
+    }
+    
+    const UInt8 * src[ipd->nb_planes];
+    UInt32 src_stride[ipd->nb_planes];
+    for (UInt32 i = 0; i < ipd->nb_planes; ++i) {
+        const UInt32 hss = ipd->planes[i].hss;
+        const UInt32 vss = ipd->planes[i].vss;
+        if (input->buffers[i].size < (ipf.width * ipf.height * ipd->planes[i].bpp) / (8 * hss * vss)) {
+            ERROR("bad input buffer, size mismatch.");
+            return kMediaErrorBadParameters;
+        }
+        src_stride[i]   = (ipf.width * ipd->planes[i].bpp) / (8 * hss);
+        src[i]          = input->buffers[i].data + (ipf.rect.y / vss) * src_stride[i] +
+                          (ipf.rect.x * ipd->planes[i].bpp) / (8 * hss);
+    }
+    
+    UInt8 * dst[opd->nb_planes];
+    UInt32 dst_stride[opd->nb_planes];
+    for (UInt32 i = 0; i < opd->nb_planes; ++i) {
+        const UInt32 hss = opd->planes[i].hss;
+        const UInt32 vss = opd->planes[i].vss;
+        const UInt32 size = (opf.width * opf.height * opd->planes[i].bpp) / (8 * hss * vss);
+        if (output->buffers[i].capacity < size) {
+            ERROR("bad output buffer, capacity mismatch");
+            return kMediaErrorBadParameters;
+        }
+        output->buffers[i].size = size;
+        dst_stride[i]   = (opf.width * opd->planes[i].bpp) / (8 * hss);
+        dst[i]          = output->buffers[i].data;
+    }
+    
+    // negative height flips input vertically
+    const Int height = ccc->vflip ? -ipf.rect.h : ipf.rect.h;
+    // yv12 & nv21: swap u & v on output
+    const Bool swapuv = ipf.format == kPixelFormat420YpCrCbPlanar ||
+                        ipf.format == kPixelFormat420YpCrCbSemiPlanar;
+    const UInt32 u = swapuv ? 2 : 1;
+    const UInt32 v = swapuv ? 1 : 2;
+    
+    Int st;
+    if (ipd->nb_planes == 3) {
+        st = libyuv::I420Rotate(src[0], src_stride[0],
+                                src[1], src_stride[1],
+                                src[2], src_stride[2],
+                                dst[0], dst_stride[0],
+                                dst[u], dst_stride[u],
+                                dst[v], dst_stride[v],
+                                ipf.rect.w, height,
+                                ccc->rotation);
+    } else if (ipd->nb_planes == 2) {
+        st = libyuv::NV12ToI420Rotate(src[0], src_stride[0],
+                                      src[1], src_stride[1],
+                                      dst[0], dst_stride[0],
+                                      dst[u], dst_stride[u],
+                                      dst[v], dst_stride[v],
+                                      ipf.rect.w, height,
+                                      ccc->rotation);
+    } else {
+        // rotate 4 bytes pixels, byte order doesn't matter
+        st = libyuv::ARGBRotate(src[0], src_stride[0],
+                                dst[0], dst_stride[0],
+                                ipf.rect.w, height,
+                                ccc->rotation);
+    }
+    
+    DEBUG("rotate: => %s", GetMediaBufferListString(*output).c_str());
+    return st == 0 ? kMediaNoError : kMediaErrorUnknown;
+}
+
 static const ePixelFormat kPixelFormatList[] = {
     kPixelFormat420YpCbCrPlanar,
     kPixelFormat420YpCrCbPlanar,
@@ -1148,11 +1702,57 @@ static const ePixelFormat kPixelFormatList[] = {
     kPixelFormatUnknown
 };
 
+// 10-bit pixels, only convert to 8-bit by colordepth units
+static const ePixelFormat kPixelFormat10List[] = {
+    kPixelFormat420YpCbCr10Planar,
+    kPixelFormat420YpCbCr10SemiPlanar,
+    kPixelFormat422YpCbCr10,
+    kPixelFormatUnknown
+};
+
+// output of color units
+static const ePixelFormat kOutputFormat420p[] = {
+    kPixelFormat420YpCbCrPlanar,
+    kPixelFormatUnknown
+};
+
+static const ePixelFormat kOutputFormatBGRA[] = {
+    kPixelFormatBGRA,
+    kPixelFormatUnknown
+};
+
+static const ePixelFormat kOutputFormatRGBA[] = {
+    kPixelFormatRGBA,
+    kPixelFormatUnknown
+};
+
+static const ePixelFormat kOutputFormatBGR[] = {
+    kPixelFormatBGR,
+    kPixelFormatUnknown
+};
+
+static const ePixelFormat kOutputFormatRGB16[] = {
+    kPixelFormatRGB16,
+    kPixelFormatUnknown
+};
+
+static const ePixelFormat kOutputFormatI010[] = {
+    kPixelFormat420YpCbCr10Planar,
+    kPixelFormatUnknown
+};
+
+// 10-bit pixels into i010: p010 & v210
+static const ePixelFormat kColorDepthI010Input[] = {
+    kPixelFormat420YpCbCr10SemiPlanar,
+    kPixelFormat422YpCbCr10,
+    kPixelFormatUnknown
+};
+
 static const MediaUnit kConvertTo420p = {
     .name       = "color converter 420p",
     .flags      = 0,
     .iformats   = kPixelFormatList,
-    .oformats   = (const ePixelFormat[]){ kPixelFormat420YpCbCrPlanar, kPixelFormatUnknown },
+    .oformats   = kOutputFormat420p,
     .alloc      = colorconvertor_alloc,
     .dealloc    = colorconvertor_dealloc,
     .init       = colorconvertor_init_420p,
@@ -1165,7 +1765,7 @@ static const MediaUnit kConvertToBGRA = {
     .name       = "color converter BGRA",
     .flags      = 0,
     .iformats   = kPixelFormatList,
-    .oformats   = (const ePixelFormat[]){ kPixelFormatBGRA, kPixelFormatUnknown },
+    .oformats   = kOutputFormatBGRA,
     .alloc      = colorconvertor_alloc,
     .dealloc    = colorconvertor_dealloc,
     .init       = colorconvertor_init_bgra,
@@ -1177,7 +1777,7 @@ static const MediaUnit kConvertToRGBA = {
     .name       = "color converter RGBA",
     .flags      = 0,
     .iformats   = kPixelFormatList,
-    .oformats   = (const ePixelFormat[]){ kPixelFormatRGBA, kPixelFormatUnknown },
+    .oformats   = kOutputFormatRGBA,
     .alloc      = colorconvertor_alloc,
     .dealloc    = colorconvertor_dealloc,
     .init       = colorconvertor_init_rgba,
@@ -1190,7 +1790,7 @@ static const MediaUnit kConvertToBGR = {
     .name       = "color converter BGR",
     .flags      = 0,
     .iformats   = kPixelFormatList,
-    .oformats   = (const ePixelFormat[]){ kPixelFormatBGR, kPixelFormatUnknown },
+    .oformats   = kOutputFormatBGR,
     .alloc      = colorconvertor_alloc,
     .dealloc    = colorconvertor_dealloc,
     .init       = colorconvertor_init_rgb24,
@@ -1203,7 +1803,7 @@ static const MediaUnit kConvertToBGR565 = {
     .name       = "color converter BGR565",
     .flags      = 0,
     .iformats   = kPixelFormatList,
-    .oformats   = (const ePixelFormat[]){ kPixelFormatRGB16, kPixelFormatUnknown },
+    .oformats   = kOutputFormatRGB16,
     .alloc      = colorconvertor_alloc,
     .dealloc    = colorconvertor_dealloc,
     .init       = colorconvertor_init_rgb16,
@@ -1211,12 +1811,85 @@ static const MediaUnit kConvertToBGR565 = {
     .reset      = Nil,
 };
 
+// 10-bit -> 420p with dither
+static const MediaUnit kConvert10To420p = {
+    .name       = "color depth 420p",
+    .flags      = 0,
+    .iformats   = kPixelFormat10List,
+    .oformats   = kOutputFormat420p,
+    .alloc      = colorconvertor_alloc,
+    .dealloc    = colorconvertor_dealloc,
+    .init       = colordepth_init,
+    .process    = colordepth_process,
+    .reset      = Nil,
+};
+
+// 10-bit -> i010
+static const MediaUnit kConvert10ToI010 = {
+    .name       = "color depth i010",
+    .flags      = 0,
+    .iformats   = kColorDepthI010Input,
+    .oformats   = kOutputFormatI010,
+    .alloc      = colorconvertor_alloc,
+    .dealloc    = colorconvertor_dealloc,
+    .init       = colordepth_init,
+    .process    = colordepth_process,
+    .reset      = Nil,
+};
+
+// crop & scale
+static const MediaUnit kColorScaler = {
+    .name       = "color scaler",
+    .flags      = 0,
+    .iformats   = kScalePixelFormatList,
+    .oformats   = kScalePixelFormatList,
+    .alloc      = colorconvertor_alloc,
+    .dealloc    = colorconvertor_dealloc,
+    .init       = colorscaler_init,
+    .process    = colorscaler_process,
+    .reset      = Nil,
+};
+
+// crop, flip & rotate
+static const MediaUnit kColorRotator = {
+    .name       = "color rotator",
+    .flags      = 0,
+    .iformats   = kRotatePixelFormatList,
+    .oformats   = kRotateOutputFormatList,
+    .alloc      = colorconvertor_alloc,
+    .dealloc    = colorconvertor_dealloc,
+    .init       = colorrotator_init,
+    .process    = colorrotator_process,
+    .reset      = Nil,
+};
+
+static const MediaUnit * kRotateUnitList[] = {
+    &kColorRotator,
+    // END OF LIST
+    Nil
+};
+
+static const MediaUnit * kScaleUnitList[] = {
+    &kColorScaler,
+    // END OF LIST
+    Nil
+};
+
 static const MediaUnit * kColorUnitList[] = {
     &kConvertTo420p,
     &kConvertToBGRA,
     &kConvertToRGBA,
     &kConvertToBGR,
     &kConvertToBGR565,
+    &kConvert10To420p,
+    &kConvert10ToI010,
+    // END OF LIST
+    Nil
+};
+
+static const MediaUnit * kDepthUnitList[] = {
+    &kConvert10To420p,
+    &kConvert10ToI010,
     // END OF LIST
     Nil
 };
@@ -1256,48 +1929,532 @@ static const MediaUnit * ColorUnitNew(const MediaUnit * list[],
     return unit;
 }
 
+// ? -> output pixel format
+static const convert_t * GetConvertList(const ePixelFormat& oformat) {
+    switch (oformat) {
+        case kPixelFormat420YpCbCrPlanar:   return kTo420YpCbCrPlanar;
+        case kPixelFormatBGRA:              return kToBGRA;
+        case kPixelFormatRGBA:              return kToRGBA;
+        case kPixelFormatBGR:               return kToBGR;
+        case kPixelFormatRGB16:             return kToRGB16;
+        default:                            return Nil;
+    }
+}
+
+// can iformat be converted to oformat by one unit directly
+static Bool ColorUnitSupport(const ePixelFormat& iformat, const ePixelFormat& oformat) {
+    if (iformat == oformat) return False;
+    for (UInt32 i = 0; kDepthUnitList[i] != Nil; ++i) {
+        if (ContainsPixelFormat(kDepthUnitList[i]->iformats, iformat) &&
+            ContainsPixelFormat(kDepthUnitList[i]->oformats, oformat)) {
+            return True;
+        }
+    }
+    const convert_t * list = GetConvertList(oformat);
+    if (list == Nil) return False;
+    UInt32 flags;
+    return get_convert_hnd(list, iformat, &flags).planar2planar != Nil;
+}
+
+// max hops of a convertion path
+#define MAX_HOPS    (3)
+
+// pixel formats of a convertion path, including source & target
+struct ColorPath {
+    UInt32          count;
+    ePixelFormat    formats[MAX_HOPS + 1];
+};
+
+static Mutex sPathLock;
+static HashTable<UInt64, ColorPath> sPathCache;
+
+// shortest path from iformat to oformat over all color units,
+// each hop is a full frame pass and costs the same, and less bpp
+// intermediate formats are preferred to save memory bandwidth.
+// @return True on success, and path with count == 1 if iformat == oformat
+static Bool ColorPathFind(const ePixelFormat& iformat, const ePixelFormat& oformat, ColorPath * path) {
+    const UInt64 key = ((UInt64)iformat << 32) | oformat;
+    AutoLock _l(sPathLock);
+    if (sPathCache.find(key)) {
+        *path = sPathCache[key];
+        return path->count != 0;
+    }
+    
+    // nodes: 8-bit pixels & 10-bit pixels
+    UInt32 n8 = 0, n10 = 0;
+    while (kPixelFormatList[n8] != kPixelFormatUnknown) ++n8;
+    while (kPixelFormat10List[n10] != kPixelFormatUnknown) ++n10;
+    const UInt32 n = n8 + n10;
+    ePixelFormat nodes[n];
+    for (UInt32 i = 0; i < n8; ++i)     nodes[i]        = kPixelFormatList[i];
+    for (UInt32 i = 0; i < n10; ++i)    nodes[n8 + i]   = kPixelFormat10List[i];
+    
+    UInt32 cost[n];
+    UInt32 hops[n];
+    Int32 prev[n];
+    Bool done[n];
+    Int32 source = -1;
+    Int32 target = -1;
+    for (UInt32 i = 0; i < n; ++i) {
+        cost[i] = 0xffffffff;
+        hops[i] = 0;
+        prev[i] = -1;
+        done[i] = False;
+        if (nodes[i] == iformat) source = i;
+        if (nodes[i] == oformat) target = i;
+    }
+    
+    path->count = 0;
+    if (source >= 0 && target >= 0) {
+        // dijkstra, the graph is small
+        cost[source] = 0;
+        for (;;) {
+            Int32 u = -1;
+            for (UInt32 i = 0; i < n; ++i) {
+                if (!done[i] && cost[i] != 0xffffffff && (u < 0 || cost[i] < cost[u])) u = i;
+            }
+            if (u < 0 || u == target) break;
+            done[u] = True;
+            if (hops[u] >= MAX_HOPS) continue;
+            
+            for (UInt32 v = 0; v < n; ++v) {
+                if (done[v] || !ColorUnitSupport(nodes[u], nodes[v])) continue;
+                const PixelDescriptor * desc = GetPixelFormatDescriptor(nodes[v]);
+                const UInt32 c = cost[u] + 1024 + (desc ? desc->bpp : 32);
+                if (c < cost[v]) {
+                    cost[v] = c;
+                    hops[v] = hops[u] + 1;
+                    prev[v] = u;
+                }
+            }
+        }
+        
+        if (cost[target] != 0xffffffff) {
+            path->count = hops[target] + 1;
+            for (Int32 i = target, j = hops[target]; i >= 0; i = prev[i], --j) {
+                path->formats[j] = nodes[i];
+            }
+        }
+    }
+    
+    sPathCache.insert(key, *path);
+    if (path->count == 0) {
+        ERROR("no path for %.4s => %.4s", (const Char *)&iformat, (const Char *)&oformat);
+        return False;
+    }
+#if LOG_NDEBUG == 0
+    String line = String::format("%.4s", (const Char *)&path->formats[0]);
+    for (UInt32 i = 1; i < path->count; ++i) {
+        line += String::format(" => %.4s", (const Char *)&path->formats[i]);
+    }
+    DEBUG("path: %s", line.c_str());
+#endif
+    return True;
+}
+
+// max stages: convert hops -> scale -> rotate -> convert hops
+#define MAX_STAGES  (2 * MAX_HOPS + 2)
+
+struct ColorStage {
+    const MediaUnit *           unit;
+    MediaUnitContext            instance;
+    ImageFormat                 oformat;
+    sp<MediaFrame>              frame;      // intermediate frame, Nil for the last stage
+};
+
+// flip is applied before rotation, and a horizontal flip equals
+// a vertical flip followed by 180 degrees rotation.
+static void GetLibyuvRotation(eRotate rotate, eFlip flip, libyuv::RotationMode * mode, Bool * vflip) {
+    UInt32 degrees = 0;
+    switch (rotate) {
+        case kRotate90:     degrees = 90;   break;
+        case kRotate180:    degrees = 180;  break;
+        case kRotate270:    degrees = 270;  break;
+        default:            break;
+    }
+    if (flip == kFlipHorizontal) degrees = (degrees + 180) % 360;
+    *vflip  = flip == kFlipHorizontal || flip == kFlipVertical;
+    *mode   = (libyuv::RotationMode)degrees;
+}
+
+static FORCE_INLINE Bool IsRotateSwap(eRotate rotate) {
+    return rotate == kRotate90 || rotate == kRotate270;
+}
+
+static UInt32 GetNumberOfThreads(UInt32 threads) {
+    if (threads == 0) {
+        const long n = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = n > 0 ? n : 1;
+    }
+    return threads > MAX_WORKERS + 1 ? MAX_WORKERS + 1 : threads;
+}
+
 struct ColorConverter : public MediaDevice {
     ImageFormat                 mInput;
     ImageFormat                 mOutput;
+    eScaleFilter                mFilter;
+    eRotate                     mRotate;
+    eFlip                       mFlip;
+    UInt32                      mThreads;
+    UInt32                      mThreshold;
     
-    const MediaUnit *           mUnit;
-    MediaUnitContext            mInstance;
+    ColorStage                  mStages[MAX_STAGES];
+    UInt32                      mNumStages;
+    sp<Buffer>                  mPool[2];   // buffers for intermediate frames
     sp<MediaFrame>              mFrame;
 
-    ColorConverter() : MediaDevice() { }
+    ColorConverter() : MediaDevice(), mFilter(kScaleFilterDefault),
+    mRotate(kRotate0), mFlip(kFlipNone),
+    mThreads(GetNumberOfThreads(0)), mThreshold(kParallelThreshold), mNumStages(0) {
+        AcquireColorWorkers();
+    }
     
     virtual ~ColorConverter() {
-        if (mUnit) {
-            mUnit->dealloc(mInstance);
-            mUnit = Nil;
-            mInstance = Nil;
+        clearStages();
+        ReleaseColorWorkers();
+    }
+    
+    void clearStages() {
+        for (UInt32 i = 0; i < mNumStages; ++i) {
+            mStages[i].unit->dealloc(mStages[i].instance);
+            mStages[i].unit     = Nil;
+            mStages[i].instance = Nil;
+            mStages[i].frame.clear();
         }
+        mNumStages = 0;
     }
     
-    MediaError init(const ImageFormat& iformat, const ImageFormat& oformat, const sp<Message>&) {
+    Bool addStage(const MediaUnit * list[], const ImageFormat& iformat, const ImageFormat& oformat) {
+        CHECK_LT(mNumStages, MAX_STAGES);
+        ColorStage& stage = mStages[mNumStages];
+        stage.unit = ColorUnitNew(list, iformat, oformat, &stage.instance);
+        if (stage.unit == Nil) return False;
+        
+        ColorConvertorContext * ccc = static_cast<ColorConvertorContext *>(stage.instance);
+        if (list == kScaleUnitList) {
+            ccc->filter     = GetLibyuvFilter(mFilter);
+        } else if (list == kRotateUnitList) {
+            GetLibyuvRotation(mRotate, mFlip, &ccc->rotation, &ccc->vflip);
+        } else {
+            ccc->threads    = mThreads;
+            ccc->threshold  = mThreshold;
+        }
+        stage.oformat = oformat;
+        ++mNumStages;
+        return True;
+    }
+    
+    MediaError init(const ImageFormat& iformat, const ImageFormat& oformat, const sp<Message>& options) {
         DEBUG("init ColorConverter: %s => %s", GetImageFormatString(iformat).c_str(), GetImageFormatString(oformat).c_str());
         mInput      = iformat;
         mOutput     = oformat;
+        if (!options.isNil()) {
+            mFilter     = (eScaleFilter)options->findInt32(kKeyScaleFilter, kScaleFilterDefault);
+            mThreads    = GetNumberOfThreads(options->findInt32(kKeyThreads, 0));
+            mThreshold  = options->findInt32(kKeyParallelThreshold, kParallelThreshold);
+            mRotate     = (eRotate)options->findInt32(kKeyRotate, kRotate0);
+            mFlip       = (eFlip)options->findInt32(kKeyFlip, kFlipNone);
+        }
+        
+        // empty rect means the whole image
+        if (mInput.rect.w == 0 || mInput.rect.h == 0) {
+            mInput.rect.x   = 0;
+            mInput.rect.y   = 0;
+            mInput.rect.w   = mInput.width;
+            mInput.rect.h   = mInput.height;
+        }
+        // empty output size means no scale
+        if (mOutput.width == 0 || mOutput.height == 0) {
+            mOutput.width   = IsRotateSwap(mRotate) ? mInput.rect.h : mInput.rect.w;
+            mOutput.height  = IsRotateSwap(mRotate) ? mInput.rect.w : mInput.rect.h;
+        }
+        mOutput.rect.x      = 0;
+        mOutput.rect.y      = 0;
+        mOutput.rect.w      = mOutput.width;
+        mOutput.rect.h      = mOutput.height;
+        
+        return prepare();
+    }
+    
+    // add convert stages along the path, the first stage may crop
+    Bool addConvertStages(const ColorPath& path, ImageFormat& image) {
+        for (UInt32 i = 0; i + 1 < path.count; ++i) {
+            ImageFormat next    = image;
+            next.format         = path.formats[i + 1];
+            next.width          = image.rect.w;
+            next.height         = image.rect.h;
+            next.rect.x         = 0;
+            next.rect.y         = 0;
+            if (i + 2 == path.count) next.matrix = mOutput.matrix;
+            if (!addStage(kColorUnitList, image, next)) return False;
+            image = next;
+        }
+        return True;
+    }
+    
+    // build the stages for crop, scale & convert with fewest full frame passes
+    MediaError prepare() {
+        clearStages();
+        
+        const ImageFormat& in   = mInput;
+        const ImageFormat& out  = mOutput;
+        const Bool swap         = IsRotateSwap(mRotate);
+        const Bool scale        = (swap ? in.rect.h : in.rect.w) != out.width ||
+                                  (swap ? in.rect.w : in.rect.h) != out.height;
+        const Bool crop         = in.rect.x || in.rect.y || in.rect.w != in.width || in.rect.h != in.height;
+        
+        if (mRotate != kRotate0 || mFlip != kFlipNone) {
+            return prepareRotation(scale);
+        }
         
-        mUnit = ColorUnitNew(kColorUnitList, iformat, oformat, &mInstance);
-        if (mUnit) {
-            DEBUG("new unit %.4s => %.4s", (const Char *)&iformat.format, (const Char *)&oformat.format);
+        // pass through
+        if (in.format == out.format && !scale && !crop) {
+            DEBUG("pass through");
             return kMediaNoError;
         }
         
+        ImageFormat image = in;
+        if (in.format != out.format && !scale) {
+            ColorPath path;
+            if (ColorPathFind(in.format, out.format, &path) &&
+                addConvertStages(path, image)) {
+                return finishStages();
+            }
+            clearStages();
+            if (!crop) return kMediaErrorNotSupported;
+            // no path: go through the scaler for crop
+        }
+        
+        // scale first on down scale and scale last on up scale,
+        // fall back to the other order if any stage of it is not supported.
+        const Bool down         = out.width * out.height <= in.rect.w * in.rect.h;
+        ColorPath ipath, opath;
+        if (findScalePaths(down, &ipath, &opath)) {
+            if (addScaleStages(ipath, opath)) return finishStages();
+            clearStages();
+            
+            ColorPath ipath2, opath2;
+            if (findScalePaths(!down, &ipath2, &opath2) &&
+                (ipath2.count != ipath.count || opath2.count != opath.count ||
+                 ipath2.formats[ipath2.count - 1] != ipath.formats[ipath.count - 1])) {
+                DEBUG("fall back to scale %s", down ? "last" : "first");
+                if (addScaleStages(ipath2, opath2)) return finishStages();
+                clearStages();
+            }
+        }
+        
+        ERROR("no stages for %s => %s",
+              GetImageFormatString(in).c_str(), GetImageFormatString(out).c_str());
+        clearStages();
+        return kMediaErrorNotSupported;
+    }
+    
+    // choose a scalable format to scale in:
+    //  1. fewest passes
+    //  2. fewer passes before scale if first, otherwise fewer passes after
+    Bool findScalePaths(Bool first, ColorPath * ipath, ColorPath * opath) const {
+        UInt32 best = 0xffffffff;
+        for (UInt32 i = 0; kScalePixelFormatList[i] != kPixelFormatUnknown; ++i) {
+            ColorPath a, b;
+            if (!ColorPathFind(mInput.format, kScalePixelFormatList[i], &a) ||
+                !ColorPathFind(kScalePixelFormatList[i], mOutput.format, &b)) {
+                continue;
+            }
+            const UInt32 passes = a.count + b.count;
+            const UInt32 cost   = passes * 16 + (first ? a.count : b.count);
+            if (cost < best) {
+                best    = cost;
+                *ipath  = a;
+                *opath  = b;
+            }
+        }
+        return best != 0xffffffff;
+    }
+    
+    // convert hops -> scale -> convert hops
+    Bool addScaleStages(const ColorPath& ipath, const ColorPath& opath) {
+        const ImageFormat& out  = mOutput;
+        ImageFormat image = mInput;
+        if (!addConvertStages(ipath, image)) return False;
+        
+        ImageFormat scaled  = image;
+        scaled.width        = out.width;
+        scaled.height       = out.height;
+        scaled.rect.x       = 0;
+        scaled.rect.y       = 0;
+        scaled.rect.w       = out.width;
+        scaled.rect.h       = out.height;
+        if (opath.count == 1) scaled.matrix = out.matrix;
+        if (!addStage(kScaleUnitList, image, scaled)) return False;
+        image = scaled;
+        
+        return addConvertStages(opath, image);
+    }
+    
+    // rotation is done by the rotator, which also converts planar and semi-planar
+    // yuv into 420p, so it replaces the copy or the last hop into 420p.
+    // choose the rotatable format with fewest passes, and scale in the rotator's
+    // output format, before rotation on down scale if possible.
+    MediaError prepareRotation(Bool scale) {
+        const ImageFormat& in   = mInput;
+        const ImageFormat& out  = mOutput;
+        const Bool down         = out.width * out.height <= in.rect.w * in.rect.h;
+        
+        ColorPath ipath, opath;
+        ePixelFormat rotate     = kPixelFormatUnknown;
+        UInt32 best = 0xffffffff;
+        for (UInt32 i = 0; kRotatePixelFormatList[i] != kPixelFormatUnknown; ++i) {
+            const ePixelFormat r = kRotatePixelFormatList[i];
+            ColorPath a, b;
+            if (!ColorPathFind(in.format, r, &a) ||
+                !ColorPathFind(GetRotateOutput(r), out.format, &b)) {
+                continue;
+            }
+            const UInt32 passes = a.count + b.count - 1 + (scale ? 1 : 0);
+            const UInt32 cost   = passes * 16 + (down ? a.count : b.count);
+            if (cost < best) {
+                best    = cost;
+                rotate  = r;
+                ipath   = a;
+                opath   = b;
+            }
+        }
+        
+        if (best != 0xffffffff && addRotateStages(ipath, rotate, opath, scale, down)) {
+            return finishStages();
+        }
+        
+        ERROR("no stages for %s => %s",
+              GetImageFormatString(in).c_str(), GetImageFormatString(out).c_str());
+        clearStages();
         return kMediaErrorNotSupported;
     }
     
+    // convert hops -> [down scale] -> rotate -> [up scale] -> convert hops
+    Bool addRotateStages(const ColorPath& ipath, const ePixelFormat& rotate, const ColorPath& opath,
+                         Bool scale, Bool down) {
+        const ImageFormat& out  = mOutput;
+        const Bool swap         = IsRotateSwap(mRotate);
+        
+        ImageFormat image = mInput;
+        if (!addConvertStages(ipath, image)) return False;
+        
+        // down scale before rotation, in unrotated dimention
+        if (scale && down && GetRotateOutput(rotate) == rotate) {
+            ImageFormat next    = image;
+            next.width          = swap ? out.height : out.width;
+            next.height         = swap ? out.width : out.height;
+            next.rect.x         = 0;
+            next.rect.y         = 0;
+            next.rect.w         = next.width;
+            next.rect.h         = next.height;
+            if (!addStage(kScaleUnitList, image, next)) return False;
+            image   = next;
+            scale   = False;
+        }
+        
+        ImageFormat rotated = image;
+        rotated.format      = GetRotateOutput(rotate);
+        rotated.width       = swap ? image.rect.h : image.rect.w;
+        rotated.height      = swap ? image.rect.w : image.rect.h;
+        rotated.rect.x      = 0;
+        rotated.rect.y      = 0;
+        rotated.rect.w      = rotated.width;
+        rotated.rect.h      = rotated.height;
+        if (opath.count == 1 && !scale) rotated.matrix = out.matrix;
+        if (!addStage(kRotateUnitList, image, rotated)) return False;
+        image = rotated;
+        
+        if (scale) {
+            ImageFormat next    = image;
+            next.width          = out.width;
+            next.height         = out.height;
+            next.rect.w         = out.width;
+            next.rect.h         = out.height;
+            if (opath.count == 1) next.matrix = out.matrix;
+            if (!addStage(kScaleUnitList, image, next)) return False;
+            image = next;
+        }
+        
+        return addConvertStages(opath, image);
+    }
+    
+    // intermediate frames share two pooled buffers in ping-pong way,
+    // as stage i only reads the output of stage i - 1.
+    MediaError finishStages() {
+        UInt32 bytes = 0;
+        for (UInt32 i = 0; i + 1 < mNumStages; ++i) {
+            const ImageFormat& image = mStages[i].oformat;
+            const UInt32 n = (image.width * image.height * GetPixelFormatDescriptor(image.format)->bpp) / 8;
+            if (n > bytes) bytes = n;
+        }
+        
+        for (UInt32 i = 0; i + 1 < mNumStages; ++i) {
+            sp<Buffer>& buffer = mPool[i % 2];
+            if (buffer.isNil() || buffer->capacity() < bytes) {
+                buffer = new Buffer(bytes);
+            }
+            mStages[i].frame = MediaFrame::Create(mStages[i].oformat, buffer);
+            if (mStages[i].frame.isNil()) return kMediaErrorUnknown;
+        }
+        DEBUG("%zu stages for %s => %s", mNumStages,
+              GetImageFormatString(mInput).c_str(), GetImageFormatString(mOutput).c_str());
+        return kMediaNoError;
+    }
+    
     virtual sp<Message> formats() const {
         sp<Message> format = new Message;
         format->setInt32(kKeyFormat, mOutput.format);
         format->setInt32(kKeyWidth, mOutput.width);
-        format->setInt32(kKeyHeight, mOutput.width);
+        format->setInt32(kKeyHeight, mOutput.height);
         return format;
     }
     
+    // negotiate output with sink's formats()
     virtual MediaError configure(const sp<Message>& options) {
-        return kMediaErrorNotSupported;
+        if (!options->contains(kKeyFormat) &&
+            !options->contains(kKeyWidth) &&
+            !options->contains(kKeyHeight) &&
+            !options->contains(kKeyScaleFilter) &&
+            !options->contains(kKeyThreads) &&
+            !options->contains(kKeyParallelThreshold) &&
+            !options->contains(kKeyRotate) &&
+            !options->contains(kKeyFlip)) {
+            return kMediaErrorNotSupported;
+        }
+        
+        const ImageFormat last  = mOutput;
+        const eScaleFilter filter = mFilter;
+        const eRotate rotate    = mRotate;
+        const eFlip flip        = mFlip;
+        mRotate         = (eRotate)options->findInt32(kKeyRotate, mRotate);
+        mFlip           = (eFlip)options->findInt32(kKeyFlip, mFlip);
+        // keep output orientation if size is not given
+        if (IsRotateSwap(mRotate) != IsRotateSwap(rotate)) {
+            mOutput.width   = last.height;
+            mOutput.height  = last.width;
+        }
+        if (options->contains(kKeyThreads)) {
+            mThreads    = GetNumberOfThreads(options->findInt32(kKeyThreads));
+        }
+        mThreshold      = options->findInt32(kKeyParallelThreshold, mThreshold);
+        mOutput.format  = options->findInt32(kKeyFormat, mOutput.format);
+        mOutput.width   = options->findInt32(kKeyWidth, mOutput.width);
+        mOutput.height  = options->findInt32(kKeyHeight, mOutput.height);
+        mOutput.rect.w  = mOutput.width;
+        mOutput.rect.h  = mOutput.height;
+        mFilter         = (eScaleFilter)options->findInt32(kKeyScaleFilter, mFilter);
+        
+        if (prepare() != kMediaNoError) {
+            ERROR("configure %s failed", options->string().c_str());
+            mOutput = last;
+            mFilter = filter;
+            mRotate = rotate;
+            mFlip   = flip;
+            prepare();
+            return kMediaErrorNotSupported;
+        }
+        return kMediaNoError;
     }
     
     virtual MediaError push(const sp<MediaFrame>& input) {
@@ -1305,23 +2462,28 @@ struct ColorConverter : public MediaDevice {
         
         if (mFrame != Nil) return kMediaErrorResourceBusy;
         
-        sp<MediaFrame> output   = MediaFrame::Create(mOutput);
-        
-        MediaError st = mUnit->process(mInstance,
-                                       &input->planes,
-                                       &output->planes);
-        
-        if (st != kMediaNoError) {
-            ERROR("push %s failed", input->string().c_str());
-            return kMediaErrorUnknown;
+        sp<MediaFrame> frame = input;
+        for (UInt32 i = 0; i < mNumStages; ++i) {
+            sp<MediaFrame> output = mStages[i].frame;
+            if (output.isNil()) output = MediaFrame::Create(mOutput);
+            
+            MediaError st = mStages[i].unit->process(mStages[i].instance,
+                                                     &frame->planes,
+                                                     &output->planes);
+            
+            if (st != kMediaNoError) {
+                ERROR("push %s failed @ %s", input->string().c_str(), mStages[i].unit->name);
+                return kMediaErrorUnknown;
+            }
+            frame = output;
         }
         
         // copy input properties
-        output->id          = input->id;
-        output->flags       = input->flags;
-        output->timecode    = input->timecode;
-        output->duration    = input->duration;
-        mFrame              = output;
+        frame->id           = input->id;
+        frame->flags        = input->flags;
+        frame->timecode     = input->timecode;
+        frame->duration     = input->duration;
+        mFrame              = frame;
         return kMediaNoError;
     }
     
@@ -1332,9 +2494,12 @@ struct ColorConverter : public MediaDevice {
     }
     
     virtual MediaError reset() {
-        if (mUnit && mUnit->reset) {
-            mUnit->reset(mInstance);
+        for (UInt32 i = 0; i < mNumStages; ++i) {
+            if (mStages[i].unit->reset) {
+                mStages[i].unit->reset(mStages[i].instance);
+            }
         }
+        mFrame.clear();
         return kMediaNoError;
     }
 };
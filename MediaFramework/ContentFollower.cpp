@@ -0,0 +1,157 @@
+/******************************************************************************
+ * Copyright (c) 2016, Chen Fang <mtdcy.chen@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+
+
+
+
+/**
+ * File:    ContentFollower.cpp
+ * Author:  mtdcy.chen
+ * Changes:
+ *          1. 20201101     initial version
+ *
+ */
+
+#define LOG_TAG "ContentFollower"
+//#define LOG_NDEBUG 0
+#include "MediaTypes.h"
+#include "ContentFollower.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+
+// max latency of new bytes detection, inotify wakes up earlier
+#define kPollInterval       (50)    // ms
+
+__BEGIN_NAMESPACE_MFWK
+
+ContentFollower::ContentFollower() : SharedObject(), mTimeout(0LL), mNotify(-1) {
+}
+
+ContentFollower::~ContentFollower() {
+    if (mNotify >= 0) close(mNotify);
+}
+
+sp<ContentFollower> ContentFollower::Open(const String& url, Int64 timeout) {
+    String path = url;
+    if (!strncmp(url.c_str(), "file://", 7)) path = url.c_str() + 7;
+    
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+        ERROR("%s is not a local file, can't follow", url.c_str());
+        return Nil;
+    }
+    
+    sp<ContentFollower> follower = new ContentFollower;
+    follower->mURL      = url;
+    follower->mPath     = path;
+    follower->mTimeout  = Time::MicroSeconds(timeout);
+#ifdef __linux__
+    follower->mNotify   = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (follower->mNotify >= 0 &&
+        inotify_add_watch(follower->mNotify, path.c_str(), IN_MODIFY | IN_CLOSE_WRITE) < 0) {
+        close(follower->mNotify);
+        follower->mNotify = -1;
+    }
+    if (follower->mNotify < 0) {
+        WARN("inotify is not available, polling %s", path.c_str());
+    }
+#endif
+    INFO("follow %s @ %" PRId64 " bytes", path.c_str(), (Int64)st.st_size);
+    return follower;
+}
+
+#ifdef __linux__
+// sleep until file is modified or interval expired
+// close by writer is not the end, writer may reopen and append,
+// which is detected by size and idle timeout.
+static void WaitForEvents(Int fd) {
+    struct pollfd pfd;
+    pfd.fd      = fd;
+    pfd.events  = POLLIN;
+    pfd.revents = 0;
+    if (poll(&pfd, 1, kPollInterval) <= 0) return;
+    
+    // drain events, content is checked by stat
+    Char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    while (read(fd, events, sizeof(events)) > 0) { }
+}
+#endif
+
+sp<ABuffer> ContentFollower::wait(const sp<ABuffer>& current) {
+    const Int64 length = current->offset() + current->size();
+    const Time start = Time::Now();
+    for (;;) {
+#ifdef __linux__
+        // events are drained before stat, bytes written after stat
+        // will wake up next poll immediately.
+        if (mNotify >= 0) {
+            WaitForEvents(mNotify);
+        } else {
+            usleep(kPollInterval * 1000);
+        }
+#else
+        usleep(kPollInterval * 1000);
+#endif
+        
+        struct stat st;
+        if (stat(mPath.c_str(), &st) != 0) {
+            ERROR("%s is gone", mPath.c_str());
+            return Nil;
+        }
+        
+        if (st.st_size > length) break;
+        
+        if (st.st_size < length) {
+            ERROR("%s is truncated, %" PRId64 " < %" PRId64, mPath.c_str(), (Int64)st.st_size, length);
+            return Nil;
+        }
+        
+        if (Time::Now() - start >= mTimeout) {
+            INFO("%s stops growing @ %" PRId64, mPath.c_str(), length);
+            return Nil;
+        }
+    }
+    
+    // new bytes are visible through a new content only,
+    // reopen it without parsing the structure again.
+    sp<ABuffer> content = Content::Create(mURL);
+    if (content.isNil()) {
+        ERROR("reopen %s failed", mURL.c_str());
+        return Nil;
+    }
+    content->skipBytes(current->offset());
+    DEBUG("%s grows to %" PRId64, mPath.c_str(), content->offset() + content->size());
+    return content;
+}
+
+__END_NAMESPACE_MFWK
@@ -0,0 +1,86 @@
+/******************************************************************************
+ * Copyright (c) 2016, Chen Fang <mtdcy.chen@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+
+
+
+
+/**
+ * File:    ContentFollower.h
+ * Author:  mtdcy.chen
+ * Changes:
+ *          1. 20201101     initial version
+ *
+ */
+
+#ifndef MFWK_CONTENT_FOLLOWER_H
+#define MFWK_CONTENT_FOLLOWER_H
+#include <MediaFramework/MediaTypes.h>
+
+#ifdef __cplusplus
+__BEGIN_NAMESPACE_MFWK
+
+/**
+ * content follower waits for a local file which is still being written,
+ * so demuxer can continue from where it stops instead of reporting eos.
+ *
+ * new bytes are detected by inotify on linux, and by polling file size
+ * on other platforms.
+ *
+ * @note follow mode is enabled by kKeyFollow of file device.
+ */
+struct ContentFollower : public SharedObject {
+    /**
+     * follow url
+     * @param timeout   give up if file stops growing for this long, in us
+     * @return Nil if url is not a local file
+     */
+    static sp<ContentFollower> Open(const String& url, Int64 timeout);
+    
+    /**
+     * wait until file grows beyond the end of current content
+     * @return new content at the same position as current, or
+     *         Nil if file stops growing or is truncated.
+     */
+    sp<ABuffer>     wait(const sp<ABuffer>& current);
+    
+    virtual ~ContentFollower();
+    
+    private:
+    ContentFollower();
+    
+    String          mURL;
+    String          mPath;
+    Time            mTimeout;
+    Int             mNotify;    // inotify fd, -1 if not available
+    
+    OBJECT_TAIL(ContentFollower);
+};
+
+__END_NAMESPACE_MFWK
+#endif // __cplusplus
+
+#endif // MFWK_CONTENT_FOLLOWER_H
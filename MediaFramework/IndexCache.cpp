@@ -0,0 +1,342 @@
+/******************************************************************************
+ * Copyright (c) 2016, Chen Fang <mtdcy.chen@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+
+
+/**
+ * File:    IndexCache.cpp
+ * Author:  mtdcy.chen
+ * Changes:
+ *          1. 20201018     initial version
+ *
+ */
+
+#define LOG_TAG "IndexCache"
+//#define LOG_NDEBUG 0
+#include "MediaTypes.h"
+#include "IndexCache.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#define kCacheMagic         FOURCC('MFIC')
+#define kCacheVersion       (2)
+// bytes at file head & tail for content hash
+#define kHashLength         (64 * 1024)
+
+__BEGIN_NAMESPACE_MFWK
+
+// cache header, in little endian:
+//  magic[4] version[4] size[8] mtime[8] hash[8] pathLength[4] numChunks[4]
+// followed by path, then chunk table aligned to 8 bytes:
+//  tag[4] length[4] offset[8]
+#define kHeaderLength       (40)
+#define kChunkLength        (16)
+
+static FORCE_INLINE void PutLE(UInt8 * p, UInt64 v, UInt32 n) {
+    for (UInt32 i = 0; i < n; ++i) p[i] = (UInt8)(v >> (8 * i));
+}
+
+static FORCE_INLINE UInt64 GetLE(const UInt8 * p, UInt32 n) {
+    UInt64 v = 0;
+    for (UInt32 i = 0; i < n; ++i) v |= (UInt64)p[i] << (8 * i);
+    return v;
+}
+
+#define ALIGN8(x)   (((x) + 7) & ~7ULL)
+
+// FNV-1a
+static UInt64 Hash(const UInt8 * data, UInt64 length, UInt64 hash = 0xcbf29ce484222325ULL) {
+    for (UInt64 i = 0; i < length; ++i) {
+        hash ^= data[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static Bool HashContent(const String& path, UInt64 size, UInt64 * hash) {
+    Int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return False;
+    
+    UInt8 * data = new UInt8[kHashLength];
+    *hash = Hash((const UInt8 *)&size, sizeof(size));
+    // head
+    ssize_t n = pread(fd, data, kHashLength, 0);
+    if (n > 0) *hash = Hash(data, n, *hash);
+    // tail
+    if (n >= 0 && size > kHashLength) {
+        n = pread(fd, data, kHashLength, size - kHashLength);
+        if (n > 0) *hash = Hash(data, n, *hash);
+    }
+    delete [] data;
+    close(fd);
+    return n >= 0;
+}
+
+IndexCache::IndexCache() : SharedObject(), mMapped(Nil), mMappedLength(0) {
+}
+
+IndexCache::~IndexCache() {
+    if (mMapped) munmap(mMapped, mMappedLength);
+}
+
+sp<IndexCache> IndexCache::Open(const String& url) {
+    String dir = GetEnvironmentValue("INDEX_CACHE");
+    if (dir.equals("")) return Nil;
+    
+    String path = url;
+    if (!strncmp(url.c_str(), "file://", 7)) path = url.c_str() + 7;
+    
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+        DEBUG("%s is not a local file", url.c_str());
+        return Nil;
+    }
+    
+    sp<IndexCache> cache = new IndexCache;
+    cache->mPath        = path;
+    cache->mKey.size    = st.st_size;
+#ifdef __APPLE__
+    cache->mKey.mtime   = st.st_mtimespec.tv_sec * 1000000000LL + st.st_mtimespec.tv_nsec;
+#else
+    cache->mKey.mtime   = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+#endif
+    if (!HashContent(path, cache->mKey.size, &cache->mKey.hash)) {
+        ERROR("read %s failed", path.c_str());
+        return Nil;
+    }
+    const UInt64 name = Hash((const UInt8 *)path.c_str(), strlen(path.c_str()));
+    cache->mName = String::format("%s/%016" PRIx64 ".idx", dir.c_str(), name);
+    
+    if (cache->load()) {
+        INFO("%s: %zu chunks in cache", path.c_str(), cache->mChunks.size());
+    }
+    return cache;
+}
+
+Bool IndexCache::load() {
+    Int fd = open(mName.c_str(), O_RDONLY);
+    if (fd < 0) return False;
+    
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < kHeaderLength) {
+        close(fd);
+        return False;
+    }
+    
+    void * mapped = mmap(Nil, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        ERROR("mmap %s failed", mName.c_str());
+        return False;
+    }
+    mMapped         = (UInt8 *)mapped;
+    mMappedLength   = st.st_size;
+    
+    // path & chunk table are bounded by file size before read
+    const UInt32 pathLength = strlen(mPath.c_str());
+    const UInt32 numChunks  = GetLE(mMapped + 36, 4);
+    const UInt64 offset     = ALIGN8(kHeaderLength + pathLength);
+    Bool valid = GetLE(mMapped, 4) == kCacheMagic &&
+        GetLE(mMapped + 4, 4) == kCacheVersion &&
+        GetLE(mMapped + 8, 8) == mKey.size &&
+        (Int64)GetLE(mMapped + 16, 8) == mKey.mtime &&
+        GetLE(mMapped + 24, 8) == mKey.hash &&
+        GetLE(mMapped + 32, 4) == pathLength &&
+        offset + (UInt64)numChunks * kChunkLength <= mMappedLength &&
+        !memcmp(mMapped + kHeaderLength, mPath.c_str(), pathLength);
+    
+    for (UInt32 i = 0; valid && i < numChunks; ++i) {
+        const UInt8 * p = mMapped + offset + i * kChunkLength;
+        Chunk chunk;
+        chunk.tag       = GetLE(p, 4);
+        chunk.length    = GetLE(p + 4, 4);
+        chunk.offset    = GetLE(p + 8, 8);
+        if (chunk.offset > mMappedLength || chunk.length > mMappedLength - chunk.offset) valid = False;
+        else mChunks.push(chunk);
+    }
+    
+    if (!valid) {
+        INFO("%s: cache is stale", mPath.c_str());
+        munmap(mMapped, mMappedLength);
+        mMapped         = Nil;
+        mMappedLength   = 0;
+        mChunks.clear();
+        return False;
+    }
+    return True;
+}
+
+const UInt8 * IndexCache::find(UInt32 tag, UInt32 * length) const {
+    for (UInt32 i = 0; i < mChunks.size(); ++i) {
+        if (mChunks[i].tag != tag) continue;
+        *length = mChunks[i].length;
+        return mMapped + mChunks[i].offset;
+    }
+    return Nil;
+}
+
+void IndexCache::put(UInt32 tag, const sp<Buffer>& data) {
+    for (UInt32 i = 0; i < mPendingTags.size(); ++i) {
+        if (mPendingTags[i] == tag) {
+            mPending[i] = data;
+            return;
+        }
+    }
+    mPendingTags.push(tag);
+    mPending.push(data);
+}
+
+MediaError IndexCache::commit() {
+    if (mPending.empty()) return kMediaNoError;
+    
+    // chunks in old cache are kept if not replaced
+    Vector<Chunk> chunks;
+    Vector<const UInt8 *> payloads;
+    for (UInt32 i = 0; i < mChunks.size(); ++i) {
+        Bool replaced = False;
+        for (UInt32 j = 0; j < mPendingTags.size(); ++j) {
+            if (mPendingTags[j] == mChunks[i].tag) replaced = True;
+        }
+        if (replaced) continue;
+        chunks.push(mChunks[i]);
+        payloads.push(mMapped + mChunks[i].offset);
+    }
+    for (UInt32 i = 0; i < mPending.size(); ++i) {
+        Chunk chunk = { mPendingTags[i], (UInt32)mPending[i]->size(), 0 };
+        chunks.push(chunk);
+        payloads.push((const UInt8 *)mPending[i]->data());
+    }
+    
+    const UInt32 pathLength = strlen(mPath.c_str());
+    UInt8 header[kHeaderLength];
+    PutLE(header, kCacheMagic, 4);
+    PutLE(header + 4, kCacheVersion, 4);
+    PutLE(header + 8, mKey.size, 8);
+    PutLE(header + 16, mKey.mtime, 8);
+    PutLE(header + 24, mKey.hash, 8);
+    PutLE(header + 32, pathLength, 4);
+    PutLE(header + 36, chunks.size(), 4);
+    
+    UInt64 offset = ALIGN8(kHeaderLength + pathLength) + chunks.size() * kChunkLength;
+    for (UInt32 i = 0; i < chunks.size(); ++i) {
+        offset              = ALIGN8(offset);
+        chunks[i].offset    = offset;
+        offset              += chunks[i].length;
+    }
+    
+    // write to a temp file and rename, readers never see a partial cache
+    String temp = String::format("%s.%d", mName.c_str(), (Int)getpid());
+    FILE * fp = fopen(temp.c_str(), "wb");
+    if (fp == Nil) {
+        ERROR("create %s failed", temp.c_str());
+        return kMediaErrorSystemError;
+    }
+    
+    static const UInt8 kZeros[8] = { 0 };
+    Bool ok = fwrite(header, 1, kHeaderLength, fp) == kHeaderLength &&
+        fwrite(mPath.c_str(), 1, pathLength, fp) == pathLength;
+    UInt64 pos = kHeaderLength + pathLength;
+    ok = ok && fwrite(kZeros, 1, ALIGN8(pos) - pos, fp) == ALIGN8(pos) - pos;
+    pos = ALIGN8(pos);
+    for (UInt32 i = 0; ok && i < chunks.size(); ++i) {
+        UInt8 chunk[kChunkLength];
+        PutLE(chunk, chunks[i].tag, 4);
+        PutLE(chunk + 4, chunks[i].length, 4);
+        PutLE(chunk + 8, chunks[i].offset, 8);
+        ok = fwrite(chunk, 1, kChunkLength, fp) == kChunkLength;
+        pos += kChunkLength;
+    }
+    for (UInt32 i = 0; ok && i < chunks.size(); ++i) {
+        ok = fwrite(kZeros, 1, chunks[i].offset - pos, fp) == chunks[i].offset - pos &&
+            fwrite(payloads[i], 1, chunks[i].length, fp) == chunks[i].length;
+        pos = chunks[i].offset + chunks[i].length;
+    }
+    ok = fclose(fp) == 0 && ok;
+    
+    if (!ok || rename(temp.c_str(), mName.c_str()) != 0) {
+        ERROR("write %s failed", mName.c_str());
+        unlink(temp.c_str());
+        return kMediaErrorSystemError;
+    }
+    
+    INFO("%s: %zu chunks written to %s", mPath.c_str(), chunks.size(), mName.c_str());
+    mPendingTags.clear();
+    mPending.clear();
+    return kMediaNoError;
+}
+
+IndexWriter::IndexWriter() : mBuffer(Nil), mCapacity(0), mLength(0) {
+}
+
+void IndexWriter::write(const void * data, UInt32 length) {
+    if (mLength + length > mCapacity) {
+        UInt32 capacity = mCapacity ? mCapacity * 2 : 4096;
+        while (capacity < mLength + length) capacity *= 2;
+        sp<Buffer> buffer = new Buffer(capacity);
+        if (mLength) memcpy(buffer->base(), mBuffer->base(), mLength);
+        mBuffer     = buffer;
+        mCapacity   = capacity;
+    }
+    memcpy((UInt8 *)mBuffer->base() + mLength, data, length);
+    mLength += length;
+}
+
+void IndexWriter::writeLE(UInt64 v, UInt32 n) {
+    UInt8 data[8];
+    PutLE(data, v, n);
+    write(data, n);
+}
+
+sp<Buffer> IndexWriter::release() {
+    sp<Buffer> buffer = mBuffer;
+    if (buffer == Nil) buffer = new Buffer(1);
+    buffer->setBytesRange(0, mLength);
+    mBuffer     = Nil;
+    mCapacity   = 0;
+    mLength     = 0;
+    return buffer;
+}
+
+Bool IndexReader::read(void * data, UInt32 length) {
+    if (!mStatus || length > mLength - mOffset) return mStatus = False;
+    memcpy(data, mData + mOffset, length);
+    mOffset += length;
+    return True;
+}
+
+Bool IndexReader::readLE(UInt64 * v, UInt32 n) {
+    if (!mStatus || n > mLength - mOffset) return mStatus = False;
+    *v = GetLE(mData + mOffset, n);
+    mOffset += n;
+    return True;
+}
+
+__END_NAMESPACE_MFWK
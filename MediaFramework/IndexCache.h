@@ -0,0 +1,183 @@
+/******************************************************************************
+ * Copyright (c) 2016, Chen Fang <mtdcy.chen@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+
+
+/**
+ * File:    IndexCache.h
+ * Author:  mtdcy.chen
+ * Changes:
+ *          1. 20201018     initial version
+ *
+ */
+
+#ifndef MFWK_INDEX_CACHE_H
+#define MFWK_INDEX_CACHE_H
+#include <MediaFramework/MediaTypes.h>
+
+#ifdef __cplusplus
+__BEGIN_NAMESPACE_MFWK
+
+/**
+ * index cache keeps demuxer's prepared track formats and seek index on disk,
+ * so reopen a file is a single mmap instead of a full structure parse.
+ *
+ * cache is keyed by path, size, mtime and a hash of file head & tail,
+ * and holds a list of tagged chunks, everything on disk is little endian.
+ *
+ * @note cache is enabled by environment INDEX_CACHE, which is the cache directory.
+ */
+struct IndexCache : public SharedObject {
+    /**
+     * open cache for url
+     * @return Nil if cache is disabled or url is not a local file
+     */
+    static sp<IndexCache> Open(const String& url);
+    
+    /**
+     * find chunk in cache
+     * @return Nil if chunk is missing, memory is valid until cache released
+     */
+    const UInt8 *   find(UInt32 tag, UInt32 * length) const;
+    
+    /**
+     * add chunk to cache, which will be written by commit()
+     */
+    void            put(UInt32 tag, const sp<Buffer>& data);
+    
+    /**
+     * write chunks to disk, replace the old cache atomically
+     */
+    MediaError      commit();
+    
+    virtual ~IndexCache();
+    
+    private:
+    IndexCache();
+    
+    struct Key {
+        UInt64      size;
+        Int64       mtime;      // in ns
+        UInt64      hash;       // hash of file head & tail
+    };
+    struct Chunk {
+        UInt32      tag;
+        UInt32      length;
+        UInt64      offset;
+    };
+    
+    String          mPath;      // path of media file
+    String          mName;      // path of cache file
+    Key             mKey;
+    // mapped cache file
+    UInt8 *         mMapped;
+    UInt64          mMappedLength;
+    Vector<Chunk>   mChunks;
+    // chunks to write
+    Vector<UInt32>      mPendingTags;
+    Vector<sp<Buffer> > mPending;
+    
+    Bool            load();
+    
+    OBJECT_TAIL(IndexCache);
+};
+
+/**
+ * chunk builder, values are written in little endian.
+ *
+ * integers, Bool and enums are written with sizeof(T) bytes, struct elements
+ * of Vector are written by IndexWrite(IndexWriter&, const T&) found by ADL.
+ */
+struct IndexWriter {
+    IndexWriter();
+    
+    // raw bytes
+    void            write(const void *, UInt32);
+    template <typename T> FORCE_INLINE void write(const T& v) { writeLE((UInt64)v, sizeof(T)); }
+    template <typename T> FORCE_INLINE void write(const Vector<T>& v) {
+        write<UInt32>(v.size());
+        for (UInt32 i = 0; i < v.size(); ++i) IndexWrite(*this, v[i]);
+    }
+    
+    // get chunk data, writer is reset
+    sp<Buffer>      release();
+    
+    private:
+    sp<Buffer>      mBuffer;
+    UInt32          mCapacity;
+    UInt32          mLength;
+    
+    void            writeLE(UInt64, UInt32);
+};
+
+/**
+ * chunk reader, fails on the first short read.
+ */
+struct IndexReader {
+    FORCE_INLINE IndexReader(const UInt8 * data, UInt32 length) :
+    mData(data), mLength(data ? length : 0), mOffset(0), mStatus(True) { }
+    
+    // raw bytes
+    Bool            read(void *, UInt32);
+    template <typename T> FORCE_INLINE Bool read(T& v) {
+        UInt64 x = 0;
+        if (!readLE(&x, sizeof(T))) return False;
+        v = (T)x;
+        return True;
+    }
+    template <typename T> FORCE_INLINE Bool read(Vector<T>& v) {
+        UInt32 n = 0;
+        // each element takes one byte at least
+        if (!read<UInt32>(n) || n > remains()) return mStatus = False;
+        v.clear();
+        for (UInt32 i = 0; i < n && mStatus; ++i) {
+            T e;
+            IndexRead(*this, e);
+            v.push(e);
+        }
+        return mStatus;
+    }
+    
+    FORCE_INLINE Bool status() const    { return mStatus; }
+    FORCE_INLINE UInt32 remains() const { return mLength - mOffset; }
+    
+    private:
+    const UInt8 *   mData;
+    UInt32          mLength;
+    UInt32          mOffset;
+    Bool            mStatus;
+    
+    Bool            readLE(UInt64 *, UInt32);
+};
+
+// Vector elements of scalar type, overload these for struct elements
+template <typename T> FORCE_INLINE void IndexWrite(IndexWriter& writer, const T& v) { writer.write<T>(v); }
+template <typename T> FORCE_INLINE Bool IndexRead(IndexReader& reader, T& v) { return reader.read<T>(v); }
+
+__END_NAMESPACE_MFWK
+#endif // __cplusplus
+
+#endif // MFWK_INDEX_CACHE_H
@@ -60,6 +60,8 @@ struct MediaCodec : public IMediaSession {
     sp<MediaDevice>         mCodec;                     // reference to codec
     sp<PacketReadyEvent>    mPacketReadyEvent;          // when packet ready
     eCodecType              mType;
+    eRotate                 mRotate;                    // display rotation of track
+    eFlip                   mFlip;                      // display flip of track
 
     // internal mutable context
     // TODO: clock for decoder, handle late frames
@@ -89,6 +91,7 @@ struct MediaCodec : public IMediaSession {
     mPacketRequestEvent(Nil), mInfoEvent(Nil),
     // internal static context
     mCodec(Nil), mPacketReadyEvent(Nil), mType(kCodecTypeAudio),
+    mRotate(kRotate0), mFlip(kFlipNone),
     // internal mutable context
     mState(Init), mGeneration(0), mInputEOS(False), mSignalCodecEOS(False),
     mLastPacketTime(kMediaTimeInvalid), mFrameRequestEvent(new OnFrameRequest(this)),
@@ -121,6 +124,8 @@ struct MediaCodec : public IMediaSession {
         CHECK_TRUE(formats->contains(kKeyType));
         CHECK_TRUE(formats->contains(kKeyFormat));
         mType = (eCodecType)formats->findInt32(kKeyType);
+        mRotate = (eRotate)formats->findInt32(kKeyRotate, kRotate0);
+        mFlip = (eFlip)formats->findInt32(kKeyFlip, kFlipNone);
         
         sp<Message> options0 = new Message;
         options0->setInt32(kKeyMode, mMode);
@@ -200,6 +205,11 @@ struct MediaCodec : public IMediaSession {
                         
                         sp<Message> codecFormat = mCodec->formats();
                         codecFormat->setObject(kKeyFrameRequestEvent, mFrameRequestEvent);
+                        // codec knows nothing about display orientation
+                        if (mRotate != kRotate0 && !codecFormat->contains(kKeyRotate))
+                            codecFormat->setInt32(kKeyRotate, mRotate);
+                        if (mFlip != kFlipNone && !codecFormat->contains(kKeyFlip))
+                            codecFormat->setInt32(kKeyFlip, mFlip);
                         notify(kSessionInfoReady, codecFormat);
                     }
                     
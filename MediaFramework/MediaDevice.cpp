@@ -41,6 +41,9 @@
 
 #include "MediaTypes.h"
 #include "MediaDevice.h"
+#include "MediaSession.h"
+#include "IndexCache.h"
+#include "ContentFollower.h"
 #include "id3/ID3.h"
 #include "matroska/EBML.h"
 
@@ -135,10 +138,12 @@ static eFileFormat GetFormat(const sp<ABuffer>& data) {
     return format;
 }
 
-sp<MediaDevice> CreateMp3File(const sp<ABuffer>&);
-sp<MediaDevice> CreateMp4File(const sp<ABuffer>&);
-sp<MediaDevice> CreateMatroskaFile(const sp<ABuffer>&);
-sp<MediaDevice> CreateWaveFile(const sp<ABuffer>&);
+sp<MediaDevice> CreateMp3File(const sp<ABuffer>&, const String&, const sp<IndexCache>&);
+sp<MediaDevice> CreateMp4File(const sp<ABuffer>&, const sp<IndexCache>&, const sp<ContentFollower>&);
+sp<MediaDevice> CreateMatroskaFile(const sp<ABuffer>&, const sp<IndexCache>&, const sp<ContentFollower>&);
+sp<MediaDevice> CreateWaveFile(const sp<ABuffer>&, const String&);
+sp<MediaDevice> CreateAviFile(const sp<ABuffer>&);
+sp<MediaDevice> CreateFlacFile(const sp<ABuffer>&);
 
 #ifdef __APPLE__
 sp<MediaDevice> CreateVideoToolboxDecoder(const sp<Message>& formats, const sp<Message>& options);
@@ -158,6 +163,24 @@ sp<MediaDevice> CreateSDLAudio(const sp<Message>& formats, const sp<Message>& op
 
 sp<MediaDevice> CreateMp3Packetizer();
 
+// empty if not available
+static String GetURL(const sp<Message>& formats) {
+    if (!formats->contains(kKeyURL)) return String();
+    return formats->findString(kKeyURL);
+}
+
+// index cache is keyed by path
+static sp<IndexCache> OpenIndexCache(const sp<Message>& formats) {
+    if (!formats->contains(kKeyURL)) return Nil;
+    return IndexCache::Open(formats->findString(kKeyURL));
+}
+
+// follow mode needs url to reopen the content
+static sp<ContentFollower> OpenContentFollower(const sp<Message>& formats) {
+    if (!formats->contains(kKeyFollow) || !formats->contains(kKeyURL)) return Nil;
+    return ContentFollower::Open(formats->findString(kKeyURL), formats->findInt64(kKeyFollow));
+}
+
 sp<MediaDevice> MediaDevice::create(const sp<Message>& formats, const sp<Message>& options) {
     // ENV
     String env0 = GetEnvironmentValue("FORCE_AVFORMAT");
@@ -197,16 +220,52 @@ sp<MediaDevice> MediaDevice::create(const sp<Message>& formats, const sp<Message
     
     switch (format) {
         case kFileFormatWave:
-            return CreateWaveFile(buffer);
+            // url for mapping samples into memory
+            return CreateWaveFile(buffer, GetURL(formats));
         case kFileFormatMp3:
-            return CreateMp3File(buffer);
+            // url for background seek index, which reads with its own content
+            return CreateMp3File(buffer, GetURL(formats), OpenIndexCache(formats));
         case kFileFormatMp4:
-            return CreateMp4File(buffer);
+        {
+            // cache of a growing file is always stale
+            sp<ContentFollower> follower = OpenContentFollower(formats);
+            sp<IndexCache> cache;
+            if (follower.isNil()) cache = OpenIndexCache(formats);
+            return CreateMp4File(buffer, cache, follower);
+        }
         case kFileFormatMkv:
-            return CreateMatroskaFile(buffer);
-        case kFileFormatApe:
-        case kFileFormatFlac:
+        {
+            sp<ContentFollower> follower = OpenContentFollower(formats);
+            sp<IndexCache> cache;
+            if (follower.isNil()) cache = OpenIndexCache(formats);
+            return CreateMatroskaFile(buffer, cache, follower);
+        }
         case kFileFormatAvi:
+        {
+            const Int64 offset = buffer->offset();
+            sp<MediaDevice> file = CreateAviFile(buffer);
+            if (!file.isNil()) return file;
+#ifdef WITH_FFMPEG
+            // AMV, unsupported codecs, ...
+            buffer->skipBytes(offset - buffer->offset());
+            return CreateLibavformat(buffer);
+#else
+            return Nil;
+#endif
+        }
+        case kFileFormatFlac:
+        {
+            const Int64 offset = buffer->offset();
+            sp<MediaDevice> file = CreateFlacFile(buffer);
+            if (!file.isNil()) return file;
+#ifdef WITH_FFMPEG
+            buffer->skipBytes(offset - buffer->offset());
+            return CreateLibavformat(buffer);
+#else
+            return Nil;
+#endif
+        }
+        case kFileFormatApe:
         case kFileFormatLAVF:
 #ifdef WITH_FFMPEG
             return CreateLibavformat(buffer);
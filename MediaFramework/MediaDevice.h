@@ -61,6 +61,8 @@
  *   kKeyHeight:        UInt32          [*] video height
  *   kKeyavcC:          sp<Buffer>      [ ] h264 avcC data
  *   kKeyhvcC:          sp<Buffer>      [ ] hevc hvcC data
+ *   kKeyRotate:        eRotate         [ ] display rotation, default:kRotate0
+ *   kKeyFlip:          eFlip           [ ] display flip, default:kFlipNone
  *
  *  video pixel formats:
  *   kKeyFormat:        ePixelFormat    [*] pixel format
@@ -76,6 +78,8 @@
  * File Device:
  *  input formats:
  *   kKeyContent:       sp<ABuffer>     [*] media content
+ *   kKeyURL:           String          [ ] media url, for index cache, follow mode & mapping
+ *   kKeyFollow:        Int64           [ ] follow growing file, give up if no new bytes for this long in us
  *
  *  input options:
  *
@@ -90,6 +94,7 @@
  *  configure options:
  *   kKeySeek:          Int64           [ ] perform seek
  *   kKeyTracks:        UInt32          [ ] perform track select based on track mask
+ *   kKeyDuration:      Int64           [ ] frame duration in us, for pcm files
  *
  * Codec Device:
  *  input formats:
@@ -116,6 +121,27 @@
  *
  *  configure options:
  *   kKeyPause:         Bool            [ ] pause/unpause device
+ *
+ * Color Converter:
+ *  input options:
+ *   kKeyScaleFilter:   eScaleFilter    [ ] scale filter, default:kScaleFilterDefault
+ *   kKeyThreads:       UInt32          [ ] max threads for conversion, default:0(auto)
+ *   kKeyParallelThreshold: UInt32      [ ] min pixels for parallel conversion, default:1920x1088
+ *   kKeyRotate:        eRotate         [ ] rotate clockwise, default:kRotate0
+ *   kKeyFlip:          eFlip           [ ] flip before rotate, default:kFlipNone
+ *
+ *  output formats:
+ *   ... pixel formats
+ *
+ *  configure options:
+ *   kKeyFormat:        ePixelFormat    [ ] output pixel format
+ *   kKeyWidth:         UInt32          [ ] output width, scale if differ from input rect
+ *   kKeyHeight:        UInt32          [ ] output height, scale if differ from input rect
+ *   kKeyScaleFilter:   eScaleFilter    [ ] scale filter
+ *   kKeyThreads:       UInt32          [ ] max threads for conversion
+ *   kKeyParallelThreshold: UInt32      [ ] min pixels for parallel conversion
+ *   kKeyRotate:        eRotate         [ ] rotate clockwise, output width & height are swapped for 90/270
+ *   kKeyFlip:          eFlip           [ ] flip before rotate
  */
 
 __BEGIN_DECLS
@@ -137,7 +163,8 @@ enum {
     kKeyChannelMap      = FOURCC('cmap'),       ///< UInt32
     kKeyWidth           = FOURCC('widt'),       ///< UInt32
     kKeyHeight          = FOURCC('heig'),       ///< UInt32
-    kKeyRotate          = FOURCC('?rot'),       ///< UInt32, eRotate
+    kKeyRotate          = FOURCC('?rot'),       ///< UInt32, eRotate, clockwise
+    kKeyFlip            = FOURCC('?flp'),       ///< UInt32, eFlip, applied before kKeyRotate
     kKeyCount           = FOURCC('#cnt'),       ///< UInt32
     kKeyBitrate         = FOURCC('btrt'),       ///< UInt32
     kKeyTracks          = FOURCC('trak'),       ///< Int32, bit mask
@@ -154,6 +181,10 @@ enum {
     kKeyMetaData        = FOURCC('meta'),       ///< sp<Message>
     kKeyEncoderDelay    = FOURCC('edly'),       ///< Int32
     kKeyEncoderPadding  = FOURCC('epad'),       ///< Int32
+    kKeyScaleFilter     = FOURCC('sflt'),       ///< UInt32, @see eScaleFilter
+    kKeyThreads         = FOURCC('#thr'),       ///< UInt32, max threads, 0 means auto
+    kKeyParallelThreshold = FOURCC('pthr'),     ///< UInt32, min pixels to process in parallel
+    kKeyFollow          = FOURCC('folw'),       ///< Int64, us, follow growing file, @see ContentFollower
     
     // Microsoft codec manager data
     kKeyMicrosoftVCM    = FOURCC('MVCM'),       ///< sp<Buffer>, Microsoft VCM, exists in matroska, @see BITMAPINFOHEADER
@@ -212,6 +243,16 @@ enum {
 };
 typedef UInt32 eBlockModeType;
 
+// key - kKeyScaleFilter
+enum {
+    kScaleFilterNone        = FOURCC('!flt'),   ///< point sampling, fastest
+    kScaleFilterLinear      = FOURCC('lflt'),   ///< horizontal only linear filter
+    kScaleFilterBilinear    = FOURCC('bflt'),   ///< bilinear filter
+    kScaleFilterBox         = FOURCC('xflt'),   ///< box filter, best for down scale
+    kScaleFilterDefault     = kScaleFilterBilinear
+};
+typedef UInt32 eScaleFilter;
+
 enum {
     kDeviceOpenGL       = FOURCC('opgl'),
     kDeviceOpenAL       = FOURCC('opal'),
@@ -81,6 +81,10 @@ struct MediaFile : public IMediaSession {
         
         sp<Message> formats = new Message;
         formats->setObject(kKeyContent, pipe);
+        formats->setString(kKeyURL, url);
+        if (media->contains(kKeyFollow)) {
+            formats->setInt64(kKeyFollow, media->findInt64(kKeyFollow));
+        }
         mMediaFile = MediaDevice::create(formats, Nil);
         if (mMediaFile.isNil()) {
             ERROR("create file failed");
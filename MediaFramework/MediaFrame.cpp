@@ -68,7 +68,8 @@ struct FullPlaneMediaFrame : public MediaFrame {
 MediaFrame::MediaFrame() : SharedObject(), id(0),
 timecode(kMediaTimeInvalid), duration(kMediaTimeInvalid),
 format(0), opaque(Nil) {
-    
+    trim.head   = 0;
+    trim.tail   = 0;
 }
 
 sp<MediaFrame> MediaFrame::Create(UInt32 n) {
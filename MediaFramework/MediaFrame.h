@@ -79,6 +79,10 @@ struct API_EXPORT MediaFrame : public SharedObject {
         ImageFormat     video;          ///< video format
         ImageFormat     image;          ///< image format
     };
+    struct {
+        UInt32        head;           ///< samples to discard at the beginning
+        UInt32        tail;           ///< samples to discard at the end
+    } trim;                             ///< for kFrameTypeTrimmed, in decoded samples
     void *              opaque;         ///< invisible, for special purposes
     MediaBufferList     planes;         ///< this SHOULD be the last data member
 
@@ -39,6 +39,7 @@
 #include "MediaClock.h"
 #include "MediaPlayer.h"
 #include "AudioConverter.h"
+#include "ColorConverter.h"
 
 #define MIN_COUNT (16)
 #define MAX_COUNT (32)
@@ -109,6 +110,8 @@ struct MediaRenderer : public IMediaSession {
         AudioFormat         mAudio;
         ImageFormat         mImage;
     };
+    eRotate                 mRotate;            // display rotation of video
+    eFlip                   mFlip;              // display flip of video
     sp<MediaDevice>         mConverter;
     
     // statistics
@@ -127,6 +130,7 @@ struct MediaRenderer : public IMediaSession {
     mRenderJob(new RenderJob(this)), mState(kStateInit),
     mClockUpdated(False), mInputEOS(False),
     mLastFrameTime(kMediaTimeInvalid),
+    mRotate(kRotate0), mFlip(kFlipNone),
     // statistics
     mFramesRenderred(0) {
     }
@@ -179,6 +183,15 @@ struct MediaRenderer : public IMediaSession {
             Int32 width = formats->findInt32(kKeyWidth);
             Int32 height = formats->findInt32(kKeyHeight);
             delayInit = width == 0 || height == 0;
+            mImage.matrix   = (eColorMatrix)formats->findInt32(kKeyColorMatrix, kColorMatrixNull);
+            mImage.width    = width;
+            mImage.height   = height;
+            mImage.rect.x   = 0;
+            mImage.rect.y   = 0;
+            mImage.rect.w   = width;
+            mImage.rect.h   = height;
+            mRotate         = (eRotate)formats->findInt32(kKeyRotate, kRotate0);
+            mFlip           = (eFlip)formats->findInt32(kKeyFlip, kFlipNone);
         }
         
         if (delayInit) return;
@@ -195,7 +208,57 @@ struct MediaRenderer : public IMediaSession {
             }
 
             if (mType == kCodecTypeVideo) {
-                // setup color converter
+                // rotate by out device if it can, otherwise rotate in color converter
+                Bool rotated = mRotate == kRotate0 && mFlip == kFlipNone;
+                if (!rotated && mFlip == kFlipNone) {
+                    sp<Message> rotate = new Message;
+                    rotate->setInt32(kKeyRotate, mRotate);
+                    rotated = mOut->configure(rotate) == kMediaNoError;
+                }
+                const Bool swap = !rotated && (mRotate == kRotate90 || mRotate == kRotate270);
+                if (swap) {
+                    // recreate out device in rotated dimention
+                    sp<Message> rotatedFormat = formats->copy();
+                    rotatedFormat->setInt32(kKeyWidth, mImage.height);
+                    rotatedFormat->setInt32(kKeyHeight, mImage.width);
+                    mOut->reset();
+                    mOut = MediaDevice::create(rotatedFormat, options);
+                    if (mOut.isNil()) {
+                        ERROR("%s: create out failed", mName.c_str());
+                        notify(kSessionInfoError, Nil);
+                        return;
+                    }
+                }
+                
+                // setup color converter, negotiate pixel format & size with out device,
+                // so memory and bandwidth scale with output size instead of source size.
+                sp<Message> outFormat = mOut->formats();
+                ImageFormat image = mImage;
+                image.format    = outFormat->findInt32(kKeyFormat, mImage.format);
+                image.width     = outFormat->findInt32(kKeyWidth, swap ? mImage.height : mImage.width);
+                image.height    = outFormat->findInt32(kKeyHeight, swap ? mImage.width : mImage.height);
+                image.rect.w    = image.width;
+                image.rect.h    = image.height;
+                
+                mConverter.clear();
+                if (!rotated ||
+                    image.format != mImage.format ||
+                    image.width != mImage.width ||
+                    image.height != mImage.height) {
+                    sp<Message> transform;
+                    if (!rotated) {
+                        // rotation is fused with conversion in a single pass
+                        transform = new Message;
+                        transform->setInt32(kKeyRotate, mRotate);
+                        transform->setInt32(kKeyFlip, mFlip);
+                    }
+                    mConverter = CreateColorConverter(mImage, image, transform);
+                    if (mConverter.isNil()) {
+                        ERROR("create color converter failed");
+                        notify(kSessionInfoError, Nil);
+                        return;
+                    }
+                }
             } else if (mType == kCodecTypeAudio) {
                 // setup resampler
                 sp<Message> outFormat = mOut->formats();
@@ -262,6 +325,8 @@ struct MediaRenderer : public IMediaSession {
             format->setInt32(kKeyFormat, frame->video.format);
             format->setInt32(kKeyWidth, frame->video.width);
             format->setInt32(kKeyHeight, frame->video.height);
+            format->setInt32(kKeyRotate, mRotate);
+            format->setInt32(kKeyFlip, mFlip);
         } else if (mType == kCodecTypeAudio) {
             format->setInt32(kKeyFormat, frame->audio.format);
             format->setInt32(kKeyChannels, frame->audio.channels);
@@ -262,7 +262,9 @@ enum {
     /** Y'CbCr others **/
 
     /** Y'CbCr 10-bit family **/
-    kPixelFormat420YpCbCr10Planar       = FOURCC('v210'),  ///< Planar Y'CbCr 10-bit 4:2:0, 15bpp, 3 planes: Y'/Cb/Cr
+    kPixelFormat420YpCbCr10Planar       = FOURCC('I010'),   ///< Planar Y'CbCr 10-bit 4:2:0, 24bpp, 3 planes: Y'/Cb/Cr, 16-bit LE samples in low bits
+    kPixelFormat420YpCbCr10SemiPlanar   = FOURCC('P010'),   ///< Planar Y'CbCr 10-bit 4:2:0, 24bpp, 2 planes: Y'/Cb&Cr(interleaved), 16-bit LE samples in high bits
+    kPixelFormat422YpCbCr10             = FOURCC('v210'),   ///< Packed Y'CbCr 10-bit 4:2:2, 6 pixels in 128 bits, rows aligned to 48 pixels
 
     /** RGB color space section **/
     kPixelFormatRGB565                  = FOURCC('16RG'),   ///< packed RGB 5:6:5, 16 bpp, RGB565 in byte-order
@@ -352,6 +354,18 @@ enum {
 };
 typedef UInt32 eRotate;
 
+/**
+ * flip is applied before rotation
+ */
+enum {
+    kFlipNone           = 0,
+    kFlipHorizontal     = FOURCC('Fhor'),   ///< mirror left & right
+    kFlipVertical       = FOURCC('Fver'),   ///< mirror top & bottom
+    
+    kFlipMax            = MEDIA_ENUM_MAX
+};
+typedef UInt32 eFlip;
+
 /**
  * kFrameTypeSync: sync frame, depends on nobody.
  *      @note seek can only seek at this kind of frame.
@@ -360,12 +374,15 @@ typedef UInt32 eRotate;
  *      @note some B-frame be depended by others, in this case, no type should set.
  * kFrameTypeReference: frames that should be decoded but no output.
  *      @note can combine with kFrameTypeSync or kFrameTypeDepended
+ * kFrameTypeTrimmed: frame partially trimmed by container, e.g. edit list.
+ *      @note decoder should discard MediaFrame::trim samples from its output.
  */
 enum {
     kFrameTypeUnknown       = 0,
     kFrameTypeSync          = (1<<0),
     kFrameTypeDisposal      = (1<<2),
     kFrameTypeReference     = (1<<3),
+    kFrameTypeTrimmed       = (1<<4),
     
     kFrameTypeMax           = MEDIA_ENUM_MAX
 };
@@ -110,6 +110,8 @@ struct {
     {kPixelFormat420YpCrCbSemiPlanar,   AV_PIX_FMT_NV21},
     {kPixelFormatRGB565,                AV_PIX_FMT_RGB565},
     {kPixelFormatRGB,                   AV_PIX_FMT_RGB24},
+    {kPixelFormat420YpCbCr10Planar,     AV_PIX_FMT_YUV420P10LE},
+    {kPixelFormat420YpCbCr10SemiPlanar, AV_PIX_FMT_P010LE},
     // Hardware accel
 #ifdef __APPLE__
     {kPixelFormat420YpCbCrSemiPlanar,   AV_PIX_FMT_VIDEOTOOLBOX},
@@ -430,6 +432,15 @@ static MediaError setupExtraData(AVCodecContext *avcc, const sp<Message>& format
                 ERROR("missing hvcC for hevc");
                 return kMediaErrorUnknown;
             } break;
+        case AV_CODEC_ID_FLAC:
+            // STREAMINFO, frame header may refer to it
+            if (formats->contains(kKeyCodecSpecData)) {
+                sp<Buffer> csd = formats->findObject(kKeyCodecSpecData);
+                avcc->extradata_size = csd->size();
+                avcc->extradata = (UInt8*)av_mallocz(avcc->extradata_size +
+                        AV_INPUT_BUFFER_PADDING_SIZE);
+                memcpy(avcc->extradata, csd->data(), avcc->extradata_size);
+            } break;
         default:
             break;
     }
@@ -834,6 +845,20 @@ struct LavcDecoder : public MediaDevice {
             if (input->flags & kFrameTypeDisposal) {
                 pkt->flags |= AV_PKT_FLAG_DISPOSABLE;
             }
+            
+            // let decoder discard samples trimmed by container
+            if (input->flags & kFrameTypeTrimmed) {
+                UInt8 * skip = av_packet_new_side_data(pkt, AV_PKT_DATA_SKIP_SAMPLES, 10);
+                if (skip != Nil) {
+                    // le32 skip start, le32 discard end, u8 reasons
+                    for (UInt32 i = 0; i < 4; ++i) {
+                        skip[i]     = input->trim.head >> (8 * i);
+                        skip[4 + i] = input->trim.tail >> (8 * i);
+                    }
+                    skip[8] = 0;
+                    skip[9] = 0;
+                }
+            }
 
             Int ret = avcodec_send_packet(avcc, pkt);
             MediaError err = kMediaNoError;
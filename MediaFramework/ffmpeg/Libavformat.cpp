@@ -356,6 +356,16 @@ struct AVFormat : public MediaDevice {
                     trak->setInt32(kKeyType, kCodecTypeVideo);
                     trak->setInt32(kKeyWidth, st->codecpar->width);
                     trak->setInt32(kKeyHeight, st->codecpar->height);
+                    {
+                        // display matrix shares the layout of tkhd matrix
+                        const UInt8 * matrix = av_stream_get_side_data(st, AV_PKT_DATA_DISPLAYMATRIX, Nil);
+                        eRotate rotate;
+                        eFlip flip;
+                        if (matrix && MPEG4::GetMatrixRotation((const Int32 *)matrix, &rotate, &flip)) {
+                            if (rotate != kRotate0) trak->setInt32(kKeyRotate, rotate);
+                            if (flip != kFlipNone)  trak->setInt32(kKeyFlip, flip);
+                        }
+                    }
                     break;
                 default:
                     break;
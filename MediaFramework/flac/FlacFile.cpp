@@ -0,0 +1,713 @@
+/******************************************************************************
+ * Copyright (c) 2016, Chen Fang <mtdcy.chen@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+
+
+// File:    FlacFile.cpp
+// Author:  mtdcy.chen
+// Changes:
+//          1. 20201101     initial version
+//
+
+#define LOG_TAG "FlacFile"
+//#define LOG_NDEBUG 0
+#include "MediaTypes.h"
+#include "id3/ID3.h"
+
+#include <string.h>
+#include <strings.h>
+
+#include "MediaDevice.h"
+
+// refer to: https://xiph.org/flac/format.html
+
+__BEGIN_NAMESPACE_MFWK
+
+#define kReadWindowLength   (256 * 1024)
+// max frame header length, sync code to crc8
+#define kMaxHeaderLength    (16)
+// max frame length if STREAMINFO doesn't tell
+#define kMaxFrameLength     (2 * 1024 * 1024)
+// stop bisection and skip frames by headers
+#define kBisectLength       (64 * 1024)
+
+#define STREAMINFO_LENGTH   (34)
+#define APE_FOOTER_LENGTH   (32)
+
+enum {
+    BLOCK_STREAMINFO        = 0,
+    BLOCK_PADDING           = 1,
+    BLOCK_APPLICATION       = 2,
+    BLOCK_SEEKTABLE         = 3,
+    BLOCK_VORBIS_COMMENT    = 4,
+    BLOCK_CUESHEET          = 5,
+    BLOCK_PICTURE           = 6,
+};
+
+// crc-8, x^8 + x^2 + x^1 + x^0, init 0
+static const UInt8 kCRC8Table[256] = {
+    0x00, 0x07, 0x0e, 0x09, 0x1c, 0x1b, 0x12, 0x15, 0x38, 0x3f, 0x36, 0x31, 0x24, 0x23, 0x2a, 0x2d,
+    0x70, 0x77, 0x7e, 0x79, 0x6c, 0x6b, 0x62, 0x65, 0x48, 0x4f, 0x46, 0x41, 0x54, 0x53, 0x5a, 0x5d,
+    0xe0, 0xe7, 0xee, 0xe9, 0xfc, 0xfb, 0xf2, 0xf5, 0xd8, 0xdf, 0xd6, 0xd1, 0xc4, 0xc3, 0xca, 0xcd,
+    0x90, 0x97, 0x9e, 0x99, 0x8c, 0x8b, 0x82, 0x85, 0xa8, 0xaf, 0xa6, 0xa1, 0xb4, 0xb3, 0xba, 0xbd,
+    0xc7, 0xc0, 0xc9, 0xce, 0xdb, 0xdc, 0xd5, 0xd2, 0xff, 0xf8, 0xf1, 0xf6, 0xe3, 0xe4, 0xed, 0xea,
+    0xb7, 0xb0, 0xb9, 0xbe, 0xab, 0xac, 0xa5, 0xa2, 0x8f, 0x88, 0x81, 0x86, 0x93, 0x94, 0x9d, 0x9a,
+    0x27, 0x20, 0x29, 0x2e, 0x3b, 0x3c, 0x35, 0x32, 0x1f, 0x18, 0x11, 0x16, 0x03, 0x04, 0x0d, 0x0a,
+    0x57, 0x50, 0x59, 0x5e, 0x4b, 0x4c, 0x45, 0x42, 0x6f, 0x68, 0x61, 0x66, 0x73, 0x74, 0x7d, 0x7a,
+    0x89, 0x8e, 0x87, 0x80, 0x95, 0x92, 0x9b, 0x9c, 0xb1, 0xb6, 0xbf, 0xb8, 0xad, 0xaa, 0xa3, 0xa4,
+    0xf9, 0xfe, 0xf7, 0xf0, 0xe5, 0xe2, 0xeb, 0xec, 0xc1, 0xc6, 0xcf, 0xc8, 0xdd, 0xda, 0xd3, 0xd4,
+    0x69, 0x6e, 0x67, 0x60, 0x75, 0x72, 0x7b, 0x7c, 0x51, 0x56, 0x5f, 0x58, 0x4d, 0x4a, 0x43, 0x44,
+    0x19, 0x1e, 0x17, 0x10, 0x05, 0x02, 0x0b, 0x0c, 0x21, 0x26, 0x2f, 0x28, 0x3d, 0x3a, 0x33, 0x34,
+    0x4e, 0x49, 0x40, 0x47, 0x52, 0x55, 0x5c, 0x5b, 0x76, 0x71, 0x78, 0x7f, 0x6a, 0x6d, 0x64, 0x63,
+    0x3e, 0x39, 0x30, 0x37, 0x22, 0x25, 0x2c, 0x2b, 0x06, 0x01, 0x08, 0x0f, 0x1a, 0x1d, 0x14, 0x13,
+    0xae, 0xa9, 0xa0, 0xa7, 0xb2, 0xb5, 0xbc, 0xbb, 0x96, 0x91, 0x98, 0x9f, 0x8a, 0x8d, 0x84, 0x83,
+    0xde, 0xd9, 0xd0, 0xd7, 0xc2, 0xc5, 0xcc, 0xcb, 0xe6, 0xe1, 0xe8, 0xef, 0xfa, 0xfd, 0xf4, 0xf3,
+};
+
+static FORCE_INLINE UInt8 CRC8(const UInt8 * data, UInt32 length) {
+    UInt8 crc = 0;
+    for (UInt32 i = 0; i < length; ++i) crc = kCRC8Table[crc ^ data[i]];
+    return crc;
+}
+
+static const UInt32 kSampleRateTable[16] = {
+    0, 88200, 176400, 192000, 8000, 16000, 22050, 24000,
+    32000, 44100, 48000, 96000, 0, 0, 0, 0
+};
+
+static const UInt32 kBitsPerSampleTable[8] = {
+    0, 8, 12, 0, 16, 20, 24, 32
+};
+
+// Frame Header:
+// 11111111 111110RB BBBBSSSS CCCCZZZR <number> [blocksize] [samplerate] <crc8>
+// R    - <1>   reserved, must be 0
+// B    - <1>   blocking strategy, 0 - fixed, 1 - variable
+// B    - <4>   block size code
+// S    - <4>   sample rate code
+// C    - <4>   channel assignment
+// Z    - <3>   sample size code
+// number       - utf-8 coded frame number(fixed) or sample number(variable)
+struct FlacFrameHeader {
+    UInt8       strategy;
+    UInt32      blockSize;
+    UInt32      sampleRate;     // 0 - refer to STREAMINFO
+    UInt32      channels;
+    UInt32      bitsPerSample;  // 0 - refer to STREAMINFO
+    UInt64      number;
+    UInt32      length;         // header length, including crc8
+};
+
+// @return True if header is valid, crc8 included
+static Bool ParseFrameHeader(const UInt8 * p, UInt32 n, FlacFrameHeader * h) {
+    if (n < 6) return False;
+    // fast path: sync code and reserved bits
+    if (p[0] != 0xFF || (p[1] & 0xFE) != 0xF8 || (p[3] & 0x01)) return False;
+
+    const UInt32 bs = p[2] >> 4;
+    const UInt32 sr = p[2] & 0xF;
+    const UInt32 ch = p[3] >> 4;
+    const UInt32 ss = (p[3] >> 1) & 0x7;
+    if (bs == 0 || sr == 15 || ch > 10 || ss == 3) return False;
+
+    h->strategy         = p[1] & 0x1;
+    h->channels         = ch < 8 ? ch + 1 : 2;
+    h->bitsPerSample    = kBitsPerSampleTable[ss];
+    h->sampleRate       = kSampleRateTable[sr];
+
+    // utf-8 coded number, up to 36 bits
+    UInt32 i = 4;
+    UInt64 v = p[i++];
+    UInt32 more = 0;
+    if (v < 0x80)                   { more = 0;             }
+    else if ((v & 0xE0) == 0xC0)    { more = 1; v &= 0x1F;  }
+    else if ((v & 0xF0) == 0xE0)    { more = 2; v &= 0x0F;  }
+    else if ((v & 0xF8) == 0xF0)    { more = 3; v &= 0x07;  }
+    else if ((v & 0xFC) == 0xF8)    { more = 4; v &= 0x03;  }
+    else if ((v & 0xFE) == 0xFC)    { more = 5; v &= 0x01;  }
+    else if (v == 0xFE)             { more = 6; v = 0;      }
+    else return False;
+    if (i + more + 1 > n) return False;
+    for (; more > 0; --more) {
+        if ((p[i] & 0xC0) != 0x80) return False;
+        v = (v << 6) | (p[i++] & 0x3F);
+    }
+    h->number = v;
+
+    if (bs == 1)        h->blockSize = 192;
+    else if (bs <= 5)   h->blockSize = 576 << (bs - 2);
+    else if (bs == 6) {
+        if (i + 2 > n) return False;
+        h->blockSize = p[i++] + 1;
+    } else if (bs == 7) {
+        if (i + 3 > n) return False;
+        h->blockSize = ((p[i] << 8) | p[i + 1]) + 1;
+        i += 2;
+    } else              h->blockSize = 256 << (bs - 8);
+
+    if (sr == 12) {
+        if (i + 2 > n) return False;
+        h->sampleRate = p[i++] * 1000;
+    } else if (sr == 13 || sr == 14) {
+        if (i + 3 > n) return False;
+        h->sampleRate = (p[i] << 8) | p[i + 1];
+        if (sr == 14) h->sampleRate *= 10;
+        i += 2;
+    }
+
+    if (CRC8(p, i) != p[i]) return False;
+    h->length = i + 1;
+    return True;
+}
+
+struct FlacSeekPoint {
+    UInt64      sample;     // first sample of target frame
+    Int64       offset;     // offset of target frame, relative to first frame
+};
+
+static struct {
+    const Char *    name;
+    UInt32          key;
+} kVorbisComments[] = {
+    {"TITLE",           kKeyTitle       },
+    {"ALBUM",           kKeyAlbum       },
+    {"ARTIST",          kKeyArtist      },
+    {"ALBUMARTIST",     kKeyAlbumArtist },
+    {"ALBUM ARTIST",    kKeyAlbumArtist },
+    {"PERFORMER",       kKeyPerformer   },
+    {"COMPOSER",        kKeyComposer    },
+    {"GENRE",           kKeyGenre       },
+    {"DATE",            kKeyDate        },
+    {"YEAR",            kKeyYear        },
+    {"TRACKNUMBER",     kKeyTrackNum    },
+    {"DISCNUMBER",      kKeyDiskNum     },
+    {"COMMENT",         kKeyComment     },
+    {"DESCRIPTION",     kKeyComment     },
+    {"COMPILATION",     kKeyCompilation },
+    {"COPYRIGHT",       kKeyCopyright   },
+    {"LICENSE",         kKeyLicense     },
+    {"LOCATION",        kKeyLocation    },
+    {"LANGUAGE",        kKeyLanguage    },
+    {"ENCODER",         kKeyEncoder     },
+    {"BPM",             kKeyBPM         },
+    // END OF LIST
+    {Nil,               0               }
+};
+
+// vorbis comment is little endian, unlike other blocks
+static void ReadVorbisComment(const sp<Buffer>& data, const sp<Message>& meta) {
+    if (data->size() < 8) return;
+    const UInt32 vendor = data->rl32();
+    if ((Int64)vendor + 4 > data->size()) return;
+    data->skipBytes(vendor);
+    UInt32 count = data->rl32();
+    for (; count > 0 && data->size() >= 4; --count) {
+        const UInt32 length = data->rl32();
+        if (length > data->size()) break;
+        String comment = data->rs(length);
+        const Char * s = comment.c_str();
+        const Char * value = strchr(s, '=');
+        if (value == Nil) continue;
+        const UInt32 n = value - s;
+        for (UInt32 i = 0; kVorbisComments[i].name; ++i) {
+            if (strlen(kVorbisComments[i].name) != n ||
+                strncasecmp(s, kVorbisComments[i].name, n)) continue;
+            // multiple values: keep the first one
+            if (!meta->contains(kVorbisComments[i].key)) {
+                meta->setString(kVorbisComments[i].key, String(value + 1));
+            }
+            break;
+        }
+    }
+}
+
+// id3v1 & apev2 tags after the last frame are not part of it
+// @return end of frames
+static Int64 TrimTrailingTags(const sp<ABuffer>& buffer, Int64 start, Int64 end) {
+    if (end - start >= ID3V1_LENGTH) {
+        buffer->skipBytes(end - ID3V1_LENGTH - buffer->offset());
+        if (buffer->rs(3).equals("TAG")) end -= ID3V1_LENGTH;
+    }
+    if (end - start >= APE_FOOTER_LENGTH) {
+        buffer->skipBytes(end - APE_FOOTER_LENGTH - buffer->offset());
+        if (buffer->rs(8).equals("APETAGEX")) {
+            buffer->skipBytes(4);                   // version
+            const UInt32 size   = buffer->rl32();   // items & footer
+            buffer->skipBytes(4);                   // item count
+            const UInt32 flags  = buffer->rl32();
+            const Int64 length  = (Int64)size + ((flags & 0x80000000) ? APE_FOOTER_LENGTH : 0);
+            if (length <= end - start) end -= length;
+        }
+    }
+    buffer->skipBytes(start - buffer->offset());
+    return end;
+}
+
+// @return picture data, Nil on failure
+static sp<Buffer> ReadPicture(const sp<Buffer>& data, UInt32 * type) {
+    if (data->size() < 32) return Nil;
+    *type = data->rb32();
+    const UInt32 mime = data->rb32();
+    if ((Int64)mime + 4 > data->size()) return Nil;
+    data->skipBytes(mime);
+    const UInt32 desc = data->rb32();
+    if ((Int64)desc + 20 > data->size()) return Nil;
+    data->skipBytes(desc + 16);     // description, width, height, depth, colors
+    const UInt32 length = data->rb32();
+    if (length == 0 || length > data->size()) return Nil;
+    return data->readBytes(length);
+}
+
+struct FlacFile : public MediaDevice {
+    sp<ABuffer>             mContent;
+    Int64                   mFirstFrameOffset;
+    Int64                   mDataEnd;
+
+    // STREAMINFO
+    sp<Buffer>              mStreamInfo;
+    UInt32                  mMinBlockSize;
+    UInt32                  mMaxBlockSize;
+    UInt32                  mMinFrameSize;
+    UInt32                  mMaxFrameSize;  // 0 - unknown
+    UInt32                  mSampleRate;
+    UInt32                  mChannels;
+    UInt32                  mBitsPerSample;
+    UInt64                  mTotalSamples;  // 0 - unknown
+    UInt8                   mStrategy;      // blocking strategy of first frame
+
+    Vector<FlacSeekPoint>   mSeekTable;
+    sp<Message>             mMeta;
+
+    // frames are scanned through read window
+    sp<Buffer>              mWindow;
+    UInt32                  mWindowCapacity;
+    Int64                   mWindowOffset;      // file offset of window
+    UInt32                  mWindowLength;      // valid bytes in window
+    Int64                   mPosition;          // offset of next frame
+
+    FlacFile() : mContent(Nil), mFirstFrameOffset(0), mDataEnd(0),
+        mStreamInfo(Nil), mMinBlockSize(0), mMaxBlockSize(0),
+        mMinFrameSize(0), mMaxFrameSize(0), mSampleRate(0), mChannels(0),
+        mBitsPerSample(0), mTotalSamples(0), mStrategy(0), mMeta(Nil),
+        mWindow(Nil), mWindowCapacity(0), mWindowOffset(0), mWindowLength(0),
+        mPosition(0) { }
+
+    virtual ~FlacFile() { }
+
+    MediaError init(const sp<ABuffer>& buffer) {
+        const Int64 start = buffer->offset();
+        mDataEnd = TrimTrailingTags(buffer, start, start + buffer->size());
+
+        // id3v2 is not part of flac, but some taggers put it here
+        if (ID3::SkipID3v2(buffer) != kMediaNoError) {
+            buffer->skipBytes(start - buffer->offset());
+        }
+
+        if (buffer->size() < 4 + 4 + STREAMINFO_LENGTH || !buffer->rs(4).equals("fLaC")) {
+            ERROR("missing fLaC marker");
+            return kMediaErrorBadFormat;
+        }
+
+        for (Bool last = False; !last; ) {
+            if (buffer->size() < 4) {
+                ERROR("truncated metadata block header");
+                return kMediaErrorBadFormat;
+            }
+            const UInt32 head   = buffer->rb32();
+            const UInt32 type   = (head >> 24) & 0x7F;
+            const UInt32 length = head & 0xFFFFFF;
+            last = head >> 31;
+            if (length > buffer->size()) {
+                ERROR("truncated metadata block %" PRIu32 ", length %" PRIu32, type, length);
+                return kMediaErrorBadFormat;
+            }
+
+            if (type != BLOCK_STREAMINFO && type != BLOCK_SEEKTABLE &&
+                type != BLOCK_VORBIS_COMMENT && type != BLOCK_PICTURE) {
+                DEBUG("skip metadata block %" PRIu32 ", length %" PRIu32, type, length);
+                buffer->skipBytes(length);
+                continue;
+            }
+
+            // each block with a single read
+            sp<Buffer> data = buffer->readBytes(length);
+            if (data.isNil() || data->size() < length) {
+                ERROR("read metadata block %" PRIu32 " failed", type);
+                return kMediaErrorBadFormat;
+            }
+
+            if (type == BLOCK_STREAMINFO) {
+                if (length < STREAMINFO_LENGTH) {
+                    ERROR("bad STREAMINFO length %" PRIu32, length);
+                    return kMediaErrorBadFormat;
+                }
+                const UInt8 * p = (const UInt8 *)data->data();
+                mMinBlockSize   = (p[0] << 8) | p[1];
+                mMaxBlockSize   = (p[2] << 8) | p[3];
+                mMinFrameSize   = (p[4] << 16) | (p[5] << 8) | p[6];
+                mMaxFrameSize   = (p[7] << 16) | (p[8] << 8) | p[9];
+                mSampleRate     = (p[10] << 12) | (p[11] << 4) | (p[12] >> 4);
+                mChannels       = ((p[12] >> 1) & 0x7) + 1;
+                mBitsPerSample  = (((p[12] & 0x1) << 4) | (p[13] >> 4)) + 1;
+                mTotalSamples   = ((UInt64)(p[13] & 0xF) << 32) |
+                    ((UInt32)p[14] << 24) | (p[15] << 16) | (p[16] << 8) | p[17];
+                // STREAMINFO is the extradata for decoder
+                mStreamInfo     = data;
+                mStreamInfo->setBytesRange(0, STREAMINFO_LENGTH);
+                INFO("STREAMINFO: block %" PRIu32 "-%" PRIu32 ", frame %" PRIu32 "-%" PRIu32
+                     ", %" PRIu32 " Hz, %" PRIu32 " ch, %" PRIu32 " bits, %" PRIu64 " samples",
+                     mMinBlockSize, mMaxBlockSize, mMinFrameSize, mMaxFrameSize,
+                     mSampleRate, mChannels, mBitsPerSample, mTotalSamples);
+            } else if (type == BLOCK_SEEKTABLE) {
+                for (UInt32 i = 0; i < length / 18; ++i) {
+                    FlacSeekPoint point;
+                    point.sample    = ((UInt64)data->rb32() << 32) | data->rb32();
+                    point.offset    = ((UInt64)data->rb32() << 32) | data->rb32();
+                    data->skipBytes(2);     // samples in target frame
+                    // placeholders are at the end
+                    if (point.sample == 0xFFFFFFFFFFFFFFFFULL) break;
+                    // points are sorted, ignore broken ones
+                    if (!mSeekTable.empty() &&
+                        (point.sample <= mSeekTable[mSeekTable.size() - 1].sample ||
+                         point.offset <= mSeekTable[mSeekTable.size() - 1].offset)) {
+                        continue;
+                    }
+                    mSeekTable.push(point);
+                }
+                DEBUG("SEEKTABLE: %zu points", mSeekTable.size());
+            } else if (type == BLOCK_VORBIS_COMMENT) {
+                if (mMeta.isNil()) mMeta = new Message;
+                ReadVorbisComment(data, mMeta);
+            } else if (type == BLOCK_PICTURE) {
+                UInt32 picture = 0;
+                sp<Buffer> pic = ReadPicture(data, &picture);
+                if (pic.isNil()) continue;
+                if (mMeta.isNil()) mMeta = new Message;
+                // prefer front cover
+                if (!mMeta->contains(kKeyAlbumArt) || picture == 3) {
+                    mMeta->setObject(kKeyAlbumArt, pic);
+                }
+            }
+        }
+
+        if (mStreamInfo.isNil() || mSampleRate == 0 || mMaxBlockSize < 16) {
+            ERROR("missing or bad STREAMINFO");
+            return kMediaErrorBadFormat;
+        }
+
+        mContent            = buffer;
+        mFirstFrameOffset   = buffer->offset();
+        mPosition           = mFirstFrameOffset;
+
+        // blocking strategy is fixed for a stream
+        FlacFrameHeader h;
+        UInt32 n = fill(mFirstFrameOffset, kMaxHeaderLength);
+        if (!ParseFrameHeader(window(mFirstFrameOffset), n, &h) || !validFrame(h)) {
+            ERROR("bad first frame @ %" PRId64, mFirstFrameOffset);
+            return kMediaErrorBadFormat;
+        }
+        mStrategy = h.strategy;
+        DEBUG("first frame @ %" PRId64 ", %s block size",
+              mFirstFrameOffset, mStrategy ? "variable" : "fixed");
+        return kMediaNoError;
+    }
+
+    virtual sp<Message> formats() const {
+        sp<Message> info = new Message;
+        info->setInt32(kKeyFormat, kFileFormatFlac);
+        if (mTotalSamples) {
+            const MediaTime duration = MediaTime(mTotalSamples, mSampleRate);
+            info->setInt64(kKeyDuration, duration.useconds());
+            info->setInt32(kKeyBitrate, (8 * (mDataEnd - mFirstFrameOffset)) / duration.seconds());
+        }
+        if (!mMeta.isNil()) info->setObject(kKeyMetaData, mMeta);
+
+        sp<Message> trak = new Message;
+        trak->setInt32(kKeyType, kCodecTypeAudio);
+        trak->setInt32(kKeyFormat, kAudioCodecFLAC);
+        trak->setInt32(kKeyChannels, mChannels);
+        trak->setInt32(kKeySampleRate, mSampleRate);
+        trak->setObject(kKeyCodecSpecData, mStreamInfo);
+
+        info->setObject(kKeyTrack, trak);
+        return info;
+    }
+
+    virtual MediaError configure(const sp<Message>& options) {
+        if (options->contains(kKeySeek)) {
+            seek(options->findInt64(kKeySeek));
+            return kMediaNoError;
+        }
+        return kMediaErrorNotSupported;
+    }
+
+    // make bytes [offset, offset + length) available in window,
+    // bytes already in window are kept.
+    // @return bytes available from offset, less than length at the end
+    UInt32 fill(Int64 offset, UInt32 length) {
+        if (offset >= mDataEnd) return 0;
+        if (length > mDataEnd - offset) length = mDataEnd - offset;
+        const Int64 windowEnd = mWindowOffset + mWindowLength;
+        if (offset >= mWindowOffset && offset + length <= windowEnd) {
+            return windowEnd - offset;
+        }
+
+        // large frame, grow the window
+        if (mWindow.isNil() || length > mWindowCapacity) {
+            UInt32 capacity = kReadWindowLength;
+            while (capacity < length) capacity *= 2;
+            sp<Buffer> window = new Buffer(capacity);
+            if (offset >= mWindowOffset && offset < windowEnd) {
+                memcpy(window->base(), mWindow->base() + (offset - mWindowOffset), windowEnd - offset);
+                mWindowLength = windowEnd - offset;
+            } else {
+                mWindowLength = 0;
+            }
+            mWindow         = window;
+            mWindowCapacity = capacity;
+        } else if (offset >= mWindowOffset && offset < windowEnd) {
+            memmove(mWindow->base(), mWindow->base() + (offset - mWindowOffset), windowEnd - offset);
+            mWindowLength = windowEnd - offset;
+        } else {
+            mWindowLength = 0;
+        }
+        mWindowOffset = offset;
+
+        Int64 bytes = mDataEnd - (mWindowOffset + mWindowLength);
+        if (bytes > mWindowCapacity - mWindowLength) bytes = mWindowCapacity - mWindowLength;
+        mContent->skipBytes(mWindowOffset + mWindowLength - mContent->offset());
+        mWindowLength += mContent->readBytes(mWindow->base() + mWindowLength, bytes);
+        return mWindowLength;
+    }
+
+    FORCE_INLINE const UInt8 * window(Int64 offset) const {
+        return (const UInt8 *)mWindow->base() + (offset - mWindowOffset);
+    }
+
+    // frame header is validated by crc8 only, check it against STREAMINFO
+    FORCE_INLINE Bool validFrame(const FlacFrameHeader& h) const {
+        if (h.channels != mChannels) return False;
+        if (h.sampleRate && h.sampleRate != mSampleRate) return False;
+        if (h.bitsPerSample && h.bitsPerSample != mBitsPerSample) return False;
+        if (h.blockSize > mMaxBlockSize) return False;
+        return True;
+    }
+
+    FORCE_INLINE UInt64 frameSample(const FlacFrameHeader& h) const {
+        return h.strategy ? h.number : h.number * mMaxBlockSize;
+    }
+
+    // locate next frame header in [from, to)
+    // @return offset of the header, or -1 if not found
+    Int64 syncFrame(Int64 from, Int64 to, FlacFrameHeader * h) {
+        if (to > mDataEnd) to = mDataEnd;
+        while (from < to) {
+            const UInt32 n = fill(from, kMaxHeaderLength);
+            if (n < 2) break;
+            const UInt8 * p = window(from);
+            UInt32 i = 0;
+            for (;;) {
+                const UInt8 * q = (const UInt8 *)memchr(p + i, 0xFF, n - 1 - i);
+                if (q == Nil) { i = n - 1; break; }
+                i = q - p;
+                if (from + i >= to) return -1;
+                if ((p[i + 1] & 0xFE) != 0xF8) { ++i; continue; }
+                // header crosses window, refill
+                if (i + kMaxHeaderLength > n && from + n < mDataEnd) break;
+                if (ParseFrameHeader(p + i, n - i, h) && validFrame(*h) &&
+                    h->strategy == mStrategy) {
+                    return from + i;
+                }
+                ++i;
+            }
+            from += i;
+        }
+        return -1;
+    }
+
+    // find end of frame @ offset by the header with next frame/sample number,
+    // which rejects headers with crc8 inside frame data.
+    // @param fallback  first header with other number, -1 if none
+    // @return offset of next frame, mDataEnd for the last frame, or -1
+    Int64 followingFrame(Int64 offset, const FlacFrameHeader& h, Int64 * fallback) {
+        const UInt64 next = h.strategy ? h.number + h.blockSize : h.number + 1;
+        Int64 from = offset + h.length + 2;     // crc16 at least
+        if (mMinFrameSize && offset + mMinFrameSize > from) from = offset + mMinFrameSize;
+        const Int64 to = offset + (mMaxFrameSize ? mMaxFrameSize : kMaxFrameLength) + 1;
+
+        *fallback = -1;
+        FlacFrameHeader nh;
+        for (;;) {
+            const Int64 pos = syncFrame(from, to, &nh);
+            if (pos < 0) break;
+            if (nh.number == next) return pos;
+            if (*fallback < 0) *fallback = pos;
+            from = pos + 1;
+        }
+        // last frame
+        if (*fallback < 0 && to >= mDataEnd) return mDataEnd;
+        return -1;
+    }
+
+    // @return offset of next frame, or -1 if not found
+    Int64 nextFrame(Int64 offset, const FlacFrameHeader& h) {
+        Int64 fallback;
+        const Int64 next = followingFrame(offset, h, &fallback);
+        if (next >= 0) return next;
+        if (fallback >= 0) {
+            // lost frames ?
+            WARN("frame @ %" PRId64 " is not followed by frame %" PRIu64, offset,
+                 h.strategy ? h.number + h.blockSize : h.number + 1);
+            return fallback;
+        }
+        return -1;
+    }
+
+    void seek(Int64 us) {
+        if (us < 0) us = 0;
+        const UInt64 target = (us * mSampleRate) / 1000000LL;
+
+        // seek point narrows the range for bisection
+        Int64 lo = mFirstFrameOffset;
+        Int64 hi = mDataEnd;
+        UInt64 loSample = 0;
+        UInt64 hiSample = mTotalSamples ? mTotalSamples : 0xFFFFFFFFFFFFFFFFULL;
+        for (UInt32 i = 0; i < mSeekTable.size(); ++i) {
+            const FlacSeekPoint& point = mSeekTable[i];
+            if (mFirstFrameOffset + point.offset >= mDataEnd) break;
+            if (point.sample > target) {
+                hi          = mFirstFrameOffset + point.offset;
+                hiSample    = point.sample;
+                break;
+            }
+            lo          = mFirstFrameOffset + point.offset;
+            loSample    = point.sample;
+        }
+
+        // bisect by frame headers
+        FlacFrameHeader h;
+        while (hi - lo > kBisectLength) {
+            const Int64 mid = lo + (hi - lo) / 2;
+            Int64 pos = syncFrame(mid, hi, &h);
+            // crc8 passes random bytes too often, a sync is accepted
+            // only if the frame is followed by the next frame.
+            Int64 fallback;
+            while (pos >= 0 && followingFrame(pos, h, &fallback) < 0) {
+                pos = syncFrame(pos + 1, hi, &h);
+            }
+            if (pos < 0) {
+                hi = mid;
+                continue;
+            }
+            const UInt64 sample = frameSample(h);
+            if (sample < loSample || sample > hiSample) {
+                // false sync, or broken stream
+                hi = mid;
+            } else if (sample <= target) {
+                lo          = pos;
+                loSample    = sample;
+            } else {
+                hi          = mid;
+                hiSample    = sample;
+            }
+        }
+
+        // skip frames by headers
+        for (;;) {
+            const UInt32 n = fill(lo, kMaxHeaderLength);
+            if (!ParseFrameHeader(window(lo), n, &h) || !validFrame(h)) break;
+            if (frameSample(h) + h.blockSize > target) break;
+            const Int64 next = nextFrame(lo, h);
+            if (next < 0 || next >= mDataEnd) break;
+            lo = next;
+        }
+
+        DEBUG("seek %" PRId64 " us to frame @ %" PRId64, us, lo);
+        mPosition = lo;
+    }
+
+    virtual MediaError push(const sp<MediaFrame>&) {
+        return kMediaErrorInvalidOperation;
+    }
+
+    // frames are packetized by headers, and sent to decoder as is.
+    virtual sp<MediaFrame> pull() {
+        for (;;) {
+            FlacFrameHeader h;
+            const UInt32 n = fill(mPosition, kMaxHeaderLength);
+            if (n == 0) {
+                INFO("eos...");
+                return Nil;
+            }
+            if (!ParseFrameHeader(window(mPosition), n, &h) || !validFrame(h)) {
+                const Int64 pos = syncFrame(mPosition + 1, mDataEnd, &h);
+                if (pos < 0) {
+                    INFO("eos...");
+                    return Nil;
+                }
+                WARN("skip %" PRId64 " bytes junk @ %" PRId64, pos - mPosition, mPosition);
+                mPosition = pos;
+                continue;
+            }
+
+            const Int64 next = nextFrame(mPosition, h);
+            if (next < 0) {
+                ERROR("frame @ %" PRId64 " is too large, corrupt file?", mPosition);
+                ++mPosition;
+                continue;
+            }
+
+            const UInt32 length = next - mPosition;
+            if (fill(mPosition, length) < length) {
+                ERROR("read frame @ %" PRId64 " failed", mPosition);
+                return Nil;
+            }
+
+            sp<MediaFrame> packet = MediaFrame::Create(length);
+            memcpy(packet->planes.buffers[0].data, window(mPosition), length);
+            packet->planes.buffers[0].size  = length;
+            packet->timecode                = MediaTime(frameSample(h), mSampleRate);
+            packet->duration                = MediaTime(h.blockSize, mSampleRate);
+            packet->flags                   = kFrameTypeSync;
+            mPosition                       = next;
+
+            DEBUG("pull %s", packet->string().c_str());
+            return packet;
+        }
+    }
+
+    virtual MediaError reset() {
+        return kMediaNoError;
+    }
+};
+
+sp<MediaDevice> CreateFlacFile(const sp<ABuffer>& buffer) {
+    sp<FlacFile> file = new FlacFile;
+    if (file->init(buffer) == kMediaNoError) return file;
+    return Nil;
+}
+
+__END_NAMESPACE_MFWK
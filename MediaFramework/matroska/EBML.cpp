@@ -88,24 +88,27 @@ static FORCE_INLINE UInt8 EBMLGetBytesLength(UInt8 v) {
     return __builtin_clz((UInt)v) - 24 + 1;
 }
 
+// read n more bytes into x in big endian, n < 8
+static FORCE_INLINE UInt64 EBMLReadBytes(const sp<ABuffer>& buffer, UInt64 x, UInt32 n) {
+    if (n & 4) x = (x << 32) | buffer->rb32();
+    if (n & 2) x = (x << 16) | buffer->rb16();
+    if (n & 1) x = (x << 8)  | buffer->r8();
+    return x;
+}
+
 // vint with leading 1-bit
 static FORCE_INLINE EBMLInteger EBMLGetCodedInteger(const sp<ABuffer>& buffer) {
     if (buffer->size() == 0) return EBMLIntegerNull;
     
     EBMLInteger vint;
     vint.u8     = buffer->r8();
+    if (vint.u8 == 0) return EBMLIntegerNull;   // vint longer than 8 bytes
     vint.length = EBMLGetBytesLength(vint.u8);
-    CHECK_GT(vint.length, 0);
-    CHECK_LE(vint.length, 8);
-    if (buffer->size() < vint.length) {
+    if (buffer->size() < vint.length - 1) {
         return EBMLIntegerNull;
     }
 
-    if (vint.length > 1) {
-        for (UInt32 i = 1; i < vint.length; ++i) {
-            vint.u64 = (vint.u64 << 8) | buffer->r8();
-        }
-    }
+    vint.u64    = EBMLReadBytes(buffer, vint.u8, vint.length - 1);
     return vint;
 }
 
@@ -130,11 +133,7 @@ static FORCE_INLINE EBMLInteger EBMLGetInteger(const sp<ABuffer>& buffer, UInt32
     EBMLInteger vint;
     vint.u8 = buffer->r8();
     vint.length = n;
-    if (n > 1) {
-        for (UInt32 i = 1; i < n; ++i) {
-            vint.u64 = (vint.u64 << 8) | buffer->r8();
-        }
-    }
+    vint.u64 = EBMLReadBytes(buffer, vint.u8, n - 1);
     return vint;
 }
 
@@ -319,217 +318,258 @@ String EBMLSimpleBlockElement::string() const {
             (UInt32)TrackNumber.u64, TimeCode, Flags, data.size());
 }
 
-#define ITEM(X, T)  { .NAME = #X, .ID = ID_##X, .TYPE = T   }
-static const struct {
+#define ID_ANY      0   // element may appear inside any master element
+#define ITEM(X, P, T)  { .NAME = #X, .ID = ID_##X, .PARENT = ID_##P, .TYPE = T   }
+struct EBMLSchema {
     const Char *        NAME;
-    UInt64            ID;
+    UInt64              ID;
+    UInt64              PARENT;
     eEBMLElementType    TYPE;
-} ELEMENTS[] = {
+};
+
+static const EBMLSchema ELEMENTS[] = {
     // top level elements
-    ITEM(   EBMLHEADER,                 kEBMLElementMaster      ),
-    ITEM(   SEGMENT,                    kEBMLElementMaster      ),
+    ITEM(   EBMLHEADER,                 ANY,                kEBMLElementMaster      ),
+    ITEM(   SEGMENT,                    ANY,                kEBMLElementMaster      ),
     // top level EBML element's children
-    ITEM(   EBMLVERSION,                kEBMLElementInteger     ),
-    ITEM(   EBMLREADVERSION,            kEBMLElementInteger     ),
-    ITEM(   EBMLMAXIDLENGTH,            kEBMLElementInteger     ),
-    ITEM(   EBMLMAXSIZELENGTH,          kEBMLElementInteger     ),
-    ITEM(   DOCTYPEVERSION,             kEBMLElementInteger     ),
-    ITEM(   DOCTYPEREADVERSION,         kEBMLElementInteger     ),
-    ITEM(   DOCTYPE,                    kEBMLElementString      ),
+    ITEM(   EBMLVERSION,                EBMLHEADER,         kEBMLElementInteger     ),
+    ITEM(   EBMLREADVERSION,            EBMLHEADER,         kEBMLElementInteger     ),
+    ITEM(   EBMLMAXIDLENGTH,            EBMLHEADER,         kEBMLElementInteger     ),
+    ITEM(   EBMLMAXSIZELENGTH,          EBMLHEADER,         kEBMLElementInteger     ),
+    ITEM(   DOCTYPEVERSION,             EBMLHEADER,         kEBMLElementInteger     ),
+    ITEM(   DOCTYPEREADVERSION,         EBMLHEADER,         kEBMLElementInteger     ),
+    ITEM(   DOCTYPE,                    EBMLHEADER,         kEBMLElementString      ),
     // SEGMENT
-    ITEM(   SEGMENTINFO,                kEBMLElementMaster      ),
-    ITEM(   SEEKHEAD,                   kEBMLElementMaster      ),
-    ITEM(   CLUSTER,                    kEBMLElementMaster      ),
-    ITEM(   TRACKS,                     kEBMLElementMaster      ),
-    ITEM(   CUES,                       kEBMLElementMaster      ),
-    ITEM(   ATTACHMENTS,                kEBMLElementMaster      ),
-    ITEM(   CHAPTERS,                   kEBMLElementMaster      ),
-    ITEM(   TAGS,                       kEBMLElementMaster      ),
+    ITEM(   SEGMENTINFO,                SEGMENT,            kEBMLElementMaster      ),
+    ITEM(   SEEKHEAD,                   SEGMENT,            kEBMLElementMaster      ),
+    ITEM(   CLUSTER,                    SEGMENT,            kEBMLElementMaster      ),
+    ITEM(   TRACKS,                     SEGMENT,            kEBMLElementMaster      ),
+    ITEM(   CUES,                       SEGMENT,            kEBMLElementMaster      ),
+    ITEM(   ATTACHMENTS,                SEGMENT,            kEBMLElementMaster      ),
+    ITEM(   CHAPTERS,                   SEGMENT,            kEBMLElementMaster      ),
+    ITEM(   TAGS,                       SEGMENT,            kEBMLElementMaster      ),
     // SEGMENTINFO
-    ITEM(   SEGMENTUID,                 kEBMLElementBinary      ),
-    ITEM(   SEGMENTFILENAME,            kEBMLElementUTF8        ),
-    ITEM(   PREVUID,                    kEBMLElementBinary      ),
-    ITEM(   PREVFILENAME,               kEBMLElementUTF8        ),
-    ITEM(   NEXTUID,                    kEBMLElementBinary      ),
-    ITEM(   NEXTFILENAME,               kEBMLElementUTF8        ),
-    ITEM(   TIMECODESCALE,              kEBMLElementInteger     ),
-    ITEM(   DURATION,                   kEBMLElementFloat       ),
-    ITEM(   TITLE,                      kEBMLElementUTF8        ),
-    ITEM(   MUXINGAPP,                  kEBMLElementString      ),
-    ITEM(   WRITINGAPP,                 kEBMLElementUTF8        ),
-    ITEM(   DATEUTC,                    kEBMLElementSignedInteger   ),
+    ITEM(   SEGMENTUID,                 SEGMENTINFO,        kEBMLElementBinary      ),
+    ITEM(   SEGMENTFILENAME,            SEGMENTINFO,        kEBMLElementUTF8        ),
+    ITEM(   PREVUID,                    SEGMENTINFO,        kEBMLElementBinary      ),
+    ITEM(   PREVFILENAME,               SEGMENTINFO,        kEBMLElementUTF8        ),
+    ITEM(   NEXTUID,                    SEGMENTINFO,        kEBMLElementBinary      ),
+    ITEM(   NEXTFILENAME,               SEGMENTINFO,        kEBMLElementUTF8        ),
+    ITEM(   TIMECODESCALE,              SEGMENTINFO,        kEBMLElementInteger     ),
+    ITEM(   DURATION,                   SEGMENTINFO,        kEBMLElementFloat       ),
+    ITEM(   TITLE,                      SEGMENTINFO,        kEBMLElementUTF8        ),
+    ITEM(   MUXINGAPP,                  SEGMENTINFO,        kEBMLElementString      ),
+    ITEM(   WRITINGAPP,                 SEGMENTINFO,        kEBMLElementUTF8        ),
+    ITEM(   DATEUTC,                    SEGMENTINFO,        kEBMLElementSignedInteger   ),
     // SEEKHEAD
-    ITEM(   SEEK,                       kEBMLElementMaster      ),
-    ITEM(   SEEKID,                     kEBMLElementInteger     ),
-    ITEM(   SEEKPOSITION,               kEBMLElementInteger     ),
+    ITEM(   SEEK,                       SEEKHEAD,           kEBMLElementMaster      ),
+    ITEM(   SEEKID,                     SEEK,               kEBMLElementInteger     ),
+    ITEM(   SEEKPOSITION,               SEEK,               kEBMLElementInteger     ),
     // TRACKS
-    ITEM(   TRACKENTRY,                 kEBMLElementMaster      ),
-    ITEM(   TRACKNUMBER,                kEBMLElementInteger     ),
-    ITEM(   TRACKUID,                   kEBMLElementInteger     ),
-    ITEM(   TRACKTYPE,                  kEBMLElementInteger     ),
-    ITEM(   FLAGENABLED,                kEBMLElementInteger     ),
-    ITEM(   FLAGDEFAULT,                kEBMLElementInteger     ),
-    ITEM(   FLAGFORCED,                 kEBMLElementInteger     ),
-    ITEM(   FLAGLACING,                 kEBMLElementInteger     ),
-    ITEM(   MINCACHE,                   kEBMLElementInteger     ),
-    ITEM(   MAXCACHE,                   kEBMLElementInteger     ),
-    ITEM(   DEFAULTDURATION,            kEBMLElementInteger     ),
-    ITEM(   TRACKTIMECODESCALE,         kEBMLElementFloat       ),
-    ITEM(   NAME,                       kEBMLElementUTF8        ),
-    ITEM(   LANGUAGE,                   kEBMLElementString      ),
-    ITEM(   CODECID,                    kEBMLElementString      ),
-    ITEM(   CODECPRIVATE,               kEBMLElementBinary      ),
-    ITEM(   CODECNAME,                  kEBMLElementUTF8        ),
-    ITEM(   ATTACHMENTLINK,             kEBMLElementInteger     ),
-    ITEM(   CONTENTENCODING,            kEBMLElementMaster      ),
-    ITEM(   CONTENTENCODINGORDER,       kEBMLElementInteger     ),
-    ITEM(   CONTENTENCODINGSCOPE,       kEBMLElementInteger     ),
-    ITEM(   CONTENTENCODINGTYPE,        kEBMLElementInteger     ),
-    ITEM(   CONTENTCOMPRESSION,         kEBMLElementMaster      ),
-    ITEM(   CONTENTCOMPALGO,            kEBMLElementInteger     ),
-    ITEM(   CONTENTCOMPSETTINGS,        kEBMLElementBinary      ),
+    ITEM(   TRACKENTRY,                 TRACKS,             kEBMLElementMaster      ),
+    ITEM(   TRACKNUMBER,                TRACKENTRY,         kEBMLElementInteger     ),
+    ITEM(   TRACKUID,                   TRACKENTRY,         kEBMLElementInteger     ),
+    ITEM(   TRACKTYPE,                  TRACKENTRY,         kEBMLElementInteger     ),
+    ITEM(   FLAGENABLED,                TRACKENTRY,         kEBMLElementInteger     ),
+    ITEM(   FLAGDEFAULT,                TRACKENTRY,         kEBMLElementInteger     ),
+    ITEM(   FLAGFORCED,                 TRACKENTRY,         kEBMLElementInteger     ),
+    ITEM(   FLAGLACING,                 TRACKENTRY,         kEBMLElementInteger     ),
+    ITEM(   MINCACHE,                   TRACKENTRY,         kEBMLElementInteger     ),
+    ITEM(   MAXCACHE,                   TRACKENTRY,         kEBMLElementInteger     ),
+    ITEM(   DEFAULTDURATION,            TRACKENTRY,         kEBMLElementInteger     ),
+    ITEM(   TRACKTIMECODESCALE,         TRACKENTRY,         kEBMLElementFloat       ),
+    ITEM(   NAME,                       TRACKENTRY,         kEBMLElementUTF8        ),
+    ITEM(   LANGUAGE,                   TRACKENTRY,         kEBMLElementString      ),
+    ITEM(   CODECID,                    TRACKENTRY,         kEBMLElementString      ),
+    ITEM(   CODECPRIVATE,               TRACKENTRY,         kEBMLElementBinary      ),
+    ITEM(   CODECNAME,                  TRACKENTRY,         kEBMLElementUTF8        ),
+    ITEM(   ATTACHMENTLINK,             TRACKENTRY,         kEBMLElementInteger     ),
+    ITEM(   CONTENTENCODING,            CONTENTENCODINGS,   kEBMLElementMaster      ),
+    ITEM(   CONTENTENCODINGORDER,       CONTENTENCODING,    kEBMLElementInteger     ),
+    ITEM(   CONTENTENCODINGSCOPE,       CONTENTENCODING,    kEBMLElementInteger     ),
+    ITEM(   CONTENTENCODINGTYPE,        CONTENTENCODING,    kEBMLElementInteger     ),
+    ITEM(   CONTENTCOMPRESSION,         CONTENTENCODING,    kEBMLElementMaster      ),
+    ITEM(   CONTENTCOMPALGO,            CONTENTCOMPRESSION, kEBMLElementInteger     ),
+    ITEM(   CONTENTCOMPSETTINGS,        CONTENTCOMPRESSION, kEBMLElementBinary      ),
     // VIDEO
-    ITEM(   VIDEO,                      kEBMLElementMaster      ),
-    ITEM(   PIXELWIDTH,                 kEBMLElementInteger     ),
-    ITEM(   PIXELHEIGHT,                kEBMLElementInteger     ),
-    ITEM(   PIXELCROPBOTTOM,            kEBMLElementInteger     ),
-    ITEM(   PIXELCROPTOP,               kEBMLElementInteger     ),
-    ITEM(   PIXELCROPLEFT,              kEBMLElementInteger     ),
-    ITEM(   PIXELCROPRIGHT,             kEBMLElementInteger     ),
-    ITEM(   DISPLAYWIDTH,               kEBMLElementInteger     ),
-    ITEM(   DISPLAYHEIGHT,              kEBMLElementInteger     ),
-    ITEM(   DISPLAYUNIT,                kEBMLElementInteger     ),
-    ITEM(   FLAGINTERLACED,             kEBMLElementInteger     ),
+    ITEM(   VIDEO,                      TRACKENTRY,         kEBMLElementMaster      ),
+    ITEM(   PIXELWIDTH,                 VIDEO,              kEBMLElementInteger     ),
+    ITEM(   PIXELHEIGHT,                VIDEO,              kEBMLElementInteger     ),
+    ITEM(   PIXELCROPBOTTOM,            VIDEO,              kEBMLElementInteger     ),
+    ITEM(   PIXELCROPTOP,               VIDEO,              kEBMLElementInteger     ),
+    ITEM(   PIXELCROPLEFT,              VIDEO,              kEBMLElementInteger     ),
+    ITEM(   PIXELCROPRIGHT,             VIDEO,              kEBMLElementInteger     ),
+    ITEM(   DISPLAYWIDTH,               VIDEO,              kEBMLElementInteger     ),
+    ITEM(   DISPLAYHEIGHT,              VIDEO,              kEBMLElementInteger     ),
+    ITEM(   DISPLAYUNIT,                VIDEO,              kEBMLElementInteger     ),
+    ITEM(   FLAGINTERLACED,             VIDEO,              kEBMLElementInteger     ),
     // AUDIO
-    ITEM(   AUDIO,                      kEBMLElementMaster      ),
-    ITEM(   SAMPLINGFREQUENCY,          kEBMLElementFloat       ),
-    ITEM(   OUTPUTSAMPLINGFREQUENCY,    kEBMLElementFloat       ),
-    ITEM(   CHANNELS,                   kEBMLElementInteger     ),
-    ITEM(   BITDEPTH,                   kEBMLElementInteger     ),
+    ITEM(   AUDIO,                      TRACKENTRY,         kEBMLElementMaster      ),
+    ITEM(   SAMPLINGFREQUENCY,          AUDIO,              kEBMLElementFloat       ),
+    ITEM(   OUTPUTSAMPLINGFREQUENCY,    AUDIO,              kEBMLElementFloat       ),
+    ITEM(   CHANNELS,                   AUDIO,              kEBMLElementInteger     ),
+    ITEM(   BITDEPTH,                   AUDIO,              kEBMLElementInteger     ),
     // CONTENTENCODINGS
-    ITEM(   CONTENTENCODINGS,           kEBMLElementMaster      ),
-    // SEEKHEAD
-    ITEM(   SEEK,                       kEBMLElementMaster      ),
-    ITEM(   SEEKID,                     kEBMLElementInteger     ),
-    ITEM(   SEEKPOSITION,               kEBMLElementInteger     ),
+    ITEM(   CONTENTENCODINGS,           TRACKENTRY,         kEBMLElementMaster      ),
     // CLUSTER
-    ITEM(   CRC32,                      kEBMLElementInteger     ),
-    ITEM(   TIMECODE,                   kEBMLElementInteger     ),
-    ITEM(   POSITION,                   kEBMLElementInteger     ),
-    ITEM(   PREVSIZE,                   kEBMLElementInteger     ),
-    ITEM(   BLOCKGROUP,                 kEBMLElementMaster      ),
-    ITEM(   SIMPLEBLOCK,                kEBMLElementBlock       ),  // kEBMLElementBinary
+    ITEM(   CRC32,                      ANY,                kEBMLElementInteger     ),
+    ITEM(   TIMECODE,                   CLUSTER,            kEBMLElementInteger     ),
+    ITEM(   POSITION,                   CLUSTER,            kEBMLElementInteger     ),
+    ITEM(   PREVSIZE,                   CLUSTER,            kEBMLElementInteger     ),
+    ITEM(   BLOCKGROUP,                 CLUSTER,            kEBMLElementMaster      ),
+    ITEM(   SIMPLEBLOCK,                CLUSTER,            kEBMLElementBlock       ),  // kEBMLElementBinary
     // BLOCKGROUP
-    ITEM(   BLOCK,                      kEBMLElementBlock       ),  // kEBMLElementBinary
-    ITEM(   REFERENCEBLOCK,             kEBMLElementSignedInteger   ),
-    ITEM(   REFERENCEPRIORITY,          kEBMLElementInteger     ),
-    ITEM(   BLOCKDURATION,              kEBMLElementInteger     ),
-    ITEM(   BLOCKVIRTUAL,               kEBMLElementBinary      ),
-    ITEM(   BLOCKADDITIONS,             kEBMLElementMaster      ),
-    ITEM(   CODECSTATE,                 kEBMLElementBinary      ),
-    ITEM(   DISCARDPADDING,             kEBMLElementSignedInteger   ),
+    ITEM(   BLOCK,                      BLOCKGROUP,         kEBMLElementBlock       ),  // kEBMLElementBinary
+    ITEM(   REFERENCEBLOCK,             BLOCKGROUP,         kEBMLElementSignedInteger   ),
+    ITEM(   REFERENCEPRIORITY,          BLOCKGROUP,         kEBMLElementInteger     ),
+    ITEM(   BLOCKDURATION,              BLOCKGROUP,         kEBMLElementInteger     ),
+    ITEM(   BLOCKVIRTUAL,               BLOCKGROUP,         kEBMLElementBinary      ),
+    ITEM(   BLOCKADDITIONS,             BLOCKGROUP,         kEBMLElementMaster      ),
+    ITEM(   CODECSTATE,                 BLOCKGROUP,         kEBMLElementBinary      ),
+    ITEM(   DISCARDPADDING,             BLOCKGROUP,         kEBMLElementSignedInteger   ),
     // CUES
-    ITEM(   CUEPOINT,                   kEBMLElementMaster      ),
+    ITEM(   CUEPOINT,                   CUES,               kEBMLElementMaster      ),
     // CUEPOINT
-    ITEM(   CUETIME,                    kEBMLElementInteger     ),
-    ITEM(   CUETRACKPOSITIONS,          kEBMLElementMaster      ),
+    ITEM(   CUETIME,                    CUEPOINT,           kEBMLElementInteger     ),
+    ITEM(   CUETRACKPOSITIONS,          CUEPOINT,           kEBMLElementMaster      ),
     // CUETRACKPOSITIONS
-    ITEM(   CUETRACK,                   kEBMLElementInteger     ),
-    ITEM(   CUECLUSTERPOSITION,         kEBMLElementInteger     ),
-    ITEM(   CUERELATIVEPOSITION,        kEBMLElementInteger     ),
-    ITEM(   CUEBLOCKNUMBER,             kEBMLElementInteger     ),
-    ITEM(   CUECODECSTATE,              kEBMLElementInteger     ),
-    ITEM(   CUEREFERENCE,               kEBMLElementMaster      ),
+    ITEM(   CUETRACK,                   CUETRACKPOSITIONS,  kEBMLElementInteger     ),
+    ITEM(   CUECLUSTERPOSITION,         CUETRACKPOSITIONS,  kEBMLElementInteger     ),
+    ITEM(   CUERELATIVEPOSITION,        CUETRACKPOSITIONS,  kEBMLElementInteger     ),
+    ITEM(   CUEBLOCKNUMBER,             CUETRACKPOSITIONS,  kEBMLElementInteger     ),
+    ITEM(   CUECODECSTATE,              CUETRACKPOSITIONS,  kEBMLElementInteger     ),
+    ITEM(   CUEREFERENCE,               CUETRACKPOSITIONS,  kEBMLElementMaster      ),
     // CUEREFERENCE
-    ITEM(   CUEREFTIME,                 kEBMLElementInteger     ),
-    ITEM(   CUEREFCLUSTER,              kEBMLElementInteger     ),
-    ITEM(   CUEREFNUMBER,               kEBMLElementInteger     ),
-    ITEM(   CUEREFCODECSTATE,           kEBMLElementInteger     ),
+    ITEM(   CUEREFTIME,                 CUEREFERENCE,       kEBMLElementInteger     ),
+    ITEM(   CUEREFCLUSTER,              CUEREFERENCE,       kEBMLElementInteger     ),
+    ITEM(   CUEREFNUMBER,               CUEREFERENCE,       kEBMLElementInteger     ),
+    ITEM(   CUEREFCODECSTATE,           CUEREFERENCE,       kEBMLElementInteger     ),
     // TAGS
-    ITEM(   TAG,                        kEBMLElementMaster      ),
-    ITEM(   TARGETS,                    kEBMLElementMaster      ),
-    ITEM(   SIMPLETAG,                  kEBMLElementMaster      ),
+    ITEM(   TAG,                        TAGS,               kEBMLElementMaster      ),
+    ITEM(   TARGETS,                    TAG,                kEBMLElementMaster      ),
+    ITEM(   SIMPLETAG,                  TAG,                kEBMLElementMaster      ),
     // TARGETS
-    ITEM(   TARGETTYPEVALUE,            kEBMLElementInteger     ),
-    ITEM(   TARGETTYPE,                 kEBMLElementUTF8        ),
-    ITEM(   TARGETTRACKUID,             kEBMLElementInteger     ),
-    ITEM(   TARGETEDITIONUID,           kEBMLElementInteger     ),
-    ITEM(   TARGETCHAPTERUID,           kEBMLElementInteger     ),
-    ITEM(   ATTACHMENTUID,              kEBMLElementInteger     ),
+    ITEM(   TARGETTYPEVALUE,            TARGETS,            kEBMLElementInteger     ),
+    ITEM(   TARGETTYPE,                 TARGETS,            kEBMLElementUTF8        ),
+    ITEM(   TARGETTRACKUID,             TARGETS,            kEBMLElementInteger     ),
+    ITEM(   TARGETEDITIONUID,           TARGETS,            kEBMLElementInteger     ),
+    ITEM(   TARGETCHAPTERUID,           TARGETS,            kEBMLElementInteger     ),
+    ITEM(   ATTACHMENTUID,              TARGETS,            kEBMLElementInteger     ),
     // SIMPLETAG
-    ITEM(   TAGNAME,                    kEBMLElementUTF8        ),
-    ITEM(   TAGLANGUAGE,                kEBMLElementString      ),
-    ITEM(   TAGORIGINAL,                kEBMLElementInteger     ),
-    ITEM(   TAGSTRING,                  kEBMLElementString      ),
-    ITEM(   TAGBINARY,                  kEBMLElementBinary      ),
+    ITEM(   TAGNAME,                    SIMPLETAG,          kEBMLElementUTF8        ),
+    ITEM(   TAGLANGUAGE,                SIMPLETAG,          kEBMLElementString      ),
+    ITEM(   TAGORIGINAL,                SIMPLETAG,          kEBMLElementInteger     ),
+    ITEM(   TAGSTRING,                  SIMPLETAG,          kEBMLElementString      ),
+    ITEM(   TAGBINARY,                  SIMPLETAG,          kEBMLElementBinary      ),
     // CHAPTERS
-    ITEM(   EDITIONENTRY,               kEBMLElementMaster      ),
-    ITEM(   EDITIONUID,                 kEBMLElementInteger     ),
-    ITEM(   EDITIONFLAGHIDDEN,          kEBMLElementInteger     ),
-    ITEM(   EDITIONFLAGDEFAULT,         kEBMLElementInteger     ),
-    ITEM(   EDITIONFLAGORDERED,         kEBMLElementInteger     ),
-    ITEM(   CHAPTERATOM,                kEBMLElementMaster      ),
+    ITEM(   EDITIONENTRY,               CHAPTERS,           kEBMLElementMaster      ),
+    ITEM(   EDITIONUID,                 EDITIONENTRY,       kEBMLElementInteger     ),
+    ITEM(   EDITIONFLAGHIDDEN,          EDITIONENTRY,       kEBMLElementInteger     ),
+    ITEM(   EDITIONFLAGDEFAULT,         EDITIONENTRY,       kEBMLElementInteger     ),
+    ITEM(   EDITIONFLAGORDERED,         EDITIONENTRY,       kEBMLElementInteger     ),
+    ITEM(   CHAPTERATOM,                EDITIONENTRY,       kEBMLElementMaster      ),
     // CHAPTERATOM
-    ITEM(   CHAPTERUID,                 kEBMLElementInteger     ),
-    ITEM(   CHAPTERTIMESTART,           kEBMLElementInteger     ),
-    ITEM(   CHAPTERTIMEEND,             kEBMLElementInteger     ),
-    ITEM(   CHAPTERFLAGHIDDEN,          kEBMLElementInteger     ),
-    ITEM(   CHAPTERFLAGENABLED,         kEBMLElementInteger     ),
-    ITEM(   CHAPTERSEGMENTUID,          kEBMLElementBinary      ),
-    ITEM(   CHAPTERSEGMENTEDITIONUID,   kEBMLElementInteger     ),
-    ITEM(   CHAPTERTRACKS,              kEBMLElementMaster      ),
-    ITEM(   CHAPTERDISPLAY,             kEBMLElementMaster      ),
+    ITEM(   CHAPTERUID,                 CHAPTERATOM,        kEBMLElementInteger     ),
+    ITEM(   CHAPTERTIMESTART,           CHAPTERATOM,        kEBMLElementInteger     ),
+    ITEM(   CHAPTERTIMEEND,             CHAPTERATOM,        kEBMLElementInteger     ),
+    ITEM(   CHAPTERFLAGHIDDEN,          CHAPTERATOM,        kEBMLElementInteger     ),
+    ITEM(   CHAPTERFLAGENABLED,         CHAPTERATOM,        kEBMLElementInteger     ),
+    ITEM(   CHAPTERSEGMENTUID,          CHAPTERATOM,        kEBMLElementBinary      ),
+    ITEM(   CHAPTERSEGMENTEDITIONUID,   CHAPTERATOM,        kEBMLElementInteger     ),
+    ITEM(   CHAPTERTRACKS,              CHAPTERATOM,        kEBMLElementMaster      ),
+    ITEM(   CHAPTERDISPLAY,             CHAPTERATOM,        kEBMLElementMaster      ),
     // CHAPTERTRACKS
-    ITEM(   CHAPTERTRACKNUMBER,         kEBMLElementInteger     ),
+    ITEM(   CHAPTERTRACKNUMBER,         CHAPTERTRACKS,      kEBMLElementInteger     ),
     // CHAPTERDISPLAY
-    ITEM(   CHAPSTRING,                 kEBMLElementUTF8        ),
-    ITEM(   CHAPLANGUAGE,               kEBMLElementString      ),
-    ITEM(   CHAPCOUNTRY,                kEBMLElementUTF8        ),
-    ITEM(   VOID,                       kEBMLElementSkip        ),
-    ITEM(   ATTACHEDFILE,               kEBMLElementMaster      ),
-    ITEM(   FILEDESCRIPTION,            kEBMLElementUTF8        ),
-    ITEM(   FILENAME,                   kEBMLElementUTF8        ),
-    ITEM(   FILEMIMETYPE,               kEBMLElementString      ),
-    ITEM(   FILEDATA,                   kEBMLElementBinary      ),
-    ITEM(   FILEUID,                    kEBMLElementInteger     ),
+    ITEM(   CHAPSTRING,                 CHAPTERDISPLAY,     kEBMLElementUTF8        ),
+    ITEM(   CHAPLANGUAGE,               CHAPTERDISPLAY,     kEBMLElementString      ),
+    ITEM(   CHAPCOUNTRY,                CHAPTERDISPLAY,     kEBMLElementUTF8        ),
+    ITEM(   VOID,                       ANY,                kEBMLElementSkip        ),
+    ITEM(   ATTACHEDFILE,               ATTACHMENTS,        kEBMLElementMaster      ),
+    ITEM(   FILEDESCRIPTION,            ATTACHEDFILE,       kEBMLElementUTF8        ),
+    ITEM(   FILENAME,                   ATTACHEDFILE,       kEBMLElementUTF8        ),
+    ITEM(   FILEMIMETYPE,               ATTACHEDFILE,       kEBMLElementString      ),
+    ITEM(   FILEDATA,                   ATTACHEDFILE,       kEBMLElementBinary      ),
+    ITEM(   FILEUID,                    ATTACHEDFILE,       kEBMLElementInteger     ),
     
     // END OF LIST
 };
 #define NELEM(x)    sizeof(x)/sizeof(x[0])
 
-sp<EBMLElement> MakeEBMLElement(const EBMLInteger& id, EBMLInteger& size) {
-    for (UInt32 i = 0; i < NELEM(ELEMENTS); ++i) {
-        if (ELEMENTS[i].ID == id.u64) {
-            //DEBUG("make element %s[%#x]", ELEMENTS[i].NAME, ELEMENTS[i].ID);
-            switch (ELEMENTS[i].TYPE) {
-                case kEBMLElementInteger:
-                    return new EBMLIntegerElement(ELEMENTS[i].NAME, id, size);
-                case kEBMLElementSignedInteger:
-                    return new EBMLSignedIntegerElement(ELEMENTS[i].NAME, id, size);
-                case kEBMLElementString:
-                    return new EBMLStringElement(ELEMENTS[i].NAME, id, size);
-                case kEBMLElementUTF8:
-                    return new EBMLUTF8Element(ELEMENTS[i].NAME, id, size);
-                case kEBMLElementFloat:
-                    return new EBMLFloatElement(ELEMENTS[i].NAME, id, size);
-                case kEBMLElementMaster:
-                    return new EBMLMasterElement(ELEMENTS[i].NAME, id, size);
-                case kEBMLElementBinary:
-                    return new EBMLBinaryElement(ELEMENTS[i].NAME, id, size);
-                case kEBMLElementSkip:
-                    return new EBMLSkipElement(ELEMENTS[i].NAME, id, size);
-                case kEBMLElementBlock:
-                    return new EBMLSimpleBlockElement(ELEMENTS[i].NAME, id, size);
-                default:
-                    FATAL("FIXME");
-                    break;
+// ELEMENTS sorted by id, for lookup in O(log(n))
+struct EBMLSchemaIndex {
+    const EBMLSchema *  entries[NELEM(ELEMENTS)];
+    
+    EBMLSchemaIndex() {
+        for (UInt32 i = 0; i < NELEM(ELEMENTS); ++i) {
+            UInt32 j = i;
+            for (; j > 0 && entries[j - 1]->ID > ELEMENTS[i].ID; --j) {
+                entries[j] = entries[j - 1];
             }
+            entries[j] = &ELEMENTS[i];
+        }
+    }
+    
+    const EBMLSchema * find(UInt64 id) const {
+        UInt32 first = 0;
+        UInt32 last = NELEM(ELEMENTS);
+        while (first < last) {
+            const UInt32 mid = (first + last) / 2;
+            if (entries[mid]->ID < id)  first = mid + 1;
+            else                        last = mid;
         }
+        if (first < NELEM(ELEMENTS) && entries[first]->ID == id) return entries[first];
+        return Nil;
+    }
+};
+
+static FORCE_INLINE const EBMLSchema * LookupEBMLSchema(UInt64 id) {
+    static const EBMLSchemaIndex index;
+    return index.find(id);
+}
+
+// SIMPLETAG & CHAPTERATOM can be nested in itself
+static FORCE_INLINE Bool EBMLIsChildOf(const EBMLSchema * schema, UInt64 parent) {
+    return schema->PARENT == ID_ANY || schema->PARENT == parent || schema->ID == parent;
+}
+
+static sp<EBMLElement> MakeEBMLElement(const EBMLSchema * schema, const EBMLInteger& id, EBMLInteger& size) {
+    //DEBUG("make element %s[%#x]", schema->NAME, schema->ID);
+    switch (schema->TYPE) {
+        case kEBMLElementInteger:
+            return new EBMLIntegerElement(schema->NAME, id, size);
+        case kEBMLElementSignedInteger:
+            return new EBMLSignedIntegerElement(schema->NAME, id, size);
+        case kEBMLElementString:
+            return new EBMLStringElement(schema->NAME, id, size);
+        case kEBMLElementUTF8:
+            return new EBMLUTF8Element(schema->NAME, id, size);
+        case kEBMLElementFloat:
+            return new EBMLFloatElement(schema->NAME, id, size);
+        case kEBMLElementMaster:
+            return new EBMLMasterElement(schema->NAME, id, size);
+        case kEBMLElementBinary:
+            return new EBMLBinaryElement(schema->NAME, id, size);
+        case kEBMLElementSkip:
+            return new EBMLSkipElement(schema->NAME, id, size);
+        case kEBMLElementBlock:
+            return new EBMLSimpleBlockElement(schema->NAME, id, size);
+        default:
+            FATAL("FIXME");
+            break;
     }
-    ERROR("unknown element %#x", id.u64);
     return Nil;
 }
 
+sp<EBMLElement> MakeEBMLElement(const EBMLInteger& id, EBMLInteger& size) {
+    const EBMLSchema * schema = LookupEBMLSchema(id.u64);
+    if (schema == Nil) {
+        ERROR("unknown element %#x", id.u64);
+        return Nil;
+    }
+    return MakeEBMLElement(schema, id, size);
+}
+
 sp<EBMLElement> FindEBMLElement(const sp<EBMLMasterElement>& master, UInt64 id) {
     CHECK_EQ(master->type, kEBMLElementMaster);
     List<EBMLMasterElement::Entry>::const_iterator it = master->children.cbegin();
@@ -653,15 +693,19 @@ sp<EBMLElement> ReadEBMLElement(const sp<ABuffer>& buffer, UInt32 flags) {
         
         const UInt32 elementLength = id.length + size.length + size.u64;
         
-        sp<EBMLElement> element = MakeEBMLElement(id, size);
-        if (element.isNil()) {
-            ERROR("%s: + unsupported element %#x, length %zu[%zu][%zu]",
-                  master->name, id.u64, (UInt32)size.u64, elementLength, masterLength);
+        // skip unknown or misplaced element without allocation
+        const EBMLSchema * schema = LookupEBMLSchema(id.u64);
+        if (schema == Nil || !EBMLIsChildOf(schema, master->id.u64)) {
+            ERROR("%s: + %s element %#x, length %zu[%zu][%zu]",
+                  master->name, schema == Nil ? "unsupported" : "misplaced",
+                  id.u64, (UInt32)size.u64, elementLength, masterLength);
             buffer->skipBytes(size.u64);
             masterLength -= elementLength;
             continue;
         }
         
+        sp<EBMLElement> element = MakeEBMLElement(schema, id, size);
+        
         DEBUG("%s: + %s @ %" PRIu64 " length = %zu[%zu][%zu]",
              master->name, element->name, offset, (UInt32)size.u64, elementLength, masterLength);
         
@@ -739,6 +783,288 @@ sp<EBMLElement> ReadEBMLElement(const sp<ABuffer>& buffer, UInt32 flags) {
     return root;
 }
 
+EBMLBlockReader::EBMLBlockReader() : TrackNumber(0), TimeCode(0), Flags(0),
+    mBuffer(Nil), mClusterStart(0), mClusterEnd(-1), mRelative(0), mClusterTimeCode(0),
+    mGroupEnd(0), mBlockEnd(0), mFrameCount(0), mFrameIndex(0), mPending(False) { }
+
+// element id (at most 4 bytes) and size (at most 8 bytes)
+#define EBML_HEADER_MAX_LENGTH  (12)
+
+void EBMLBlockReader::reset(const sp<ABuffer>& buffer, Int64 relative) {
+    mBuffer         = buffer;
+    mClusterStart   = 0;
+    mClusterEnd     = -1;
+    mRelative       = relative;
+    mClusterTimeCode = 0;
+    mGroupEnd       = 0;
+    mBlockEnd       = 0;
+    mFrameCount     = 0;
+    mFrameIndex     = 0;
+    mPending        = False;
+}
+
+void EBMLBlockReader::resume(const sp<ABuffer>& buffer) {
+    if (!mBuffer.isNil()) {
+        buffer->skipBytes(mBuffer->offset() - buffer->offset());
+    }
+    mBuffer     = buffer;
+    mPending    = False;
+}
+
+Bool EBMLBlockReader::enterCluster() {
+    for (;;) {
+        const Int64 offset  = mBuffer->offset();
+        EBMLInteger id      = EBMLGetCodedInteger(mBuffer);
+        EBMLInteger size    = EBMLGetLength(mBuffer);
+        if (id == EBMLIntegerNull || size == EBMLIntegerNull) {
+            // END OF BUFFER, or a header is being written
+            mBuffer->skipBytes(offset - mBuffer->offset());
+            mPending = mBuffer->size() < EBML_HEADER_MAX_LENGTH;
+            return False;
+        }
+
+        if (id.u64 == ID_VOID) {
+            if (mBuffer->size() < size.u64) {
+                mBuffer->skipBytes(offset - mBuffer->offset());
+                mPending = True;
+                return False;
+            }
+            mBuffer->skipBytes(size.u64);
+            continue;
+        }
+
+        if (id.u64 != ID_CLUSTER) {
+            DEBUG("no more cluster, found %#x", id.u64);
+            mBuffer->skipBytes(-(Int64)(id.length + size.length));
+            return False;
+        }
+
+        mClusterStart = mBuffer->offset();
+        if (size.u64 == MASK(7 * size.length)) {
+            DEBUG("cluster with unknown size @ 0x%" PRIx64, mClusterStart);
+            mClusterEnd = 0;
+        } else {
+            mClusterEnd = mClusterStart + size.u64;
+        }
+        mClusterTimeCode = 0;
+        mGroupEnd   = 0;
+        return True;
+    }
+}
+
+// only track number, timecode and flags are read here, so blocks of
+// unselected tracks are skipped with a few bytes read.
+Bool EBMLBlockReader::parseHeader(UInt32 size) {
+    const Int64 offset = mBuffer->offset();
+    mBlockEnd   = offset + size;
+    if (mBuffer->size() < size || size < 4) {
+        ERROR("truncated block @ 0x%" PRIx64, offset);
+        return False;
+    }
+
+    TrackNumber = EBMLGetInteger(mBuffer).u32;
+    TimeCode    = mClusterTimeCode + (Int16)mBuffer->rb16();
+    Flags       = mBuffer->r8();
+    mFrameCount = -1;
+    mFrameIndex = 0;
+    DEBUGV("[%zu] block size %zu, %#x", TrackNumber, size, Flags);
+    return True;
+}
+
+Bool EBMLBlockReader::parseLacing() {
+    const Int64 offset = mBuffer->offset();
+    mFrameCount = 1;
+
+    UInt32 laced = 0;   // bytes of frames with stored length
+    if (Flags & kBlockFlagLace) {
+        mFrameCount = 1 + mBuffer->r8();
+        if ((Flags & kBlockFlagLace) == kBlockFlagEBML) {
+            mFrames[0] = EBMLGetInteger(mBuffer).u32;
+            laced = mFrames[0];
+            for (Int32 i = 1; i < mFrameCount - 1; ++i) {
+                mFrames[i] = mFrames[i-1] + EBMLGetSignedInteger(mBuffer).i32;
+                laced += mFrames[i];
+            }
+        } else if ((Flags & kBlockFlagLace) == kBlockFlagXiph) {
+            for (Int32 i = 0; i < mFrameCount - 1; ++i) {
+                UInt8 u8 = mBuffer->r8();
+                mFrames[i] = u8;
+                while (u8 == 255) {
+                    u8 = mBuffer->r8();
+                    mFrames[i] += u8;
+                }
+                laced += mFrames[i];
+            }
+        } else {    // kBlockFlagFixed
+            const UInt32 total = mBlockEnd - mBuffer->offset();
+            if (total % mFrameCount) {
+                ERROR("bad fixed lacing block @ 0x%" PRIx64, offset);
+                mFrameCount = 0;
+                return False;
+            }
+            for (Int32 i = 0; i < mFrameCount - 1; ++i) {
+                mFrames[i] = total / mFrameCount;
+            }
+            laced = total - total / mFrameCount;
+        }
+    }
+
+    // last frame length is not stored
+    const Int64 remains = mBlockEnd - mBuffer->offset();
+    if (remains < laced) {
+        ERROR("bad lacing block @ 0x%" PRIx64, offset);
+        mFrameCount = 0;
+        return False;
+    }
+    mFrames[mFrameCount - 1] = remains - laced;
+    DEBUGV("[%zu] %d frames", TrackNumber, mFrameCount);
+    return True;
+}
+
+Bool EBMLBlockReader::next() {
+    if (mBuffer.isNil()) return False;
+    mPending = False;
+
+    // skip frames not read
+    if (mBlockEnd) {
+        mBuffer->skipBytes(mBlockEnd - mBuffer->offset());
+        mBlockEnd   = 0;
+        mFrameCount = 0;
+    }
+
+    for (;;) {
+        if (mClusterEnd < 0 && !enterCluster()) return False;
+
+        const Int64 offset = mBuffer->offset();
+        if (mGroupEnd && offset >= mGroupEnd) mGroupEnd = 0;
+        if (mClusterEnd > 0 && offset >= mClusterEnd) {
+            DEBUG("finish with this cluster");
+            mClusterEnd = -1;
+            mRelative   = 0;
+            continue;
+        }
+
+        EBMLInteger id      = EBMLGetCodedInteger(mBuffer);
+        EBMLInteger size    = EBMLGetLength(mBuffer);
+        if (id == EBMLIntegerNull || size == EBMLIntegerNull) {
+            // stay in cluster if header is incomplete, see resume()
+            mBuffer->skipBytes(offset - mBuffer->offset());
+            mPending = mBuffer->size() < EBML_HEADER_MAX_LENGTH;
+            if (!mPending) mClusterEnd = -1;
+            return False;
+        }
+
+        // cluster with unknown size ends at next top level element,
+        // which is the only elements with 4 bytes id.
+        if (mClusterEnd == 0 && id.length == 4) {
+            mBuffer->skipBytes(-(Int64)(id.length + size.length));
+            mClusterEnd = -1;
+            mRelative   = 0;
+            continue;
+        }
+
+        // element is incomplete, BlockGroup is entered without its data
+        if (id.u64 != ID_BLOCKGROUP && mBuffer->size() < size.u64) {
+            mBuffer->skipBytes(offset - mBuffer->offset());
+            mPending = True;
+            return False;
+        }
+
+        switch (id.u64) {
+            case ID_TIMECODE:
+                mClusterTimeCode = size.u64 ? EBMLGetInteger(mBuffer, size.u64).u64 : 0;
+                // Timecode comes before any blocks, jump to the block directly
+                if (mRelative > mBuffer->offset() - mClusterStart &&
+                    (mClusterEnd == 0 || mClusterStart + mRelative < mClusterEnd)) {
+                    DEBUG("jump to block @ 0x%" PRIx64, mClusterStart + mRelative);
+                    mBuffer->skipBytes(mClusterStart + mRelative - mBuffer->offset());
+                }
+                mRelative   = 0;
+                break;
+            case ID_BLOCKGROUP:
+                // enter BlockGroup, other children are skipped
+                mGroupEnd = mBuffer->offset() + size.u64;
+                break;
+            case ID_SIMPLEBLOCK:
+            case ID_BLOCK:
+                if (parseHeader(size.u64)) return True;
+                mBuffer->skipBytes(mBlockEnd - mBuffer->offset());
+                mBlockEnd   = 0;
+                mFrameCount = 0;
+                break;
+            default:
+                mBuffer->skipBytes(size.u64);
+                break;
+        }
+    }
+}
+
+sp<Buffer> EBMLBlockReader::read(UInt32 headroom) {
+    if (mFrameCount < 0 && !parseLacing()) return Nil;
+    if (mFrameIndex >= mFrameCount) return Nil;
+    const UInt32 length = mFrames[mFrameIndex++];
+    if (headroom == 0) return mBuffer->readBytes(length);
+    
+    sp<Buffer> frame = new Buffer(headroom + length);
+    if (mBuffer->readBytes((Char *)frame->base() + headroom, length) != length) {
+        ERROR("read frame failed");
+        return Nil;
+    }
+    frame->setBytesRange(0, headroom + length);
+    return frame;
+}
+
+// Timecode is the first element of cluster except CRC32
+static FORCE_INLINE Bool EBMLGetClusterTimeCode(const sp<ABuffer>& buffer, UInt64 * timecode) {
+    EBMLInteger size = EBMLGetLength(buffer);
+    if (size == EBMLIntegerNull) return False;
+    
+    for (UInt32 i = 0; i < 2; ++i) {
+        EBMLInteger id  = EBMLGetCodedInteger(buffer);
+        size            = EBMLGetLength(buffer);
+        if (id == EBMLIntegerNull || size == EBMLIntegerNull) return False;
+        
+        if (id.u64 == ID_CRC32 && size.u64 == 4) {
+            buffer->skipBytes(4);
+        } else if (id.u64 == ID_TIMECODE && size.u64 > 0 && size.u64 <= 8) {
+            *timecode = EBMLGetInteger(buffer, size.u64).u64;
+            return True;
+        } else {
+            break;
+        }
+    }
+    return False;
+}
+
+#define RESYNC_CHUNK_LENGTH     (64 * 1024)
+Int64 FindEBMLCluster(const sp<ABuffer>& buffer, Int64 end, UInt64 * timecode) {
+    Int64 pos = buffer->offset();
+    while (pos + 4 <= end) {
+        buffer->skipBytes(pos - buffer->offset());
+        const UInt32 length = end - pos < RESYNC_CHUNK_LENGTH ? end - pos : RESYNC_CHUNK_LENGTH;
+        sp<Buffer> chunk = buffer->readBytes(length);
+        if (chunk.isNil() || chunk->size() < 4) break;
+        
+        const UInt8 * data = (const UInt8 *)chunk->data();
+        const UInt32 n = chunk->size();
+        for (UInt32 i = 0; i + 4 <= n; ++i) {
+            if (data[i] != 0x1F || data[i+1] != 0x43 || data[i+2] != 0xB6 || data[i+3] != 0x75) {
+                continue;
+            }
+            
+            buffer->skipBytes(pos + i + 4 - buffer->offset());
+            if (EBMLGetClusterTimeCode(buffer, timecode)) {
+                DEBUG("found cluster @ 0x%" PRIx64 ", timecode %" PRIu64, pos + i, *timecode);
+                buffer->skipBytes(pos + i - buffer->offset());
+                return pos + i;
+            }
+        }
+        // cluster id may across chunks
+        pos += n - 3;
+    }
+    return -1;
+}
+
 Int IsMatroskaFile(const sp<ABuffer>& buffer) {
     // detect each element without parse its content
     // if failed, add parse()
@@ -751,17 +1077,17 @@ Int IsMatroskaFile(const sp<ABuffer>& buffer) {
             break;
         }
         
-        sp<EBMLElement> element = MakeEBMLElement(id, size);
-        if (element.isNil()) {
+        const EBMLSchema * schema = LookupEBMLSchema(id.u64);
+        if (schema == Nil) {
             break;
         }
         
-        DEBUG("found element %s", element->name);
+        DEBUG("found element %s", schema->NAME);
         
         // EBML Header has 7 children, make sure the score < 100.
         // as SEGMENT must exists.
         score += 10;
-        if (element->type == kEBMLElementMaster) {
+        if (schema->TYPE == kEBMLElementMaster) {
             continue;
         }
         
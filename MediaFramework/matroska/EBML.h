@@ -386,6 +386,72 @@ struct EBMLSimpleBlockElement : public EBMLElement {
     virtual String string() const;
 };
 
+/**
+ * read blocks from clusters one by one without building the element tree.
+ * only current block header is kept, lacing and frames are read on demand
+ * by read(), and unread frames are skipped by next().
+ */
+struct EBMLBlockReader {
+    EBMLBlockReader();
+
+    /**
+     * bind to buffer, which should be at the beginning of a cluster.
+     * call it again after buffer position changed, e.g. seek.
+     * @param relative  position of the first block to read, related to
+     *                  cluster data, e.g. CueRelativePosition, 0 to read
+     *                  from the beginning.
+     */
+    void                reset(const sp<ABuffer>&, Int64 relative = 0);
+
+    /**
+     * move to next SimpleBlock or Block, enter next cluster if necessary.
+     * @return False if no more cluster
+     */
+    Bool                next();
+
+    /**
+     * read next frame of current block, Nil if no more frame.
+     * @param headroom  bytes reserved before frame data for caller,
+     *                  e.g. stripped header.
+     */
+    sp<Buffer>          read(UInt32 headroom = 0);
+
+    /**
+     * rebind to a new buffer of the same content, e.g. reopened after
+     * the file grows. cluster state is kept, so next() continues at
+     * the position where it stopped.
+     */
+    void                resume(const sp<ABuffer>&);
+
+    /**
+     * @return True if last next() stopped at an incomplete element,
+     *         which may be completed by appended bytes.
+     */
+    FORCE_INLINE Bool   pending() const { return mPending; }
+
+    // current block
+    UInt32              TrackNumber;
+    UInt64              TimeCode;       ///< cluster timecode + block timecode
+    UInt8               Flags;
+
+    private:
+    Bool                enterCluster();
+    Bool                parseHeader(UInt32 size);
+    Bool                parseLacing();
+
+    sp<ABuffer>         mBuffer;
+    Int64               mClusterStart;  ///< cluster data position
+    Int64               mClusterEnd;    ///< -1: no cluster, 0: unknown size
+    Int64               mRelative;      ///< first block position related to mClusterStart
+    UInt64              mClusterTimeCode;
+    Int64               mGroupEnd;      ///< end of BlockGroup, 0 if not in group
+    Int64               mBlockEnd;      ///< end of current block
+    Int32               mFrameCount;    ///< -1 if lacing is not parsed yet
+    Int32               mFrameIndex;
+    UInt32              mFrames[256];   ///< lacing frame sizes, at most 256 frames
+    Bool                mPending;       ///< stopped at an incomplete element
+};
+
 sp<EBMLElement> MakeEBMLElement(const EBMLInteger& id, EBMLInteger& size);
 
 sp<EBMLElement> FindEBMLElement(const sp<EBMLMasterElement>&, UInt64 id);
@@ -406,6 +472,13 @@ enum {
 
 API_EXPORT sp<EBMLElement> ReadEBMLElement(const sp<ABuffer>&, UInt32 flags = 0);
 
+/**
+ * find next cluster in [buffer->offset(), end) by its id, and validate it
+ * with its Timecode, e.g. resync after seek to a random position.
+ * @return position of the cluster and buffer is put at it, or -1 if not found.
+ */
+API_EXPORT Int64 FindEBMLCluster(const sp<ABuffer>&, Int64 end, UInt64 * timecode);
+
 Int IsMatroskaFile(const sp<ABuffer>&);
 
 __END_NAMESPACE(EBML)
@@ -36,6 +36,8 @@
 //#define LOG_NDEBUG 0
 #include "MediaTypes.h"
 #include "MediaDevice.h"
+#include "ContentFollower.h"
+#include "IndexCache.h"
 
 #include "mpeg4/Audio.h"
 #include "mpeg4/Video.h"
@@ -44,6 +46,8 @@
 
 #include "EBML.h"
 
+#include <zlib.h>
+
 // reference:
 // https://matroska.org/technical/specs/index.html
 // https://matroska.org/files/matroska.pdf
@@ -51,6 +55,8 @@
 __BEGIN_NAMESPACE_MFWK;
 __USING_NAMESPACE(EBML);
 
+#define kIndexTagMkv        FOURCC('mkv ')
+
 #define IS_ZERO(x)  ((x) < 0.0000001 || -(x) < 0.0000001)
 
 // http://haali.su/mkv/codecs.pdf
@@ -88,17 +94,280 @@ static FORCE_INLINE UInt32 GetCodecFormat(const String& codec) {
     return kAudioCodecUnknown;
 }
 
+// ID_CONTENTCOMPALGO
+enum eCompAlgo {
+    kCompAlgoZlib           = 0,
+    kCompAlgoBzlib          = 1,
+    kCompAlgoLZO1X          = 2,
+    kCompAlgoHeaderStrip    = 3,
+    kCompAlgoNone           = 4,    // not a valid ContentCompAlgo
+};
+
+// ID_CONTENTENCODINGSCOPE
+enum {
+    kCompScopeFrames        = 0x1,
+    kCompScopeCodecPrivate  = 0x2,
+};
+
+enum {
+    kLZONoError,
+    kLZOOutputFull,
+    kLZOBadContent,
+};
+
+// extended length: zero bytes count 255 each, terminated by a non-zero byte
+static FORCE_INLINE Bool LZOGetLength(const UInt8 *& ip, const UInt8 * end, UInt32 x, UInt32 mask, UInt32 * length) {
+    UInt32 n = x & mask;
+    if (n == 0) {
+        for (; ip < end && *ip == 0; ++ip) {
+            n += 255;
+            if (n > (1U << 30)) return False;
+        }
+        if (ip >= end) return False;
+        n += mask + *ip++;
+    }
+    *length = n;
+    return True;
+}
+
+// LZO1X decompression
+// https://www.kernel.org/doc/Documentation/lzo.txt
+// @param length    [in] capacity of out, [out] bytes decompressed
+static Int LZO1XDecompress(const UInt8 * in, UInt32 n, UInt8 * out, UInt32 * length) {
+    const UInt8 * ip        = in;
+    const UInt8 * ip_end    = in + n;
+    UInt8 * op              = out;
+    UInt8 * op_end          = out + *length;
+#define NEED_IP(x)  if ((UInt32)(ip_end - ip) < (UInt32)(x)) return kLZOBadContent
+#define NEED_OP(x)  if ((UInt32)(op_end - op) < (UInt32)(x)) return kLZOOutputFull
+    
+    UInt32 state = 0;   // literals copied by last instruction, 4 for long literal run
+    NEED_IP(1);
+    UInt32 x = *ip++;
+    if (x > 17) {
+        const UInt32 count = x - 17;
+        NEED_IP(count + 1);
+        NEED_OP(count);
+        memcpy(op, ip, count);
+        op += count;
+        ip += count;
+        state = count < 4 ? count : 4;
+        x = *ip++;
+    }
+    
+    for (;;) {
+        UInt32 count, distance;
+        if (x >= 64) {              // M2: 3..8 bytes, distance <= 2048
+            NEED_IP(1);
+            count       = (x >> 5) + 1;
+            distance    = (*ip++ << 3) + ((x >> 2) & 7) + 1;
+        } else if (x >= 32) {       // M3: distance <= 16384
+            if (!LZOGetLength(ip, ip_end, x, 31, &count)) return kLZOBadContent;
+            NEED_IP(2);
+            count       += 2;
+            distance    = ((ip[0] | (ip[1] << 8)) >> 2) + 1;
+            x           = ip[0];
+            ip          += 2;
+        } else if (x >= 16) {       // M4: distance 16385..49151
+            if (!LZOGetLength(ip, ip_end, x, 7, &count)) return kLZOBadContent;
+            NEED_IP(2);
+            count       += 2;
+            distance    = 16384 + ((x & 8) << 11) + ((ip[0] | (ip[1] << 8)) >> 2);
+            x           = ip[0];
+            ip          += 2;
+            if (distance == 16384) break;   // end of stream
+        } else if (state == 0) {    // literal run
+            if (!LZOGetLength(ip, ip_end, x, 15, &count)) return kLZOBadContent;
+            count += 3;
+            NEED_IP(count + 1);
+            NEED_OP(count);
+            memcpy(op, ip, count);
+            op += count;
+            ip += count;
+            state = 4;
+            x = *ip++;
+            continue;
+        } else {                    // M1: 2 bytes, or 3 bytes after literal run
+            NEED_IP(1);
+            count       = state == 4 ? 3 : 2;
+            distance    = (*ip++ << 2) + (x >> 2) + (state == 4 ? 2049 : 1);
+        }
+        
+        if (distance > (UInt32)(op - out)) return kLZOBadContent;
+        NEED_OP(count);
+        const UInt8 * m = op - distance;
+        for (UInt32 i = 0; i < count; ++i) op[i] = m[i];    // may overlap
+        op += count;
+        
+        // 0..3 literals follows the match
+        state = x & 3;
+        NEED_IP(state + 1);
+        NEED_OP(state);
+        for (UInt32 i = 0; i < state; ++i) op[i] = ip[i];
+        op += state;
+        ip += state;
+        x = *ip++;
+    }
+#undef NEED_IP
+#undef NEED_OP
+    *length = op - out;
+    return kLZONoError;
+}
+
+// output buffers of decompressed frames, which are returned on frame
+// release and reused by following frames.
+#define kMaxPooledBuffers   (4)
+struct OutputPool : public SharedObject {
+    Mutex               mLock;
+    List<sp<Buffer> >   mBuffers;
+    
+    OutputPool() : SharedObject() { }
+    
+    // get a buffer of at least capacity bytes
+    sp<Buffer> get(UInt32 capacity) {
+        AutoLock _l(mLock);
+        while (!mBuffers.empty()) {
+            sp<Buffer> buffer = mBuffers.front();
+            mBuffers.pop();
+            // smaller than prior frames, drop it
+            if (buffer->capacity() >= capacity) return buffer;
+        }
+        return new Buffer(capacity);
+    }
+    
+    void put(const sp<Buffer>& buffer) {
+        AutoLock _l(mLock);
+        if (mBuffers.size() < kMaxPooledBuffers) mBuffers.push(buffer);
+    }
+};
+
+// MediaFrame holds a pooled output buffer, and returns it on release
+struct PooledMediaFrame : public MediaFrame {
+    MediaBuffer         extend_planes[1];   // placeholder
+    sp<OutputPool>      mPool;
+    sp<Buffer>          mBuffer;
+    
+    PooledMediaFrame(const sp<OutputPool>& pool, const sp<Buffer>& buffer) :
+    MediaFrame(), mPool(pool), mBuffer(buffer) {
+        planes.count                = 1;
+        planes.buffers[0].capacity  = mBuffer->capacity();
+        planes.buffers[0].size      = mBuffer->size();
+        planes.buffers[0].data      = (UInt8 *)mBuffer->data();
+    }
+    
+    virtual ~PooledMediaFrame() {
+        mPool->put(mBuffer);
+    }
+};
+
+// decompress ContentCompression, the context is kept for all frames of
+// the track, and output buffer is sized by prior frames.
+struct ContentDecompressor : public SharedObject {
+    const UInt8     mAlgo;
+    z_stream        mStream;
+    UInt32          mHint;      // max output size of prior frames
+    sp<OutputPool>  mPool;      // output buffers of frames
+    
+    ContentDecompressor(UInt8 algo) : SharedObject(), mAlgo(algo), mHint(0), mPool(new OutputPool) {
+        memset(&mStream, 0, sizeof(mStream));
+        if (mAlgo == kCompAlgoZlib && inflateInit(&mStream) != Z_OK) {
+            ERROR("inflateInit failed");
+        }
+    }
+    
+    virtual ~ContentDecompressor() {
+        if (mAlgo == kCompAlgoZlib) inflateEnd(&mStream);
+    }
+    
+    sp<Buffer> decompress(const sp<Buffer>& input) {
+        UInt32 capacity = mHint;
+        if (capacity < input->size() * 2) capacity = input->size() * 2;
+        if (capacity < 1024) capacity = 1024;
+        
+        sp<Buffer> output;
+        if (mAlgo == kCompAlgoZlib) {
+            output = decompressZlib(input, capacity);
+        } else {
+            output = decompressLZO(input, capacity);
+        }
+        if (!output.isNil() && output->size() > mHint) mHint = output->size();
+        return output;
+    }
+    
+    sp<Buffer> decompressZlib(const sp<Buffer>& input, UInt32 capacity) {
+        if (inflateReset(&mStream) != Z_OK) return Nil;
+        sp<Buffer> output = mPool->get(capacity);
+        capacity = output->capacity();
+        mStream.next_in     = (Bytef *)input->data();
+        mStream.avail_in    = input->size();
+        mStream.next_out    = (Bytef *)output->base();
+        mStream.avail_out   = capacity;
+        for (;;) {
+            const Int ret = inflate(&mStream, Z_NO_FLUSH);
+            if (ret == Z_STREAM_END) break;
+            if (ret != Z_OK && ret != Z_BUF_ERROR) {
+                ERROR("inflate failed, ret = %d", ret);
+                return Nil;
+            }
+            if (mStream.avail_out) {
+                // input exhausted without stream end
+                ERROR("inflate truncated frame");
+                return Nil;
+            }
+            // output is full, grow it
+            sp<Buffer> grow = new Buffer(capacity * 2);
+            memcpy(grow->base(), output->base(), capacity);
+            output              = grow;
+            mStream.next_out    = (Bytef *)output->base() + capacity;
+            mStream.avail_out   = capacity;
+            capacity            *= 2;
+        }
+        output->setBytesRange(0, capacity - mStream.avail_out);
+        return output;
+    }
+    
+    sp<Buffer> decompressLZO(const sp<Buffer>& input, UInt32 capacity) {
+        for (; capacity < (1U << 28); capacity *= 2) {
+            sp<Buffer> output = mPool->get(capacity);
+            capacity = output->capacity();
+            UInt32 length = capacity;
+            const Int ret = LZO1XDecompress((const UInt8 *)input->data(), input->size(),
+                                            (UInt8 *)output->base(), &length);
+            if (ret == kLZONoError) {
+                output->setBytesRange(0, length);
+                return output;
+            }
+            if (ret != kLZOOutputFull) break;
+        }
+        ERROR("lzo decompress failed");
+        return Nil;
+    }
+};
+
 struct TOCEntry {
-    TOCEntry() : time(0), pos(0) { }
+    TOCEntry() : time(0), pos(0), relative(0) { }
     UInt64    time;
-    Int64     pos;    // cluster position related to Segment Element
+    Int64     pos;        // cluster position related to Segment Element
+    Int64     relative;   // block position related to cluster data, 0 if not exists
 };
 
+// toc is stored field by field, see IndexWriter
+static void IndexWrite(IndexWriter& writer, const TOCEntry& e) {
+    writer.write(e.time);
+    writer.write(e.pos);
+    writer.write(e.relative);
+}
+
+static Bool IndexRead(IndexReader& reader, TOCEntry& e) {
+    return reader.read(e.time) && reader.read(e.pos) && reader.read(e.relative);
+}
+
 struct MatroskaTrack {
-    MatroskaTrack() : index(0), format(0),
-    frametime(0), timescale(1.0), compAlgo(4),
+    MatroskaTrack() : index(0), enabled(True), format(0),
+    frametime(0), timescale(1.0), compAlgo(kCompAlgoNone),
     decodeTimeCode(0) { }
     UInt32                  index;
+    Bool                    enabled;    // kKeyTracks
     
     eCodecType              type;
     union {
@@ -117,10 +386,11 @@ struct MatroskaTrack {
     Int64                 frametime;  // ID_DEFAULTDURATION, not scaled
     Float64                  timescale;  // ID_TRACKTIMECODESCALE, DEPRECATED
     sp<Buffer>              csd;
-    List<TOCEntry>          toc;
+    Vector<TOCEntry>        toc;        // sorted by time
     
-    UInt8                 compAlgo;       // ID_CONTENTCOMPALGO, 0 - zlib, 1 - bzlib, 2 - lzo1x, 3 - header strip
-    sp<Buffer>              compSettings;   //
+    UInt8                 compAlgo;       // ID_CONTENTCOMPALGO, eCompAlgo
+    sp<Buffer>              compSettings;   // ID_CONTENTCOMPSETTINGS, stripped header
+    sp<ContentDecompressor> decompressor;   // zlib & lzo1x
 
     sp<MediaDevice>         packetizer;
     
@@ -135,14 +405,14 @@ static sp<MediaFrame> CreatePacket(MatroskaTrack& trak,
                                     Int64 timescale,
                                     eFrameType flag) {
     sp<MediaFrame> packet;
-    if (trak.compAlgo == 3) { // header strip
-        const UInt32 size = trak.compSettings->size() + block->size();
-        packet = MediaFrame::Create(size);
-        trak.compSettings->cloneBytes()->readBytes((Char *)packet->planes.buffers[0].data,
-                                                   trak.compSettings->size());
-        block->readBytes((Char *)packet->planes.buffers[0].data +
-                         trak.compSettings->size(), block->size());
-        packet->planes.buffers[0].size = size;
+    if (trak.compAlgo == kCompAlgoHeaderStrip) {
+        // block is read with headroom for the stripped header
+        memcpy(block->base(), trak.compSettings->data(), trak.compSettings->size());
+        packet = MediaFrame::Create(block);
+    } else if (trak.compAlgo != kCompAlgoNone) {
+        sp<Buffer> data = trak.decompressor->decompress(block);
+        if (data.isNil()) return Nil;
+        packet = new PooledMediaFrame(trak.decompressor->mPool, data);
     } else {
         packet = MediaFrame::Create(block);
     }
@@ -163,7 +433,8 @@ static sp<MediaFrame> CreatePacket(MatroskaTrack& trak,
     return packet;
 }
 
-sp<EBMLMasterElement> ReadSEGMENT(const sp<ABuffer>& buffer, Int64 * clusters) {
+// CUES after clusters is not prefetched, its position is return in cues
+sp<EBMLMasterElement> ReadSEGMENT(const sp<ABuffer>& buffer, Int64 * clusters, Int64 * cues) {
     Int64 offset = buffer->offset();
     sp<EBMLMasterElement> SEGMENT = ReadEBMLElement(buffer, kEnumStopCluster);
     if (SEGMENT.isNil()) return Nil;
@@ -176,6 +447,7 @@ sp<EBMLMasterElement> ReadSEGMENT(const sp<ABuffer>& buffer, Int64 * clusters) {
     offset += SEGMENT->id.length + SEGMENT->size.length;
     
     *clusters = buffer->offset() - offset;
+    *cues = 0;
     
     // FIXME: multi SEEKHEAD exists
     sp<EBMLMasterElement> SEEKHEAD = FindEBMLElement(SEGMENT, ID_SEEKHEAD);
@@ -200,11 +472,17 @@ sp<EBMLMasterElement> ReadSEGMENT(const sp<ABuffer>& buffer, Int64 * clusters) {
         }
         
         const Int64 pos = offset + SEEKPOSITION->vint.u64;
-        if (pos <= *clusters) {
+        if (pos <= offset + *clusters) {
             // elements before clusters, skip reading it
             continue;
         }
         
+        if (SEEKID->vint.u64 == ID_CUES) {
+            // CUES can be very large, load it on demand
+            *cues = pos;
+            continue;
+        }
+        
         if (buffer->skipBytes(pos - buffer->offset()) != pos) {
             ERROR("seek failed");
             break;
@@ -212,11 +490,11 @@ sp<EBMLMasterElement> ReadSEGMENT(const sp<ABuffer>& buffer, Int64 * clusters) {
         
         DEBUG("SEEKID %#x @ %" PRIx64, SEEKID->vint.u64, SEEKPOSITION->vint.u64);
         sp<EBMLElement> ELEMENT = ReadEBMLElement(buffer);
-        INFO("prefetch element %s", ELEMENT->name);
         if (ELEMENT.isNil() || ELEMENT->id.u64 != SEEKID->vint.u64) {
             ERROR("read element @ 0x%" PRIx64 " failed", SEEKPOSITION->vint.u64);
             break;
         }
+        INFO("prefetch element %s", ELEMENT->name);
         
         SEGMENT->children.push(EBMLMasterElement::Entry(pos, ELEMENT));
     }
@@ -228,16 +506,22 @@ Bool decodeMPEGAudioFrameHeader(const Buffer& frame, UInt32 *sampleRate, UInt32
 struct MatroskaFile : public MediaDevice {
     Int64                 mSegment;   // offset of SEGMENT
     Int64                 mClusters;  // offset of CLUSTERs
+    Int64                 mCues;      // offset of CUES, 0 if not exists or loaded
+    Bool                  mCuesLoaded;
     MediaTime               mDuration;
     UInt64                mTimeScale;
     sp<ABuffer>             mContent;
     HashTable<UInt32, MatroskaTrack> mTracks;
-    sp<EBMLMasterElement>   mCluster;
+    EBMLBlockReader         mBlocks;
+    Vector<TOCEntry>        mClusterIndex;  // clusters found by bisect(), sorted by pos
     List<sp<MediaFrame> >  mPackets;
+    sp<ContentFollower>     mFollower;      // Nil if not in follow mode
+    sp<IndexCache>          mCache;         // for CUES after clusters
 
-    MatroskaFile() : MediaDevice(), mDuration(0), mTimeScale(TIMESCALE_DEF), mContent(Nil) { }
+    MatroskaFile() : MediaDevice(), mCues(0), mCuesLoaded(False),
+    mDuration(0), mTimeScale(TIMESCALE_DEF), mContent(Nil), mFollower(Nil) { }
 
-    MediaError init(const sp<ABuffer>& buffer) {
+    MediaError init(const sp<ABuffer>& buffer, const sp<IndexCache>& cache, const sp<ContentFollower>& follower) {
         // check ebml header
         sp<EBMLMasterElement> EBMLHEADER = ReadEBMLElement(buffer);
         if (EBMLHEADER == Nil) {
@@ -252,7 +536,7 @@ struct MatroskaFile : public MediaDevice {
 
         // check SEGMENT
         Int64 offset = buffer->offset();
-        sp<EBMLMasterElement> SEGMENT = ReadSEGMENT(buffer, &mClusters);
+        sp<EBMLMasterElement> SEGMENT = ReadSEGMENT(buffer, &mClusters, &mCues);
         if (SEGMENT == Nil) {
             ERROR("missing SEGMENT");
             return kMediaErrorBadFormat;
@@ -341,6 +625,53 @@ struct MatroskaFile : public MediaDevice {
                 DEBUG("track csd %s", trak.csd->string(True).c_str());
             }
 
+            // only the first ContentEncoding is supported
+            sp<EBMLMasterElement> CONTENTENCODING = FindEBMLElementInside(TRACKENTRY, ID_CONTENTENCODINGS, ID_CONTENTENCODING);
+            if (CONTENTENCODING != Nil) {
+                sp<EBMLIntegerElement> CONTENTENCODINGTYPE = FindEBMLElement(CONTENTENCODING, ID_CONTENTENCODINGTYPE);
+                sp<EBMLIntegerElement> CONTENTENCODINGSCOPE = FindEBMLElement(CONTENTENCODING, ID_CONTENTENCODINGSCOPE);
+                if (CONTENTENCODINGTYPE != Nil && CONTENTENCODINGTYPE->vint.u32 != 0) {
+                    ERROR("%s: encrypted track is not supported", CODECID->str.c_str());
+                    continue;
+                }
+                const UInt32 scope = CONTENTENCODINGSCOPE.isNil() ? kCompScopeFrames : CONTENTENCODINGSCOPE->vint.u32;
+                
+                sp<EBMLMasterElement> CONTENTCOMPRESSION = FindEBMLElement(CONTENTENCODING, ID_CONTENTCOMPRESSION);
+                if (CONTENTCOMPRESSION != Nil) {
+                    sp<EBMLIntegerElement> CONTENTCOMPALGO = FindEBMLElement(CONTENTCOMPRESSION, ID_CONTENTCOMPALGO);
+                    sp<EBMLBinaryElement> CONTENTCOMPSETTINGS = FindEBMLElement(CONTENTCOMPRESSION, ID_CONTENTCOMPSETTINGS);
+                    
+                    const UInt8 algo = CONTENTCOMPALGO.isNil() ? kCompAlgoZlib : CONTENTCOMPALGO->vint.u8;
+                    if (algo == kCompAlgoHeaderStrip) {
+                        if (CONTENTCOMPSETTINGS.isNil()) {
+                            ERROR("%s: missing stripped header", CODECID->str.c_str());
+                            continue;
+                        }
+                        trak.compSettings = CONTENTCOMPSETTINGS->data;
+                    } else if (algo == kCompAlgoZlib || algo == kCompAlgoLZO1X) {
+                        trak.decompressor = new ContentDecompressor(algo);
+                    } else {
+                        ERROR("%s: compression %u is not supported", CODECID->str.c_str(), algo);
+                        continue;
+                    }
+                    
+                    if ((scope & kCompScopeCodecPrivate) && trak.csd != Nil) {
+                        if (algo == kCompAlgoHeaderStrip) {
+                            sp<Buffer> csd = new Buffer(trak.compSettings->size() + trak.csd->size());
+                            csd->writeBytes(trak.compSettings->data(), trak.compSettings->size());
+                            csd->writeBytes(trak.csd->data(), trak.csd->size());
+                            trak.csd = csd;
+                        } else {
+                            trak.csd = trak.decompressor->decompress(trak.csd);
+                        }
+                    }
+                    
+                    if (scope & kCompScopeFrames) {
+                        trak.compAlgo = algo;
+                    }
+                }
+            }
+
             sp<EBMLIntegerElement> TRACKTYPE = FindEBMLElement(TRACKENTRY, ID_TRACKTYPE);
             if (TRACKTYPE->vint.u32 & kTrackTypeAudio) trak.type = kCodecTypeAudio;
             else if (TRACKTYPE->vint.u32 & kTrackTypeVideo) trak.type = kCodecTypeVideo;
@@ -391,58 +722,25 @@ struct MatroskaFile : public MediaDevice {
                 //trak.packetizer = MediaPacketizer::Create(trak.format);
             }
             
-            sp<EBMLMasterElement> CONTENTENCODING = FindEBMLElementInside(TRACKENTRY, ID_CONTENTENCODINGS, ID_CONTENTENCODING);
-            if (CONTENTENCODING != Nil) {
-                sp<EBMLMasterElement> CONTENTCOMPRESSION = FindEBMLElement(CONTENTENCODING, ID_CONTENTCOMPRESSION);
-                if (CONTENTCOMPRESSION != Nil) {
-                    sp<EBMLIntegerElement> CONTENTCOMPALGO = FindEBMLElement(CONTENTCOMPRESSION, ID_CONTENTCOMPALGO);
-                    sp<EBMLBinaryElement> CONTENTCOMPSETTINGS = FindEBMLElement(CONTENTCOMPRESSION, ID_CONTENTCOMPSETTINGS);
-                    
-                    trak.compAlgo = CONTENTCOMPALGO->vint.u8;
-                    if (trak.compAlgo == 3) {
-                        CHECK_FALSE(CONTENTCOMPSETTINGS.isNil());
-                        trak.compSettings = CONTENTCOMPSETTINGS->data;
-                    }
-                }
-            }
-
             trak.index  = mTracks.size();
             mTracks.insert(TRACKNUMBER->vint.u32, trak);
         }
 
-        // CUES
+        // CUES before clusters is already read, otherwise load it on first seek
         sp<EBMLMasterElement> CUES = FindEBMLElement(SEGMENT, ID_CUES);
         if (!CUES.isNil()) {
-            it = CUES->children.cbegin();
-            for (; it != CUES->children.cend(); ++it) {     // CUES can be very large, use iterator
-                const EBMLMasterElement::Entry& e = *it;
-                if (e.element->id.u64 != ID_CUEPOINT) continue;
-                
-                sp<EBMLMasterElement> CUEPOINT = e.element;
-                TOCEntry entry;
-                
-                List<EBMLMasterElement::Entry>::const_iterator it0 = CUEPOINT->children.cbegin();
-                for (; it0 != CUEPOINT->children.cend(); ++it0) {
-                    sp<EBMLIntegerElement> e = (*it0).element;
-                    
-                    if (e->id.u64 == ID_CUETIME) {
-                        entry.time = e->vint.u64;
-                    } else if (e->id.u64 == ID_CUETRACKPOSITIONS) {     // may contains multi
-                        sp<EBMLIntegerElement> CUETRACK = FindEBMLElement(e, ID_CUETRACK);
-                        sp<EBMLIntegerElement> CUECLUSTERPOSITION = FindEBMLElement(e, ID_CUECLUSTERPOSITION);
-                        
-                        entry.pos = CUECLUSTERPOSITION->vint.u64;
-                        mTracks[CUETRACK->vint.u32].toc.push(entry);
-                    }
-                }
-            }
-        } else {
+            parseCues(CUES);
+            mCuesLoaded = True;
+        } else if (mCues == 0) {
             ERROR("CUES is missing");
         }
 
         DEBUG("cluster start @ %" PRId64, mSegment + mClusters);
         buffer->skipBytes(mSegment + mClusters - buffer->offset());
         mContent    = buffer;
+        mFollower   = follower;
+        mCache      = cache;
+        mBlocks.reset(mContent);
 
 #if 0
         // stage 2: workarounds for some codec
@@ -536,114 +834,306 @@ struct MatroskaFile : public MediaDevice {
     }
     
     virtual MediaError configure(const sp<Message>& options) {
+        INFO("configure << %s", options->string().c_str());
+        MediaError status = kMediaErrorNotSupported;
+        if (options->contains(kKeyTracks)) {
+            Bits<UInt32> mask = options->findInt32(kKeyTracks);
+            CHECK_FALSE(mask.empty());
+            HashTable<UInt32, MatroskaTrack>::iterator it = mTracks.begin();
+            for (; it != mTracks.end(); ++it) {
+                MatroskaTrack& trak = it.value();
+                trak.enabled = mask.test(trak.index);
+            }
+            // drop packets of disabled tracks
+            List<sp<MediaFrame> >::iterator it0 = mPackets.begin();
+            while (it0 != mPackets.end()) {
+                if (mask.test((*it0)->id)) ++it0;
+                else it0 = mPackets.erase(it0);
+            }
+            status = kMediaNoError;
+        }
+        
         if (options->contains(kKeySeek)) {
             seek(options->findInt64(kKeySeek));
-            return kMediaNoError;
+            status = kMediaNoError;
         }
+        return status;
+    }
+    
+    // put cue points into each track's toc, keep toc sorted by time
+    void parseCues(const sp<EBMLMasterElement>& CUES) {
+        List<EBMLMasterElement::Entry>::const_iterator it = CUES->children.cbegin();
+        for (; it != CUES->children.cend(); ++it) {     // CUES can be very large, use iterator
+            const EBMLMasterElement::Entry& e = *it;
+            if (e.element->id.u64 != ID_CUEPOINT) continue;
+            
+            sp<EBMLMasterElement> CUEPOINT = e.element;
+            TOCEntry entry;
+            
+            List<EBMLMasterElement::Entry>::const_iterator it0 = CUEPOINT->children.cbegin();
+            for (; it0 != CUEPOINT->children.cend(); ++it0) {
+                sp<EBMLIntegerElement> e = (*it0).element;
+                
+                if (e->id.u64 == ID_CUETIME) {
+                    entry.time = e->vint.u64;
+                } else if (e->id.u64 == ID_CUETRACKPOSITIONS) {     // may contains multi
+                    sp<EBMLIntegerElement> CUETRACK = FindEBMLElement(e, ID_CUETRACK);
+                    sp<EBMLIntegerElement> CUECLUSTERPOSITION = FindEBMLElement(e, ID_CUECLUSTERPOSITION);
+                    sp<EBMLIntegerElement> CUERELATIVEPOSITION = FindEBMLElement(e, ID_CUERELATIVEPOSITION);
+                    if (CUETRACK.isNil() || CUECLUSTERPOSITION.isNil()) continue;
+                    if (mTracks.find(CUETRACK->vint.u32) == Nil) continue;
+                    
+                    entry.pos       = CUECLUSTERPOSITION->vint.u64;
+                    entry.relative  = CUERELATIVEPOSITION.isNil() ? 0 : CUERELATIVEPOSITION->vint.u64;
+                    
+                    Vector<TOCEntry>& toc = mTracks[CUETRACK->vint.u32].toc;
+                    toc.push(entry);
+                    // CUEPOINTs are sorted by time usually
+                    for (UInt32 i = toc.size() - 1; i > 0 && toc[i - 1].time > entry.time; --i) {
+                        toc[i] = toc[i - 1];
+                        toc[i - 1] = entry;
+                    }
+                }
+            }
+        }
+    }
+    
+    void loadCues() {
+        if (mCuesLoaded) return;
+        mCuesLoaded = True;
+        if (mCues == 0) return;
         
-        return kMediaErrorNotSupported;
+        if (mCache != Nil && restoreCues(mCache)) {
+            mCache.clear();
+            return;
+        }
+        
+        const Int64 offset = mContent->offset();
+        mContent->skipBytes(mCues - offset);
+        sp<EBMLMasterElement> CUES = ReadEBMLElement(mContent);
+        if (CUES.isNil() || CUES->id.u64 != ID_CUES) {
+            ERROR("read CUES @ 0x%" PRIx64 " failed", mCues);
+        } else {
+            parseCues(CUES);
+            if (mCache != Nil) storeCues(mCache);
+        }
+        mContent->skipBytes(offset - mContent->offset());
+        mCache.clear();
+    }
+    
+    // save each track's toc to index cache
+    void storeCues(const sp<IndexCache>& cache) {
+        IndexWriter writer;
+        writer.write(mCues);
+        writer.write<UInt32>(mTracks.size());
+        HashTable<UInt32, MatroskaTrack>::const_iterator it = mTracks.cbegin();
+        for (; it != mTracks.cend(); ++it) {
+            writer.write<UInt32>(it.key());
+            writer.write(it.value().toc);
+        }
+        cache->put(kIndexTagMkv, writer.release());
+        cache->commit();
+    }
+    
+    // restore each track's toc from index cache
+    Bool restoreCues(const sp<IndexCache>& cache) {
+        UInt32 length = 0;
+        const UInt8 * data = cache->find(kIndexTagMkv, &length);
+        if (data == Nil) return False;
+        
+        IndexReader reader(data, length);
+        Int64 cues = 0;
+        UInt32 count = 0;
+        reader.read(cues);
+        reader.read(count);
+        if (!reader.status() || cues != mCues || count != mTracks.size()) {
+            WARN("bad index cache, load CUES instead");
+            return False;
+        }
+        
+        Vector<Vector<TOCEntry> > tocs;
+        Vector<UInt32> numbers;
+        for (UInt32 i = 0; i < count; ++i) {
+            UInt32 number = 0;
+            Vector<TOCEntry> toc;
+            reader.read(number);
+            reader.read(toc);
+            if (!reader.status() || mTracks.find(number) == Nil) {
+                WARN("bad index cache, load CUES instead");
+                return False;
+            }
+            numbers.push(number);
+            tocs.push(toc);
+        }
+        
+        for (UInt32 i = 0; i < numbers.size(); ++i) {
+            mTracks[numbers[i]].toc = tocs[i];
+        }
+        INFO("CUES restored from index cache");
+        return True;
     }
     
     void seek(Int64 us) {
-        DEBUG("seek @ %.3fs", time.seconds());
-        mCluster.clear();
+        DEBUG("seek @ %.3fs", us / 1E6);
         mPackets.clear();
+        loadCues();
         
-        // seek with the first track who has toc
+        // seek with the first video track who has toc, or any track has toc
+        const MatroskaTrack * target = Nil;
         HashTable<UInt32, MatroskaTrack>::const_iterator it = mTracks.cbegin();
         for (; it != mTracks.cend(); ++it) {
             const MatroskaTrack& trak = it.value();
             if (trak.toc.empty()) continue;
-            
-            //UInt64 timecode = MediaTime(time).rescale(1000000000LL / mTimeScale).value * trak.timescale;
-            UInt64 timecode = (us * trak.timescale * 1000LL) / mTimeScale;
-            
-            List<TOCEntry>::const_iterator it0 = trak.toc.crbegin();
-            for (; it0 != trak.toc.crend(); --it0) {
-                const TOCEntry& entry = *it0;
-                // find the entry with time < timecode
-                if (entry.time <= timecode) {
-                    DEBUG("seek hit @ %" PRIu64 ", cluster %" PRId64,
-                          entry.time, entry.pos);
-                    mContent->skipBytes(mSegment + entry.pos - mContent->offset());
-                    break;
-                }
+            if (target == Nil || (target->type != kCodecTypeVideo && trak.type == kCodecTypeVideo)) {
+                target = &trak;
             }
         }
+        
+        if (target == Nil) {
+            bisect((us * 1000LL) / mTimeScale);
+            return;
+        }
+        
+        //UInt64 timecode = MediaTime(time).rescale(1000000000LL / mTimeScale).value * trak.timescale;
+        const UInt64 timecode = (us * target->timescale * 1000LL) / mTimeScale;
+        
+        // find the last entry with time <= timecode
+        UInt32 first = 0;
+        UInt32 last = target->toc.size();
+        while (first < last) {
+            const UInt32 mid = (first + last) / 2;
+            if (target->toc[mid].time <= timecode)  first = mid + 1;
+            else                                    last = mid;
+        }
+        const TOCEntry& entry = target->toc[first > 0 ? first - 1 : 0];
+        DEBUG("seek hit @ %" PRIu64 ", cluster %" PRId64 " + %" PRId64,
+              entry.time, entry.pos, entry.relative);
+        mContent->skipBytes(mSegment + entry.pos - mContent->offset());
+        mBlocks.reset(mContent, entry.relative);
     }
 
-    MediaError preparePackets() {
-        // prepare blocks
-        if (mCluster == Nil) {
-            mCluster = ReadEBMLElement(mContent);
-            if (mCluster == Nil || mCluster->id.u64 != ID_CLUSTER) {
-                INFO("no more cluster");
-                return kMediaErrorBadContent;
-            }
-
-#if LOG_NDEBUG == 0
-            PrintEBMLElements(mCluster);
-#endif
+    // remember cluster found by bisect(), keep it sorted by pos
+    void addCluster(Int64 pos, UInt64 timecode) {
+        TOCEntry entry;
+        entry.time  = timecode;
+        entry.pos   = pos - mSegment;
+        // binary search for insert position
+        UInt32 first = 0;
+        UInt32 last = mClusterIndex.size();
+        while (first < last) {
+            const UInt32 mid = (first + last) / 2;
+            if (mClusterIndex[mid].pos < entry.pos)     first = mid + 1;
+            else                                        last = mid;
         }
-
-        sp<EBMLIntegerElement> TIMECODE = FindEBMLElement(mCluster, ID_TIMECODE);
-        List<EBMLMasterElement::Entry>::iterator it = mCluster->children.begin();
-        for (; it != mCluster->children.end();) {
-            sp<EBMLElement> Element = (*it).element;
-            if (Element->id.u64 != ID_BLOCKGROUP && Element->id.u64 != ID_SIMPLEBLOCK) {
-                ++it;
-                continue;
+        if (first < mClusterIndex.size() && mClusterIndex[first].pos == entry.pos) return;
+        mClusterIndex.push(entry);
+        for (UInt32 i = mClusterIndex.size() - 1; i > first; --i) {
+            mClusterIndex[i] = mClusterIndex[i - 1];
+        }
+        mClusterIndex[first] = entry;
+    }
+    
+    // seek by bisection on cluster timecode, for files without CUES.
+    // @param timecode  target timecode in segment timescale
+    void bisect(UInt64 timecode) {
+        Int64 lo = mSegment + mClusters;    // first cluster
+        Int64 hi = mContent->offset() + mContent->size();
+        
+        // narrow the range with known clusters
+        for (UInt32 i = 0; i < mClusterIndex.size(); ++i) {
+            const TOCEntry& e = mClusterIndex[i];
+            if (e.time <= timecode) {
+                lo = mSegment + e.pos;
+            } else {
+                hi = mSegment + e.pos;
+                break;
             }
+        }
+        
+        // lo: the last cluster with timecode <= target
+        // hi: no cluster with timecode <= target at or after it
+        UInt32 probes = 0;
+        while (hi - lo > 1) {
+            const Int64 mid = lo + (hi - lo) / 2;
+            UInt64 tc = 0;
+            mContent->skipBytes(mid - mContent->offset());
+            const Int64 pos = FindEBMLCluster(mContent, hi, &tc);
+            ++probes;
+            // no cluster in [mid, hi), the range is within
+            // a cluster or two, blocks after lo will be read anyway.
+            if (pos < 0) break;
             
-            it = mCluster->children.erase(it);
-            sp<EBMLSimpleBlockElement> block;
-            if (Element->id.u64 == ID_BLOCKGROUP) {
-                sp<EBMLMasterElement> BLOCKGROUP = Element;
-                block = FindEBMLElement(BLOCKGROUP, ID_BLOCK);
+            addCluster(pos, tc);
+            if (tc <= timecode) {
+                lo = pos;
             } else {
-                block = Element;
+                hi = mid;
             }
-            
-            // handle each blocks
-            eFrameType type = kFrameTypeUnknown;
-            if (block->Flags & kBlockFlagKey)           type |= kFrameTypeSync;
-            if (block->Flags & kBlockFlagDiscardable)   type |= kFrameTypeDisposal;
-            if (block->Flags & kBlockFlagInvisible)     type |= kFrameTypeReference;
-            
-            if (mTracks.find(block->TrackNumber.u32) == Nil) continue;
-            MatroskaTrack& trak = mTracks[block->TrackNumber.u32];
-            UInt64 timecode = TIMECODE->vint.u64 + block->TimeCode;
-            List<sp<Buffer> >::iterator it0 = block->data.begin();
-            for (; it0 != block->data.end(); ++it0) {
-
-                sp<MediaFrame> packet = CreatePacket(trak,
-                                                      *it0,
-                                                      timecode,
-                                                      mTimeScale,
-                                                      type);
-
-                if (trak.packetizer != Nil) {
-                    if (trak.packetizer->push(packet) != kMediaNoError) {
-                        DEBUG("[%zu] packetizer enqueue failed", packet->index);
-                    }
-                    packet = trak.packetizer->pull();
+        }
+        
+        INFO("bisect %" PRIu64 " => cluster @ 0x%" PRIx64 " with %u probes", timecode, lo, probes);
+        mContent->skipBytes(lo - mContent->offset());
+        mBlocks.reset(mContent);
+    }
+    
+    MediaError preparePackets() {
+        // process one block each time, frames are read from content directly
+        if (!mBlocks.next()) {
+            // file being recorded: clusters with unknown size are
+            // continued with appended bytes.
+            if (mBlocks.pending() && !mFollower.isNil()) {
+                sp<ABuffer> content = mFollower->wait(mContent);
+                if (!content.isNil()) {
+                    mContent = content;
+                    mBlocks.resume(mContent);
+                    return kMediaNoError;
                 }
+                mFollower.clear();
+            }
+            INFO("no more cluster");
+            return kMediaErrorBadContent;
+        }
 
-                if (packet != Nil) {
-                    packet->id = trak.index;    // fix trak index
-                    DEBUG("[%zu] packet %zu bytes", packet->index, packet->size);
-                    mPackets.push(packet);
+        // unselected or unknown track, its frames are skipped by next()
+        // without reading the lacing or payload.
+        const MatroskaTrack * found = mTracks.find(mBlocks.TrackNumber);
+        if (found == Nil || !found->enabled) return kMediaNoError;
+
+        // handle each blocks
+        eFrameType type = kFrameTypeUnknown;
+        if (mBlocks.Flags & kBlockFlagKey)          type |= kFrameTypeSync;
+        if (mBlocks.Flags & kBlockFlagDiscardable)  type |= kFrameTypeDisposal;
+        if (mBlocks.Flags & kBlockFlagInvisible)    type |= kFrameTypeReference;
+
+        MatroskaTrack& trak = mTracks[mBlocks.TrackNumber];
+        UInt64 timecode = mBlocks.TimeCode;
+        const UInt32 headroom = trak.compAlgo == kCompAlgoHeaderStrip ? trak.compSettings->size() : 0;
+        for (sp<Buffer> data = mBlocks.read(headroom); !data.isNil(); data = mBlocks.read(headroom)) {
+            sp<MediaFrame> packet = CreatePacket(trak,
+                                                  data,
+                                                  timecode,
+                                                  mTimeScale,
+                                                  type);
+            if (packet.isNil()) {
+                ERROR("[%zu] bad frame", trak.index);
+                timecode += trak.frametime;
+                continue;
+            }
+
+            if (trak.packetizer != Nil) {
+                if (trak.packetizer->push(packet) != kMediaNoError) {
+                    DEBUG("[%zu] packetizer enqueue failed", packet->index);
                 }
+                packet = trak.packetizer->pull();
+            }
 
-                timecode += trak.frametime;
+            if (packet != Nil) {
+                packet->id = trak.index;    // fix trak index
+                DEBUG("[%zu] packet %zu bytes", packet->index, packet->size);
+                mPackets.push(packet);
             }
-            break;  // process once block each time.
-        }
 
-        // we have finished this cluster
-        if (it == mCluster->children.end()) {
-            DEBUG("finish with this cluster");
-            mCluster.clear();
+            timecode += trak.frametime;
         }
 
         return kMediaNoError;
@@ -683,9 +1173,9 @@ struct MatroskaFile : public MediaDevice {
     }
 };
 
-sp<MediaDevice> CreateMatroskaFile(const sp<ABuffer>& buffer) {
+sp<MediaDevice> CreateMatroskaFile(const sp<ABuffer>& buffer, const sp<IndexCache>& cache, const sp<ContentFollower>& follower) {
     sp<MatroskaFile> file = new MatroskaFile;
-    if (file->init(buffer) == kMediaNoError) return file;
+    if (file->init(buffer, cache, follower) == kMediaNoError) return file;
     return Nil;
 }
 
@@ -26,60 +26,45 @@
  ******************************************************************************/
 
 
-// File:    WaveFile.cpp
+// File:    AviFile.cpp
 // Author:  mtdcy.chen
 // Changes:
 //          1. 20160701     initial version
 //
 
 #define LOG_TAG "AviFile"
-#define LOG_NDEBUG 0
+//#define LOG_NDEBUG 0
 #include "MediaTypes.h"
-#include "MediaFile.h"
+#include "MediaDevice.h"
 #include "Microsoft.h"
 #include "RIFF.h"
 
+#include "mpeg4/Audio.h"
+
+#include <string.h>
+
 // references:
 // 1. https://wiki.multimedia.cx/index.php/Microsoft_Audio/Video_Interleaved
 // 2. https://docs.microsoft.com/en-us/previous-versions//ms779636(v=vs.85)?redirectedfrom=MSDN
+// 3. OpenDML AVI File Format Extensions, Version 1.02
 
 __BEGIN_NAMESPACE_MFWK
 
 enum {
     ID_RIFF = FOURCC('RIFF'),
     ID_AVI  = FOURCC('AVI '),
+    ID_AVIX = FOURCC('AVIX'),   // OpenDML, following RIFFs
     ID_LIST = FOURCC('LIST'),
     ID_HDRL = FOURCC('hdrl'),
     ID_AVIH = FOURCC('avih'),
     ID_STRL = FOURCC('strl'),
     ID_STRH = FOURCC('strh'),
     ID_STRF = FOURCC('strf'),
-    ID_STRD = FOURCC('strd'),
-    ID_STRN = FOURCC('strn'),
-    ID_INFO = FOURCC('INFO'),
     ID_MOVI = FOURCC('movi'),
-    ID_00DB = FOURCC('00DB'),   // uncompressed video
-    ID_00DC = FOURCC('00dc'),   // compressed video
-    ID_01WB = FOURCC('01wb'),   // audio
     ID_IDX1 = FOURCC('idx1'),
     
     // OpenDML
-    ID_VPRP = FOURCC('vprp'),
-    ID_ISFT = FOURCC('ISFT'),
-    // ..
-    ID_JUNK = FOURCC('JUNK'),
-};
-
-struct JUNKChunk : RIFF::SKIPChunk {
-    JUNKChunk(UInt32 size) : RIFF::SKIPChunk(ID_JUNK, size) { }
-};
-
-struct ListChunk : RIFF::MasterChunk {
-    UInt32                ckListType;     // FOURCC
-    
-    // RIFF is a bad structure, different ckListType for different structure
-    ListChunk(UInt32 size, UInt32 type) : RIFF::MasterChunk(ID_LIST, size), ckListType(type) { }
-    virtual String string() const { return MasterChunk::Chunk::string() + String::format(", ckListType = %.4s", (const Char *)&ckListType); }
+    ID_INDX = FOURCC('indx'),
 };
 
 enum {
@@ -88,274 +73,962 @@ enum {
     kStreamTypeSubtitle = FOURCC('txts'),
 };
 
+// idx1 flags
+#define AVIIF_LIST              (0x00000001)
+#define AVIIF_KEYFRAME          (0x00000010)
+
+// OpenDML index
+#define AVI_INDEX_OF_INDEXES    (0x00)
+#define AVI_INDEX_OF_CHUNKS     (0x01)
+#define AVI_INDEX_DELTA_FRAME   (0x80000000)    // bit 31 of dwSize in standard index
+
+// chunks are word aligned
+#define AVI_PAD(x)              (((x) + 1) & ~1LL)
+
+// data chunk ckID: '##dc', '##wb', ..., where ## is stream number
+static FORCE_INLINE UInt32 GetStreamNumber(UInt32 ckID) {
+    const UInt8 a = ckID & 0xFF;
+    const UInt8 b = (ckID >> 8) & 0xFF;
+    if (a < '0' || a > '9' || b < '0' || b > '9') return 100;
+    return (a - '0') * 10 + (b - '0');
+}
+
+static FORCE_INLINE UInt64 ReadL64(const sp<ABuffer>& buffer) {
+    const UInt64 lo = buffer->rl32();
+    const UInt64 hi = buffer->rl32();
+    return (hi << 32) | lo;
+}
+
+static sp<RIFF::Chunk> ReadChunk(const sp<ABuffer>&);
+
+// RIFF is a bad structure, different ckListType for different structure
+struct ListChunk : public RIFF::MasterChunk {
+    UInt32      ckListType;     // FOURCC
+    
+    ListChunk(UInt32 size) : RIFF::MasterChunk(ID_LIST, size), ckListType(0) { }
+    
+    virtual MediaError parse(const sp<ABuffer>& buffer) {
+        if (buffer->size() < 4)
+            return kMediaErrorBadContent;
+        ckListType = buffer->rl32();
+        while (buffer->size() >= RIFF_CHUNK_MIN_LENGTH) {
+            sp<RIFF::Chunk> ck = ReadChunk(buffer);
+            // keep chunks before the broken one
+            if (ck.isNil()) break;
+            ckChildren.push(ck);
+        }
+        return kMediaNoError;
+    }
+    
+    virtual UInt32 size() const { return sizeof(UInt32); }
+    virtual String string() const { return MasterChunk::string() + String::format(", ckListType = %.4s", (const Char *)&ckListType); }
+};
+
 // https://docs.microsoft.com/en-us/previous-versions//ms779632(v=vs.85)
-// ckListType == 'hdrl', fcc = 'avih'
-struct MainHeaderListChunk : public ListChunk {
-    UInt32    fcc;
-    UInt32    cb;
-    UInt32    dwMicroSecPerFrame;
-    UInt32    dwMaxBytesPerSec;
-    UInt32    dwPaddingGranularity;
-    UInt32    dwFlags;
-    UInt32    dwTotalFrames;
-    UInt32    dwInitialFrames;
-    UInt32    dwStreams;
-    UInt32    dwSuggestedBufferSize;
-    UInt32    dwWidth;
-    UInt32    dwHeight;
-    UInt32    dwReserved[4];
-    // 16 * 4 = 64 bytes
-    
-    MainHeaderListChunk(UInt32 size) : ListChunk(size, ID_AVIH) { }
+struct MainHeaderChunk : public RIFF::Chunk {
+    UInt32      dwMicroSecPerFrame;
+    UInt32      dwMaxBytesPerSec;
+    UInt32      dwPaddingGranularity;
+    UInt32      dwFlags;
+    UInt32      dwTotalFrames;      // frames in the first RIFF only
+    UInt32      dwInitialFrames;
+    UInt32      dwStreams;
+    UInt32      dwSuggestedBufferSize;
+    UInt32      dwWidth;
+    UInt32      dwHeight;
+    // dwReserved[4]
+    
+    MainHeaderChunk(UInt32 size) : RIFF::Chunk(ID_AVIH, size) { }
     
     virtual MediaError parse(const sp<ABuffer>& buffer) {
-        // TODO
+        if (buffer->size() < 40)
+            return kMediaErrorBadContent;
+        dwMicroSecPerFrame      = buffer->rl32();
+        dwMaxBytesPerSec        = buffer->rl32();
+        dwPaddingGranularity    = buffer->rl32();
+        dwFlags                 = buffer->rl32();
+        dwTotalFrames           = buffer->rl32();
+        dwInitialFrames         = buffer->rl32();
+        dwStreams               = buffer->rl32();
+        dwSuggestedBufferSize   = buffer->rl32();
+        dwWidth                 = buffer->rl32();
+        dwHeight                = buffer->rl32();
         return kMediaNoError;
     }
-    virtual UInt32 size() const { return 64; }
-    virtual String string() const { return ListChunk::string() + String::format(", ..."); }
+    virtual String string() const {
+        return RIFF::Chunk::string() + String::format(", %u streams, %u frames", dwStreams, dwTotalFrames);
+    }
 };
 
 // https://docs.microsoft.com/en-us/previous-versions//ms779638(v=vs.85)
-struct StreamHeaderChunk : RIFF::Chunk {
-    UInt32 fcc;
-    UInt32  cb;
-    UInt32 fccType;
-    UInt32 fccHandler;
-    UInt32  dwFlags;
-    UInt16   wPriority;
-    UInt16   wLanguage;
-    UInt32  dwInitialFrames;
-    UInt32  dwScale;
-    UInt32  dwRate;
-    UInt32  dwStart;
-    UInt32  dwLength;
-    UInt32  dwSuggestedBufferSize;
-    UInt32  dwQuality;
-    UInt32  dwSampleSize;
-    struct {
-        short Int left;
-        short Int top;
-        short Int right;
-        short Int bottom;
-    }  rcFrame;
+struct StreamHeaderChunk : public RIFF::Chunk {
+    UInt32      fccType;
+    UInt32      fccHandler;
+    UInt32      dwFlags;
+    UInt16      wPriority;
+    UInt16      wLanguage;
+    UInt32      dwInitialFrames;
+    UInt32      dwScale;
+    UInt32      dwRate;             // dwRate / dwScale = samples per second
+    UInt32      dwStart;
+    UInt32      dwLength;
+    UInt32      dwSuggestedBufferSize;
+    UInt32      dwQuality;
+    UInt32      dwSampleSize;       // 0 if samples vary in size
+    // rcFrame is ignored
     
     StreamHeaderChunk(UInt32 size) : RIFF::Chunk(ID_STRH, size) { }
     
     virtual MediaError parse(const sp<ABuffer>& buffer) {
+        if (buffer->size() < 48)
+            return kMediaErrorBadContent;
+        fccType                 = buffer->rl32();
+        fccHandler              = buffer->rl32();
+        dwFlags                 = buffer->rl32();
+        wPriority               = buffer->rl16();
+        wLanguage               = buffer->rl16();
+        dwInitialFrames         = buffer->rl32();
+        dwScale                 = buffer->rl32();
+        dwRate                  = buffer->rl32();
+        dwStart                 = buffer->rl32();
+        dwLength                = buffer->rl32();
+        dwSuggestedBufferSize   = buffer->rl32();
+        dwQuality               = buffer->rl32();
+        dwSampleSize            = buffer->rl32();
         return kMediaNoError;
     }
+    virtual String string() const {
+        return RIFF::Chunk::string() + String::format(", %.4s, %u/%u", (const Char *)&fccType, dwRate, dwScale);
+    }
 };
 
-struct StreamFormatChunk : RIFF::Chunk {
+struct StreamFormatChunk : public RIFF::Chunk {
     // WAVEFORMATEX or BITMAPINFOHEADER
     sp<Buffer>  Format;
     
     StreamFormatChunk(UInt32 size) : RIFF::Chunk(ID_STRF, size) { }
     
     virtual MediaError parse(const sp<ABuffer>& buffer) {
-        return kMediaNoError;
+        Format = buffer->readBytes(buffer->size());
+        return Format.isNil() ? kMediaErrorBadContent : kMediaNoError;
     }
 };
 
-struct StreamDataChunk : RIFF::Chunk {
-    sp<Buffer>  Data;
+// OpenDML super index, which points to standard indexes (ix##) in movi
+struct SuperIndexChunk : public RIFF::Chunk {
+    struct Entry {
+        UInt64  qwOffset;       // position of ix## chunk
+        UInt32  dwSize;         // length of ix## chunk
+    };
+    Vector<Entry>   Entries;
     
-    StreamDataChunk(UInt32 size) : RIFF::Chunk(ID_STRD, size) { }
+    SuperIndexChunk(UInt32 size) : RIFF::Chunk(ID_INDX, size) { }
     
     virtual MediaError parse(const sp<ABuffer>& buffer) {
+        if (buffer->size() < 24)
+            return kMediaErrorBadContent;
+        const UInt16 wLongsPerEntry = buffer->rl16();
+        buffer->r8();   // bIndexSubType
+        const UInt8 bIndexType      = buffer->r8();
+        const UInt32 nEntriesInUse  = buffer->rl32();
+        buffer->rl32(); // dwChunkId
+        buffer->skipBytes(12);      // dwReserved[3]
+        
+        if (bIndexType != AVI_INDEX_OF_INDEXES || wLongsPerEntry != 4) {
+            // standard index in place is rare, fall back to idx1
+            WARN("unsupported index type %u", bIndexType);
+            return kMediaNoError;
+        }
+        
+        for (UInt32 i = 0; i < nEntriesInUse && buffer->size() >= 16; ++i) {
+            Entry e;
+            e.qwOffset  = ReadL64(buffer);
+            e.dwSize    = buffer->rl32();
+            buffer->rl32(); // dwDuration
+            Entries.push(e);
+        }
         return kMediaNoError;
     }
+    virtual String string() const {
+        return RIFF::Chunk::string() + String::format(", %zu indexes", Entries.size());
+    }
 };
 
-// optional
-struct StreamNameChunk : RIFF::Chunk {
-    String  Name;
-    StreamNameChunk(UInt32 size) : RIFF::Chunk(ID_STRN, size) { }
+// read a chunk with its data from header buffer
+static sp<RIFF::Chunk> ReadChunk(const sp<ABuffer>& buffer) {
+    if (buffer.isNil() || buffer->size() < RIFF_CHUNK_MIN_LENGTH)
+        return Nil;
     
-    virtual MediaError parse(const sp<ABuffer>& buffer) {
-        return kMediaNoError;
+    const UInt32 ckID   = buffer->rl32();
+    const UInt32 ckSize = buffer->rl32();
+    if (ckSize > buffer->size()) {
+        ERROR("chunk %.4s[%u] exceeds its parent", (const Char *)&ckID, ckSize);
+        return Nil;
     }
-};
-
-// OpenDML ...
-struct VideoPropHeader : public RIFF::Chunk {
-    UInt32 VideoFormatToken;
-     UInt32 VideoStandard;
-     UInt32 dwVerticalRefreshRate;
-     UInt32 dwHTotalInT;
-     UInt32 dwVTotalInLines;
-     UInt32 dwFrameAspectRatio;
-     UInt32 dwFrameWidthInPixels;
-     UInt32 dwFrameHeightInLines;
-     // UInt32 nbFieldPerFrame;
-     struct VIDEO_FIELD_DESC {
-     UInt32 CompressedBMHeight;
-     UInt32 CompressedBMWidth;
-     UInt32 ValidBMHeight;
-     UInt32 ValidBMWidth;
-     UInt32 ValidBMXOffset;
-     UInt32 ValidBMYOffset;
-     UInt32 VideoXOffsetInT;
-     UInt32 VideoYValidStartLine;
-    };
-    Vector<VIDEO_FIELD_DESC>    FieldInfo;  // size() == nbFieldPerFrame
     
-    VideoPropHeader(UInt32 size) : RIFF::Chunk(ID_VPRP, size) { }
-    virtual MediaError parse(const sp<ABuffer>& buffer) {
-        return kMediaNoError;
+    sp<RIFF::Chunk> ck;
+    switch (ckID) {
+        case ID_LIST:   ck = new ListChunk(ckSize);         break;
+        case ID_AVIH:   ck = new MainHeaderChunk(ckSize);   break;
+        case ID_STRH:   ck = new StreamHeaderChunk(ckSize); break;
+        case ID_STRF:   ck = new StreamFormatChunk(ckSize); break;
+        case ID_INDX:   ck = new SuperIndexChunk(ckSize);   break;
+        default:        break;
     }
-};
-
-struct InfoSoftware : public RIFF::Chunk {
-    String      Name;
-    InfoSoftware(UInt32 size) : RIFF::Chunk(ID_ISFT, size) { }
-    virtual MediaError parse(const sp<ABuffer>& buffer) {
-        Name = buffer->rs(buffer->size());
-        return kMediaNoError;
+    
+    if (ck.isNil()) {
+        // JUNK, strd, strn, vprp, ...
+        ck = new RIFF::SKIPChunk(ckID, ckSize);
+        ck->parse(buffer);
+    } else {
+        sp<ABuffer> data;
+        if (ckSize) data = buffer->readBytes(ckSize);
+        if (data.isNil() || ck->parse(data) != kMediaNoError) {
+            ERROR("parse chunk %.4s[%u] failed", (const Char *)&ckID, ckSize);
+            return Nil;
+        }
     }
-    virtual String string() const {
-        return RIFF::Chunk::string() + String::format(", %s", Name.c_str());
+    
+    if ((ckSize & 1) && buffer->size()) buffer->skipBytes(1);
+    DEBUG("%s", ck->string().c_str());
+    return ck;
+}
+
+// WaveFile.cpp
+eSampleFormat GetSampleFormat(const Microsoft::WAVEFORMATEX&);
+
+static UInt32 GetAudioFormat(const Microsoft::WAVEFORMATEX& wave) {
+    UInt32 format = wave.wFormat;
+    if (wave.wFormat == Microsoft::WAVE_FORMAT_EXTENSIBLE)
+        format = wave.wSubFormat;
+    switch (format) {
+        case Microsoft::WAVE_FORMAT_PCM:
+            // no sample format for 24 bits
+            if (wave.wBitsPerSample == 8 ||
+                wave.wBitsPerSample == 16 ||
+                wave.wBitsPerSample == 32)
+                return GetSampleFormat(wave);
+            break;
+        case Microsoft::WAVE_FORMAT_IEEE_FLOAT:
+            if (wave.wBitsPerSample == 32 || wave.wBitsPerSample == 64)
+                return GetSampleFormat(wave);
+            break;
+        case Microsoft::WAVE_FORMAT_MPEG:
+        case Microsoft::WAVE_FORMAT_MPEGLAYER3:
+            return kAudioCodecMP3;
+        case Microsoft::WAVE_FORMAT_AAC:
+        case Microsoft::WAVE_FORMAT_MPEG_ADTS_AAC:
+        case Microsoft::WAVE_FORMAT_MPEG_HEAAC:
+            return kAudioCodecAAC;
+        case Microsoft::WAVE_FORMAT_AC3:
+            return kAudioCodecAC3;
+        case Microsoft::WAVE_FORMAT_DTS:
+            return kAudioCodecDTS;
+        case Microsoft::WAVE_FORMAT_MSAUDIO1:
+        case Microsoft::WAVE_FORMAT_WMAUDIO2:
+        case Microsoft::WAVE_FORMAT_WMAUDIO3:
+            return kAudioCodecWMA;
+        default:
+            break;
     }
+    return kAudioCodecUnknown;
+}
+
+// biCompression -> video codec
+static struct {
+    UInt32          fourcc;
+    eVideoCodec     format;
+} kVideoCodecMap[] = {
+    { FOURCC('H264'),       kVideoCodecH264             },
+    { FOURCC('h264'),       kVideoCodecH264             },
+    { FOURCC('X264'),       kVideoCodecH264             },
+    { FOURCC('x264'),       kVideoCodecH264             },
+    { FOURCC('AVC1'),       kVideoCodecH264             },
+    { FOURCC('avc1'),       kVideoCodecH264             },
+    { FOURCC('XVID'),       kVideoCodecMPEG4            },
+    { FOURCC('xvid'),       kVideoCodecMPEG4            },
+    { FOURCC('DIVX'),       kVideoCodecMPEG4            },
+    { FOURCC('divx'),       kVideoCodecMPEG4            },
+    { FOURCC('DX50'),       kVideoCodecMPEG4            },
+    { FOURCC('FMP4'),       kVideoCodecMPEG4            },
+    { FOURCC('MP4V'),       kVideoCodecMPEG4            },
+    { FOURCC('mp4v'),       kVideoCodecMPEG4            },
+    { FOURCC('DIV3'),       kVideoCodecMicrosoftMPEG4   },
+    { FOURCC('div3'),       kVideoCodecMicrosoftMPEG4   },
+    { FOURCC('MP43'),       kVideoCodecMicrosoftMPEG4   },
+    { FOURCC('MP42'),       kVideoCodecMicrosoftMPEG4   },
+    { FOURCC('MPG4'),       kVideoCodecMicrosoftMPEG4   },
+    { FOURCC('H263'),       kVideoCodecH263             },
+    { FOURCC('h263'),       kVideoCodecH263             },
+    { FOURCC('VP80'),       kVideoCodecVP8              },
+    { FOURCC('VP90'),       kVideoCodecVP9              },
+    { FOURCC('WVC1'),       kVideoCodecVC1              },
+    // END OF LIST
+    { 0,                    kVideoCodecUnknown          },
 };
 
-typedef sp<RIFF::Chunk> (*create_ck_t)(UInt32);
-static HashTable<UInt32, create_ck_t> ckRegister;
-struct ChunkRegister {
-    
-    template <typename TYPE>
-    static sp<RIFF::Chunk> Create(UInt32 size) { return new TYPE(size); }
-    
-    ChunkRegister() {
-        ckRegister.insert(ID_RIFF,  Create<RIFF::RIFFChunk>         );
-        ckRegister.insert(ID_HDRL,  Create<MainHeaderListChunk>     );
-        ckRegister.insert(ID_STRH,  Create<StreamHeaderChunk>       );
-        ckRegister.insert(ID_STRF,  Create<StreamFormatChunk>       );
-        ckRegister.insert(ID_STRD,  Create<StreamDataChunk>         );
-        ckRegister.insert(ID_STRN,  Create<StreamNameChunk>         );
-        ckRegister.insert(ID_JUNK,  Create<JUNKChunk>               );
-        
-        // OpenDML
-        ckRegister.insert(ID_VPRP,  Create<VideoPropHeader>         );
-        ckRegister.insert(ID_ISFT,  Create<InfoSoftware>            );
+static UInt32 GetVideoFormat(UInt32 biCompression) {
+    for (UInt32 i = 0; kVideoCodecMap[i].fourcc; ++i) {
+        if (kVideoCodecMap[i].fourcc == biCompression)
+            return kVideoCodecMap[i].format;
     }
+    return kVideoCodecUnknown;
+}
+
+// find next NAL unit in Annex B stream, p moves to next start code
+// @return Nil if no more NAL unit
+static const UInt8 * FindNALU(const UInt8 *& p, const UInt8 * end, UInt32 * length) {
+    while (p + 3 <= end && !(p[0] == 0 && p[1] == 0 && p[2] == 1)) ++p;
+    if (p + 3 > end) return Nil;
     
-    sp<RIFF::Chunk> alloc(UInt32 id, UInt32 size) {
-        if (ckRegister.find(id)) {
-            sp<RIFF::Chunk> ck = ckRegister[id](size);
-            return ck;
+    const UInt8 * nalu = p + 3;
+    for (p = nalu; p + 3 <= end && !(p[0] == 0 && p[1] == 0 && p[2] == 1); ++p) { }
+    if (p + 3 > end) p = end;
+    
+    // trailing zeros belong to next start code
+    const UInt8 * last = p;
+    while (last > nalu && last[-1] == 0) --last;
+    *length = last - nalu;
+    return nalu;
+}
+
+// avcC from the first SPS & PPS in Annex B stream
+static sp<Buffer> MakeAVCC(const sp<Buffer>& stream) {
+    const UInt8 * p     = (const UInt8 *)stream->data();
+    const UInt8 * end   = p + stream->size();
+    const UInt8 * sps   = Nil;
+    const UInt8 * pps   = Nil;
+    UInt32 spsLength    = 0;
+    UInt32 ppsLength    = 0;
+    UInt32 length;
+    for (const UInt8 * nalu = FindNALU(p, end, &length); nalu; nalu = FindNALU(p, end, &length)) {
+        if (length == 0) continue;
+        const UInt8 type = nalu[0] & 0x1f;
+        if (type == 7 && sps == Nil && length >= 4) {
+            sps = nalu;
+            spsLength = length;
+        } else if (type == 8 && pps == Nil) {
+            pps = nalu;
+            ppsLength = length;
         }
-        ERROR("unknown chunk %.4s[%d]", (const Char *)&id, size);
-        return Nil;
     }
-};
+    if (sps == Nil || pps == Nil) return Nil;
+    
+    const UInt32 n = 6 + 2 + spsLength + 1 + 2 + ppsLength;
+    sp<Buffer> avcC = new Buffer(n);
+    UInt8 * dest = (UInt8 *)avcC->base();
+    dest[0] = 1;                // configurationVersion
+    dest[1] = sps[1];           // AVCProfileIndication
+    dest[2] = sps[2];           // profile_compatibility
+    dest[3] = sps[3];           // AVCLevelIndication
+    dest[4] = 0xFF;             // lengthSizeMinusOne = 3
+    dest[5] = 0xE1;             // numOfSequenceParameterSets = 1
+    dest[6] = spsLength >> 8;
+    dest[7] = spsLength & 0xFF;
+    memcpy(dest + 8, sps, spsLength);
+    dest += 8 + spsLength;
+    dest[0] = 1;                // numOfPictureParameterSets
+    dest[1] = ppsLength >> 8;
+    dest[2] = ppsLength & 0xFF;
+    memcpy(dest + 3, pps, ppsLength);
+    avcC->setBytesRange(0, n);
+    return avcC;
+}
 
-struct Entry {
-    sp<RIFF::MasterChunk>   ckMaster;
-    UInt32                ckSize;
-    Entry(sp<RIFF::MasterChunk>& master, UInt32 size) :
-    ckMaster(master), ckSize(size) { }
+// Annex B -> NAL units with 4 bytes length, as described by MakeAVCC().
+// converted in place if all start codes are 4 bytes
+static sp<Buffer> AnnexBToNALU(const sp<Buffer>& data) {
+    const UInt8 * begin = (const UInt8 *)data->data();
+    const UInt8 * end   = begin + data->size();
+    const UInt8 * p     = begin;
+    UInt32 total        = 0;
+    Bool inplace        = True;
+    UInt32 length;
+    for (const UInt8 * nalu = FindNALU(p, end, &length); nalu; nalu = FindNALU(p, end, &length)) {
+        if (total + 4 > (UInt32)(nalu - begin)) inplace = False;
+        total += 4 + length;
+    }
+    if (total == 0) return data;    // not Annex B
+    
+    sp<Buffer> out = data;
+    if (!inplace) out = new Buffer(total);
+    UInt8 * dest = (UInt8 *)out->base();
+    p = begin;
+    for (const UInt8 * nalu = FindNALU(p, end, &length); nalu; nalu = FindNALU(p, end, &length)) {
+        dest[0] = length >> 24;
+        dest[1] = length >> 16;
+        dest[2] = length >> 8;
+        dest[3] = length;
+        memmove(dest + 4, nalu, length);
+        dest += 4 + length;
+    }
+    out->setBytesRange(0, total);
+    return out;
+}
+
+// compact index entry, one for each data chunk
+struct AviIndexEntry {
+    Int64       offset;     // chunk data position in file
+    Int64       start;      // in stream units, @see AviTrack::time()
+    UInt32      size;       // chunk data length
+    UInt32      flags;      // kFrameTypeSync or kFrameTypeUnknown
 };
 
-static sp<RIFF::Chunk> EnumChunks(const sp<ABuffer>& buffer) {
-    static ChunkRegister    cks;
-    List<Entry>             ckParents;
-    sp<RIFF::MasterChunk>   ckMaster;
-    UInt32                ckMasterLength;
+struct AviTrack : public SharedObject {
+    AviTrack() : SharedObject(), index(0), enabled(True), type(kCodecTypeUnknown), format(0),
+    dwScale(1), dwRate(1), dwStart(0), dwSampleSize(0), pcm(False), annexb(False),
+    length(0), cursor(0) { }
     
-    UInt32 ckID           = buffer->rl32();
-    UInt32 ckSize         = buffer->rl32();
+    UInt32                  index;      // track index in formats
+    Bool                    enabled;    // kKeyTracks
+    eCodecType              type;
+    UInt32                  format;     // eAudioCodec|eVideoCodec|eSampleFormat
+    UInt32                  dwScale;
+    UInt32                  dwRate;
+    UInt32                  dwStart;
+    UInt32                  dwSampleSize;
+    union {
+        struct {
+            UInt32          width;
+            UInt32          height;
+        } video;
+        struct {
+            UInt32          sampleRate;
+            UInt32          channels;
+            UInt32          blockAlign;
+        } audio;
+    };
+    Bool                    pcm;        // format is eSampleFormat
+    Bool                    annexb;     // h264 packets in Annex B format
+    sp<Buffer>              strf;       // WAVEFORMATEX or BITMAPINFOHEADER
+    sp<Buffer>              csd;        // extra data after strf structure
+    sp<Buffer>              avcC;
+    Vector<SuperIndexChunk::Entry>  indx;
     
-    sp<RIFF::RIFFChunk> RIFF = new RIFF::RIFFChunk(ckSize);
-    RIFF->parse(buffer);
+    Vector<AviIndexEntry>   entries;
+    Vector<UInt32>          keys;       // entries of sync frames, video only
+    Int64                   length;     // in stream units
+    UInt32                  cursor;     // next entry to read
     
-    if (RIFF->ckID != ID_RIFF || RIFF->ckFileType != ID_AVI) {
-        ERROR("missing RIFF/AVI header");
-        return Nil;
+    FORCE_INLINE Int64 units(UInt32 size) const {
+        return dwSampleSize ? size / dwSampleSize : 1;
+    }
+    
+    FORCE_INLINE MediaTime time(Int64 start) const {
+        return MediaTime((start + dwStart) * dwScale, dwRate);
     }
     
-    DEBUG("[%zu] %s", ckParents.size(), RIFF->string().c_str());
+    FORCE_INLINE Int64 start(Int64 us) const {
+        return (us * dwRate) / (1000000LL * dwScale) - dwStart;
+    }
+    
+    void add(Int64 offset, UInt32 size, UInt32 flags) {
+        AviIndexEntry e;
+        e.offset    = offset;
+        e.start     = length;
+        e.size      = size;
+        e.flags     = type == kCodecTypeVideo ? flags : kFrameTypeSync;
+        if (type == kCodecTypeVideo && (e.flags & kFrameTypeSync)) keys.push(entries.size());
+        entries.push(e);
+        length += units(size);
+    }
     
-    ckMaster        = RIFF;
-    ckMasterLength  = ckSize;
+    // @return the last entry starts at or before start
+    UInt32 find(Int64 start) const {
+        UInt32 first = 0;
+        UInt32 last = entries.size();
+        while (first < last) {
+            const UInt32 mid = (first + last) / 2;
+            if (entries[mid].start <= start)    first = mid + 1;
+            else                                last = mid;
+        }
+        return first > 0 ? first - 1 : 0;
+    }
     
-    for (;;) {
-        UInt32 ckID   = buffer->rl32();
-        UInt32 ckSize = buffer->rl32();
+    // @return the last sync entry at or before entry i
+    UInt32 findKey(UInt32 i) const {
+        UInt32 first = 0;
+        UInt32 last = keys.size();
+        while (first < last) {
+            const UInt32 mid = (first + last) / 2;
+            if (keys[mid] <= i) first = mid + 1;
+            else                last = mid;
+        }
+        return first > 0 ? keys[first - 1] : 0;
+    }
+};
+
+struct AviFile : public MediaDevice {
+    sp<ABuffer>             mContent;
+    Vector<sp<AviTrack> >   mStreams;   // by stream number, Nil if not supported
+    UInt32                  mNumTracks;
+    Int64                   mMovi;      // position of the first 'movi'
+    Int64                   mMoviEnd;
+    Int64                   mDuration;  // us
+    
+    AviFile() : MediaDevice(), mNumTracks(0), mMovi(0), mMoviEnd(0), mDuration(0) { }
+    
+    MediaError init(const sp<ABuffer>& buffer) {
+        mContent = buffer;
         
-        // workaound for RIFF LIST
-        // LIST is a very bad structure, it may contains other LIST
-        // or raw struct, this make LIST parse() very hard
-        if (ckID == ID_LIST) {
-            ckID        = buffer->rl32();
+        const Int64 riffStart = buffer->offset();
+        if (buffer->size() < RIFF_CHUNK_LENGTH) return kMediaErrorBadContent;
+        const UInt32 ckID       = buffer->rl32();
+        const UInt32 ckSize     = buffer->rl32();
+        const UInt32 fileType   = buffer->rl32();
+        if (ckID != ID_RIFF || fileType != ID_AVI) {
+            ERROR("missing RIFF/AVI header");
+            return kMediaErrorBadContent;
         }
         
-        sp<RIFF::Chunk> ck = cks.alloc(ckID, ckSize);
-        if (ck.isNil()) {
-#if LOG_NDEBUG == 1
-            break;
-#else
-            continue;
-#endif
+        // RIFF size is not set by unfinished writer
+        Int64 riffEnd = riffStart + 8 + ckSize;
+        if (ckSize == 0 || riffEnd > buffer->capacity()) riffEnd = buffer->capacity();
+        
+        sp<ListChunk> hdrl;
+        sp<ABuffer> idx1;
+        while (buffer->offset() + RIFF_CHUNK_MIN_LENGTH <= riffEnd) {
+            const Int64 pos         = buffer->offset();
+            const UInt32 ckID       = buffer->rl32();
+            const UInt32 ckSize     = buffer->rl32();
+            const UInt32 listType   = (ckID == ID_LIST && ckSize >= 4) ? buffer->rl32() : 0;
+            
+            if (listType == ID_MOVI) {
+                mMovi       = pos + 8;
+                mMoviEnd    = pos + 8 + ckSize;
+                if (ckSize == 0 || mMoviEnd > riffEnd) mMoviEnd = riffEnd;
+            } else if (listType == ID_HDRL) {
+                // header list with a single read
+                buffer->skipBytes(-4);
+                sp<ABuffer> data = buffer->readBytes(ckSize);
+                hdrl = new ListChunk(ckSize);
+                if (data.isNil() || hdrl->parse(data) != kMediaNoError) {
+                    ERROR("read hdrl failed");
+                    return kMediaErrorBadContent;
+                }
+            } else if (ckID == ID_IDX1) {
+                idx1 = buffer->readBytes(ckSize);
+            }
+            
+            const Int64 next = pos + 8 + AVI_PAD(ckSize);
+            if (next >= riffEnd) break;
+            buffer->skipBytes(next - buffer->offset());
         }
         
-        ckMasterLength -= ck->size() + 8;
+        if (hdrl.isNil() || mMovi == 0) {
+            ERROR("missing hdrl or movi");
+            return kMediaErrorBadContent;
+        }
         
-        DEBUG("[%zu] %s, remains ckLength = %zu",
-              ckParents.size() + 1, ck->string().c_str(), ckMasterLength);
+        for (UInt32 i = 0; i < hdrl->ckChildren.size(); ++i) {
+            const sp<RIFF::Chunk>& ck = hdrl->ckChildren[i];
+            if (ck->ckID == ID_AVIH) {
+                INFO("%s", ck->string().c_str());
+            } else if (ck->ckID == ID_LIST) {
+                sp<ListChunk> strl = ck;
+                if (strl->ckListType != ID_STRL) continue;
+                // keep stream number even it is not supported
+                sp<AviTrack> trak = createTrack(strl);
+                if (!trak.isNil()) trak->index = mNumTracks++;
+                mStreams.push(trak);
+            }
+        }
         
-        if (ck->parse(buffer) != kMediaNoError) {
-            ERROR("ck %.4s parse failed", (const Char *)&ckID);
-            break;
+        if (mNumTracks == 0) {
+            ERROR("no supported stream");
+            return kMediaErrorNotSupported;
         }
-                
-        ckMaster->ckChildren.push(ck);
         
-        if (ck->ckType == RIFF::kChunkTypeMaster) {
-            ckParents.push(Entry(ckMaster, ckMasterLength));
-            ckMaster        = ck;
-            ckMasterLength  = ckSize;
-            continue;
+        // idx1 covers the first RIFF only, prefer OpenDML index
+        if (!loadOpenDMLIndex() && (idx1.isNil() || !loadIndex(idx1))) {
+            scanMovi(riffEnd);
         }
         
-        CHECK_FALSE(ckMaster.isNil());
+        for (UInt32 i = 0; i < mStreams.size(); ++i) {
+            const sp<AviTrack>& trak = mStreams[i];
+            if (trak.isNil()) continue;
+            if (trak->format == kVideoCodecH264) prepareH264(trak);
+            
+            const Int64 duration = trak->time(trak->length).useconds();
+            if (duration > mDuration) mDuration = duration;
+            INFO("stream %u: %zu chunks, %zu sync, %.3fs", i,
+                 trak->entries.size(), trak->keys.size(), duration / 1E6);
+        }
+        return kMediaNoError;
+    }
+    
+    sp<AviTrack> createTrack(const sp<ListChunk>& strl) {
+        sp<StreamHeaderChunk> strh;
+        sp<StreamFormatChunk> strf;
+        sp<SuperIndexChunk> indx;
+        for (UInt32 i = 0; i < strl->ckChildren.size(); ++i) {
+            const sp<RIFF::Chunk>& ck = strl->ckChildren[i];
+            if (ck->ckID == ID_STRH)        strh = ck;
+            else if (ck->ckID == ID_STRF)   strf = ck;
+            else if (ck->ckID == ID_INDX)   indx = ck;
+        }
         
-        // ckSize SHOULD excluding ckID & ckSize & padding,
-        // but someone may set it wrong
-        while (ckMasterLength < RIFF_CHUNK_MIN_LENGTH) {
-            if (ckParents.empty()) break;
-            Entry& e = ckParents.back();
-            ckMaster        = e.ckMaster;
-            ckMasterLength  = e.ckSize;
-            ckParents.pop_back();
+        if (strh.isNil() || strf.isNil()) {
+            ERROR("missing strh or strf");
+            return Nil;
         }
         
-        if (ckParents.empty() && ckMasterLength < RIFF_CHUNK_MIN_LENGTH) break;
+        if (strh->dwScale == 0 || strh->dwRate == 0) {
+            ERROR("bad stream rate %u/%u", strh->dwRate, strh->dwScale);
+            return Nil;
+        }
+        
+        sp<AviTrack> trak   = new AviTrack;
+        trak->dwScale       = strh->dwScale;
+        trak->dwRate        = strh->dwRate;
+        trak->dwStart       = strh->dwStart;
+        trak->dwSampleSize  = strh->dwSampleSize;
+        trak->strf          = strf->Format;
+        if (!indx.isNil()) trak->indx = indx->Entries;
+        
+        sp<ABuffer> format = strf->Format->cloneBytes();
+        if (strh->fccType == kStreamTypeVideo) {
+            if (format->size() < BITMAPINFOHEADER_MIN_LENGTH) {
+                ERROR("bad BITMAPINFOHEADER");
+                return Nil;
+            }
+            Microsoft::BITMAPINFOHEADER biHead;
+            biHead.parse(format);
+            trak->type          = kCodecTypeVideo;
+            trak->format        = GetVideoFormat(biHead.biCompression);
+            trak->video.width   = biHead.biWidth;
+            // negative for top-down dib
+            trak->video.height  = (Int32)biHead.biHeight < 0 ? -(Int32)biHead.biHeight : biHead.biHeight;
+            if (trak->format == kVideoCodecUnknown) {
+                WARN("unsupported video %.4s", (const Char *)&biHead.biCompression);
+                return Nil;
+            }
+        } else if (strh->fccType == kStreamTypeAudio) {
+            Microsoft::WAVEFORMATEX wave;
+            if (wave.parse(format) != kMediaNoError) {
+                ERROR("bad WAVEFORMATEX");
+                return Nil;
+            }
+            trak->type              = kCodecTypeAudio;
+            trak->format            = GetAudioFormat(wave);
+            trak->audio.sampleRate  = wave.nSamplesPerSec;
+            trak->audio.channels    = wave.nChannels;
+            trak->audio.blockAlign  = wave.nBlockAlign;
+            const UInt32 tag = wave.wFormat == Microsoft::WAVE_FORMAT_EXTENSIBLE ? wave.wSubFormat : wave.wFormat;
+            trak->pcm = tag == Microsoft::WAVE_FORMAT_PCM || tag == Microsoft::WAVE_FORMAT_IEEE_FLOAT;
+            if (trak->pcm && wave.nBlockAlign == 0) {
+                ERROR("bad pcm block align");
+                return Nil;
+            }
+            if (trak->format == kAudioCodecUnknown) {
+                WARN("unsupported audio %#x", wave.wFormat);
+                return Nil;
+            }
+            if (trak->pcm && trak->dwSampleSize == 0) trak->dwSampleSize = wave.nBlockAlign;
+        } else {
+            INFO("ignore stream %.4s", (const Char *)&strh->fccType);
+            return Nil;
+        }
+        
+        if (format->size() > 0) trak->csd = format->readBytes(format->size());
+        return trak;
     }
-    return ckMaster;
-}
-
-struct AviFile : public MediaFile {
-    AviFile() { }
     
-    MediaError init(const sp<ABuffer>& buffer) {
-        sp<RIFF::RIFFChunk> RIFF = EnumChunks(buffer);
+    // load ix## of all streams, each with a single read
+    Bool loadOpenDMLIndex() {
+        for (UInt32 i = 0; i < mStreams.size(); ++i) {
+            if (!mStreams[i].isNil() && mStreams[i]->indx.empty()) return False;
+        }
+        
+        for (UInt32 i = 0; i < mStreams.size(); ++i) {
+            const sp<AviTrack>& trak = mStreams[i];
+            if (trak.isNil()) continue;
+            for (UInt32 j = 0; j < trak->indx.size(); ++j) {
+                const SuperIndexChunk::Entry& e = trak->indx[j];
+                mContent->skipBytes(e.qwOffset - mContent->offset());
+                sp<ABuffer> data = mContent->readBytes(e.dwSize);
+                if (data.isNil() || data->size() < RIFF_CHUNK_MIN_LENGTH + 24) {
+                    ERROR("read ix## @ %" PRIu64 " failed", e.qwOffset);
+                    clearIndex();
+                    return False;
+                }
+                data->skipBytes(RIFF_CHUNK_MIN_LENGTH);     // ix## header
+                
+                const UInt16 wLongsPerEntry = data->rl16();
+                data->r8();     // bIndexSubType
+                const UInt8 bIndexType      = data->r8();
+                const UInt32 nEntriesInUse  = data->rl32();
+                data->rl32();   // dwChunkId
+                const UInt64 qwBaseOffset   = ReadL64(data);
+                data->rl32();   // dwReserved
+                if (bIndexType != AVI_INDEX_OF_CHUNKS || wLongsPerEntry < 2) {
+                    ERROR("bad ix## @ %" PRIu64, e.qwOffset);
+                    clearIndex();
+                    return False;
+                }
+                
+                // field index has an extra dwOffsetField2
+                const UInt32 skip = (wLongsPerEntry - 2) * 4;
+                for (UInt32 k = 0; k < nEntriesInUse && data->size() >= wLongsPerEntry * 4U; ++k) {
+                    const UInt32 dwOffset   = data->rl32();
+                    const UInt32 dwSize     = data->rl32();
+                    if (skip) data->skipBytes(skip);
+                    trak->add(qwBaseOffset + dwOffset,
+                              dwSize & ~AVI_INDEX_DELTA_FRAME,
+                              (dwSize & AVI_INDEX_DELTA_FRAME) ? kFrameTypeUnknown : kFrameTypeSync);
+                }
+            }
+        }
+        return True;
+    }
+    
+    // drop partial index, before falling back to next index
+    void clearIndex() {
+        for (UInt32 i = 0; i < mStreams.size(); ++i) {
+            const sp<AviTrack>& trak = mStreams[i];
+            if (trak.isNil()) continue;
+            trak->entries.clear();
+            trak->keys.clear();
+            trak->length = 0;
+        }
+    }
+    
+    Bool loadIndex(const sp<ABuffer>& idx1) {
+        Int64 base = -1;
+        while (idx1->size() >= 16) {
+            const UInt32 ckID       = idx1->rl32();
+            const UInt32 dwFlags    = idx1->rl32();
+            const UInt32 dwOffset   = idx1->rl32();
+            const UInt32 dwSize     = idx1->rl32();
+            if (dwFlags & AVIIF_LIST) continue;     // 'rec '
+            
+            const UInt32 number = GetStreamNumber(ckID);
+            if (number >= mStreams.size() || mStreams[number].isNil()) continue;
+            
+            // offset is relative to 'movi' usually, but absolute in some files
+            if (base < 0) base = dwOffset < mMovi ? mMovi : 0;
+            mStreams[number]->add(base + dwOffset + RIFF_CHUNK_MIN_LENGTH,
+                                  dwSize,
+                                  (dwFlags & AVIIF_KEYFRAME) ? kFrameTypeSync : kFrameTypeUnknown);
+        }
+        return base >= 0;
+    }
+    
+    // no index: walk chunk headers in all movi lists.
+    // keyframes are unknown, so seek always goes to the first frame.
+    void scanMovi(Int64 riffEnd) {
+        WARN("no index, scan movi");
+        Int64 pos = mMovi + 4;
+        Int64 end = mMoviEnd;
+        for (;;) {
+            while (pos + RIFF_CHUNK_MIN_LENGTH <= end) {
+                mContent->skipBytes(pos - mContent->offset());
+                if (mContent->size() < RIFF_CHUNK_MIN_LENGTH) return;
+                const UInt32 ckID   = mContent->rl32();
+                const UInt32 ckSize = mContent->rl32();
+                if (ckID == ID_LIST) {
+                    pos += RIFF_CHUNK_LENGTH;   // enter 'rec '
+                    continue;
+                }
+                
+                const UInt32 number = GetStreamNumber(ckID);
+                if (number < mStreams.size() && !mStreams[number].isNil()) {
+                    sp<AviTrack>& trak = mStreams[number];
+                    trak->add(pos + RIFF_CHUNK_MIN_LENGTH, ckSize,
+                              trak->entries.empty() ? kFrameTypeSync : kFrameTypeUnknown);
+                }
+                pos += RIFF_CHUNK_MIN_LENGTH + AVI_PAD(ckSize);
+            }
+            
+            // OpenDML: movi in following RIFF AVIX
+            const Int64 next = AVI_PAD(riffEnd);
+            mContent->skipBytes(next - mContent->offset());
+            if (mContent->size() < RIFF_CHUNK_LENGTH) return;
+            if (mContent->rl32() != ID_RIFF) return;
+            riffEnd = next + RIFF_CHUNK_MIN_LENGTH + mContent->rl32();
+            if (mContent->rl32() != ID_AVIX) return;
+            
+            pos = end = 0;
+            for (Int64 start = next + RIFF_CHUNK_LENGTH; start + RIFF_CHUNK_LENGTH <= riffEnd; ) {
+                mContent->skipBytes(start - mContent->offset());
+                if (mContent->size() < RIFF_CHUNK_LENGTH) return;
+                const UInt32 ckID   = mContent->rl32();
+                const UInt32 ckSize = mContent->rl32();
+                if (ckID == ID_LIST && mContent->rl32() == ID_MOVI) {
+                    pos = start + RIFF_CHUNK_LENGTH;
+                    end = start + RIFF_CHUNK_MIN_LENGTH + ckSize;
+                    break;
+                }
+                start += RIFF_CHUNK_MIN_LENGTH + AVI_PAD(ckSize);
+            }
+            if (end == 0) return;
+        }
+    }
+    
+    // h264 in avi is Annex B usually, make avcC from strf extra data
+    // or the first sync frame, and convert packets to NAL units.
+    void prepareH264(const sp<AviTrack>& trak) {
+        if (!trak->csd.isNil() && trak->csd->size() > 0 && *(const UInt8 *)trak->csd->data() == 1) {
+            trak->avcC = trak->csd;
+            return;
+        }
+        
+        trak->annexb = True;
+        if (!trak->csd.isNil()) trak->avcC = MakeAVCC(trak->csd);
+        if (trak->avcC.isNil() && !trak->keys.empty()) {
+            const AviIndexEntry& e = trak->entries[trak->keys[0]];
+            mContent->skipBytes(e.offset - mContent->offset());
+            sp<Buffer> data = mContent->readBytes(e.size);
+            if (!data.isNil()) trak->avcC = MakeAVCC(data);
+        }
+        if (trak->avcC.isNil()) {
+            WARN("missing SPS & PPS for h264");
+        }
     }
     
     virtual sp<Message> formats() const {
-        return Nil;
+        sp<Message> info = new Message;
+        info->setInt32(kKeyFormat, kFileFormatAvi);
+        info->setInt32(kKeyCount, mNumTracks);
+        if (mDuration) info->setInt64(kKeyDuration, mDuration);
+        for (UInt32 i = 0; i < mStreams.size(); ++i) {
+            const sp<AviTrack>& trak = mStreams[i];
+            if (trak.isNil()) continue;
+            
+            sp<Message> trakInfo = new Message;
+            trakInfo->setInt32(kKeyType, trak->type);
+            trakInfo->setInt32(kKeyFormat, trak->format);
+            if (trak->type == kCodecTypeVideo) {
+                trakInfo->setInt32(kKeyWidth, trak->video.width);
+                trakInfo->setInt32(kKeyHeight, trak->video.height);
+                if (!trak->avcC.isNil()) {
+                    trakInfo->setObject(kKeyavcC, trak->avcC);
+                } else if (trak->format == kVideoCodecMicrosoftMPEG4) {
+                    trakInfo->setObject(kKeyMicrosoftVCM, trak->strf);
+                }
+            } else {
+                trakInfo->setInt32(kKeySampleRate, trak->audio.sampleRate);
+                trakInfo->setInt32(kKeyChannels, trak->audio.channels);
+                if (trak->format == kAudioCodecAAC) {
+                    // AudioSpecificConfig -> ESDS
+                    sp<Buffer> esds;
+                    if (!trak->csd.isNil()) esds = MPEG4::MakeAudioESDS(trak->csd->cloneBytes());
+                    if (esds.isNil()) {
+                        MPEG4::AudioSpecificConfig asc (MPEG4::AOT_AAC_LC, trak->audio.sampleRate, trak->audio.channels);
+                        esds = MPEG4::MakeAudioESDS(asc);
+                    }
+                    trakInfo->setObject(kKeyESDS, esds);
+                }
+                trakInfo->setObject(kKeyMicorsoftACM, trak->strf);
+            }
+            
+            INFO("trak %u: %s", trak->index, trakInfo->string().c_str());
+            info->setObject(kKeyTrack + trak->index, trakInfo);
+        }
+        return info;
     }
     
     virtual MediaError configure(const sp<Message>& options) {
+        INFO("configure << %s", options->string().c_str());
+        MediaError status = kMediaErrorNotSupported;
+        if (options->contains(kKeyTracks)) {
+            Bits<UInt32> mask = options->findInt32(kKeyTracks);
+            CHECK_FALSE(mask.empty());
+            for (UInt32 i = 0; i < mStreams.size(); ++i) {
+                sp<AviTrack>& trak = mStreams[i];
+                if (!trak.isNil()) trak->enabled = mask.test(trak->index);
+            }
+            status = kMediaNoError;
+        }
+        
+        if (options->contains(kKeySeek)) {
+            seek(options->findInt64(kKeySeek));
+            status = kMediaNoError;
+        }
+        return status;
+    }
+    
+    // seek the first video track to sync frame, others follow it
+    void seek(Int64 us) {
+        sp<AviTrack> target;
+        for (UInt32 i = 0; i < mStreams.size(); ++i) {
+            const sp<AviTrack>& trak = mStreams[i];
+            if (trak.isNil() || !trak->enabled || trak->entries.empty()) continue;
+            if (target.isNil() || (target->type != kCodecTypeVideo && trak->type == kCodecTypeVideo)) {
+                target = trak;
+            }
+        }
+        if (target.isNil()) return;
+        
+        UInt32 i = target->find(target->start(us));
+        if (target->type == kCodecTypeVideo) i = target->findKey(i);
+        target->cursor = i;
+        
+        const Int64 time = target->time(target->entries[i].start).useconds();
+        for (UInt32 j = 0; j < mStreams.size(); ++j) {
+            sp<AviTrack>& trak = mStreams[j];
+            if (trak.isNil() || trak == target) continue;
+            trak->cursor = trak->find(trak->start(time));
+        }
+        DEBUG("seek %.3fs => %.3fs, chunk %u", us / 1E6, time / 1E6, i);
+    }
+    
+    virtual MediaError push(const sp<MediaFrame>&) {
         return kMediaErrorInvalidOperation;
     }
     
-    virtual sp<MediaFrame> read(const eReadMode& mode, const MediaTime& ts) {
-        return Nil;
+    virtual sp<MediaFrame> pull() {
+        for (;;) {
+            // read chunks in file order
+            sp<AviTrack> trak;
+            for (UInt32 i = 0; i < mStreams.size(); ++i) {
+                const sp<AviTrack>& t = mStreams[i];
+                if (t.isNil() || !t->enabled || t->cursor >= t->entries.size()) continue;
+                if (trak.isNil() || t->entries[t->cursor].offset < trak->entries[trak->cursor].offset) {
+                    trak = t;
+                }
+            }
+            if (trak.isNil()) {
+                INFO("EOS");
+                return Nil;
+            }
+            
+            const AviIndexEntry& e = trak->entries[trak->cursor++];
+            // empty chunk: dropped frame
+            if (e.size == 0) continue;
+            
+            // each chunk with a single read
+            mContent->skipBytes(e.offset - mContent->offset());
+            sp<Buffer> data = mContent->readBytes(e.size);
+            if (data.isNil() || data->size() < e.size) {
+                ERROR("read chunk @ %" PRId64 " failed, corrupt file?", e.offset);
+                return Nil;
+            }
+            if (trak->annexb) data = AnnexBToNALU(data);
+            
+            sp<MediaFrame> packet   = MediaFrame::Create(data);
+            packet->id              = trak->index;
+            packet->flags           = e.flags;
+            packet->timecode        = trak->time(e.start);
+            packet->duration        = MediaTime(trak->units(e.size) * trak->dwScale, trak->dwRate);
+            if (trak->pcm) {
+                packet->audio.format    = (eSampleFormat)trak->format;
+                packet->audio.channels  = trak->audio.channels;
+                packet->audio.freq      = trak->audio.sampleRate;
+                packet->audio.samples   = e.size / trak->audio.blockAlign;
+            }
+            
+            DEBUG("pull %s", packet->string().c_str());
+            return packet;
+        }
+    }
+    
+    virtual MediaError reset() {
+        return kMediaNoError;
     }
 };
 
-sp<MediaFile> OpenAviFile(const sp<ABuffer>& buffer) {
+sp<MediaDevice> CreateAviFile(const sp<ABuffer>& buffer) {
     sp<AviFile> file = new AviFile;
     if (file->init(buffer) == kMediaNoError) return file;
     return Nil;
@@ -44,6 +44,16 @@ __BEGIN_NAMESPACE(Microsoft)
 enum {
     WAVE_FORMAT_PCM         = 0x0001,
     WAVE_FORMAT_IEEE_FLOAT  = 0x0003,
+    WAVE_FORMAT_MPEG        = 0x0050,
+    WAVE_FORMAT_MPEGLAYER3  = 0x0055,
+    WAVE_FORMAT_AAC         = 0x00FF,
+    WAVE_FORMAT_MSAUDIO1    = 0x0160,
+    WAVE_FORMAT_WMAUDIO2    = 0x0161,
+    WAVE_FORMAT_WMAUDIO3    = 0x0162,
+    WAVE_FORMAT_MPEG_ADTS_AAC = 0x1600,
+    WAVE_FORMAT_MPEG_HEAAC  = 0x1610,
+    WAVE_FORMAT_AC3         = 0x2000,
+    WAVE_FORMAT_DTS         = 0x2001,
     WAVE_FORMAT_EXTENSIBLE  = 0xFFFE,
 };
 
@@ -40,6 +40,12 @@
 #include "RIFF.h"
 #include "id3/ID3.h"
 
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
 // samples:
 //  http://www-mmsp.ece.mcgill.ca/Documents/AudioFormats/WAVE/Samples.html
 // TODO: 
@@ -61,7 +67,11 @@ eSampleFormat GetSampleFormat(const Microsoft::WAVEFORMATEX& wave) {
                 default:    break;
             } break;
         case Microsoft::WAVE_FORMAT_IEEE_FLOAT:
-            return kSampleFormatF32Packed;
+            switch (wave.wBitsPerSample) {
+                case 32:    return kSampleFormatF32Packed;
+                case 64:    return kSampleFormatF64Packed;
+                default:    break;
+            } break;
         default:
             break;
     }
@@ -69,8 +79,85 @@ eSampleFormat GetSampleFormat(const Microsoft::WAVEFORMATEX& wave) {
     return kSampleFormatUnknown;
 }
 
+// default samples per frame, see kKeyDuration in configure
 static const UInt32 kFrameSize  = 2048;
 
+// data chunk mapped into memory, pcm frames refer to its pages
+// instead of copying samples out of content.
+struct WaveMapping : public SharedObject {
+    UInt8 *         mAddress;   // page aligned
+    UInt64          mLength;    // mapped length
+    const UInt8 *   mData;      // data chunk start
+    Int64           mDataLength;
+    
+    WaveMapping() : SharedObject(), mAddress(Nil), mLength(0), mData(Nil), mDataLength(0) { }
+    
+    virtual ~WaveMapping() {
+        if (mAddress) munmap(mAddress, mLength);
+    }
+    
+    static sp<WaveMapping> Map(const String& url, Int64 offset, Int64 length) {
+        String path = url;
+        if (!strncmp(url.c_str(), "file://", 7)) path = url.c_str() + 7;
+        
+        Int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) return Nil;
+        
+        struct stat st;
+        if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= offset) {
+            close(fd);
+            return Nil;
+        }
+        if (offset + length > st.st_size) length = st.st_size - offset;
+        
+        const Int64 page    = sysconf(_SC_PAGESIZE);
+        const Int64 start   = offset & ~(page - 1);
+        const UInt64 bytes  = length + (offset - start);
+        // read-only: frames are consumed as const input by decoders,
+        // converters and sinks, none of them modifies samples in place.
+        void * mapped = mmap(Nil, bytes, PROT_READ, MAP_PRIVATE, fd, start);
+        close(fd);
+        if (mapped == MAP_FAILED) {
+            ERROR("mmap %s failed", path.c_str());
+            return Nil;
+        }
+        madvise(mapped, bytes, MADV_SEQUENTIAL);
+        
+        sp<WaveMapping> mapping = new WaveMapping;
+        mapping->mAddress       = (UInt8 *)mapped;
+        mapping->mLength        = bytes;
+        mapping->mData          = mapping->mAddress + (offset - start);
+        mapping->mDataLength    = length;
+        return mapping;
+    }
+};
+
+// MediaFrame holds samples in mapped pages
+struct MappedMediaFrame : public MediaFrame {
+    MediaBuffer         extend_planes[1];   // placeholder
+    sp<WaveMapping>     mMapping;
+    
+    MappedMediaFrame(const sp<WaveMapping>& mapping, const UInt8 * data, UInt32 length) :
+    MediaFrame(), mMapping(mapping) {
+        planes.count                = 1;
+        planes.buffers[0].capacity  = length;
+        planes.buffers[0].size      = length;
+        planes.buffers[0].data      = (UInt8 *)data;
+    }
+};
+
+#define S24LE(x)    ((x)[0] | (((x)[1] << 8) & 0xFF00) | (((x)[2] << 16) & 0xFF0000))
+// 24 bits -> 32 bits samples, in a single pass
+static sp<MediaFrame> UnpackS24(const UInt8 * src, UInt32 count) {
+    sp<MediaFrame> packet = MediaFrame::Create(count * sizeof(Int32));
+    Int32 * dest = (Int32 *)packet->planes.buffers[0].data;
+    for (UInt32 i = 0; i < count; ++i, src += 3) {
+        dest[i] = (Int32)(S24LE(src) << 8);
+    }
+    packet->planes.buffers[0].size = count * sizeof(Int32);
+    return packet;
+}
+
 static FORCE_INLINE Bool isValidChunkID(const String& ckID) {
     for (Int i = 0; i < 4; i++) {
         if (ckID[i] < ' ' || ckID[i] > 126) return False;
@@ -126,6 +213,10 @@ struct WaveFile : public MediaDevice {
     sp<Message>         mID3v1;
     sp<Message>         mID3v2;
     sp<FMTChunk>        mFormat;
+    sp<WaveMapping>     mMapping;
+    Int64               mPosition;      // read position in data chunk, mapped only
+    UInt32              mSampleBytes;   // bytes per sample of all channels
+    UInt32              mFrameSamples;
 
     // dwSampleLength: Number of samples (per channel)
     // for non-pcm formats
@@ -133,11 +224,12 @@ struct WaveFile : public MediaDevice {
 
     WaveFile() : MediaDevice(),
     mDataOffset(0), mDataLength(0),
-    mFormat(Nil), dwSampleLength(0) { }
+    mFormat(Nil), mPosition(0), mSampleBytes(0), mFrameSamples(kFrameSize),
+    dwSampleLength(0) { }
 
     // refer to:
     // 1. http://www-mmsp.ece.mcgill.ca/documents/audioformats/wave/wave.html
-    MediaError init(const sp<ABuffer>& buffer) {
+    MediaError init(const sp<ABuffer>& buffer, const String& url) {
         mContent = buffer;
 
         mID3v2 = ID3::ReadID3v2(buffer);
@@ -177,6 +269,27 @@ struct WaveFile : public MediaDevice {
             return kMediaErrorBadContent;
         }
         
+        const Microsoft::WAVEFORMATEX& wave = mFormat->Wave;
+        mSampleBytes = (wave.nChannels * wave.wBitsPerSample) >> 3;
+        if (mSampleBytes == 0 || wave.nSamplesPerSec == 0) {
+            ERROR("bad format chunk");
+            return kMediaErrorBadContent;
+        }
+        
+        // data length is 0 or larger than file when writer didn't finish
+        if (success && (mDataLength == 0 || mDataOffset + mDataLength > buffer->capacity())) {
+            mDataLength = buffer->capacity() - mDataOffset;
+        }
+        
+        if (success && !url.equals("")) {
+            mMapping = WaveMapping::Map(url, mDataOffset, mDataLength);
+            if (mMapping.isNil()) {
+                INFO("map %s failed, read through content", url.c_str());
+            } else {
+                mDataLength = mMapping->mDataLength;
+            }
+        }
+        
         if (success) {
             // read id3v1
             mID3v1 = ID3::ReadID3v1(buffer);
@@ -235,13 +348,24 @@ struct WaveFile : public MediaDevice {
     }
     
     virtual MediaError configure(const sp<Message>& options) {
+        MediaError status = kMediaErrorNotSupported;
+        if (options->contains(kKeyDuration)) {
+            // frame duration
+            Int64 us = options->findInt64(kKeyDuration);
+            if (us <= 0) return kMediaErrorInvalidOperation;
+            Int64 samples = (us * mFormat->Wave.nSamplesPerSec) / 1000000LL;
+            mFrameSamples = samples > 0 ? samples : 1;
+            INFO("frame duration %" PRId64 " us, %u samples", us, mFrameSamples);
+            status = kMediaNoError;
+        }
+        
         if (options->contains(kKeySeek)) {
             Int64 us = options->findInt64(kKeySeek);
             seek(us);
-            return kMediaNoError;
+            status = kMediaNoError;
         }
         
-        return kMediaErrorNotSupported;
+        return status;
     }
 
     void seek(Int64 us) {
@@ -253,11 +377,12 @@ struct WaveFile : public MediaDevice {
         Int64 offset = (us * byterate) / 1000000LL;
 
         if (offset > mDataLength) offset = mDataLength;
-        Int32 align = (wave.nChannels * wave.wBitsPerSample) / 8;
+        Int32 align = mSampleBytes;
         if (wave.nBlockAlign) align = wave.nBlockAlign;
 
-        offset = (offset / wave.nBlockAlign) * wave.nBlockAlign;
+        offset = (offset / align) * align;
 
+        mPosition = offset;
         mContent->resetBytes();
         mContent->skipBytes(mDataOffset + offset);
     }
@@ -266,46 +391,53 @@ struct WaveFile : public MediaDevice {
         return kMediaErrorInvalidOperation;
     }
 
-#define S24LE(x)    ((x)[0] | (((x)[1] << 8) & 0xFF00) | (((x)[2] << 16) & 0xFF0000))
     virtual sp<MediaFrame> pull() {
         const Microsoft::WAVEFORMATEX& wave = mFormat->Wave;
-        const UInt32 sampleBytes = ((wave.nChannels * wave.wBitsPerSample) >> 3);
-        Int64 samplesRead = (mContent->offset() - mDataOffset) / sampleBytes;
-        MediaTime pts (samplesRead, wave.nSamplesPerSec);
-
-        sp<Buffer> data = mContent->readBytes(kFrameSize * sampleBytes);
-        if (data.isNil()) {
+        const Int64 position = mMapping.isNil() ? mContent->offset() - mDataOffset : mPosition;
+        
+        Int64 samples = (mDataLength - position) / mSampleBytes;
+        if (samples > mFrameSamples) samples = mFrameSamples;
+        if (samples <= 0) {
             INFO("EOS...");
             return Nil;
         }
+        MediaTime pts (position / mSampleBytes, wave.nSamplesPerSec);
+        
+        sp<MediaFrame> packet;
+        if (!mMapping.isNil()) {
+            const UInt8 * data = mMapping->mData + position;
+            mPosition += samples * mSampleBytes;
+            if (wave.wBitsPerSample == 24) {
+                packet = UnpackS24(data, samples * wave.nChannels);
+            } else {
+                packet = new MappedMediaFrame(mMapping, data, samples * mSampleBytes);
+            }
+        } else {
+            sp<Buffer> data = mContent->readBytes(samples * mSampleBytes);
+            if (data.isNil() || data->size() < mSampleBytes) {
+                INFO("EOS...");
+                return Nil;
+            }
+            samples = data->size() / mSampleBytes;
+            if (wave.wBitsPerSample == 24) {
+                packet = UnpackS24((const UInt8 *)data->data(), samples * wave.nChannels);
+            } else {
+                packet = MediaFrame::Create(data);
+            }
+        }
         
         AudioFormat audio;
         audio.format    = GetSampleFormat(wave);
         audio.channels  = wave.nChannels;
         audio.freq      = wave.nSamplesPerSec;
-        audio.samples   = data->size() / sampleBytes;
-
-        sp<MediaFrame> packet;
-        if (wave.wBitsPerSample == 24) {
-            // 24 bits -> 32 bits samples
-            sp<Buffer> to   = new Buffer((data->capacity() / 3) * 4);
-            UInt8 * src    = (UInt8 *)data->data() + data->size();
-            Int32 * dest  = (Int32 *)to->base() + audio.samples * audio.channels;
-            for (UInt32 i = 0; i < audio.samples * audio.channels; ++i) {
-                src -= 3;
-                *--dest = S24LE(src) << 8;
-            }
-            to->setBytesRange(0, audio.samples * audio.channels * sizeof(Int32));
-            data = to;
-        }
-        packet = MediaFrame::Create(data);
+        audio.samples   = samples;
 
         packet->id          = 0;
         packet->flags       = kFrameTypeSync;
         packet->audio       = audio;
         //packet->pts         = pts;
         packet->timecode    = pts;
-        packet->duration    = MediaTime(packet->planes.buffers[0].size / sampleBytes, wave.nSamplesPerSec);
+        packet->duration    = MediaTime(samples, wave.nSamplesPerSec);
 
         DEBUG("pull %s", packet->string().c_str());
         return packet;
@@ -316,9 +448,9 @@ struct WaveFile : public MediaDevice {
     }
 };
 
-sp<MediaDevice> CreateWaveFile(const sp<ABuffer>& buffer) {
+sp<MediaDevice> CreateWaveFile(const sp<ABuffer>& buffer, const String& url) {
     sp<WaveFile> wave = new WaveFile;
-    if (wave->init(buffer) == kMediaNoError)
+    if (wave->init(buffer, url) == kMediaNoError)
         return wave;
     return Nil;
 }
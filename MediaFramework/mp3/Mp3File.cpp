@@ -40,11 +40,18 @@
 #include <stdio.h> // FIXME: sscanf
 
 #include "MediaDevice.h"
+#include "IndexCache.h"
 
 __BEGIN_NAMESPACE_MFWK
 
 const static Int kScanLength = 32 * 1024;
 
+#define kIndexTagMp3        FOURCC('mp3 ')
+// index entry every n frames, frames between are skipped by headers
+#define kIndexInterval      (16)
+// frames indexed by one job, then yield to other jobs
+#define kIndexFramesPerJob  (4096)
+
 
 // MPEG Audio Frame Header:
 // refer to http://www.codeproject.com/Articles/8295/MPEG-Audio-Frame-Header
@@ -247,6 +254,53 @@ Bool decodeMPEGAudioFrameHeader(const sp<ABuffer>& frame, UInt32 *sampleRate, UI
     return True;
 }
 
+// read frame head at current position, the frame must have common head
+// and ends before end.
+// @return frame length, or -1 with buffer at the same position
+static ssize_t readFrameHead(const sp<ABuffer>& buffer, UInt32 common, Int64 end, UInt32 *head) {
+    const Int64 offset = buffer->offset();
+    if (offset + 4 > end) return -1;
+    
+    *head = buffer->rb32();
+    ssize_t frameLength = -1;
+    if ((*head & kHeaderMask) == common) {
+        frameLength = decodeFrameHeader(*head, Nil);
+    }
+    if (frameLength <= 4 || offset + frameLength > end) {
+        buffer->skipBytes(-4);
+        return -1;
+    }
+    return frameLength;
+}
+
+// find next frame with common head, which is followed by another
+// frame or the end. only for corrupt content or after seek.
+// @return True with buffer at the frame
+static Bool resyncFrame(const sp<ABuffer>& buffer, UInt32 common, Int64 end) {
+    const Int64 start = buffer->offset();
+    UInt32 head = 0;
+    while (buffer->offset() < end) {
+        head = (head << 8) | buffer->r8();
+        if ((head & kHeaderMask) != common) continue;
+        
+        const Int64 offset = buffer->offset() - 4;
+        ssize_t frameLength = decodeFrameHeader(head, Nil);
+        if (frameLength <= 4 || offset + frameLength > end) continue;
+        
+        if (offset + frameLength + 4 <= end) {
+            buffer->skipBytes(frameLength - 4);
+            const UInt32 next = buffer->rb32();
+            buffer->skipBytes(-(Int64)frameLength);
+            if ((next & kHeaderMask) != common) continue;
+        }
+        
+        DEBUG("resync %" PRId64 " bytes junk", offset - start);
+        buffer->skipBytes(-4);
+        return True;
+    }
+    return False;
+}
+
 struct XingHeader {
     String          ID;
     UInt32        numFrames;
@@ -538,6 +592,158 @@ struct Mp3Packetizer : public MediaDevice {
     }
 };
 
+// frame offset index, built by a background job with frame headers only.
+// entries are valid while building, so seek can use it before ready.
+struct Mp3Index : public SharedObject {
+    mutable Mutex   mLock;
+    Vector<Int64>   mEntries;       // offset of frame i * kIndexInterval
+    Bool            mReady;
+    Bool            mCancel;
+    // accessed by background job only
+    const UInt32    mCommonHead;
+    const Int64     mDataEnd;
+    sp<ABuffer>     mContent;       // content of its own
+    sp<IndexCache>  mCache;
+    Int64           mOffset;        // next frame to index
+    UInt32          mNumFrames;     // frames indexed
+
+    Mp3Index(UInt32 common, Int64 start, Int64 end) : SharedObject(),
+    mReady(False), mCancel(False), mCommonHead(common), mDataEnd(end),
+    mContent(Nil), mCache(Nil), mOffset(start), mNumFrames(0) { }
+    
+    void cancel() {
+        AutoLock _l(mLock);
+        mCancel = True;
+    }
+    
+    // find the last entry at or before frame
+    // @return False if frame is not indexed yet
+    Bool find(UInt32 frame, Int64 *offset, UInt32 *first) const {
+        AutoLock _l(mLock);
+        UInt32 i = frame / kIndexInterval;
+        if (i >= mEntries.size()) {
+            if (!mReady || mEntries.empty()) return False;
+            i = mEntries.size() - 1;
+        }
+        *offset = mEntries[i];
+        *first  = i * kIndexInterval;
+        return True;
+    }
+    
+    // index next kIndexFramesPerJob frames
+    // @return False if finished or cancelled
+    Bool scan() {
+        for (UInt32 i = 0; i < kIndexFramesPerJob; ++i) {
+            mContent->skipBytes(mOffset - mContent->offset());
+            UInt32 head;
+            ssize_t frameLength = readFrameHead(mContent, mCommonHead, mDataEnd, &head);
+            if (frameLength < 0) {
+                if (!resyncFrame(mContent, mCommonHead, mDataEnd)) return finish();
+                mOffset = mContent->offset();
+                continue;
+            }
+            
+            if ((mNumFrames % kIndexInterval) == 0) {
+                AutoLock _l(mLock);
+                if (mCancel) return False;
+                mEntries.push(mOffset);
+            }
+            ++mNumFrames;
+            mOffset += frameLength;
+        }
+        
+        AutoLock _l(mLock);
+        return !mCancel;
+    }
+    
+    Bool finish() {
+        {
+            AutoLock _l(mLock);
+            mReady = True;
+        }
+        INFO("%" PRIu32 " frames indexed", mNumFrames);
+        mContent.clear();
+        
+        if (mCache != Nil) {
+            IndexWriter writer;
+            writer.write<UInt32>(kIndexInterval);
+            writer.write(mNumFrames);
+            writer.write(mEntries);
+            mCache->put(kIndexTagMp3, writer.release());
+            mCache->commit();
+            mCache.clear();
+        }
+        return False;
+    }
+    
+    Bool restore(const sp<IndexCache>& cache) {
+        UInt32 length = 0;
+        const UInt8 * data = cache->find(kIndexTagMp3, &length);
+        if (data == Nil) return False;
+        
+        IndexReader reader(data, length);
+        UInt32 interval = 0;
+        reader.read(interval);
+        reader.read(mNumFrames);
+        reader.read(mEntries);
+        if (!reader.status() || interval != kIndexInterval) {
+            WARN("bad index cache, build index instead");
+            mEntries.clear();
+            mNumFrames = 0;
+            return False;
+        }
+        
+        mReady = True;
+        INFO("%" PRIu32 " frames restored from index cache", mNumFrames);
+        return True;
+    }
+};
+
+static Mutex sIndexWorkerLock;
+static UInt32 sIndexWorkerUsers = 0;
+static sp<Looper> sIndexWorker;
+
+// all files share one worker, jobs are interleaved by kIndexFramesPerJob.
+// worker is held by files building index, and terminated with the last one.
+static sp<Looper> AcquireIndexWorker() {
+    AutoLock _l(sIndexWorkerLock);
+    if (sIndexWorkerUsers++ == 0) {
+        sIndexWorker = new Looper("mp3-index");
+    }
+    return sIndexWorker;
+}
+
+static void ReleaseIndexWorker() {
+    sp<Looper> worker;
+    {
+        AutoLock _l(sIndexWorkerLock);
+        CHECK_GT(sIndexWorkerUsers, 0);
+        if (--sIndexWorkerUsers) return;
+        worker = sIndexWorker;
+        sIndexWorker.clear();
+    }
+    // outside of lock, as the running job may dispatch itself again
+    worker->terminate();
+}
+
+// @return Nil if no file is building index
+static sp<Looper> GetIndexWorker() {
+    AutoLock _l(sIndexWorkerLock);
+    return sIndexWorker;
+}
+
+struct Mp3IndexJob : public Job {
+    sp<Mp3Index>    mIndex;
+    
+    Mp3IndexJob(const sp<Mp3Index>& index) : Job(), mIndex(index) { }
+    
+    virtual void onJob() {
+        if (!mIndex->scan()) return;
+        sp<Looper> worker = GetIndexWorker();
+        if (!worker.isNil()) worker->dispatch(this);
+    }
+};
+
 struct Mp3File : public MediaDevice {
     sp<ABuffer>             mContent;
     Int64                 mFirstFrameOffset;
@@ -551,10 +757,13 @@ struct Mp3File : public MediaDevice {
 
     Vector<Int64>         mTOC;
 
-    MediaTime               mAnchorTime;
-
-    sp<MediaFrame>          mRawPacket;
-    sp<MediaDevice>         mPacketizer;
+    // frames are read one by one with length in its header
+    UInt32                  mCommonHead;
+    Int64                   mDataEnd;       // end of frames, excluding id3v1
+    MediaTime               mFrameTime;
+    MediaTime               mNextFrameTime;
+    sp<Mp3Index>            mIndex;         // Nil if url is not available
+    Bool                    mIndexing;      // index worker is acquired
     
     sp<Message>             mID3v1;
     sp<Message>             mID3v2;
@@ -566,15 +775,18 @@ struct Mp3File : public MediaDevice {
         mNumFrames(0),
         mNumBytes(0),
         mDuration(kMediaTimeInvalid),
-        mAnchorTime(0),
-        mRawPacket(Nil),
-        mPacketizer(new Mp3Packetizer) { }
+        mCommonHead(0),
+        mDataEnd(0),
+        mFrameTime(kMediaTimeInvalid),
+        mNextFrameTime(0),
+        mIndex(Nil),
+        mIndexing(False) { }
     
     // refer to:
     // 1. http://gabriel.mp3-tech.org/mp3infotag.html#versionstring
     // 2. http://www.codeproject.com/Articles/8295/MPEG-Audio-Frame-Header
     // 3. http://mpgedit.org/mpgedit/mpeg_format/mpeghdr.htm
-    virtual MediaError init(const sp<ABuffer>& buffer) {
+    virtual MediaError init(const sp<ABuffer>& buffer, const String& url, const sp<IndexCache>& cache) {
         CHECK_TRUE(buffer != 0);
 
         sp<Message> outputFormat    = new Message;
@@ -611,15 +823,19 @@ struct Mp3File : public MediaDevice {
         }
 
         // skip junk before first frame.
-        ssize_t result = locateFirstFrame(scanData, &mHeader, Nil, Nil);
+        UInt32 head = 0;
+        ssize_t result = locateFirstFrame(scanData, &mHeader, Nil, &head);
         if (result < 0) {
             ERROR("failed to locate the first frame.");
             return kMediaErrorBadFormat;
         } else if (result > 0) {
             DEBUG("%zu bytes junk data before first frame", (UInt32)result);
         }
-        buffer->skipBytes(-(buffer->offset() - result));
+        // result is relative to scan data, which starts after ID3v2
         mFirstFrameOffset += result;
+        buffer->skipBytes(mFirstFrameOffset - buffer->offset());
+        mCommonHead = head & kHeaderMask;
+        mFrameTime  = MediaTime(mHeader.samplesPerFrame, mHeader.sampleRate);
         DEBUG("mFirstFrameOffset = %" PRId64, mFirstFrameOffset);
 
         sp<Buffer> firstFrame = buffer->readBytes(mHeader.frameLengthInBytes);
@@ -629,8 +845,11 @@ struct Mp3File : public MediaDevice {
         }
         DEBUG("first frame size %zu", mHeader.frameLengthInBytes);
         
+        // ReadID3v1 leaves buffer at the end
+        const Int64 length = buffer->offset() + buffer->size();
         mID3v1 = ID3::ReadID3v1(buffer);
-        Int64 totalLength = buffer->size() - (mID3v1.isNil() ? 0 : ID3V1_LENGTH);
+        Int64 totalLength = length - (mID3v1.isNil() ? 0 : ID3V1_LENGTH);
+        mDataEnd = totalLength;
 
         // decode first frame
         const UInt32 offset = 4 + kSideInfoOffset[mHeader.Version == MPEG_VERSION_1 ? 0 : 1]
@@ -702,10 +921,35 @@ struct Mp3File : public MediaDevice {
         mContent = buffer;
 
         DEBUG("firstFrameOffset %" PRId64, mFirstFrameOffset);
+        
+        if (!url.equals("")) prepareIndex(url, cache);
         return kMediaNoError;
     }
+    
+    // restore index from cache, or build it in background
+    // with a content of its own.
+    void prepareIndex(const String& url, const sp<IndexCache>& cache) {
+        sp<Mp3Index> index = new Mp3Index(mCommonHead, mFirstFrameOffset, mDataEnd);
+        if (cache != Nil && index->restore(cache)) {
+            mIndex = index;
+            return;
+        }
+        
+        index->mContent = Content::Create(url);
+        if (index->mContent.isNil()) {
+            WARN("open %s failed, seek without index", url.c_str());
+            return;
+        }
+        index->mCache = cache;
+        mIndex = index;
+        mIndexing = True;
+        AcquireIndexWorker()->dispatch(new Mp3IndexJob(index));
+    }
 
-    virtual ~Mp3File() { }
+    virtual ~Mp3File() {
+        if (mIndex != Nil) mIndex->cancel();
+        if (mIndexing) ReleaseIndexWorker();
+    }
 
     virtual sp<Message> formats() const {
         sp<Message> info = new Message;
@@ -733,14 +977,19 @@ struct Mp3File : public MediaDevice {
     }
     
     void seek(Int64 us) {
+        if (mIndex != Nil && seekIndex(us)) return;
+        
+        const Int64 duration = mDuration.useconds();
+        if (us < 0) us = 0;
+        else if (us > duration) us = duration;
+        
         Int64 pos = 0;
-        Float64 percent   = us / mDuration.useconds();
-        if (percent < 0) percent = 0;
-        else if (percent > 1) percent = 1;
+        Float64 percent   = duration > 0 ? (Float64)us / duration : 0;
 
-        if (mTOC.size()) {
-            Float32 a = percent * (mTOC.size() - 1);
+        if (mTOC.size() > 1) {
+            Float64 a = percent * (mTOC.size() - 1);
             Int index = (Int)a;
+            if (index > (Int)mTOC.size() - 2) index = mTOC.size() - 2;
 
             Int64 fa  = mTOC[index];
             Int64 fb  = mTOC[index + 1];
@@ -755,75 +1004,84 @@ struct Mp3File : public MediaDevice {
         }
 
         DEBUG("seek to %" PRId64 " of %" PRId64, pos, mContent->size());
-        mContent->skipBytes(-(pos - mContent->offset()));
-        // TODO: calc anchor time by index.
-        mAnchorTime = us;
-        mAnchorTime.rescale(mHeader.sampleRate);
+        // pos may be inside a frame, pull() will resync.
+        mContent->skipBytes(pos - mContent->offset());
+        mNextFrameTime = us;
+        mNextFrameTime.rescale(mHeader.sampleRate);
+    }
+    
+    // seek to exact frame with index, frames after the index entry
+    // are skipped by frame headers.
+    Bool seekIndex(Int64 us) {
+        if (us < 0) us = 0;
+        const UInt32 frame = (us * mHeader.sampleRate) / (1000000LL * mHeader.samplesPerFrame);
+        Int64 offset;
+        UInt32 first;
+        if (!mIndex->find(frame, &offset, &first)) return False;
         
-        mPacketizer->reset();
+        mContent->skipBytes(offset - mContent->offset());
+        for (; first < frame; ++first) {
+            UInt32 head;
+            ssize_t frameLength = readFrameHead(mContent, mCommonHead, mDataEnd, &head);
+            if (frameLength < 0) break;     // pull() will resync
+            mContent->skipBytes(frameLength - 4);
+        }
+        
+        mNextFrameTime = MediaTime((Int64)first * mHeader.samplesPerFrame, mHeader.sampleRate);
+        DEBUG("seek to frame %" PRIu32 " @ %" PRId64, first, mContent->offset());
+        return True;
     }
     
     virtual MediaError push(const sp<MediaFrame>&) {
         return kMediaErrorInvalidOperation;
     }
 
+    // read frame by frame, each frame is read into packet directly.
     virtual sp<MediaFrame> pull() {
-        Bool sawInputEOS = False;
-        sp<MediaFrame> packet;
         for (;;) {
-            if (mRawPacket == 0 && !sawInputEOS) {
-                DEBUG("read content at %" PRId64 "/%" PRId64,
-                        mContent->offset(),
-                        mContent->size());
-                // mInternalBuffer must be twice of this
-                sp<Buffer> data = mContent->readBytes(2048);
-                if (data == Nil) {
-                    DEBUG("saw content eos..");
-                    sawInputEOS = True;
-                } else {
-                    mRawPacket = MediaFrame::Create(data);
-                }
-            }
-
-            if (sawInputEOS) {
-                DEBUG("flushing...");
-                mPacketizer->push(Nil);
-            } else if (mPacketizer->push(mRawPacket) == kMediaNoError) {
-                DEBUG("enqueue buffer done");
-                mRawPacket.clear();
-            }
-
-            packet = mPacketizer->pull();
-            if (packet == Nil) {
-                if (sawInputEOS) {
-                    break;
+            const Int64 offset = mContent->offset();
+            UInt32 head;
+            ssize_t frameLength = readFrameHead(mContent, mCommonHead, mDataEnd, &head);
+            if (frameLength < 0) {
+                if (!resyncFrame(mContent, mCommonHead, mDataEnd)) {
+                    INFO("eos...");
+                    return Nil;
                 }
                 continue;
-            } else {
-                break;
             }
+            
+            const UInt32 length = frameLength;
+            sp<MediaFrame> packet = MediaFrame::Create(length);
+            UInt8 * data = packet->planes.buffers[0].data;
+            data[0] = head >> 24;
+            data[1] = head >> 16;
+            data[2] = head >> 8;
+            data[3] = head;
+            if (mContent->readBytes((Char *)data + 4, length - 4) != length - 4) {
+                ERROR("read frame @ %" PRId64 " failed", offset);
+                return Nil;
+            }
+            
+            packet->planes.buffers[0].size  = length;
+            packet->timecode                = mNextFrameTime;
+            packet->duration                = mFrameTime;
+            packet->flags                   = kFrameTypeSync;
+            mNextFrameTime                  += mFrameTime;
+            
+            DEBUG("pull %s", packet->string().c_str());
+            return packet;
         }
-
-        if (packet == Nil) {
-            INFO("eos...");
-            return Nil;
-        }
-
-        packet->timecode += mAnchorTime;
-        DEBUG("pull %s", packet->string.c_str());
-        return packet;
     }
     
     virtual MediaError reset() {
-        mAnchorTime     = 0;
-        mPacketizer->reset();
+        mNextFrameTime  = 0;
         return kMediaNoError;
     }
 };
 
-sp<MediaDevice> CreateMp3File(const sp<ABuffer>& buffer) {
+sp<MediaDevice> CreateMp3File(const sp<ABuffer>& buffer, const String& url, const sp<IndexCache>& cache) {
     sp<Mp3File> file = new Mp3File;
-    if (file->init(buffer) == kMediaNoError) return file;
+    if (file->init(buffer, url, cache) == kMediaNoError) return file;
     return Nil;
 }
 
@@ -163,6 +163,77 @@ MediaError ContainerBox::_parse(const sp<ABuffer>& buffer, const sp<FileTypeBox>
 }
 void ContainerBox::compose(sp<ABuffer>&, const sp<FileTypeBox>&) { }
 
+UInt32 ContainerBox::typeAt(UInt32 i) const {
+    if (slices.size()) return slices[i].type;
+    return child[i]->Type;
+}
+
+sp<Box> ContainerBox::at(UInt32 i) {
+    if (child[i] != Nil || slices.empty()) return child[i];
+    
+    const Slice& slice = slices[i];
+    sp<Box> box = MakeBoxByType(slice.type);
+    if (box == Nil) return Nil;
+    
+    MediaError st;
+    if (box->Class & kBoxLazy) {
+        sp<LazyContainerBox> container = box;
+        st = container->load(source, slice.offset, slice.length, filetype);
+    } else {
+        source->resetBytes();
+        source->skipBytes(slice.offset);
+        st = box->parse(source->readBytes(slice.length), filetype);
+    }
+    
+    if (st != kMediaNoError) {
+        ERROR("box %s:  + parse %s failed", Name.c_str(), BOXNAME(slice.type));
+        return Nil;
+    }
+    child[i] = box;
+    return box;
+}
+
+MediaError LazyContainerBox::parse(const sp<ABuffer>& buffer, const sp<FileTypeBox>& ftyp) {
+    return load(buffer, buffer->offset(), buffer->size(), ftyp);
+}
+
+MediaError LazyContainerBox::load(const sp<ABuffer>& buffer, Int64 offset, Int64 length, const sp<FileTypeBox>& ftyp) {
+    source      = buffer;
+    filetype    = ftyp;
+    
+    source->resetBytes();
+    source->skipBytes(offset);
+    Box::parse(source, ftyp);
+    
+    // only box heads are read here, @see ContainerBox::_parse
+    const Int64 end = offset + length;
+    while (source->offset() + 8 <= end) {
+        UInt32 boxSize    = source->rb32();
+        UInt32 boxType    = source->rb32();
+        DEBUG("box %s:  + %s %" PRIu32, Name.c_str(), BOXNAME(boxType), boxSize);
+        
+        // mov terminator box
+        if (boxType == kBoxTerminator && boxSize == 8) break;
+        
+        if (boxSize < 8 || source->offset() + boxSize - 8 > end) {
+            ERROR("box %s:  + broken box %s", Name.c_str(), BOXNAME(boxType));
+            break;
+        }
+        
+        boxSize     -= 8;
+        // this exists in mov
+        if (boxSize == 0) continue;
+        
+        Slice slice = { boxType, source->offset(), boxSize };
+        slices.push(slice);
+        child.push(Nil);
+        source->skipBytes(boxSize);
+    }
+    
+    DEBUGV("box %s: + child.size() = %zu", Name.c_str(), child.size());
+    return kMediaNoError;
+}
+
 typedef sp<Box> (*create_t)();
 static HashTable<UInt32, create_t> sRegister;
 struct RegisterHelper {
@@ -265,7 +336,9 @@ MediaError TrackHeaderBox::parse(const sp<ABuffer>& buffer, const sp<FileTypeBox
     alternate_group = buffer->rb16();
     volume          = buffer->rb16();
     buffer->skip(16);
-    buffer->skip(32 * 9);
+    for (UInt32 i = 0; i < 9; ++i) {
+        matrix[i]   = buffer->rb32();
+    }
     width           = buffer->rb32();
     height          = buffer->rb32();
 
@@ -635,13 +708,13 @@ MediaError SampleSizeBox::parse(const sp<ABuffer>& buffer, const sp<FileTypeBox>
         buffer->skip(24);            //reserved
         UInt8 field_size      = buffer->r8();
         sample_size             = 0; // always 0
-        UInt32 sample_count     = buffer->rb32();
+        sample_count            = buffer->rb32();
         for (UInt32 i = 0; i < sample_count; i++) {
             entries.push(buffer->read(field_size));
         }
     } else {
         sample_size             = buffer->rb32();
-        UInt32 sample_count     = buffer->rb32();
+        sample_count            = buffer->rb32();
         if (sample_size == 0) {
             for (UInt32 i = 0; i < sample_count; i++) {
                 entries.push(buffer->rb32());
@@ -654,7 +727,7 @@ MediaError SampleSizeBox::parse(const sp<ABuffer>& buffer, const sp<FileTypeBox>
 
 #if 1
     for (UInt32 i = 0; i < entries.size(); ++i) {
-        DEBUGV("box %s: %" PRIu64, Name.c_str(), entries[i]);
+        DEBUGV("box %s: %" PRIu32, Name.c_str(), entries[i]);
     }
 #endif 
     return kMediaNoError;
@@ -766,13 +839,14 @@ MediaError EditListBox::parse(const sp<ABuffer>& buffer, const sp<FileTypeBox>&
             e.media_time          = buffer->rb64();
         } else {
             e.segment_duration    = buffer->rb32();
-            e.media_time          = buffer->rb32();
+            e.media_time          = (Int32)buffer->rb32();  // -1 for empty edit
         }
         e.media_rate_integer      = buffer->rb16();
         e.media_rate_fraction     = buffer->rb16();
         DEBUGV("box %s: %" PRIu64 ", %" PRId64 ", %" PRIu16 ", %" PRIu16, 
                 Name.c_str(), e.segment_duration, e.media_time,
                 e.media_rate_integer, e.media_rate_fraction);
+        entries.push(e);
     };
     return kMediaNoError;
 }
@@ -822,15 +896,120 @@ void MovieFragmentHeaderBox::compose(sp<ABuffer>& buffer, const sp<FileTypeBox>&
 MediaError TrackFragmentHeaderBox::parse(const sp<ABuffer>& buffer, const sp<FileTypeBox>& ftyp) {
     Box::parse(buffer, ftyp);
     track_ID    = buffer->rb32();
-    if (Flags & 0x1)    base_data_offset            = buffer->rb32();
-    if (Flags & 0x2)    sample_description_index    = buffer->rb64();
-    if (Flags & 0x8)    default_sample_duration     = buffer->rb32();
-    if (Flags & 0x10)   default_sample_size         = buffer->rb32();
-    if (Flags & 0x20)   default_sample_flags        = buffer->rb32();
+    base_data_offset            = 0;
+    sample_description_index    = 0;
+    default_sample_duration     = 0;
+    default_sample_size         = 0;
+    default_sample_flags        = 0;
+    if (Flags & Base_data_offset_present)           base_data_offset            = buffer->rb64();
+    if (Flags & Sample_description_index_present)   sample_description_index    = buffer->rb32();
+    if (Flags & Default_sample_duration_present)    default_sample_duration     = buffer->rb32();
+    if (Flags & Default_sample_size_present)        default_sample_size         = buffer->rb32();
+    if (Flags & Default_sample_flags_present)       default_sample_flags        = buffer->rb32();
     return kMediaNoError;
 }
 void TrackFragmentHeaderBox::compose(sp<ABuffer>& buffer, const sp<FileTypeBox>& ftyp) { }
 
+MediaError TrackRunBox::parse(const sp<ABuffer>& buffer, const sp<FileTypeBox>& ftyp) {
+    Box::parse(buffer, ftyp);
+    UInt32 count        = buffer->rb32();
+    data_offset         = 0;
+    first_sample_flags  = 0;
+    if (Flags & Data_offset_present)        data_offset         = (Int32)buffer->rb32();
+    if (Flags & First_sample_flags_present) first_sample_flags  = buffer->rb32();
+    for (UInt32 i = 0; i < count; ++i) {
+        // missing fields are filled with defaults by user
+        Entry e = { 0, 0, 0, 0 };
+        if (Flags & Sample_duration_present)    e.sample_duration   = buffer->rb32();
+        if (Flags & Sample_size_present)        e.sample_size       = buffer->rb32();
+        if (Flags & Sample_flags_present)       e.sample_flags      = buffer->rb32();
+        // Version 0 is UInt32, but small enough to read as Int32, @see CompositionOffsetBox
+        if (Flags & Sample_composition_time_offsets_present)
+            e.sample_composition_time_offset    = (Int32)buffer->rb32();
+        entries.push(e);
+    }
+    DEBUGV("box %s: %zu samples, data offset %" PRId32,
+            Name.c_str(), entries.size(), data_offset);
+    return kMediaNoError;
+}
+void TrackRunBox::compose(sp<ABuffer>& buffer, const sp<FileTypeBox>& ftyp) { }
+
+MediaError TrackFragmentBaseMediaDecodeTimeBox::parse(const sp<ABuffer>& buffer, const sp<FileTypeBox>& ftyp) {
+    Box::parse(buffer, ftyp);
+    if (Version == 1) {
+        baseMediaDecodeTime = buffer->rb64();
+    } else {
+        baseMediaDecodeTime = buffer->rb32();
+    }
+    return kMediaNoError;
+}
+void TrackFragmentBaseMediaDecodeTimeBox::compose(sp<ABuffer>& buffer, const sp<FileTypeBox>& ftyp) { }
+
+MediaError SegmentIndexBox::parse(const sp<ABuffer>& buffer, const sp<FileTypeBox>& ftyp) {
+    Box::parse(buffer, ftyp);
+    reference_ID    = buffer->rb32();
+    timescale       = buffer->rb32();
+    if (Version == 0) {
+        earliest_presentation_time  = buffer->rb32();
+        first_offset                = buffer->rb32();
+    } else {
+        earliest_presentation_time  = buffer->rb64();
+        first_offset                = buffer->rb64();
+    }
+    buffer->skip(16);   // reserved
+    UInt16 count    = buffer->rb16();
+    for (UInt16 i = 0; i < count; ++i) {
+        Entry e;
+        UInt32 v                = buffer->rb32();
+        e.reference_type        = v >> 31;
+        e.referenced_size       = v & 0x7fffffff;
+        e.subsegment_duration   = buffer->rb32();
+        v                       = buffer->rb32();
+        e.starts_with_SAP       = v >> 31;
+        e.SAP_type              = (v >> 28) & 0x7;
+        e.SAP_delta_time        = v & 0x0fffffff;
+        entries.push(e);
+    }
+    DEBUGV("box %s: %zu references, timescale %" PRIu32,
+            Name.c_str(), entries.size(), timescale);
+    return kMediaNoError;
+}
+void SegmentIndexBox::compose(sp<ABuffer>& buffer, const sp<FileTypeBox>& ftyp) { }
+
+MediaError TrackFragmentRandomAccessBox::parse(const sp<ABuffer>& buffer, const sp<FileTypeBox>& ftyp) {
+    Box::parse(buffer, ftyp);
+    track_ID        = buffer->rb32();
+    UInt32 v        = buffer->rb32();
+    // 26 bits reserved
+    const UInt32 traf_bytes     = ((v >> 4) & 0x3) + 1;
+    const UInt32 trun_bytes     = ((v >> 2) & 0x3) + 1;
+    const UInt32 sample_bytes   = (v & 0x3) + 1;
+    UInt32 count    = buffer->rb32();
+    for (UInt32 i = 0; i < count; ++i) {
+        Entry e;
+        if (Version == 1) {
+            e.time          = buffer->rb64();
+            e.moof_offset   = buffer->rb64();
+        } else {
+            e.time          = buffer->rb32();
+            e.moof_offset   = buffer->rb32();
+        }
+        e.traf_number       = buffer->read(traf_bytes * 8);
+        e.trun_number       = buffer->read(trun_bytes * 8);
+        e.sample_number     = buffer->read(sample_bytes * 8);
+        entries.push(e);
+    }
+    return kMediaNoError;
+}
+void TrackFragmentRandomAccessBox::compose(sp<ABuffer>& buffer, const sp<FileTypeBox>& ftyp) { }
+
+MediaError MovieFragmentRandomAccessOffsetBox::parse(const sp<ABuffer>& buffer, const sp<FileTypeBox>& ftyp) {
+    Box::parse(buffer, ftyp);
+    size            = buffer->rb32();
+    return kMediaNoError;
+}
+void MovieFragmentRandomAccessOffsetBox::compose(sp<ABuffer>& buffer, const sp<FileTypeBox>& ftyp) { }
+
 MediaError PrimaryItemBox::parse(const sp<ABuffer>& buffer, const sp<FileTypeBox>& ftyp) {
     Box::parse(buffer, ftyp);
     item_ID     = buffer->rb16();
@@ -1033,6 +1212,11 @@ RegisterBox(kBoxTypeMEHD, MovieExtendsHeaderBox);
 RegisterBox(kBoxTypeTREX, TrackExtendsBox);
 RegisterBox(kBoxTypeMFHD, MovieFragmentHeaderBox);
 RegisterBox(kBoxTypeTFHD, TrackFragmentHeaderBox);
+RegisterBox(kBoxTypeTRUN, TrackRunBox);
+RegisterBox(kBoxTypeTFDT, TrackFragmentBaseMediaDecodeTimeBox);
+RegisterBox(kBoxTypeSIDX, SegmentIndexBox);
+RegisterBox(kBoxTypeTFRA, TrackFragmentRandomAccessBox);
+RegisterBox(kBoxTypeMFRO, MovieFragmentRandomAccessOffsetBox);
 RegisterBox(kBoxTypePITM, PrimaryItemBox);
 RegisterBox(kBoxTypeCTRY, CountryListBox);
 RegisterBox(kBoxTypeLANG, LanguageListBox);
@@ -1050,6 +1234,7 @@ RegisterBox(kBoxTypeUDTA, UserDataBox);
 RegisterBox(kBoxTypeMVEX, MovieExtendsBox);
 RegisterBox(kBoxTypeMOOF, MovieFragmentBox);
 RegisterBox(kBoxTypeTRAF, TrackFragmentBox);
+RegisterBox(kBoxTypeMFRA, MovieFragmentRandomAccessBox);
 RegisterBox(kBoxTypeSTSD, SampleDescriptionBox);
 RegisterBox(kBoxTypeHINT, TrackReferenceHintBox);
 RegisterBox(kBoxTypeCDSC, TrackReferenceCdscBox);
@@ -1144,6 +1329,12 @@ IgnoreBox('frma', SoundFormatBox);
 IgnoreBox('mebx', TimedMetadataSampleDescriptionBox);
 IgnoreBox('wide', WideBox);
 IgnoreBox('uuid', UUIDBox);
+// fragments
+IgnoreBox(kBoxTypeSTYP, SegmentTypeBox);
+IgnoreBox(kBoxTypePRFT, ProducerReferenceTimeBox);
+IgnoreBox(kBoxTypeSBGP, SampleToGroupBox);
+IgnoreBox(kBoxTypeSAIZ, SampleAuxiliaryInformationSizesBox);
+IgnoreBox(kBoxTypeSAIO, SampleAuxiliaryInformationOffsetsBox);
 #undef IgnoreBox
 
 RegisterBox(kBoxTypeMDAT, MediaDataBox);
@@ -1257,9 +1448,8 @@ Bool CheckTrackBox(const sp<TrackBox>& trak) {
 // find box in current container only
 sp<Box> FindBox(const sp<ContainerBox>& root, UInt32 boxType, UInt32 index) {
     for (UInt32 i = 0; i < root->child.size(); i++) {
-        sp<Box> box = root->child[i];
-        if (box->Type == boxType) {
-            if (index == 0) return box;
+        if (root->typeAt(i) == boxType) {
+            if (index == 0) return root->at(i);
             else --index;
         }
     }
@@ -1268,9 +1458,9 @@ sp<Box> FindBox(const sp<ContainerBox>& root, UInt32 boxType, UInt32 index) {
 
 sp<Box> FindBox2(const sp<ContainerBox>& root, UInt32 first, UInt32 second) {
     for (UInt32 i = 0; i < root->child.size(); i++) {
-        sp<Box> box = root->child[i];
-        if (box->Type == first || box->Type == second) {
-            return box;
+        const UInt32 type = root->typeAt(i);
+        if (type == first || type == second) {
+            return root->at(i);
         }
     }
     return Nil;
@@ -1294,7 +1484,8 @@ static void PrintBox(const sp<Box>& box, UInt32 n) {
     if (box->Class & kBoxContainer) {
         sp<ContainerBox> c = box;
         for (UInt32 i = 0; i < c->child.size(); ++i) {
-            PrintBox(c->child[i], n);
+            sp<Box> sub = c->at(i);     // parse all, debug only
+            if (sub != Nil) PrintBox(sub, n);
         }
     }
 }
@@ -170,6 +170,7 @@ const Char * BoxName(UInt32);
 enum {
     kBoxFull        = 0x1,
     kBoxContainer   = 0x2,
+    kBoxLazy        = 0x4,  // children are parsed on demand, @see LazyContainerBox
 };
 
 // ISO/IEC 14496-12: Section 4.2 Object Structure, Page 11
@@ -210,7 +211,7 @@ struct FullBox : public Box {
 
 struct ContainerBox : public Box {
     const Bool          counted;
-    Vector<sp<Box> >    child;
+    Vector<sp<Box> >    child;      ///< Nil if not parsed yet, @see at()
     
     FORCE_INLINE ContainerBox(UInt32 type, UInt8 cls = 0, Bool cnt = False) :
     Box(type, kBoxContainer | cls), counted(cnt) { }
@@ -218,6 +219,33 @@ struct ContainerBox : public Box {
     virtual MediaError parse(const sp<ABuffer>& buffer, const sp<FileTypeBox>&);
     virtual MediaError _parse(const sp<ABuffer>& buffer, const sp<FileTypeBox>&);
     virtual void compose(sp<ABuffer>&, const sp<FileTypeBox>&);
+    
+    // type of child i, without parsing it
+    UInt32              typeAt(UInt32 i) const;
+    // child i, parse it on demand
+    sp<Box>             at(UInt32 i);
+    
+    struct Slice {
+        UInt32          type;
+        Int64           offset;     // offset of child payload in source
+        Int64           length;     // child payload length
+    };
+    sp<ABuffer>         source;     // buffer holds children payload
+    sp<FileTypeBox>     filetype;
+    Vector<Slice>       slices;     // empty if children are parsed in place
+};
+
+/**
+ * container which only remembers where its children are,
+ * children are parsed when FindBox asks for them.
+ * nested lazy containers share the same source buffer without copy,
+ * so only the leaf boxes that are really used will be copied and parsed.
+ */
+struct LazyContainerBox : public ContainerBox {
+    FORCE_INLINE LazyContainerBox(UInt32 type) : ContainerBox(type, kBoxLazy) { }
+    FORCE_INLINE virtual ~LazyContainerBox() { }
+    virtual MediaError parse(const sp<ABuffer>& buffer, const sp<FileTypeBox>&);
+    MediaError load(const sp<ABuffer>& source, Int64 offset, Int64 length, const sp<FileTypeBox>&);
 };
 
 struct FullContainerBox : public ContainerBox {
@@ -288,18 +316,18 @@ struct CountedFullContainerBox : public ContainerBox {
 //  |- meta!
 #define BOX_TYPE(NAME, BOX, BASE)  struct BOX : public BASE { FORCE_INLINE BOX() : BASE(NAME) { } };
 
-BOX_TYPE(kBoxTypeMOOV,  MovieBox,               ContainerBox);
-BOX_TYPE(kBoxTypeTRAK,  TrackBox,               ContainerBox);
-BOX_TYPE(kBoxTypeMDIA,  MediaBox,               ContainerBox);
-BOX_TYPE(kBoxTypeMINF,  MediaInformationBox,    ContainerBox);
-BOX_TYPE(kBoxTypeDINF,  DataInformationBox,     ContainerBox);
-BOX_TYPE(kBoxTypeSTBL,  SampleTableBox,         ContainerBox);
-
-BOX_TYPE(kBoxTypeEDTS,  EditBox,                ContainerBox);
-BOX_TYPE(kBoxTypeUDTA,  UserDataBox,            ContainerBox);
-BOX_TYPE(kBoxTypeMVEX,  MovieExtendsBox,        ContainerBox);
-BOX_TYPE(kBoxTypeMOOF,  MovieFragmentBox,       ContainerBox);
-BOX_TYPE(kBoxTypeTRAF,  TrackFragmentBox,       ContainerBox);
+BOX_TYPE(kBoxTypeMOOV,  MovieBox,               LazyContainerBox);
+BOX_TYPE(kBoxTypeTRAK,  TrackBox,               LazyContainerBox);
+BOX_TYPE(kBoxTypeMDIA,  MediaBox,               LazyContainerBox);
+BOX_TYPE(kBoxTypeMINF,  MediaInformationBox,    LazyContainerBox);
+BOX_TYPE(kBoxTypeDINF,  DataInformationBox,     LazyContainerBox);
+BOX_TYPE(kBoxTypeSTBL,  SampleTableBox,         LazyContainerBox);
+
+BOX_TYPE(kBoxTypeEDTS,  EditBox,                LazyContainerBox);
+BOX_TYPE(kBoxTypeUDTA,  UserDataBox,            LazyContainerBox);
+BOX_TYPE(kBoxTypeMVEX,  MovieExtendsBox,        LazyContainerBox);
+BOX_TYPE(kBoxTypeMOOF,  MovieFragmentBox,       LazyContainerBox);
+BOX_TYPE(kBoxTypeTRAF,  TrackFragmentBox,       LazyContainerBox);
 BOX_TYPE(kBoxTypeDREF,  DataReferenceBox,       CountedFullContainerBox);
 BOX_TYPE(kBoxTypeSTSD,  SampleDescriptionBox,   CountedFullContainerBox);
 
@@ -344,6 +372,7 @@ struct TrackHeaderBox : public FullBox {
     UInt16    layer;
     UInt16    alternate_group;
     UInt16    volume;
+    Int32     matrix[9];          ///< transformation matrix, @see MPEG4::GetMatrixRotation
     UInt32    width;
     UInt32    height;
     
@@ -353,7 +382,7 @@ struct TrackHeaderBox : public FullBox {
 
 };
 
-BOX_TYPE(kBoxTypeTREF, TrackReferenceBox,     ContainerBox);
+BOX_TYPE(kBoxTypeTREF, TrackReferenceBox,     LazyContainerBox);
 struct TrackReferenceTypeBox : public Box {
     Vector<UInt32>    track_IDs;
 
@@ -711,7 +740,8 @@ struct BitRateBox : public Box {
 // unified SampleSizeBox & CompactSampleSizeBox
 struct SampleSizeBox : public FullBox {
     UInt32              sample_size;
-    Vector<UInt64>      entries;
+    UInt32              sample_count;
+    Vector<UInt32>      entries;        ///< empty if sample_size != 0
     
     FORCE_INLINE SampleSizeBox(UInt32 type) : FullBox(type) { }
     MediaError parse(const sp<ABuffer>& buffer, const sp<FileTypeBox>&);
@@ -864,6 +894,19 @@ struct MovieFragmentHeaderBox : public FullBox {
 };
 
 struct TrackFragmentHeaderBox : public FullBox {
+    /**
+     * flag value of tfhd
+     */
+    enum {
+        Base_data_offset_present            = 0x000001,
+        Sample_description_index_present    = 0x000002,
+        Default_sample_duration_present     = 0x000008,
+        Default_sample_size_present         = 0x000010,
+        Default_sample_flags_present        = 0x000020,
+        Duration_is_empty                   = 0x010000,
+        Default_base_is_moof                = 0x020000,
+    };
+    
     UInt32      track_ID;
     UInt64      base_data_offset;
     UInt32      sample_description_index;
@@ -876,6 +919,88 @@ struct TrackFragmentHeaderBox : public FullBox {
     void compose(sp<ABuffer>&, const sp<FileTypeBox>&);
 };
 
+struct TrackRunBox : public FullBox {
+    /**
+     * flag value of trun
+     */
+    enum {
+        Data_offset_present                     = 0x000001,
+        First_sample_flags_present              = 0x000004,
+        Sample_duration_present                 = 0x000100,
+        Sample_size_present                     = 0x000200,
+        Sample_flags_present                    = 0x000400,
+        Sample_composition_time_offsets_present = 0x000800,
+    };
+    
+    struct Entry {
+        UInt32          sample_duration;
+        UInt32          sample_size;
+        UInt32          sample_flags;
+        Int32           sample_composition_time_offset;
+    };
+    Int32           data_offset;
+    UInt32          first_sample_flags;
+    Vector<Entry>   entries;
+    
+    FORCE_INLINE TrackRunBox() : FullBox(kBoxTypeTRUN) { }
+    MediaError parse(const sp<ABuffer>& buffer, const sp<FileTypeBox>&);
+    void compose(sp<ABuffer>&, const sp<FileTypeBox>&);
+};
+
+struct TrackFragmentBaseMediaDecodeTimeBox : public FullBox {
+    UInt64      baseMediaDecodeTime;
+    
+    FORCE_INLINE TrackFragmentBaseMediaDecodeTimeBox() : FullBox(kBoxTypeTFDT) { }
+    MediaError parse(const sp<ABuffer>& buffer, const sp<FileTypeBox>&);
+    void compose(sp<ABuffer>&, const sp<FileTypeBox>&);
+};
+
+// ISO/IEC 14496-12: Section 8.16.3 Segment Index Box
+struct SegmentIndexBox : public FullBox {
+    struct Entry {
+        UInt8           reference_type;     // 1: reference to sidx, 0: to moof
+        UInt32          referenced_size;
+        UInt32          subsegment_duration;
+        UInt8           starts_with_SAP;
+        UInt8           SAP_type;
+        UInt32          SAP_delta_time;
+    };
+    UInt32          reference_ID;
+    UInt32          timescale;
+    UInt64          earliest_presentation_time;
+    UInt64          first_offset;
+    Vector<Entry>   entries;
+    
+    FORCE_INLINE SegmentIndexBox() : FullBox(kBoxTypeSIDX) { }
+    MediaError parse(const sp<ABuffer>& buffer, const sp<FileTypeBox>&);
+    void compose(sp<ABuffer>&, const sp<FileTypeBox>&);
+};
+
+BOX_TYPE(kBoxTypeMFRA,  MovieFragmentRandomAccessBox,   LazyContainerBox);
+struct TrackFragmentRandomAccessBox : public FullBox {
+    struct Entry {
+        UInt64          time;
+        UInt64          moof_offset;
+        UInt32          traf_number;
+        UInt32          trun_number;
+        UInt32          sample_number;
+    };
+    UInt32          track_ID;
+    Vector<Entry>   entries;
+    
+    FORCE_INLINE TrackFragmentRandomAccessBox() : FullBox(kBoxTypeTFRA) { }
+    MediaError parse(const sp<ABuffer>& buffer, const sp<FileTypeBox>&);
+    void compose(sp<ABuffer>&, const sp<FileTypeBox>&);
+};
+
+struct MovieFragmentRandomAccessOffsetBox : public FullBox {
+    UInt32      size;
+    
+    FORCE_INLINE MovieFragmentRandomAccessOffsetBox() : FullBox(kBoxTypeMFRO) { }
+    MediaError parse(const sp<ABuffer>& buffer, const sp<FileTypeBox>&);
+    void compose(sp<ABuffer>&, const sp<FileTypeBox>&);
+};
+
 struct PrimaryItemBox : public FullBox {
     UInt16      item_ID;
 
@@ -40,7 +40,10 @@
 #include "Video.h"
 #include "id3/ID3.h"
 #include "Box.h"
+#include "SampleTable.h"
 #include "MediaDevice.h"
+#include "IndexCache.h"
+#include "ContentFollower.h"
 
 
 // reference: 
@@ -53,6 +56,12 @@ __BEGIN_NAMESPACE_MFWK
 
 using namespace MPEG4;
 
+// samples are read through a window, so adjacent samples
+// from all tracks are served by one read
+#define kReadWindowLength   (512 * 1024)
+// chunk tag in index cache
+#define kIndexTagMp4        FOURCC('mp4 ')
+
 struct {
     const UInt32        type;
     const UInt32        format;
@@ -90,31 +99,30 @@ static MediaError prepareMetaData(const sp<Box>& meta, const sp<Message>& target
     return kMediaNoError;
 }
 
-struct Sample {
-    UInt64              offset;
-    UInt32              size;   // in bytes
-    Int64               dts;
-    Int64               pts;
-    UInt32              flags;
-};
-
 struct Mp4Track : public SharedObject {
     Mp4Track() : enabled(True), type(kCodecTypeUnknown), codec(0), duration(kMediaTimeInvalid),
-    sampleIndex(0), startIndex(0), bitReate(0), samplesRead(0) { }
+    sampleTable(Nil), startTime(0), editStart(0), editEnd(-1), editOffset(0), bitReate(0), trackID(0), trex(Nil),
+    fragmentIndex(0), fragmentFirst(0), fragmentDts(0), samplesRead(0) { }
 
     Bool                enabled;    // enabled by default
     eCodecType          type;
     UInt32              codec;  // eAudioCodec|eVideoCodec
     MediaTime           duration;
-    UInt32              sampleIndex;
-    UInt32              startIndex;
-    Vector<Sample>      sampleTable;
+    sp<SampleTable>     sampleTable;
+    SampleCursor        cursor;     // next sample to read
+    Int64               startTime;  // samples present before this are not output
+    // edit list, in track's timescale
+    Int64               editStart;  // media time of the edit
+    Int64               editEnd;    // media time where the edit ends, -1 if not limited
+    Int64               editOffset; // presentation time of editStart, by empty edits
     Int32               bitReate;
 
     union {
         struct {
             Int32       width;
             Int32       height;
+            eRotate     rotate;
+            eFlip       flip;
         } video;
         struct {
             Int32       sampleRate;
@@ -127,8 +135,20 @@ struct Mp4Track : public SharedObject {
         UInt8           lengthSizeMinusOne;     // for h264, @see AVCDecoderConfigurationRecord.lengthSizeMinusOne
     };
     
+    // fragmented mp4
+    UInt32              trackID;
+    sp<TrackExtendsBox> trex;
+    Vector<Sample>      fragment;       // samples of loaded fragments
+    UInt32              fragmentIndex;  // next sample in fragment
+    UInt32              fragmentFirst;  // sample index of fragment[0]
+    Int64               fragmentDts;    // dts of next fragment sample
+    
     // statistics
     UInt32              samplesRead;
+    
+    // convert between presentation time and media time by edit list
+    FORCE_INLINE Int64 mediaTime(Int64 t) const         { return t - editOffset + editStart; }
+    FORCE_INLINE Int64 presentationTime(Int64 t) const  { return t - editStart + editOffset; }
 };
 
 static sp<Mp4Track> prepareTrack(const sp<TrackBox>& trak, const sp<MovieHeaderBox>& mvhd) {
@@ -145,16 +165,11 @@ static sp<Mp4Track> prepareTrack(const sp<TrackBox>& trak, const sp<MovieHeaderB
     sp<DataReferenceBox> dinf           = FindBox(minf, kBoxTypeDINF);
     sp<SampleTableBox> stbl             = FindBox(minf, kBoxTypeSTBL);
     sp<SampleDescriptionBox> stsd       = FindBox(stbl, kBoxTypeSTSD);
-    sp<TimeToSampleBox> stts            = FindBox(stbl, kBoxTypeSTTS);    // dts
-    sp<SampleToChunkBox> stsc           = FindBox(stbl, kBoxTypeSTSC);    // sample to chunk
-    sp<ChunkOffsetBox> stco             = FindBox2(stbl, kBoxTypeSTCO, kBoxTypeCO64);    // chunk offset
-    sp<SampleSizeBox> stsz              = FindBox2(stbl, kBoxTypeSTSZ, kBoxTypeSTZ2);
     // optional
     sp<SyncSampleBox> stss              = FindBox(stbl, kBoxTypeSTSS);
     sp<ShadowSyncSampleBox> stsh        = FindBox(stbl, kBoxTypeSTSH);
     sp<CompositionOffsetBox> ctts       = FindBox(stbl, kBoxTypeCTTS);
     sp<TrackReferenceBox> tref          = FindBox(trak, kBoxTypeTREF);
-    sp<SampleDependencyTypeBox> sdtp    = FindBox(stbl, kBoxTypeSDTP);
 
     // check
     if (stsd->child.size() == 0) {
@@ -169,6 +184,47 @@ static sp<Mp4Track> prepareTrack(const sp<TrackBox>& trak, const sp<MovieHeaderB
     sp<Mp4Track> track = new Mp4Track;
     track->duration = MediaTime(mdhd->duration, mdhd->timescale);
 
+    // ISO/IEC 14496-12:2015 Section 8.6.6
+    //  empty edits followed by one edit, e.g. encoder delay & padding
+    sp<EditListBox> elst = FindBoxInside(trak, kBoxTypeEDTS, kBoxTypeELST);
+    if (elst != Nil && mvhd->timescale) {
+        const Vector<EditListBox::Entry>& edits = elst->entries;
+        UInt32 i = 0;
+        for (; i < edits.size() && edits[i].media_time == -1; ++i) {
+            track->editOffset += (edits[i].segment_duration * mdhd->timescale) / mvhd->timescale;
+        }
+        if (i < edits.size()) {
+            const EditListBox::Entry& e = edits[i];
+            if (e.media_rate_integer != 1) {
+                WARN("edit with media rate %" PRIu16 " is not supported", e.media_rate_integer);
+            }
+            track->editStart = e.media_time;
+            // segment_duration is 0 for fragmented files without mehd
+            if (e.segment_duration) {
+                track->editEnd = e.media_time + (e.segment_duration * mdhd->timescale) / mvhd->timescale;
+                track->duration = MediaTime(track->editOffset + track->editEnd - track->editStart,
+                                            mdhd->timescale);
+            }
+            if (i + 1 < edits.size()) {
+                WARN("%zu edits after the first one are ignored", edits.size() - i - 1);
+            }
+        }
+        INFO("edit: [%" PRId64 " - %" PRId64 "] @ %" PRId64,
+             track->editStart, track->editEnd, track->editOffset);
+    }
+
+    const Time now = Time::Now();
+    // samples are resolved lazily from stts/ctts/stsc/stco/stsz/stss/sdtp
+    track->sampleTable = SampleTable::Create(stbl);
+    if (track->sampleTable == Nil) {
+        ERROR("bad sample table");
+        return Nil;
+    }
+    track->sampleTable->locate(0, track->cursor);
+    track->trackID          = tkhd->track_ID;
+    track->fragmentFirst    = track->sampleTable->count();
+    DEBUG("init sample table takes %.2f", (Time::Now() - now) / 1E6);
+
     DEBUG("handler: [%.4s] %s", BoxName(hdlr->handler_type),
           hdlr->handler_name.c_str());
 
@@ -193,6 +249,9 @@ static sp<Mp4Track> prepareTrack(const sp<TrackBox>& trak, const sp<MovieHeaderB
         track->type = kCodecTypeVideo;
         track->video.width = sampleEntry->visual.width;
         track->video.height = sampleEntry->visual.height;
+        if (!GetMatrixRotation(tkhd->matrix, &track->video.rotate, &track->video.flip)) {
+            WARN("unsupported tkhd matrix, ignore it");
+        }
     }
 
     for (UInt32 i = 0; i < sampleEntry->child.size(); ++i) {
@@ -223,108 +282,13 @@ static sp<Mp4Track> prepareTrack(const sp<TrackBox>& trak, const sp<MovieHeaderB
     }
 
     // FIXME: no-output sample
-    const Time now = Time::Now();
-    
-    // init sampleTable with dts
-    UInt64 dts = 0;
-    for (UInt32 i = 0; i < stts->entries.size(); ++i) {
-        for (UInt32 j = 0; j < stts->entries[i].sample_count; ++j) {
-            // ISO/IEC 14496-12:2015 Section 8.6.2.1
-            //  If the sync sample box is not present, every sample is a sync sample.
-            Sample s = { 0/*offset*/, 0/*size*/,
-                dts, dts/*init pts with dts*/,
-                stss != Nil ? kFrameTypeUnknown : kFrameTypeSync};
-            track->sampleTable.push(s);
-            dts += stts->entries[i].sample_delta;
-        }
-    }
-
-    // ctts => pts
-    if (ctts != 0) {
-        UInt32 sampleIndex = 0;
-        for (UInt32 i = 0; i < ctts->entries.size(); ++i) {
-            for (UInt32 j = 0; j < ctts->entries[i].sample_count; ++j) {
-                Sample& s = track->sampleTable[sampleIndex++];
-                s.pts = s.dts + ctts->entries[i].sample_offset;
-            }
-        }
-    }
-    
     if (hdlr->handler_type == kMediaTypeVideo && ctts == Nil) {
         ERROR("ctts is not present. pts will be missing");
     }
 
-    // stco + stsc + stsz => sample size & offset
-    CHECK_EQ((UInt32)stsc->entries[0].first_chunk, 1);
-    UInt32 sampleIndex = 0;
-    UInt32 stscIndex = 0;
-    // first, go through each chunk
-    for (UInt32 chunkIndex = 0; chunkIndex < stco->entries.size(); ++chunkIndex) {
-        // find out how many samples in this chunk
-        while (stscIndex + 1 < stsc->entries.size() &&
-                stsc->entries[stscIndex + 1].first_chunk <= chunkIndex + 1) {
-            ++stscIndex;
-        }
-        const UInt32 numSamples = stsc->entries[stscIndex].samples_per_chunk;
-
-        // set each samples offset and size
-        UInt64 offset = stco->entries[chunkIndex];
-        for (UInt32 i = 0; i < numSamples; ++i && ++sampleIndex) {
-            Sample& s = track->sampleTable[sampleIndex];
-
-            s.offset = offset;
-            s.size = stsz->sample_size ?  stsz->sample_size : stsz->entries[sampleIndex];
-
-            offset += s.size;
-        }
-    }
-
-    // stss => key frames
-    if (stss != Nil) {
-        for (UInt32 i = 0; i < stss->entries.size(); ++i) {
-            Sample& s = track->sampleTable[stss->entries[i] - 1];
-            s.flags |= kFrameTypeSync;
-            //INFO("sync frame %d", stss->entries[i]);
-        }
+    if (stss != Nil && stss->entries.size()) {
         INFO("every %zu frame has one sync frame",
-                track->sampleTable.size() / stss->entries.size());
-    }
-
-    // ISO/IEC 14496-12:2015 Section 8.6.4
-    if (sdtp != Nil) {
-        for (UInt32 i = 0; i < sdtp->dependency.size(); ++i) {
-            UInt8 dep = sdtp->dependency[i];
-            UInt8 is_leading = (dep & 0xc0) >> 6;
-            UInt8 sample_depends_on = (dep & 0x30) >> 4;
-            UInt8 sample_is_depended_on = (dep & 0xc) >> 2;
-            UInt8 sample_has_redundancy = (dep & 0x3);
-#if 1
-            DEBUG("is leading %d, sample_depends_on %d, "
-                    "sample_is_depended_on %d, sample_has_redundancy %d",
-                    is_leading,
-                    sample_depends_on,
-                    sample_is_depended_on,
-                    sample_has_redundancy);
-#endif
-            Sample& s = track->sampleTable[i];
-            // does this sample depends others (e.g. is it an I‐picture)?
-            if (sample_depends_on == 2)     s.flags |= kFrameTypeSync;
-            // do no other samples depend on this one?
-            if (sample_is_depended_on == 2) s.flags |= kFrameTypeDisposal;
-            // 3: depends only on I-frame.
-            
-#if 0       // FIXME: handle is_leading & sample_has_redundacy properly
-            if (is_leading == 2)            s.flags |= kFrameFlagLeading;
-            if (sample_has_redundancy == 1) s.flags |= kFrameFlagRedundant;
-#endif
-        }
-    } else {
-        // we don't have enough infomation to seperate P-frame & B-frame,
-        // so mark unknown frames as being depended.
-        for (UInt32 i = 0; i < track->sampleTable.size(); ++i) {
-            Sample& s = track->sampleTable[i];
-            if (s.flags & kFrameTypeSync) continue;
-        }
+                track->sampleTable->count() / stss->entries.size());
     }
 
 #if 1
@@ -334,71 +298,60 @@ static sp<Mp4Track> prepareTrack(const sp<TrackBox>& trak, const sp<MovieHeaderB
     }
 #endif
 
-    DEBUG("init sample table takes %.2f", (Time::Now() - now) / 1E6);
-#if 0
-    for (UInt32 i = 0; i < track.mSampleTable.size(); ++i) {
-        Sample& s   = track.mSampleTable[i];
-        DEBUG("sample %zu: %" PRIu64 " %zu %" PRIu64 " %" PRIu64,
-                i, s.offset, s.size,
-                s.dts, s.pts);
-    }
-    DEBUG("stsz size %zu", stsz->entries.size());
-#endif
-    DEBUG("num samples %zu total %zu", track->sampleTable.size(),
-            track->sampleTable.size() * sizeof(Sample));
+    DEBUG("num samples %" PRIu32, track->sampleTable->count());
 
     return track;
 }
 
-static MediaError seekTrack(sp<Mp4Track>& track, Int64 us) {
-    const Vector<Sample>& tbl = track->sampleTable;
-    // dts&pts in tbl using duration's timescale
-    us = (us * track->duration.scale) / 1000000LL;
-
-    UInt32 first = 0;
-    UInt32 second = tbl.size() - 1;
-    UInt32 mid = 0;
-
-    // using binary search to find sample index
-    // closest search
-    UInt32 search_count = 0;
-    while (first < second) {
-        mid = (first + second) / 2; // truncated happens
-        const Sample& s0 = tbl[mid];
-        const Sample& s1 = tbl[mid + 1];
-        if (s0.dts <= us && s1.dts > us) first = second = mid;
-        else if (s0.dts > us) second = mid;
-        else first = mid;
-        ++search_count;
-    }
-
-    // find sync sample index
-    do {
-        const Sample& s = tbl[first];
-        if (s.flags & kFrameTypeSync) break;
-        if (first == 0) {
-            WARN("track %zu: no sync at start");
-            break;
-        }
-        --first;
-    } while (first > 0);
-
-    while (second < tbl.size()) {
-        const Sample& s = tbl[second];
-        if (s.flags & kFrameTypeSync) break;
-        ++second;
-    }
-
-    const UInt32 result = first;
-    track->sampleIndex  = result;   // key sample index
-    track->startIndex   = mid;
-
-    INFO("seek %.3f(s) => [%zu - %zu - %zu] => %zu # %zu",
-            us / 1E6,
-            first, mid, second, result,
-            search_count);
+// seek to the last sync sample with pts <= time, time is presentation time
+// in track's timescale. return presentation time of the sync sample
+static Int64 seekTrack(sp<Mp4Track>& track, Int64 time) {
+    const sp<SampleTable>& tbl = track->sampleTable;
+    if (tbl->count() == 0) return time;
 
-    return kMediaNoError;
+    const Int64 target = track->mediaTime(time);
+    const UInt32 sync = tbl->seek(target);
+    tbl->locate(sync, track->cursor);
+    track->startTime    = target;
+
+    const Int64 pts = track->presentationTime(tbl->pts(sync));
+    if (pts > time) {
+        WARN("no sync before %.3f(s)", time / (Float64)track->duration.scale);
+    }
+
+    INFO("seek %.3f(s) => sync sample %" PRIu32 " @ %.3f(s)",
+            time / (Float64)track->duration.scale,
+            sync, pts / (Float64)track->duration.scale);
+    return pts;
+}
+
+// ISO/IEC 14496-12:2015 Section 8.8.3.1
+static UInt32 GetSampleFlags(UInt32 v) {
+    const UInt8 sample_depends_on       = (v >> 24) & 0x3;
+    const UInt8 sample_is_depended_on   = (v >> 22) & 0x3;
+    const Bool sample_is_non_sync_sample = v & 0x10000;
+    UInt32 flags = kFrameTypeUnknown;
+    if (!sample_is_non_sync_sample || sample_depends_on == 2) flags |= kFrameTypeSync;
+    if (sample_is_depended_on == 2) flags |= kFrameTypeDisposal;
+    return flags;
+}
+
+// drop fragment samples before the last sync sample <= dts
+static void trimFragment(sp<Mp4Track>& track, Int64 dts) {
+    UInt32 sync = 0;
+    for (UInt32 i = 0; i < track->fragment.size(); ++i) {
+        const Sample& s = track->fragment[i];
+        if (s.dts > dts) break;
+        if (s.flags & kFrameTypeSync) sync = i;
+    }
+    if (sync == 0) return;
+
+    Vector<Sample> samples;
+    for (UInt32 i = sync; i < track->fragment.size(); ++i) {
+        samples.push(track->fragment[i]);
+    }
+    track->fragment         = samples;
+    track->fragmentFirst    += sync;
 }
 
 struct Mp4File : public MediaDevice {
@@ -410,14 +363,35 @@ struct Mp4File : public MediaDevice {
         UInt32              length;
     } meta;
     
+    // fragmented mp4
+    Bool                    mFragmented;
+    sp<FileTypeBox>         mFileType;
+    Int64                   mFirstFragment;     // offset of first box after moov
+    Int64                   mFragmentOffset;    // offset of next box to load
+    sp<SegmentIndexBox>     mSegmentIndex;
+    Int64                   mSegmentAnchor;     // offset of first byte after sidx
+    sp<TrackFragmentRandomAccessBox> mRandomAccess;
+    sp<ContentFollower>     mFollower;          // Nil if not in follow mode
+    
+    // read window
+    sp<Buffer>              mWindow;
+    Int64                   mWindowOffset;      // file offset of window
+    UInt32                  mWindowLength;      // valid bytes in window
+    
     // statistics
     UInt32                  mNumPacketsRead;
+    UInt32                  mNumReads;
 
     Mp4File() : MediaDevice(), mContent(Nil),
-    mDuration(kMediaTimeInvalid), mNumPacketsRead(0) {
+    mDuration(kMediaTimeInvalid), mFragmented(False), mFileType(Nil),
+    mFirstFragment(0), mFragmentOffset(0), mSegmentIndex(Nil), mSegmentAnchor(0),
+    mRandomAccess(Nil), mFollower(Nil), mWindow(Nil), mWindowOffset(0), mWindowLength(0),
+    mNumPacketsRead(0), mNumReads(0) {
     }
 
-    virtual ~Mp4File() { }
+    virtual ~Mp4File() {
+        INFO("%" PRIu32 " packets in %" PRIu32 " reads", mNumPacketsRead, mNumReads);
+    }
 
     virtual sp<Message> formats() const {
         sp<Message> info = new Message;
@@ -441,6 +415,10 @@ struct Mp4File : public MediaDevice {
             } else if (trak->type == kCodecTypeVideo) {
                 trakInfo->setInt32(kKeyWidth, trak->video.width);
                 trakInfo->setInt32(kKeyHeight, trak->video.height);
+                if (trak->video.rotate != kRotate0)
+                    trakInfo->setInt32(kKeyRotate, trak->video.rotate);
+                if (trak->video.flip != kFlipNone)
+                    trakInfo->setInt32(kKeyFlip, trak->video.flip);
             }
 
             if (trak->esds != Nil) {
@@ -448,35 +426,6 @@ struct Mp4File : public MediaDevice {
                 trakInfo->setObject(FOURCC(trak->esds->Type), trak->esds->data);
             }
 
-#if 0
-            // start time & encode delay/padding
-            UInt64 startTime = 0;     // FIXME: learn more about start time.
-            Int64 encodeDelay = 0;
-            Int64 encodePadding = 0;
-            sp<EditListBox> elst = FindBoxInside(trak, kBoxTypeEDTS, kBoxTypeELST);
-            if (elst != Nil && elst->entries.size()) {
-                UInt32 i = 0;
-                if (elst->entries[0].media_time == -1) {
-                    startTime = elst->entries[0].segment_duration;
-                    DEBUG("startTime = %" PRId64, startTime);
-                    ++i;
-                }
-
-                // we only support one non-empty edit.
-                if (elst->entries.size() == i + 1) {
-                    UInt64 media_time = elst->entries[i].media_time;
-                    UInt64 segment_duration = elst->entries[i].segment_duration;
-
-                    encodeDelay     = media_time;
-                    // XXX: borrow from android, is it right???
-                    encodePadding   = mdhd->duration - (media_time + segment_duration);
-                    if (encodePadding < 0) encodePadding = 0;
-
-                    trakInfo.setInt64(Media::EncoderDelay, encodeDelay);
-                    trakInfo.setInt64(Media::EncoderPadding, encodePadding);
-                }
-            }
-#endif
             info->setObject(kKeyTrack + i, trakInfo);
         }
 
@@ -495,8 +444,13 @@ struct Mp4File : public MediaDevice {
         return info;
     }
 
-    MediaError init(const sp<ABuffer>& buffer) {
+    MediaError init(const sp<ABuffer>& buffer, const sp<IndexCache>& cache, const sp<ContentFollower>& follower) {
         CHECK_TRUE(buffer != Nil);
+        mFollower = follower;
+        
+        if (cache != Nil && restore(cache, buffer)) {
+            return kMediaNoError;
+        }
 
         sp<FileTypeBox> ftyp = ReadBox(buffer);
         if (ftyp->Type != kBoxTypeFTYP) {
@@ -519,6 +473,8 @@ struct Mp4File : public MediaDevice {
                 }
             } else if (box->Type == kBoxTypeMOOV) {
                 moov = box;
+                // fragmented: samples are in moof, which are loaded on demand
+                if (FindBox(moov, kBoxTypeMVEX) != Nil) break;
             } else {
                 INFO("box %s before moov/mdat", box->Name.c_str());
             }
@@ -528,12 +484,16 @@ struct Mp4File : public MediaDevice {
             ERROR("missing moov box");
             return kMediaErrorBadContent;
         }
-        if (mdat.isNil()) {
+        mFragmented = FindBox(moov, kBoxTypeMVEX) != Nil;
+        if (mdat.isNil() && !mFragmented) {
             ERROR("missing mdat box");
             return kMediaErrorBadContent;
         }
         
+#if LOG_NDEBUG == 0
+        // this will parse every box in moov
         PrintBox(moov);
+#endif
 
         sp<MovieHeaderBox> mvhd = FindBox(moov, kBoxTypeMVHD);
         if (mvhd == 0) {
@@ -541,6 +501,12 @@ struct Mp4File : public MediaDevice {
             return kMediaErrorBadFormat;
         }
         mDuration = MediaTime(mvhd->duration, mvhd->timescale);
+        if (mFragmented && mvhd->duration == 0) {
+            sp<MovieExtendsHeaderBox> mehd = FindBoxInside(moov, kBoxTypeMVEX, kBoxTypeMEHD);
+            if (mehd != Nil) {
+                mDuration = MediaTime(mehd->fragment_duration, mvhd->timescale);
+            }
+        }
 
         for (UInt32 i = 0; ; ++i) {
             sp<TrackBox> trak = FindBox(moov, kBoxTypeTRAK, i);
@@ -561,13 +527,346 @@ struct Mp4File : public MediaDevice {
         // TODO: handle meta box
 
         INFO("%zu tracks ready", mTracks.size());
-
-        buffer->resetBytes();
-        buffer->skipBytes(mdat->offset);
+        
+        if (mFragmented) {
+            prepareFragments(moov, buffer, ftyp);
+            buffer->resetBytes();
+            buffer->skipBytes(mFirstFragment);
+        } else {
+            // samples of fragments are not known until loaded
+            if (cache != Nil) store(cache, mdat->offset);
+            buffer->resetBytes();
+            buffer->skipBytes(mdat->offset);
+        }
         mContent = buffer;
         return kMediaNoError;
     }
     
+    // save prepared tracks to index cache
+    void store(const sp<IndexCache>& cache, Int64 start) {
+        IndexWriter writer;
+        writer.write(mDuration.value);
+        writer.write(mDuration.scale);
+        writer.write(start);
+        writer.write<UInt32>(mTracks.size());
+        for (UInt32 i = 0; i < mTracks.size(); ++i) {
+            const sp<Mp4Track>& track = mTracks[i];
+            writer.write(track->type);
+            writer.write(track->codec);
+            writer.write(track->duration.value);
+            writer.write(track->duration.scale);
+            writer.write(track->bitReate);
+            if (track->type == kCodecTypeVideo) {
+                writer.write(track->video.width);
+                writer.write(track->video.height);
+                writer.write(track->video.rotate);
+                writer.write(track->video.flip);
+            } else if (track->type == kCodecTypeAudio) {
+                writer.write(track->audio.sampleRate);
+                writer.write(track->audio.channelCount);
+            }
+            writer.write(track->lengthSizeMinusOne);
+            writer.write(track->editStart);
+            writer.write(track->editEnd);
+            writer.write(track->editOffset);
+            writer.write(track->trackID);
+            writer.write<UInt32>(track->esds != Nil ? track->esds->Type : 0);
+            if (track->esds != Nil) {
+                writer.write<UInt32>(track->esds->data->size());
+                writer.write(track->esds->data->data(), track->esds->data->size());
+            }
+            track->sampleTable->store(writer);
+        }
+        cache->put(kIndexTagMp4, writer.release());
+        cache->commit();
+    }
+    
+    // restore prepared tracks from index cache
+    Bool restore(const sp<IndexCache>& cache, const sp<ABuffer>& buffer) {
+        UInt32 length = 0;
+        const UInt8 * data = cache->find(kIndexTagMp4, &length);
+        if (data == Nil) return False;
+        
+        IndexReader reader(data, length);
+        MediaTime duration;
+        Int64 start = 0;
+        UInt32 count = 0;
+        reader.read(duration.value);
+        reader.read(duration.scale);
+        reader.read(start);
+        reader.read(count);
+        
+        Vector<sp<Mp4Track> > tracks;
+        for (UInt32 i = 0; i < count && reader.status(); ++i) {
+            sp<Mp4Track> track = new Mp4Track;
+            reader.read(track->type);
+            reader.read(track->codec);
+            reader.read(track->duration.value);
+            reader.read(track->duration.scale);
+            reader.read(track->bitReate);
+            if (track->type == kCodecTypeVideo) {
+                reader.read(track->video.width);
+                reader.read(track->video.height);
+                reader.read(track->video.rotate);
+                reader.read(track->video.flip);
+            } else if (track->type == kCodecTypeAudio) {
+                reader.read(track->audio.sampleRate);
+                reader.read(track->audio.channelCount);
+            }
+            reader.read(track->lengthSizeMinusOne);
+            reader.read(track->editStart);
+            reader.read(track->editEnd);
+            reader.read(track->editOffset);
+            reader.read(track->trackID);
+            UInt32 type = 0;
+            reader.read(type);
+            if (type) {
+                UInt32 size = 0;
+                reader.read(size);
+                if (size > reader.remains()) break;
+                sp<CommonBox> esds = new CommonBox(type);
+                esds->data = new Buffer(size ? size : 1);
+                reader.read(esds->data->base(), size);
+                esds->data->setBytesRange(0, size);
+                track->esds = esds;
+            }
+            track->sampleTable = SampleTable::Create(reader);
+            if (track->sampleTable == Nil) break;
+            track->sampleTable->locate(0, track->cursor);
+            track->fragmentFirst = track->sampleTable->count();
+            tracks.push(track);
+        }
+        
+        if (!reader.status() || tracks.size() != count || tracks.empty()) {
+            WARN("bad index cache, parse file instead");
+            return False;
+        }
+        
+        mDuration   = duration;
+        mTracks     = tracks;
+        buffer->resetBytes();
+        buffer->skipBytes(start);
+        mContent    = buffer;
+        INFO("%zu tracks restored from index cache", mTracks.size());
+        return True;
+    }
+    
+    sp<Mp4Track> findTrack(UInt32 trackID) const {
+        for (UInt32 i = 0; i < mTracks.size(); ++i) {
+            if (mTracks[i]->trackID == trackID) return mTracks[i];
+        }
+        return Nil;
+    }
+    
+    // buffer is right after moov
+    void prepareFragments(const sp<MovieBox>& moov, const sp<ABuffer>& buffer, const sp<FileTypeBox>& ftyp) {
+        mFileType       = ftyp;
+        mFirstFragment  = buffer->offset();
+        mFragmentOffset = mFirstFragment;
+        
+        sp<MovieExtendsBox> mvex = FindBox(moov, kBoxTypeMVEX);
+        for (UInt32 i = 0; ; ++i) {
+            sp<TrackExtendsBox> trex = FindBox(mvex, kBoxTypeTREX, i);
+            if (trex == Nil) break;
+            sp<Mp4Track> track = findTrack(trex->track_ID);
+            if (track != Nil) track->trex = trex;
+        }
+        
+        // sidx is placed between moov and the first moof
+        while (buffer->size() >= 8) {
+            sp<Box> box = ReadBox(buffer, ftyp);
+            if (box.isNil()) break;
+            if (box->Type == kBoxTypeMOOF || box->Type == kBoxTypeMDAT) break;
+            if (box->Type == kBoxTypeSIDX) {
+                mSegmentIndex   = box;
+                mSegmentAnchor  = buffer->offset();
+                INFO("sidx with %zu references", mSegmentIndex->entries.size());
+                break;
+            }
+        }
+        
+        // mfra is at the end of file, located by mfro
+        if (mSegmentIndex == Nil && buffer->capacity() > mFirstFragment + 16) {
+            buffer->resetBytes();
+            buffer->skipBytes(buffer->capacity() - 16);
+            const UInt32 size   = buffer->rb32();
+            const UInt32 type   = buffer->rb32();
+            buffer->skipBytes(4);   // version & flags
+            const UInt32 length = buffer->rb32();
+            if (size == 16 && type == kBoxTypeMFRO &&
+                length > 16 && length <= buffer->capacity() - mFirstFragment) {
+                buffer->resetBytes();
+                buffer->skipBytes(buffer->capacity() - length);
+                sp<Box> mfra = ReadBox(buffer, ftyp);
+                for (UInt32 i = 0; mfra != Nil && mfra->Type == kBoxTypeMFRA; ++i) {
+                    sp<TrackFragmentRandomAccessBox> tfra = FindBox(mfra, kBoxTypeTFRA, i);
+                    if (tfra == Nil) break;
+                    // prefer video track
+                    sp<Mp4Track> track = findTrack(tfra->track_ID);
+                    if (mRandomAccess == Nil ||
+                        (track != Nil && track->type == kCodecTypeVideo)) {
+                        mRandomAccess = tfra;
+                    }
+                }
+            }
+            if (mRandomAccess != Nil) {
+                INFO("tfra with %zu entries", mRandomAccess->entries.size());
+            }
+        }
+        
+        if (mSegmentIndex == Nil && mRandomAccess == Nil) {
+            WARN("no sidx or mfra, seek will scan fragments");
+        }
+    }
+    
+    // append samples in moof to tracks
+    void prepareFragment(const sp<MovieFragmentBox>& moof, Int64 moofOffset) {
+        UInt64 dataEnd = moofOffset;
+        for (UInt32 i = 0; ; ++i) {
+            sp<TrackFragmentBox> traf = FindBox(moof, kBoxTypeTRAF, i);
+            if (traf == Nil) break;
+            
+            sp<TrackFragmentHeaderBox> tfhd = FindBox(traf, kBoxTypeTFHD);
+            if (tfhd == Nil) {
+                ERROR("tfhd is missing from traf");
+                continue;
+            }
+            sp<TrackFragmentBaseMediaDecodeTimeBox> tfdt = FindBox(traf, kBoxTypeTFDT);
+            sp<Mp4Track> track = findTrack(tfhd->track_ID);
+            sp<TrackExtendsBox> trex;
+            if (track != Nil) trex = track->trex;
+            
+            // ISO/IEC 14496-12:2015 Section 8.8.7.1
+            UInt64 base = dataEnd;
+            if (tfhd->Flags & TrackFragmentHeaderBox::Base_data_offset_present) {
+                base = tfhd->base_data_offset;
+            } else if ((tfhd->Flags & TrackFragmentHeaderBox::Default_base_is_moof) || i == 0) {
+                base = moofOffset;
+            }
+            
+            const UInt32 duration = tfhd->Flags & TrackFragmentHeaderBox::Default_sample_duration_present ?
+                tfhd->default_sample_duration : trex != Nil ? trex->default_sample_duration : 0;
+            const UInt32 size = tfhd->Flags & TrackFragmentHeaderBox::Default_sample_size_present ?
+                tfhd->default_sample_size : trex != Nil ? trex->default_sample_size : 0;
+            const UInt32 flags = tfhd->Flags & TrackFragmentHeaderBox::Default_sample_flags_present ?
+                tfhd->default_sample_flags : trex != Nil ? trex->default_sample_flags : 0;
+            
+            Int64 dts = track != Nil ? track->fragmentDts : 0;
+            if (tfdt != Nil) dts = tfdt->baseMediaDecodeTime;
+            
+            UInt64 offset = base;
+            for (UInt32 j = 0; ; ++j) {
+                sp<TrackRunBox> trun = FindBox(traf, kBoxTypeTRUN, j);
+                if (trun == Nil) break;
+                
+                if (trun->Flags & TrackRunBox::Data_offset_present) {
+                    offset = base + trun->data_offset;
+                }
+                
+                for (UInt32 k = 0; k < trun->entries.size(); ++k) {
+                    const TrackRunBox::Entry& e = trun->entries[k];
+                    UInt32 v = flags;
+                    if (k == 0 && (trun->Flags & TrackRunBox::First_sample_flags_present)) {
+                        v = trun->first_sample_flags;
+                    } else if (trun->Flags & TrackRunBox::Sample_flags_present) {
+                        v = e.sample_flags;
+                    }
+                    
+                    Sample s;
+                    s.offset    = offset;
+                    s.size      = trun->Flags & TrackRunBox::Sample_size_present ? e.sample_size : size;
+                    s.dts       = dts;
+                    s.pts       = dts + e.sample_composition_time_offset;
+                    s.duration  = trun->Flags & TrackRunBox::Sample_duration_present ?
+                        e.sample_duration : duration;
+                    s.flags     = GetSampleFlags(v);
+                    if (track != Nil && track->enabled) track->fragment.push(s);
+                    
+                    offset      += s.size;
+                    dts         += s.duration;
+                }
+            }
+            
+            dataEnd = offset;
+            if (track != Nil) track->fragmentDts = dts;
+        }
+    }
+    
+    // load next moof, samples are appended to tracks
+    Bool loadFragment() {
+        // release consumed samples
+        for (UInt32 i = 0; i < mTracks.size(); ++i) {
+            sp<Mp4Track>& track = mTracks[i];
+            if (track->fragmentIndex < track->fragment.size()) continue;
+            track->fragmentFirst    += track->fragment.size();
+            track->fragmentIndex    = 0;
+            track->fragment.clear();
+        }
+        
+        while (mFragmentOffset + 8 <= mContent->capacity()) {
+            // file being recorded: leave moof until its mdat is complete
+            if (!mFollower.isNil() && !isFragmentComplete(mFragmentOffset)) break;
+            
+            mContent->skipBytes(mFragmentOffset - mContent->offset());
+            const Int64 offset = mFragmentOffset;
+            sp<Box> box = ReadBox(mContent, mFileType);
+            if (box.isNil()) {
+                // unknown box is skipped by ReadBox
+                if (mContent->offset() <= offset) break;
+                mFragmentOffset = mContent->offset();
+                continue;
+            }
+            
+            if (box->Type == kBoxTypeMDAT) {
+                sp<MediaDataBox> mdat = box;
+                mFragmentOffset = mdat->offset + mdat->length;
+                continue;
+            }
+            
+            mFragmentOffset = mContent->offset();
+            if (box->Type == kBoxTypeMOOF) {
+                DEBUG("load fragment @ %" PRId64, offset);
+                prepareFragment(box, offset);
+                return True;
+            }
+            if (box->Type == kBoxTypeMFRA) {
+                // mfra is written when recording is finished
+                mFollower.clear();
+            }
+            DEBUG("ignore box %s between fragments", box->Name.c_str());
+        }
+        INFO("no more fragments");
+        return False;
+    }
+    
+    // get type & end of box @ offset without parsing it
+    // @return False if box header is incomplete
+    Bool peekBox(Int64 offset, UInt32 * type, Int64 * end) {
+        if (offset + 8 > mContent->capacity()) return False;
+        mContent->skipBytes(offset - mContent->offset());
+        UInt64 length   = mContent->rb32();
+        *type           = mContent->rb32();
+        if (length == 1) {
+            if (offset + 16 > mContent->capacity()) return False;
+            length      = mContent->rb64();
+        } else if (length == 0) {
+            // box extends to end of file, which is still growing
+            return False;
+        }
+        *end = offset + length;
+        return True;
+    }
+    
+    // box @ offset is complete, and so is the mdat after moof
+    Bool isFragmentComplete(Int64 offset) {
+        UInt32 type;
+        Int64 end;
+        if (!peekBox(offset, &type, &end) || end > mContent->capacity()) return False;
+        if (type != kBoxTypeMOOF) return True;
+        if (!peekBox(end, &type, &end) || end > mContent->capacity()) return False;
+        return True;
+    }
+    
     virtual MediaError configure(const sp<Message>& options) {
         INFO("configure << %s", options->string().c_str());
         MediaError status = kMediaErrorNotSupported;
@@ -588,11 +887,105 @@ struct Mp4File : public MediaDevice {
         return status;
     }
     
+    // seek video track first, and align other tracks to its sync sample.
     void seek(Int64 us) {
+        if (mFragmented) {
+            seekFragment(us);
+            return;
+        }
+        
+        UInt32 master = mTracks.size();
+        for (UInt32 i = 0; i < mTracks.size(); ++i) {
+            if (mTracks[i]->enabled && mTracks[i]->type == kCodecTypeVideo) {
+                master = i;
+                break;
+            }
+        }
+        
+        if (master < mTracks.size()) {
+            sp<Mp4Track>& track = mTracks[master];
+            const Int64 scale = track->duration.scale;
+            const Int64 pts = seekTrack(track, (us * scale) / 1000000LL);
+            // no sync sample before target, start all tracks at the first one
+            if (pts * 1000000LL > us * scale) {
+                us = (pts * 1000000LL) / scale;
+                track->startTime = track->mediaTime(pts);
+            }
+        }
+        
         for (UInt32 i = 0; i < mTracks.size(); ++i) {
+            if (i == master) continue;
             sp<Mp4Track>& track = mTracks[i];
-            // find new sample index
-            seekTrack(track, us);
+            seekTrack(track, (us * track->duration.scale) / 1000000LL);
+        }
+    }
+    
+    void seekFragment(Int64 us) {
+        // find fragment with sidx or tfra
+        Int64 offset = mFirstFragment;
+        if (mSegmentIndex != Nil && mSegmentIndex->timescale) {
+            const Int64 target = (us * mSegmentIndex->timescale) / 1000000LL;
+            Int64 time = mSegmentIndex->earliest_presentation_time;
+            Int64 pos = mSegmentAnchor + mSegmentIndex->first_offset;
+            for (UInt32 i = 0; i < mSegmentIndex->entries.size(); ++i) {
+                const SegmentIndexBox::Entry& e = mSegmentIndex->entries[i];
+                if (e.reference_type) {
+                    WARN("hierarchical sidx is not supported");
+                    break;
+                }
+                if (time > target) break;
+                offset  = pos;
+                time    += e.subsegment_duration;
+                pos     += e.referenced_size;
+            }
+        } else if (mRandomAccess != Nil) {
+            sp<Mp4Track> track = findTrack(mRandomAccess->track_ID);
+            const Int64 target = track != Nil ? track->mediaTime((us * track->duration.scale) / 1000000LL) : 0;
+            for (UInt32 i = 0; i < mRandomAccess->entries.size(); ++i) {
+                const TrackFragmentRandomAccessBox::Entry& e = mRandomAccess->entries[i];
+                if ((Int64)e.time > target) break;
+                offset = e.moof_offset;
+            }
+        }
+        
+        for (UInt32 i = 0; i < mTracks.size(); ++i) {
+            sp<Mp4Track>& track = mTracks[i];
+            // samples in moov are skipped
+            track->sampleTable->locate(track->sampleTable->count(), track->cursor);
+            track->fragmentFirst    += track->fragment.size();
+            track->fragmentIndex    = 0;
+            track->fragment.clear();
+        }
+        mFragmentOffset = offset;
+        
+        // load fragments until every track reaches the target,
+        // and keep only samples from the last sync sample.
+        while (loadFragment()) {
+            Bool ready = True;
+            for (UInt32 i = 0; i < mTracks.size(); ++i) {
+                sp<Mp4Track>& track = mTracks[i];
+                if (!track->enabled) continue;
+                const Int64 target = track->mediaTime((us * track->duration.scale) / 1000000LL);
+                trimFragment(track, target);
+                if (track->fragment.empty() || track->fragment.back().dts <= target) {
+                    ready = False;
+                }
+            }
+            if (ready) break;
+        }
+        
+        for (UInt32 i = 0; i < mTracks.size(); ++i) {
+            sp<Mp4Track>& track = mTracks[i];
+            const Int64 target = track->mediaTime((us * track->duration.scale) / 1000000LL);
+            UInt32 sync = 0;
+            for (UInt32 j = 0; j < track->fragment.size(); ++j) {
+                const Sample& s = track->fragment[j];
+                if (s.dts > target) break;
+                if ((s.flags & kFrameTypeSync) && s.pts <= target) sync = j;
+            }
+            track->fragmentIndex    = sync;
+            track->startTime        = target;
+            INFO("seek %.3f(s) => fragment sync sample %" PRIu32, us / 1E6, sync);
         }
     }
     
@@ -609,9 +1002,15 @@ struct Mp4File : public MediaDevice {
             for (UInt32 i = 0; i < mTracks.size(); ++i) {
                 sp<Mp4Track>& track = mTracks[i];
                 if (!track->enabled) continue;
-                if (track->sampleIndex >= track->sampleTable.size()) continue;
 
-                Int64 pos = track->sampleTable[track->sampleIndex].offset;
+                Int64 pos;
+                if (track->cursor.index < track->sampleTable->count()) {
+                    pos = track->cursor.offset;
+                } else if (track->fragmentIndex < track->fragment.size()) {
+                    pos = track->fragment[track->fragmentIndex].offset;
+                } else {
+                    continue;
+                }
                 if (pos <= los) {
                     los = pos;
                     trackIndex = i;
@@ -619,23 +1018,39 @@ struct Mp4File : public MediaDevice {
             }
 
             if (trackIndex >= mTracks.size()) {
+                // all loaded samples are consumed, move to next fragment
+                if (mFragmented && loadFragment()) continue;
+                // wait for fragments appended by recorder
+                if (mFragmented && !mFollower.isNil()) {
+                    sp<ABuffer> content = mFollower->wait(mContent);
+                    if (!content.isNil()) {
+                        mContent = content;
+                        continue;
+                    }
+                    // writer is done, last fragment may end with a size 0 box
+                    mFollower.clear();
+                    if (loadFragment()) continue;
+                }
                 //CHECK_TRUE(mContent->size() == 0, "FIXME: report eos with data exists");
                 INFO("eos @ %" PRId64 "[%" PRId64 "]", mContent->offset(), mContent->size());
                 return Nil;
             }
 
             sp<Mp4Track>& track = mTracks[trackIndex];
-            Vector<Sample>& tbl = track->sampleTable;
-            UInt32 sampleIndex = track->sampleIndex++;
 
             // read sample data
-            Sample& s = tbl[sampleIndex];
-
-            mContent->skipBytes(s.offset - mContent->offset());
+            Sample s;
+            if (track->cursor.index < track->sampleTable->count()) {
+                track->sampleTable->read(track->cursor, s);
+                track->sampleTable->next(track->cursor);
+            } else {
+                s = track->fragment[track->fragmentIndex++];
+            }
+            const Int64 pts = s.pts;
 
-            sp<Buffer> sample = mContent->readBytes(s.size);
+            sp<MediaFrame> packet = readSample(s);
 
-            if (sample == 0 || sample->size() < s.size) {
+            if (packet.isNil()) {
                 ERROR("read return error or corrupt file?.");
                 ERROR("report eos...");
                 return Nil;
@@ -650,11 +1065,42 @@ struct Mp4File : public MediaDevice {
 
             // setup flags
             UInt32 flags  = s.flags;
+            
+            // samples outside the edit are never output, and only video
+            // samples other samples depend on are still decoded.
+            const Int64 time = track->presentationTime(pts);
+            const Bool head = time < track->editOffset;
+            const Bool tail = track->editEnd >= 0 &&
+                time + s.duration > track->presentationTime(track->editEnd);
+            if ((head && time + s.duration <= track->editOffset) ||
+                (tail && time >= track->presentationTime(track->editEnd))) {
+                if (track->type != kCodecTypeVideo || (flags & kFrameTypeDisposal)) {
+                    DEBUG("[%zu] drop sample outside edit @ %" PRId64, trackIndex, pts);
+                    continue;
+                }
+                flags |= kFrameTypeReference;
+            }
+            
+            // audio samples straddling the edit are decoded, and samples
+            // outside the edit are discarded by the decoder.
+            UInt32 trimHead = 0, trimTail = 0;
+            if ((head || tail) && track->type == kCodecTypeAudio) {
+                const Int64 scale = track->duration.scale;
+                if (head) {
+                    trimHead = ((track->editOffset - time) * track->audio.sampleRate) / scale;
+                }
+                if (tail) {
+                    trimTail = ((time + s.duration - track->presentationTime(track->editEnd)) *
+                                track->audio.sampleRate) / scale;
+                }
+                if (trimHead || trimTail) flags |= kFrameTypeTrimmed;
+            }
 
             if (track->codec == kVideoCodecH264) {
-                if (sampleIndex < track->startIndex) {
+                if (pts < track->startTime) {
                     MPEG4::NALU nalu;
-                    sp<ABuffer> clone = sample->cloneBytes();
+                    sp<ABuffer> clone = new Buffer((const Char *)packet->planes.buffers[0].data,
+                                                   packet->planes.buffers[0].size);
                     clone->skipBytes(track->lengthSizeMinusOne + 1);
                     if (nalu.parse(clone) == kMediaNoError) {
                         DEBUG("[%zu] h264, type %#x ref %#x, falgs %#x",
@@ -675,7 +1121,7 @@ struct Mp4File : public MediaDevice {
                     }
                 }
             } else {
-                if (sampleIndex < track->startIndex) {
+                if (pts < track->startTime) {
                     if (flags & kFrameTypeSync) {
                         flags |= kFrameTypeReference;
                     } else {
@@ -686,13 +1132,12 @@ struct Mp4File : public MediaDevice {
             }
             
             // init MediaFrame context
-            sp<MediaFrame> packet   = MediaFrame::Create(sample);
             packet->id              = trackIndex;
             packet->flags           = flags;
-            if (s.pts < 0)
-                packet->timecode    = MediaTime(s.dts, track->duration.scale);
-            else
-                packet->timecode    = MediaTime(s.pts, track->duration.scale);
+            packet->timecode        = MediaTime(time, track->duration.scale);
+            packet->duration        = MediaTime(s.duration, track->duration.scale);
+            packet->trim.head       = trimHead;
+            packet->trim.tail       = trimTail;
             
             DEBUG("pull %s", packet->string().c_str());
             return packet;
@@ -701,14 +1146,47 @@ struct Mp4File : public MediaDevice {
         return Nil;
     }
     
+    // read sample data through read window, which is reused by every refill,
+    // so packets never hold the window.
+    sp<MediaFrame> readSample(const Sample& s) {
+        // large sample, read it into its own frame directly
+        if (s.size >= kReadWindowLength) {
+            mContent->skipBytes(s.offset - mContent->offset());
+            ++mNumReads;
+            sp<MediaFrame> packet = MediaFrame::Create(s.size);
+            if (mContent->readBytes((Char *)packet->planes.buffers[0].data, s.size) < s.size) return Nil;
+            packet->planes.buffers[0].size = s.size;
+            return packet;
+        }
+        
+        if ((Int64)s.offset < mWindowOffset ||
+            (Int64)(s.offset + s.size) > mWindowOffset + mWindowLength) {
+            mContent->skipBytes(s.offset - mContent->offset());
+            ++mNumReads;
+            
+            if (mWindow == Nil) mWindow = new Buffer(kReadWindowLength);
+            mWindowOffset   = s.offset;
+            mWindowLength   = mContent->readBytes((Char *)mWindow->base(), kReadWindowLength);
+            if (mWindowLength < s.size) {
+                mWindowLength = 0;
+                return Nil;
+            }
+        }
+        
+        sp<MediaFrame> packet = MediaFrame::Create(s.size);
+        memcpy(packet->planes.buffers[0].data, (const Char *)mWindow->base() + (s.offset - mWindowOffset), s.size);
+        packet->planes.buffers[0].size = s.size;
+        return packet;
+    }
+    
     virtual MediaError reset() {
         return kMediaNoError;
     }
 };
 
-sp<MediaDevice> CreateMp4File(const sp<ABuffer>& buffer) {
+sp<MediaDevice> CreateMp4File(const sp<ABuffer>& buffer, const sp<IndexCache>& cache, const sp<ContentFollower>& follower) {
     sp<Mp4File> file = new Mp4File;
-    if (file->init(buffer) == kMediaNoError) return file;
+    if (file->init(buffer, cache, follower) == kMediaNoError) return file;
     return Nil;
 }
 
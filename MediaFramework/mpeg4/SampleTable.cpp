@@ -0,0 +1,558 @@
+/******************************************************************************
+ * Copyright (c) 2016, Chen Fang <mtdcy.chen@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+
+
+
+// File:    SampleTable.cpp
+// Author:  mtdcy.chen
+// Changes:
+//          1. 20201018     initial version
+//
+
+#define LOG_TAG   "SampleTable"
+//#define LOG_NDEBUG 0
+#include <ABE/ABE.h>
+
+#include "mpeg4/SampleTable.h"
+
+__BEGIN_NAMESPACE_MFWK
+__BEGIN_NAMESPACE(MPEG4)
+
+// one checkpoint every N run-length entries
+#define kRunPointInterval   (64)
+
+// find the last checkpoint with first <= index
+static UInt32 FindRunPoint(const Vector<RunPoint>& points, UInt32 index) {
+    UInt32 lo = 0;
+    UInt32 hi = points.size();
+    while (hi - lo > 1) {
+        const UInt32 mid = (lo + hi) / 2;
+        if (points[mid].first <= index) lo = mid;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// find the last checkpoint with value <= value
+static UInt32 FindRunPointByValue(const Vector<RunPoint>& points, Int64 value) {
+    UInt32 lo = 0;
+    UInt32 hi = points.size();
+    while (hi - lo > 1) {
+        const UInt32 mid = (lo + hi) / 2;
+        if (points[mid].value <= value) lo = mid;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// find the first stss entry >= number, stss is 1-based
+static UInt32 LowerBound(const Vector<UInt32>& entries, UInt32 number) {
+    UInt32 lo = 0;
+    UInt32 hi = entries.size();
+    while (lo < hi) {
+        const UInt32 mid = (lo + hi) / 2;
+        if (entries[mid] < number) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// find the first sync point with index >= index
+static UInt32 LowerSyncPoint(const Vector<SyncPoint>& points, UInt32 index) {
+    UInt32 lo = 0;
+    UInt32 hi = points.size();
+    while (lo < hi) {
+        const UInt32 mid = (lo + hi) / 2;
+        if (points[mid].index < index) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static FORCE_INLINE Bool IsSyncDependency(UInt8 dep) {
+    // sample does not depend on others (I-picture)
+    return ((dep & 0x30) >> 4) == 2;
+}
+
+sp<SampleTable> SampleTable::Create(const sp<SampleTableBox>& stbl) {
+    sp<SampleTable> table = new SampleTable;
+    table->mSTTS    = FindBox(stbl, kBoxTypeSTTS);
+    table->mCTTS    = FindBox(stbl, kBoxTypeCTTS);
+    table->mSTSC    = FindBox(stbl, kBoxTypeSTSC);
+    table->mSTCO    = FindBox2(stbl, kBoxTypeSTCO, kBoxTypeCO64);
+    table->mSTSZ    = FindBox2(stbl, kBoxTypeSTSZ, kBoxTypeSTZ2);
+    table->mSTSS    = FindBox(stbl, kBoxTypeSTSS);
+    table->mSDTP    = FindBox(stbl, kBoxTypeSDTP);
+
+    if (table->mSTTS == Nil || table->mSTSC == Nil ||
+        table->mSTCO == Nil || table->mSTSZ == Nil) {
+        ERROR("stts/stsc/stco/stsz is missing");
+        return Nil;
+    }
+
+    // stsc is empty for fragmented files, all samples are in moof
+    if (table->mSTSC->entries.size() &&
+        table->mSTSC->entries[0].first_chunk != 1) {
+        ERROR("bad stsc");
+        return Nil;
+    }
+
+    // stts checkpoints with dts
+    const Vector<TimeToSampleBox::Entry>& stts = table->mSTTS->entries;
+    UInt32 first = 0;
+    Int64 dts = 0;
+    for (UInt32 i = 0; i < stts.size(); ++i) {
+        if (i % kRunPointInterval == 0) {
+            RunPoint point = { i, first, dts };
+            table->mSTTSPoints.push(point);
+        }
+        first   += stts[i].sample_count;
+        dts     += (Int64)stts[i].sample_count * stts[i].sample_delta;
+    }
+    const UInt32 sttsCount = first;
+
+    // ctts checkpoints
+    if (table->mCTTS != Nil) {
+        const Vector<CompositionOffsetBox::Entry>& ctts = table->mCTTS->entries;
+        first = 0;
+        for (UInt32 i = 0; i < ctts.size(); ++i) {
+            if (i % kRunPointInterval == 0) {
+                RunPoint point = { i, first, 0 };
+                table->mCTTSPoints.push(point);
+            }
+            first += ctts[i].sample_count;
+        }
+        if (ctts.size() == 0) table->mCTTS = Nil;
+    }
+
+    // stsc checkpoints
+    first = 0;
+    for (UInt32 i = 0; i < table->mSTSC->entries.size(); ++i) {
+        if (i % kRunPointInterval == 0) {
+            RunPoint point = { i, first, 0 };
+            table->mSTSCPoints.push(point);
+        }
+        first += table->stscSamples(i);
+    }
+    const UInt32 stscCount = first;
+
+    // ISO/IEC 14496-12:2015 Section 8.7.3: sample_count is the authority,
+    // but never go beyond what stts or stsc can describe.
+    table->mCount = table->mSTSZ->sample_count;
+    if (table->mCount > sttsCount) {
+        WARN("stsz has %" PRIu32 " samples, stts has %" PRIu32,
+             table->mCount, sttsCount);
+        table->mCount = sttsCount;
+    }
+    if (table->mCount > stscCount) {
+        WARN("stsz has %" PRIu32 " samples, stsc has %" PRIu32,
+             table->mCount, stscCount);
+        table->mCount = stscCount;
+    }
+
+    // sync index, sdtp may mark more sync samples than stss
+    if (table->mSTSS != Nil) {
+        const Vector<UInt32>& stss = table->mSTSS->entries;
+        UInt32 next = 0;    // next stss entry
+        UInt32 last = 0;    // last sync sample number, 1-based
+        if (table->mSDTP != Nil) {
+            const Vector<UInt8>& dep = table->mSDTP->dependency;
+            for (UInt32 i = 0; i < dep.size() && i < table->mCount; ++i) {
+                while (next < stss.size() && stss[next] < i + 1) ++next;
+                if (!IsSyncDependency(dep[i]) &&
+                    (next >= stss.size() || stss[next] != i + 1)) continue;
+                SyncPoint point = { i, table->pts(i) };
+                table->mSyncPoints.push(point);
+                last = i + 1;
+            }
+        }
+        for (; next < stss.size() && stss[next] <= table->mCount; ++next) {
+            if (stss[next] <= last) {
+                if (table->mSDTP == Nil) WARN("stss is not in increasing order");
+                continue;
+            }
+            last = stss[next];
+            SyncPoint point = { last - 1, table->pts(last - 1) };
+            table->mSyncPoints.push(point);
+        }
+    }
+
+    DEBUG("%" PRIu32 " samples, checkpoints %zu/%zu/%zu, %zu sync samples",
+          table->mCount,
+          table->mSTTSPoints.size(),
+          table->mCTTSPoints.size(),
+          table->mSTSCPoints.size(),
+          table->mSyncPoints.size());
+    return table;
+}
+
+// entries are stored field by field, see IndexWriter
+static void IndexWrite(IndexWriter& writer, const TimeToSampleBox::Entry& e) {
+    writer.write(e.sample_count);
+    writer.write(e.sample_delta);
+}
+
+static Bool IndexRead(IndexReader& reader, TimeToSampleBox::Entry& e) {
+    return reader.read(e.sample_count) && reader.read(e.sample_delta);
+}
+
+static void IndexWrite(IndexWriter& writer, const CompositionOffsetBox::Entry& e) {
+    writer.write(e.sample_count);
+    writer.write(e.sample_offset);
+}
+
+static Bool IndexRead(IndexReader& reader, CompositionOffsetBox::Entry& e) {
+    return reader.read(e.sample_count) && reader.read(e.sample_offset);
+}
+
+static void IndexWrite(IndexWriter& writer, const SampleToChunkBox::Entry& e) {
+    writer.write(e.first_chunk);
+    writer.write(e.samples_per_chunk);
+    writer.write(e.sample_description_index);
+}
+
+static Bool IndexRead(IndexReader& reader, SampleToChunkBox::Entry& e) {
+    return reader.read(e.first_chunk) && reader.read(e.samples_per_chunk) &&
+        reader.read(e.sample_description_index);
+}
+
+static void IndexWrite(IndexWriter& writer, const RunPoint& e) {
+    writer.write(e.entry);
+    writer.write(e.first);
+    writer.write(e.value);
+}
+
+static Bool IndexRead(IndexReader& reader, RunPoint& e) {
+    return reader.read(e.entry) && reader.read(e.first) && reader.read(e.value);
+}
+
+static void IndexWrite(IndexWriter& writer, const SyncPoint& e) {
+    writer.write(e.index);
+    writer.write(e.pts);
+}
+
+static Bool IndexRead(IndexReader& reader, SyncPoint& e) {
+    return reader.read(e.index) && reader.read(e.pts);
+}
+
+void SampleTable::store(IndexWriter& writer) const {
+    writer.write(mCount);
+    writer.write(mSTTS->entries);
+    writer.write<Bool>(mCTTS != Nil);
+    if (mCTTS != Nil) writer.write(mCTTS->entries);
+    writer.write(mSTSC->entries);
+    writer.write(mSTCO->entries);
+    writer.write(mSTSZ->sample_size);
+    writer.write(mSTSZ->sample_count);
+    writer.write(mSTSZ->entries);
+    writer.write<Bool>(mSTSS != Nil);
+    if (mSTSS != Nil) writer.write(mSTSS->entries);
+    writer.write<Bool>(mSDTP != Nil);
+    if (mSDTP != Nil) writer.write(mSDTP->dependency);
+    writer.write(mSTTSPoints);
+    writer.write(mCTTSPoints);
+    writer.write(mSTSCPoints);
+    writer.write(mSyncPoints);
+}
+
+sp<SampleTable> SampleTable::Create(IndexReader& reader) {
+    sp<SampleTable> table = new SampleTable;
+    Bool present;
+    table->mSTTS    = new TimeToSampleBox;
+    table->mSTSC    = new SampleToChunkBox;
+    table->mSTCO    = new PreferredChunkOffsetBox;
+    table->mSTSZ    = new PreferredSampleSizeBox;
+    reader.read(table->mCount);
+    reader.read(table->mSTTS->entries);
+    if (reader.read(present) && present) {
+        table->mCTTS = new CompositionOffsetBox;
+        reader.read(table->mCTTS->entries);
+    }
+    reader.read(table->mSTSC->entries);
+    reader.read(table->mSTCO->entries);
+    reader.read(table->mSTSZ->sample_size);
+    reader.read(table->mSTSZ->sample_count);
+    reader.read(table->mSTSZ->entries);
+    if (reader.read(present) && present) {
+        table->mSTSS = new SyncSampleBox;
+        reader.read(table->mSTSS->entries);
+    }
+    if (reader.read(present) && present) {
+        table->mSDTP = new SampleDependencyTypeBox;
+        reader.read(table->mSDTP->dependency);
+    }
+    reader.read(table->mSTTSPoints);
+    reader.read(table->mCTTSPoints);
+    reader.read(table->mSTSCPoints);
+    reader.read(table->mSyncPoints);
+    
+    if (!reader.status()) {
+        ERROR("bad sample table in cache");
+        return Nil;
+    }
+    // sanity check, the cache may come from another build
+    if (table->mCount && (table->mSTTSPoints.empty() || table->mSTSCPoints.empty() ||
+        (table->mCTTS != Nil && table->mCTTSPoints.empty()) ||
+        (!table->mSTSZ->sample_size && table->mSTSZ->entries.size() < table->mCount))) {
+        ERROR("bad sample table in cache");
+        return Nil;
+    }
+    return table;
+}
+
+UInt32 SampleTable::stscSamples(UInt32 entry) const {
+    const Vector<SampleToChunkBox::Entry>& stsc = mSTSC->entries;
+    const UInt32 next = entry + 1 < stsc.size() ?
+        stsc[entry + 1].first_chunk : mSTCO->entries.size() + 1;
+    if (next <= stsc[entry].first_chunk) return 0;
+    return (next - stsc[entry].first_chunk) * stsc[entry].samples_per_chunk;
+}
+
+UInt32 SampleTable::size(UInt32 index) const {
+    if (mSTSZ->sample_size) return mSTSZ->sample_size;
+    return mSTSZ->entries[index];
+}
+
+void SampleTable::locateTime(UInt32 index, SampleCursor& c) const {
+    c.index     = index;
+
+    // stts => dts
+    const Vector<TimeToSampleBox::Entry>& stts = mSTTS->entries;
+    const RunPoint& p0 = mSTTSPoints[FindRunPoint(mSTTSPoints, index)];
+    c.stts      = p0.entry;
+    c.sttsFirst = p0.first;
+    c.dts       = p0.value;
+    while (c.stts + 1 < stts.size() &&
+           c.sttsFirst + stts[c.stts].sample_count <= index) {
+        c.dts       += (Int64)stts[c.stts].sample_count * stts[c.stts].sample_delta;
+        c.sttsFirst += stts[c.stts].sample_count;
+        ++c.stts;
+    }
+    c.dts += (Int64)(index - c.sttsFirst) * stts[c.stts].sample_delta;
+
+    // ctts
+    c.ctts      = 0;
+    c.cttsFirst = 0;
+    if (mCTTS != Nil) {
+        const Vector<CompositionOffsetBox::Entry>& ctts = mCTTS->entries;
+        const RunPoint& p1 = mCTTSPoints[FindRunPoint(mCTTSPoints, index)];
+        c.ctts      = p1.entry;
+        c.cttsFirst = p1.first;
+        while (c.ctts + 1 < ctts.size() &&
+               c.cttsFirst + ctts[c.ctts].sample_count <= index) {
+            c.cttsFirst += ctts[c.ctts].sample_count;
+            ++c.ctts;
+        }
+    }
+}
+
+Int64 SampleTable::pts(UInt32 index) const {
+    SampleCursor c;
+    locateTime(index, c);
+    if (mCTTS == Nil) return c.dts;
+    return c.dts + mCTTS->entries[c.ctts].sample_offset;
+}
+
+Bool SampleTable::locate(UInt32 index, SampleCursor& c) const {
+    if (index >= mCount) {
+        c.index = mCount;
+        return False;
+    }
+    locateTime(index, c);
+
+    // stsc + stco => chunk
+    const Vector<SampleToChunkBox::Entry>& stsc = mSTSC->entries;
+    const RunPoint& p2 = mSTSCPoints[FindRunPoint(mSTSCPoints, index)];
+    c.stsc      = p2.entry;
+    c.stscFirst = p2.first;
+    while (c.stsc + 1 < stsc.size() &&
+           c.stscFirst + stscSamples(c.stsc) <= index) {
+        c.stscFirst += stscSamples(c.stsc);
+        ++c.stsc;
+    }
+    const UInt32 perChunk = stsc[c.stsc].samples_per_chunk;
+    const UInt32 firstChunk = stsc[c.stsc].first_chunk - 1;
+    c.chunk     = firstChunk + (index - c.stscFirst) / perChunk;
+    c.chunkFirst = c.stscFirst + (c.chunk - firstChunk) * perChunk;
+
+    // stsz => offset inside chunk
+    c.offset    = mSTCO->entries[c.chunk];
+    if (mSTSZ->sample_size) {
+        c.offset += (UInt64)(index - c.chunkFirst) * mSTSZ->sample_size;
+    } else {
+        for (UInt32 i = c.chunkFirst; i < index; ++i) {
+            c.offset += mSTSZ->entries[i];
+        }
+    }
+
+    // stss
+    c.stss      = mSTSS != Nil ? LowerBound(mSTSS->entries, index + 1) : 0;
+    return True;
+}
+
+void SampleTable::read(const SampleCursor& c, Sample& s) const {
+    s.offset    = c.offset;
+    s.size      = size(c.index);
+    s.dts       = c.dts;
+    s.pts       = c.dts;
+    if (mCTTS != Nil) s.pts += mCTTS->entries[c.ctts].sample_offset;
+    s.duration  = mSTTS->entries[c.stts].sample_delta;
+
+    // ISO/IEC 14496-12:2015 Section 8.6.2.1
+    //  If the sync sample box is not present, every sample is a sync sample.
+    s.flags     = kFrameTypeUnknown;
+    if (mSTSS == Nil) {
+        s.flags |= kFrameTypeSync;
+    } else if (c.stss < mSTSS->entries.size() &&
+               mSTSS->entries[c.stss] == c.index + 1) {
+        s.flags |= kFrameTypeSync;
+    }
+
+    // ISO/IEC 14496-12:2015 Section 8.6.4
+    if (mSDTP != Nil && c.index < mSDTP->dependency.size()) {
+        const UInt8 dep = mSDTP->dependency[c.index];
+        // does this sample depends others (e.g. is it an I‐picture)?
+        if (IsSyncDependency(dep))      s.flags |= kFrameTypeSync;
+        // do no other samples depend on this one?
+        if (((dep & 0xc) >> 2) == 2)    s.flags |= kFrameTypeDisposal;
+    }
+}
+
+void SampleTable::next(SampleCursor& c) const {
+    if (c.index >= mCount) return;
+
+    const UInt32 current = size(c.index);
+    ++c.index;
+    if (c.index >= mCount) return;
+
+    // stts
+    const Vector<TimeToSampleBox::Entry>& stts = mSTTS->entries;
+    c.dts += stts[c.stts].sample_delta;
+    while (c.stts + 1 < stts.size() &&
+           c.sttsFirst + stts[c.stts].sample_count <= c.index) {
+        c.sttsFirst += stts[c.stts].sample_count;
+        ++c.stts;
+    }
+
+    // ctts
+    if (mCTTS != Nil) {
+        const Vector<CompositionOffsetBox::Entry>& ctts = mCTTS->entries;
+        while (c.ctts + 1 < ctts.size() &&
+               c.cttsFirst + ctts[c.ctts].sample_count <= c.index) {
+            c.cttsFirst += ctts[c.ctts].sample_count;
+            ++c.ctts;
+        }
+    }
+
+    // stsc + stco
+    const Vector<SampleToChunkBox::Entry>& stsc = mSTSC->entries;
+    if (c.index - c.chunkFirst < stsc[c.stsc].samples_per_chunk) {
+        c.offset    += current;
+    } else {
+        ++c.chunk;
+        c.chunkFirst    = c.index;
+        c.offset        = mSTCO->entries[c.chunk];
+        while (c.stsc + 1 < stsc.size() &&
+               stsc[c.stsc + 1].first_chunk <= c.chunk + 1) {
+            c.stscFirst += stscSamples(c.stsc);
+            ++c.stsc;
+        }
+    }
+
+    // stss
+    if (mSTSS != Nil) {
+        const Vector<UInt32>& stss = mSTSS->entries;
+        while (c.stss < stss.size() && stss[c.stss] < c.index + 1) ++c.stss;
+    }
+}
+
+UInt32 SampleTable::find(Int64 dts) const {
+    if (mCount == 0 || dts <= 0) return 0;
+
+    const Vector<TimeToSampleBox::Entry>& stts = mSTTS->entries;
+    const RunPoint& p = mSTTSPoints[FindRunPointByValue(mSTTSPoints, dts)];
+    UInt32 entry    = p.entry;
+    UInt32 first    = p.first;
+    Int64 value     = p.value;
+    while (entry + 1 < stts.size()) {
+        const Int64 length = (Int64)stts[entry].sample_count * stts[entry].sample_delta;
+        if (value + length > dts) break;
+        value   += length;
+        first   += stts[entry].sample_count;
+        ++entry;
+    }
+
+    UInt32 index = first;
+    if (stts[entry].sample_delta && stts[entry].sample_count) {
+        Int64 n = (dts - value) / stts[entry].sample_delta;
+        if (n >= stts[entry].sample_count) n = stts[entry].sample_count - 1;
+        index += n;
+    }
+    return index < mCount ? index : mCount - 1;
+}
+
+UInt32 SampleTable::seek(Int64 pts) const {
+    if (mCount == 0) return 0;
+
+    if (mSTSS == Nil) {
+        // every sample is sync, pts >= dts for ctts version 0
+        UInt32 index = find(pts);
+        if (mCTTS != Nil) {
+            while (index > 0 && this->pts(index) > pts) --index;
+        }
+        return index;
+    }
+
+    if (mSyncPoints.empty()) return 0;
+
+    // last sync point with pts <= pts
+    UInt32 lo = 0;
+    UInt32 hi = mSyncPoints.size();
+    while (hi - lo > 1) {
+        const UInt32 mid = (lo + hi) / 2;
+        if (mSyncPoints[mid].pts <= pts) lo = mid;
+        else hi = mid;
+    }
+    return mSyncPoints[lo].index;
+}
+
+UInt32 SampleTable::syncBefore(UInt32 index) const {
+    if (mSTSS == Nil) return index;
+
+    const UInt32 entry = LowerSyncPoint(mSyncPoints, index + 1);    // first > index
+    return entry ? mSyncPoints[entry - 1].index : 0;
+}
+
+UInt32 SampleTable::syncAfter(UInt32 index) const {
+    if (mSTSS == Nil) return index < mCount ? index : mCount;
+
+    const UInt32 entry = LowerSyncPoint(mSyncPoints, index);
+    return entry < mSyncPoints.size() ? mSyncPoints[entry].index : mCount;
+}
+
+__END_NAMESPACE(MPEG4)
+__END_NAMESPACE_MFWK
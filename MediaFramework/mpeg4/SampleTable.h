@@ -0,0 +1,146 @@
+/******************************************************************************
+ * Copyright (c) 2016, Chen Fang <mtdcy.chen@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+
+
+
+// File:    SampleTable.h
+// Author:  mtdcy.chen
+// Changes:
+//          1. 20201018     initial version
+//
+
+#ifndef MFWK_MPEG4_SAMPLE_TABLE_H
+#define MFWK_MPEG4_SAMPLE_TABLE_H
+
+#include "MediaTypes.h"
+#include "IndexCache.h"
+#include "mpeg4/Box.h"
+
+__BEGIN_NAMESPACE_MFWK
+__BEGIN_NAMESPACE(MPEG4)
+
+struct Sample {
+    UInt64              offset;
+    UInt32              size;   // in bytes
+    Int64               dts;
+    Int64               pts;
+    UInt32              duration;
+    UInt32              flags;
+};
+
+// position of a sample inside the run-length boxes
+struct SampleCursor {
+    UInt32              index;      // sample index, 0-based
+    UInt32              stts;       // stts entry
+    UInt32              sttsFirst;  // first sample of stts entry
+    Int64               dts;
+    UInt32              ctts;       // ctts entry
+    UInt32              cttsFirst;  // first sample of ctts entry
+    UInt32              stsc;       // stsc entry
+    UInt32              stscFirst;  // first sample of stsc entry
+    UInt32              chunk;      // chunk index, 0-based
+    UInt32              chunkFirst; // first sample of chunk
+    UInt64              offset;     // sample offset
+    UInt32              stss;       // first stss entry >= index + 1
+};
+
+// checkpoint in run-length entries
+struct RunPoint {
+    UInt32              entry;      // entry index
+    UInt32              first;      // first sample of entry
+    Int64               value;      // accumulated value at entry, e.g. dts
+};
+
+// sync sample with its presentation time
+struct SyncPoint {
+    UInt32              index;      // sample index, 0-based
+    Int64               pts;
+};
+
+/**
+ * sample table walks stts/ctts/stsc/stco/stsz/stss/sdtp directly,
+ * instead of expanding them into samples.
+ * run-length entries are checkpointed every kRunPointInterval entries,
+ * so random access is O(log n), and sequential access is O(1).
+ * sync samples from stss and sdtp are indexed with their pts,
+ * so seek by presentation time is O(log n) too.
+ */
+struct SampleTable : public SharedObject {
+    static sp<SampleTable> Create(const sp<SampleTableBox>& stbl);
+    // restore sample table from index cache
+    static sp<SampleTable> Create(IndexReader&);
+    // save sample table to index cache
+    void        store(IndexWriter&) const;
+    
+    FORCE_INLINE UInt32 count() const { return mCount; }
+    
+    // locate cursor at sample index
+    Bool        locate(UInt32 index, SampleCursor&) const;
+    // read sample at cursor
+    void        read(const SampleCursor&, Sample&) const;
+    // move cursor to next sample
+    void        next(SampleCursor&) const;
+    
+    // sample size, in bytes
+    UInt32      size(UInt32 index) const;
+    // presentation time of sample
+    Int64       pts(UInt32 index) const;
+    // index of the last sample with dts <= dts, 0 if none
+    UInt32      find(Int64 dts) const;
+    // index of the last sync sample with pts <= pts,
+    // or the first sync sample if none
+    UInt32      seek(Int64 pts) const;
+    // index of the last sync sample <= index
+    UInt32      syncBefore(UInt32 index) const;
+    // index of the first sync sample >= index, count() if none
+    UInt32      syncAfter(UInt32 index) const;
+    
+    private:
+    SampleTable() : SharedObject() { }
+    
+    sp<TimeToSampleBox>         mSTTS;
+    sp<CompositionOffsetBox>    mCTTS;
+    sp<SampleToChunkBox>        mSTSC;
+    sp<ChunkOffsetBox>          mSTCO;
+    sp<SampleSizeBox>           mSTSZ;
+    sp<SyncSampleBox>           mSTSS;
+    sp<SampleDependencyTypeBox> mSDTP;
+    UInt32                      mCount;
+    
+    Vector<RunPoint>            mSTTSPoints;
+    Vector<RunPoint>            mCTTSPoints;
+    Vector<RunPoint>            mSTSCPoints;
+    Vector<SyncPoint>           mSyncPoints;    // empty if stss is missing
+    
+    UInt32      stscSamples(UInt32 entry) const;
+    void        locateTime(UInt32 index, SampleCursor&) const;
+};
+
+__END_NAMESPACE(MPEG4)
+__END_NAMESPACE_MFWK
+
+#endif // MFWK_MPEG4_SAMPLE_TABLE_H
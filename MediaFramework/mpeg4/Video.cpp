@@ -184,6 +184,37 @@ MediaError NALU::parse(const sp<ABuffer>& data) {
     return kMediaNoError;
 }
 
+static FORCE_INLINE Int32 sign(Int32 x) {
+    return x > 0 ? 1 : (x < 0 ? -1 : 0);
+}
+
+Bool GetMatrixRotation(const Int32 matrix[9], eRotate * rotate, eFlip * flip) {
+    // only the sign matters, as scale is not supported
+    Int32 a = sign(matrix[0]);
+    Int32 b = sign(matrix[1]);
+    const Int32 c = sign(matrix[3]);
+    const Int32 d = sign(matrix[4]);
+    
+    *flip = kFlipNone;
+    if (a * d - b * c < 0) {
+        // mirrored: M = H * R, H = { -1, 0, 0, 1 }
+        *flip = kFlipHorizontal;
+        a = -a;
+        b = -b;
+    }
+    
+    if (a == 1 && b == 0 && c == 0 && d == 1)           *rotate = kRotate0;
+    else if (a == 0 && b == 1 && c == -1 && d == 0)     *rotate = kRotate90;
+    else if (a == -1 && b == 0 && c == 0 && d == -1)    *rotate = kRotate180;
+    else if (a == 0 && b == -1 && c == 1 && d == 0)     *rotate = kRotate270;
+    else {
+        *rotate = kRotate0;
+        *flip   = kFlipNone;
+        return False;
+    }
+    return True;
+}
+
 __END_NAMESPACE(MPEG4)
 __END_NAMESPACE_MFWK
 
@@ -142,6 +142,11 @@ namespace MPEG4 {
         List<sp<Buffer> >   PPSs;
     };
 
+    // ISO/IEC 14496-12 Section 8.3.2, transformation matrix of tkhd,
+    // { a, b, u, c, d, v, x, y, w }, u/v/w in 2.30 and others in 16.16.
+    // decompose it into a flip followed by a clockwise rotation.
+    // @return False if it is not a multiple of 90 degrees rotation.
+    Bool GetMatrixRotation(const Int32 matrix[9], eRotate *, eFlip *);
 }
 
 __END_NAMESPACE_MFWK
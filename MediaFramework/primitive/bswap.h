@@ -30,6 +30,7 @@
 // Author:  mtdcy.chen
 // Changes:
 //          1. 20200630     initial version
+//          2. 20201018     add row kernels with SSSE3/NEON paths
 //
 
 #ifndef _MEDIA_PRIMITIVE_BSWAP_H
@@ -37,6 +38,12 @@
 
 #include "MediaTypes.h"
 
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
 __BEGIN_DECLS
 
 // aabb -> bbaa
@@ -74,6 +81,106 @@ static FORCE_INLINE UInt64 bswap64(UInt64 x) {
 #endif
 }
 
+// row kernels: swap n bytes from src to dst, inplace (src == dst) is allowed.
+// n SHOULD be multiple of element size, tail bytes are left untouched.
+
+// aabb -> bbaa
+static FORCE_INLINE void bswap16_row(const UInt8 * src, UInt8 * dst, UInt32 n) {
+    UInt32 i = 0;
+#if defined(__SSSE3__)
+    const __m128i mask = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    for (; i + 16 <= n; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(src + i));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_shuffle_epi8(x, mask));
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    for (; i + 16 <= n; i += 16) {
+        vst1q_u8(dst + i, vrev16q_u8(vld1q_u8(src + i)));
+    }
+#endif
+    for (; i + 2 <= n; i += 2) {
+        const UInt8 a = src[i];
+        dst[i]      = src[i + 1];
+        dst[i + 1]  = a;
+    }
+}
+
+// aabbcc -> ccbbaa
+static FORCE_INLINE void bswap24_row(const UInt8 * src, UInt8 * dst, UInt32 n) {
+    UInt32 i = 0;
+#if defined(__SSSE3__)
+    // 5 pixels per 16 bytes, the last byte is kept as it is
+    const __m128i mask = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, 15);
+    for (; i + 16 <= n; i += 15) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(src + i));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_shuffle_epi8(x, mask));
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    for (; i + 48 <= n; i += 48) {
+        uint8x16x3_t x = vld3q_u8(src + i);
+        const uint8x16_t t = x.val[0];
+        x.val[0] = x.val[2];
+        x.val[2] = t;
+        vst3q_u8(dst + i, x);
+    }
+#endif
+    for (; i + 3 <= n; i += 3) {
+        const UInt8 a = src[i];
+        dst[i + 1]  = src[i + 1];
+        dst[i]      = src[i + 2];
+        dst[i + 2]  = a;
+    }
+}
+
+// aabbccdd -> ddccbbaa
+static FORCE_INLINE void bswap32_row(const UInt8 * src, UInt8 * dst, UInt32 n) {
+    UInt32 i = 0;
+#if defined(__SSSE3__)
+    const __m128i mask = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    for (; i + 16 <= n; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(src + i));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_shuffle_epi8(x, mask));
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    for (; i + 16 <= n; i += 16) {
+        vst1q_u8(dst + i, vrev32q_u8(vld1q_u8(src + i)));
+    }
+#endif
+    for (; i + 4 <= n; i += 4) {
+        UInt32 x;
+        __builtin_memcpy(&x, src + i, 4);
+        x = bswap32(x);
+        __builtin_memcpy(dst + i, &x, 4);
+    }
+}
+
+// aabbccdd -> aaddccbb, in word order
+// => swap byte 0 & 2 of each pixel in memory, byte 1 & 3 are untouched.
+static FORCE_INLINE void bswap32l_row(const UInt8 * src, UInt8 * dst, UInt32 n) {
+    UInt32 i = 0;
+#if defined(__SSSE3__)
+    const __m128i mask = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+    for (; i + 16 <= n; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i *)(src + i));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_shuffle_epi8(x, mask));
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    for (; i + 64 <= n; i += 64) {
+        uint8x16x4_t x = vld4q_u8(src + i);
+        const uint8x16_t t = x.val[0];
+        x.val[0] = x.val[2];
+        x.val[2] = t;
+        vst4q_u8(dst + i, x);
+    }
+#endif
+    for (; i + 4 <= n; i += 4) {
+        UInt32 x;
+        __builtin_memcpy(&x, src + i, 4);
+        x = bswap32l(x);
+        __builtin_memcpy(dst + i, &x, 4);
+    }
+}
+
 __END_DECLS
 
 #ifdef __cplusplus
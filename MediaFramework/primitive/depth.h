@@ -0,0 +1,202 @@
+/******************************************************************************
+ * Copyright (c) 2016, Chen Fang <mtdcy.chen@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+
+
+
+// File:    depth.h
+// Author:  mtdcy.chen
+// Changes:
+//          1. 20201018     initial version
+//
+
+#ifndef _MEDIA_PRIMITIVE_DEPTH_H
+#define _MEDIA_PRIMITIVE_DEPTH_H
+
+#include "MediaTypes.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+__BEGIN_DECLS
+
+// 4x4 ordered dither matrix, scaled to 16-bit => 8-bit rounding range [8, 248]
+static const UInt16 kDither4x4[4][4] = {
+    {   8, 136,  40, 168 },
+    { 200,  72, 232, 104 },
+    {  56, 184,  24, 152 },
+    { 248, 120, 216,  88 },
+};
+
+// 16-bit samples -> 8-bit samples with ordered dither
+// shift: left shift to put samples in the high bits, e.g. 6 for 10-bit samples in low bits
+// dither: dither values for x & 3, @see kDither4x4
+static FORCE_INLINE void narrow16_row(const UInt16 * src, UInt8 * dst, UInt32 n,
+                                      UInt32 shift, const UInt16 dither[4]) {
+    UInt32 i = 0;
+#if defined(__SSE2__)
+    const __m128i d = _mm_setr_epi16(dither[0], dither[1], dither[2], dither[3],
+                                     dither[0], dither[1], dither[2], dither[3]);
+    const __m128i s = _mm_cvtsi32_si128(shift);
+    for (; i + 16 <= n; i += 16) {
+        __m128i a = _mm_sll_epi16(_mm_loadu_si128((const __m128i *)(src + i)), s);
+        __m128i b = _mm_sll_epi16(_mm_loadu_si128((const __m128i *)(src + i + 8)), s);
+        // saturated add => clamp to 255
+        a = _mm_srli_epi16(_mm_adds_epu16(a, d), 8);
+        b = _mm_srli_epi16(_mm_adds_epu16(b, d), 8);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(a, b));
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    const UInt16 pattern[8] = { dither[0], dither[1], dither[2], dither[3],
+                                dither[0], dither[1], dither[2], dither[3] };
+    const uint16x8_t d = vld1q_u16(pattern);
+    const int16x8_t s = vdupq_n_s16(shift);
+    for (; i + 8 <= n; i += 8) {
+        uint16x8_t a = vshlq_u16(vld1q_u16(src + i), s);
+        vst1_u8(dst + i, vshrn_n_u16(vqaddq_u16(a, d), 8));
+    }
+#endif
+    for (; i < n; ++i) {
+        const UInt32 x = ((UInt32)(UInt16)(src[i] << shift)) + dither[i & 3];
+        dst[i] = x > 0xffff ? 0xff : x >> 8;
+    }
+}
+
+// interleaved 16-bit samples -> two planes of 8-bit samples with ordered dither
+// n: number of sample pairs
+// @see narrow16_row
+static FORCE_INLINE void narrow16x2_row(const UInt16 * src, UInt8 * dst0, UInt8 * dst1, UInt32 n,
+                                        UInt32 shift, const UInt16 dither[4]) {
+    UInt32 i = 0;
+#if defined(__SSE2__)
+    const __m128i d0 = _mm_setr_epi16(dither[0], dither[0], dither[1], dither[1],
+                                      dither[2], dither[2], dither[3], dither[3]);
+    const __m128i s = _mm_cvtsi32_si128(shift);
+    const __m128i m = _mm_set1_epi16(0xff);
+    for (; i + 8 <= n; i += 8) {
+        __m128i a = _mm_sll_epi16(_mm_loadu_si128((const __m128i *)(src + 2 * i)), s);
+        __m128i b = _mm_sll_epi16(_mm_loadu_si128((const __m128i *)(src + 2 * i + 8)), s);
+        a = _mm_srli_epi16(_mm_adds_epu16(a, d0), 8);
+        b = _mm_srli_epi16(_mm_adds_epu16(b, d0), 8);
+        // 8 pairs of 8-bit samples in 16-bit lanes
+        const __m128i x = _mm_packus_epi16(a, b);
+        const __m128i u = _mm_and_si128(x, m);
+        const __m128i v = _mm_srli_epi16(x, 8);
+        _mm_storel_epi64((__m128i *)(dst0 + i), _mm_packus_epi16(u, u));
+        _mm_storel_epi64((__m128i *)(dst1 + i), _mm_packus_epi16(v, v));
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    const UInt16 pattern[8] = { dither[0], dither[1], dither[2], dither[3],
+                                dither[0], dither[1], dither[2], dither[3] };
+    const uint16x8_t d = vld1q_u16(pattern);
+    const int16x8_t s = vdupq_n_s16(shift);
+    for (; i + 8 <= n; i += 8) {
+        uint16x8x2_t x = vld2q_u16(src + 2 * i);
+        vst1_u8(dst0 + i, vshrn_n_u16(vqaddq_u16(vshlq_u16(x.val[0], s), d), 8));
+        vst1_u8(dst1 + i, vshrn_n_u16(vqaddq_u16(vshlq_u16(x.val[1], s), d), 8));
+    }
+#endif
+    for (; i < n; ++i) {
+        const UInt32 a = ((UInt32)(UInt16)(src[2 * i] << shift)) + dither[i & 3];
+        const UInt32 b = ((UInt32)(UInt16)(src[2 * i + 1] << shift)) + dither[i & 3];
+        dst0[i] = a > 0xffff ? 0xff : a >> 8;
+        dst1[i] = b > 0xffff ? 0xff : b >> 8;
+    }
+}
+
+// interleaved 16-bit samples -> two planes of 16-bit samples, right shifted
+static FORCE_INLINE void split16_row(const UInt16 * src, UInt16 * dst0, UInt16 * dst1, UInt32 n,
+                                     UInt32 shift) {
+    for (UInt32 i = 0; i < n; ++i) {
+        dst0[i] = src[2 * i] >> shift;
+        dst1[i] = src[2 * i + 1] >> shift;
+    }
+}
+
+// 16-bit samples right shifted
+static FORCE_INLINE void shift16_row(const UInt16 * src, UInt16 * dst, UInt32 n, UInt32 shift) {
+    for (UInt32 i = 0; i < n; ++i) {
+        dst[i] = src[i] >> shift;
+    }
+}
+
+// average of two rows of 16-bit samples, for 4:2:2 -> 4:2:0
+static FORCE_INLINE void average16_row(const UInt16 * a, const UInt16 * b, UInt16 * dst, UInt32 n) {
+    UInt32 i = 0;
+#if defined(__SSE2__)
+    for (; i + 8 <= n; i += 8) {
+        const __m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+        const __m128i y = _mm_loadu_si128((const __m128i *)(b + i));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_avg_epu16(x, y));
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    for (; i + 8 <= n; i += 8) {
+        vst1q_u16(dst + i, vrhaddq_u16(vld1q_u16(a + i), vld1q_u16(b + i)));
+    }
+#endif
+    for (; i < n; ++i) {
+        dst[i] = (a[i] + b[i] + 1) >> 1;
+    }
+}
+
+// bytes of a v210 row, 6 pixels in 128 bits and rows are aligned to 48 pixels
+#define V210_STRIDE(width)  ((((width) + 47) / 48) * 128)
+
+// unpack a v210 row into 10-bit Y'/Cb/Cr samples
+// v210: 4 little endian 32-bit words for 6 pixels, 3 samples in each word
+//  w0: Cb0 Y'0 Cr0
+//  w1: Y'1 Cb1 Y'2
+//  w2: Cr1 Y'3 Cb2
+//  w3: Y'4 Cr2 Y'5
+static FORCE_INLINE void unpack_v210_row(const UInt8 * src, UInt16 * y, UInt16 * u, UInt16 * v, UInt32 width) {
+    // rows are padded to 48 pixels, so it is safe to unpack the whole last group
+    UInt16 ty[6], tu[3], tv[3];
+    UInt32 w[4];
+    for (UInt32 i = 0; i < width; i += 6, src += 16) {
+        __builtin_memcpy(w, src, 16);
+        UInt16 * py = i + 6 <= width ? y + i : ty;
+        UInt16 * pu = i + 6 <= width ? u + i / 2 : tu;
+        UInt16 * pv = i + 6 <= width ? v + i / 2 : tv;
+        pu[0] = w[0] & 0x3ff;   py[0] = (w[0] >> 10) & 0x3ff;   pv[0] = (w[0] >> 20) & 0x3ff;
+        py[1] = w[1] & 0x3ff;   pu[1] = (w[1] >> 10) & 0x3ff;   py[2] = (w[1] >> 20) & 0x3ff;
+        pv[1] = w[2] & 0x3ff;   py[3] = (w[2] >> 10) & 0x3ff;   pu[2] = (w[2] >> 20) & 0x3ff;
+        py[4] = w[3] & 0x3ff;   pv[2] = (w[3] >> 10) & 0x3ff;   py[5] = (w[3] >> 20) & 0x3ff;
+        if (py == ty) {
+            for (UInt32 j = 0; i + j < width; ++j) y[i + j] = ty[j];
+            for (UInt32 j = 0; i + 2 * j < width; ++j) {
+                u[i / 2 + j] = tu[j];
+                v[i / 2 + j] = tv[j];
+            }
+        }
+    }
+}
+
+__END_DECLS
+
+#endif // _MEDIA_PRIMITIVE_DEPTH_H
@@ -0,0 +1,231 @@
+/******************************************************************************
+ * Copyright (c) 2016, Chen Fang <mtdcy.chen@gmail.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *  AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *  IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ *  ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ *  LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ *  CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ *  SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ *  INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ *  CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ *  ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ *  POSSIBILITY OF SUCH DAMAGE.
+ ******************************************************************************/
+
+
+
+/**
+ * File:    bench_main.cpp
+ * Author:  mtdcy.chen
+ * Changes:
+ *          1. 20201018     initial version
+ *
+ */
+
+#define LOG_TAG "bench.main"
+#include <MediaFramework/MediaFramework.h>
+
+#include "MediaFramework/matroska/EBML.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <chrono>
+
+USING_NAMESPACE_MFWK
+__USING_NAMESPACE(EBML)
+
+static Float64 now() {
+    return std::chrono::duration<Float64>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// color conversion scaling across 1..N threads
+static int benchColor(int argc, char **argv) {
+    const Int32 width   = argc > 0 ? String(argv[0]).toInt32() : 3840;
+    const Int32 height  = argc > 1 ? String(argv[1]).toInt32() : 2160;
+    const Char * source = argc > 2 ? argv[2] : "420p";
+    const Char * target = argc > 3 ? argv[3] : "BGRA";
+    const UInt32 maxThreads = argc > 4 ? String(argv[4]).toInt32() : 8;
+    const UInt32 count  = argc > 5 ? String(argv[5]).toInt32() : 100;
+    
+    const PixelDescriptor * ipd = GetPixelFormatDescriptorByName(source);
+    const PixelDescriptor * opd = GetPixelFormatDescriptorByName(target);
+    if (ipd == Nil || opd == Nil) return 1;
+    
+    ImageFormat iformat = {
+        .format = ipd->format,
+        .width  = width,
+        .height = height,
+        .rect   = { 0, 0, width, height }
+    };
+    ImageFormat oformat = iformat;
+    oformat.format = opd->format;
+    
+    sp<MediaFrame> input = MediaFrame::Create(iformat);
+    for (UInt32 i = 0; i < input->planes.count; ++i) {
+        input->planes.buffers[i].size = input->planes.buffers[i].capacity;
+        memset(input->planes.buffers[i].data, 0x80, input->planes.buffers[i].size);
+    }
+    
+    printf("%s %dx%d => %s, %u frames\n", ipd->name, width, height, opd->name, count);
+    Float64 single = 0;
+    for (UInt32 threads = 1; threads <= maxThreads; ++threads) {
+        sp<Message> options = new Message;
+        options->setInt32(kKeyThreads, threads);
+        options->setInt32(kKeyParallelThreshold, 0);
+        sp<MediaDevice> cc = CreateColorConverter(iformat, oformat, options);
+        if (cc.isNil()) {
+            ERROR("create color converter failed");
+            return 1;
+        }
+        
+        // warm up workers and caches
+        cc->push(input);
+        cc->pull();
+        
+        const Float64 start = now();
+        for (UInt32 i = 0; i < count; ++i) {
+            cc->push(input);
+            cc->pull();
+        }
+        const Float64 elapsed = now() - start;
+        if (threads == 1) single = elapsed;
+        printf("threads %2u: %8.3f ms/frame, %7.2f fps, speedup %.2fx\n",
+               threads, 1E3 * elapsed / count, count / elapsed, single / elapsed);
+    }
+    return 0;
+}
+
+// drop file from page cache, so the first pass reads from disk
+static Bool dropPageCache(const Char * path) {
+#ifdef POSIX_FADV_DONTNEED
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return False;
+    const int ret = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+    return ret == 0;
+#else
+    return False;
+#endif
+}
+
+// read syscalls of this process, -1 if not available
+static Int64 readCalls() {
+    FILE * fp = fopen("/proc/self/io", "r");
+    if (fp == Nil) return -1;
+    Char line[128];
+    Int64 calls = -1;
+    while (fgets(line, sizeof(line), fp)) {
+        long long n;
+        if (sscanf(line, "syscr: %lld", &n) == 1) {
+            calls = n;
+            break;
+        }
+    }
+    fclose(fp);
+    return calls;
+}
+
+// demux all packets, cold page cache first and then warm
+static int benchDemux(int argc, char **argv) {
+    if (argc < 1) return 1;
+    const String url    = argv[0];
+    const UInt32 passes = argc > 1 ? String(argv[1]).toInt32() : 3;
+    
+    for (UInt32 pass = 0; pass < passes; ++pass) {
+        const Bool cold = pass == 0 && dropPageCache(url.c_str());
+        
+        const Float64 start = now();
+        sp<ABuffer> source = Content::Create(url);
+        if (source.isNil()) {
+            ERROR("open %s failed", url.c_str());
+            return 1;
+        }
+        sp<Message> media = new Message;
+        media->setObject(kKeyContent, source);
+        media->setString(kKeyURL, url);     // enable index cache
+        sp<MediaDevice> file = MediaDevice::create(media, Nil);
+        if (file.isNil()) {
+            ERROR("create MediaFile for %s failed", url.c_str());
+            return 1;
+        }
+        const Float64 opened = now();
+        const Int64 calls = readCalls();
+        
+        UInt64 packets  = 0;
+        UInt64 bytes    = 0;
+        for (;;) {
+            sp<MediaFrame> packet = file->pull();
+            if (packet.isNil()) break;
+            ++packets;
+            bytes += packet->planes.buffers[0].size;
+        }
+        const Float64 elapsed = now() - opened;
+        const Int64 reads = calls < 0 ? -1 : readCalls() - calls;
+        printf("%s: open %8.3f ms, %llu packets, %.2f MB in %.3f s, %.0f packets/s, %.2f MB/s, %.3f reads/packet\n",
+               cold ? "cold" : "warm", 1E3 * (opened - start), (unsigned long long)packets, bytes / 1E6,
+               elapsed, packets / elapsed, bytes / 1E6 / elapsed,
+               (reads < 0 || packets == 0) ? 0. : (Float64)reads / packets);
+    }
+    return 0;
+}
+
+// parse matroska headers, clusters are skipped
+static int benchEBML(int argc, char **argv) {
+    if (argc < 1) return 1;
+    const String url    = argv[0];
+    const UInt32 passes = argc > 1 ? String(argv[1]).toInt32() : 10;
+    
+    Float64 total = 0;
+    for (UInt32 pass = 0; pass < passes; ++pass) {
+        sp<ABuffer> source = Content::Create(url);
+        if (source.isNil()) {
+            ERROR("open %s failed", url.c_str());
+            return 1;
+        }
+        
+        const Float64 start = now();
+        sp<EBMLElement> EBMLHEADER = ReadEBMLElement(source);
+        sp<EBMLElement> SEGMENT = ReadEBMLElement(source, kEnumSkipCluster);
+        const Float64 elapsed = now() - start;
+        if (EBMLHEADER.isNil() || SEGMENT.isNil()) {
+            ERROR("parse %s failed", url.c_str());
+            return 1;
+        }
+        total += elapsed;
+        printf("pass %2u: %8.3f ms, %lld bytes\n", pass, 1E3 * elapsed, (long long)source->offset());
+    }
+    printf("average %8.3f ms\n", 1E3 * total / passes);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        printf("usage: bench <case> [options]\n");
+        printf("  color [width] [height] [source pixel] [target pixel] [max threads] [frames]\n");
+        printf("  demux <url> [passes]\n");
+        printf("  ebml <url> [passes]\n");
+        return 1;
+    }
+    
+    if (!strcmp(argv[1], "color"))  return benchColor(argc - 2, argv + 2);
+    if (!strcmp(argv[1], "demux"))  return benchDemux(argc - 2, argv + 2);
+    if (!strcmp(argv[1], "ebml"))   return benchEBML(argc - 2, argv + 2);
+    
+    printf("unknown case %s\n", argv[1]);
+    return 1;
+}
@@ -61,7 +61,7 @@ static Uint32 window_flags() {
 
 int main(int argc, char **argv) {
     if (argc < 5) {
-        printf("usage: cc <source> <width> <height> <source pixel> [target pixel]\n");
+        printf("usage: cc <source> <width> <height> <source pixel> [target pixel] [target width] [target height]\n");
         return 1;
     }
     const String url = argv[1];
@@ -81,6 +81,11 @@ int main(int argc, char **argv) {
         const PixelDescriptor * opd = GetPixelFormatDescriptorByName(argv[5]);
         oformat.format = opd->format;
     }
+    if (argc > 7) {
+        oformat.width   = String(argv[6]).toInt32();
+        oformat.height  = String(argv[7]).toInt32();
+        oformat.rect    = { 0, 0, oformat.width, oformat.height };
+    }
     
     const size_t imageLength = (width * height * ipd->bpp) / 8;
     sp<ABuffer> imageBuffer = Content::Create(url);
@@ -88,7 +93,9 @@ int main(int argc, char **argv) {
     sp<MediaFrame> imageFrame = MediaFrame::Create(iformat, imageData);
     
     sp<MediaFrame> output = imageFrame;
-    if (iformat.format != oformat.format) {
+    if (iformat.format != oformat.format ||
+        iformat.width != oformat.width ||
+        iformat.height != oformat.height) {
         sp<MediaDevice> cc = CreateColorConverter(iformat, oformat, NULL);
         if (cc.isNil()) {
             ERROR("create color converter failed");